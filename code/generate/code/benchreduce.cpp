@@ -0,0 +1,247 @@
+// benchreduce.cpp - Released to the Public Domain in August of 2017.
+// see build.txt
+// ---------------------------------------------------------
+// This program times CMatrix::RowReduce() (CEchelonEngine)
+// against CMatrix::RowReduceBlocked() (CBlockedEchelonEngine)
+// on the same matrix, and checks that they agree. With -mod2, it
+// times CMatrix::CheckModTwo() (CBitEchelonEngine) instead.
+// ---------------------------------------------------------
+// g++ -I./h -std=c++11 -o benchreduce.out benchreduce.cpp -O2 -mavx2 -pthread
+// (leave out -mavx2 on machines without AVX2)
+//
+// Usage: ./benchreduce.out [-threads <n>] [-panel <k>] [-mod2] [<matrix file> | -random <rows> <columns>]
+//   <matrix file>: a matrix written by CMatrix::Write(), such as the
+//                  m0.dat that 'check2.out -reduce' writes (the default)
+//   -random: a random dense matrix of the given size instead
+//   -threads: number of threads for the blocked engine (default: one per
+//             core); it's also timed on one thread
+//   -panel: columns per panel for the blocked engine (default: 64)
+//   -mod2: only find the rank modulo 2, and whether the matrix is
+//          consistent modulo 2
+// =========================================================
+
+#include "../../include/matrix.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+// Returns the matrix in 'path', or nullptr on failure.
+static RMatrix DoReadMatrix(const char *path)
+{
+	std::FILE *fi = std::fopen(path, "rb");
+	
+	if(fi == nullptr)
+	{
+		return nullptr;
+	}
+	
+	// The header is the total size, "integral", the logical height and the logical width (see CMatrix::Write()).
+	uint64_t header[4] = { 0 };
+	
+	if(std::fread(header, sizeof(uint64_t), 4, fi) != 4 || header[2] == 0)
+	{
+		std::fclose(fi);
+		return nullptr;
+	}
+	
+	std::rewind(fi);
+	
+	RMatrix matrix = CMatrix::Create(header[2] - 1, header[3]);
+	const bool ok = matrix->Read(fi);
+	
+	std::fclose(fi);
+	
+	return ok ? matrix : nullptr;
+}
+
+static RMatrix DoMakeRandomMatrix(uint64_t height, uint64_t width)
+{
+	std::mt19937_64 random(1);
+	RMatrix matrix = CMatrix::Create(height, width);
+	std::vector<uint64_t> values(width);
+	
+	for(uint64_t y = 0; y < height; ++y)
+	{
+		for(uint64_t x = 0; x < width; ++x)
+		{
+			// Plenty of even entries, so the pivots aren't all odd.
+			values[x] = random() << (random() % 4);
+		}
+		
+		values[width - 1] = 0;		// so there are no contradictions
+		
+		matrix->SetRow(y, values.data(), width);
+	}
+	
+	return matrix;
+}
+
+static RMatrix DoCopyMatrix(const CMatrix &src)
+{
+	RMatrix matrix = CMatrix::Create(src.GetLogicalHeight() - 1, src.GetLogicalWidth());
+	std::vector<uint64_t> values(src.GetLogicalWidth());
+	
+	for(uint64_t y = 0; y < src.GetLogicalHeight(); ++y)
+	{
+		const CMatrixRow row = src.GetRow(y);
+		
+		for(uint64_t x = 0; x < values.size(); ++x)
+		{
+			values[x] = row.Get(x).x;
+		}
+		
+		matrix->SetRow(y, values.data(), values.size());
+	}
+	
+	return matrix;
+}
+
+static bool DoMatricesMatch(const CMatrix &a, const CMatrix &b)
+{
+	for(uint64_t y = 0; y < a.GetLogicalHeight(); ++y)
+	{
+		const CMatrixRow rowA = a.GetRow(y);
+		const CMatrixRow rowB = b.GetRow(y);
+		
+		for(uint64_t x = 0; x < a.GetLogicalWidth(); ++x)
+		{
+			if(rowA.Get(x).x != rowB.Get(x).x)
+			{
+				return false;
+			}
+		}
+	}
+	
+	return true;
+}
+
+// This reduces 'matrix' and returns how long it took, in seconds, or -1 on failure.
+static double DoTime(CMatrix &matrix, uint32_t numThreads, uint32_t panelWidth)
+{
+	std::ostringstream os;		// the progress output isn't wanted here
+	const auto t0 = std::chrono::steady_clock::now();
+	bool ok = false;
+	
+	if(numThreads == 0)
+	{
+		ok = matrix.RowReduce(os);
+	}
+	else
+	{
+		CBlockedEchelonEngine engine(matrix);
+		
+		engine.numThreads = numThreads;
+		engine.panelWidth = panelWidth;
+		ok = engine.Reduce(os);
+	}
+	
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	
+	return ok ? seconds : -1.0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t panelWidth = 64;
+	const char *path = "m0.dat";
+	uint64_t randomHeight = 0;
+	uint64_t randomWidth = 0;
+	bool modTwo = false;
+	
+	for(int i = 1; i < argc; ++i)
+	{
+		if(std::strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+		{
+			numThreads = std::max(1ul, std::strtoul(argv[++i], nullptr, 0));
+		}
+		else if(std::strcmp(argv[i], "-panel") == 0 && i + 1 < argc)
+		{
+			panelWidth = std::max(1ul, std::strtoul(argv[++i], nullptr, 0));
+		}
+		else if(std::strcmp(argv[i], "-mod2") == 0)
+		{
+			modTwo = true;
+		}
+		else if(std::strcmp(argv[i], "-random") == 0 && i + 2 < argc)
+		{
+			randomHeight = std::strtoull(argv[i + 1], nullptr, 0);
+			randomWidth = std::strtoull(argv[i + 2], nullptr, 0);
+			i += 2;
+		}
+		else if(argv[i][0] != '-')
+		{
+			path = argv[i];
+		}
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [-threads <n>] [-panel <k>] [-mod2] [<matrix file> | -random <rows> <columns>]" << std::endl;
+			return 1;
+		}
+	}
+	
+	RMatrix original = (randomWidth != 0) ? DoMakeRandomMatrix(randomHeight, randomWidth) : DoReadMatrix(path);
+	
+	if(original == nullptr)
+	{
+		std::cout << "Unable to read " << path << std::endl;
+		return 1;
+	}
+	
+	std::cout << original->GetActiveHeight() << " x " << original->GetLogicalWidth() << " matrix" <<
+#ifdef __AVX2__
+		", AVX2" <<
+#endif
+		std::endl
+	;
+	
+	if(modTwo == true)
+	{
+		const auto t0 = std::chrono::steady_clock::now();
+		const uint64_t m = original->GetActiveHeight();
+		CBitMatrix bits(*original, m);
+		const double copySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		CBitEchelonEngine engine(bits);
+		std::ostringstream os;
+		const bool consistent = engine.Reduce(os);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		
+		std::cout << "CheckModTwo(): rank " << engine.GetRank() << ", " << (consistent ? "consistent" : "inconsistent") << ", " <<
+			seconds << "s (" << copySeconds << "s of it making the CBitMatrix)" << std::endl
+		;
+		
+		return 0;
+	}
+	
+	RMatrix reference = DoCopyMatrix(*original);
+	const double referenceSeconds = DoTime(*reference, 0, panelWidth);
+	
+	std::cout << "RowReduce(): " << referenceSeconds << "s" << std::endl;
+	
+	std::vector<uint32_t> threadCounts(1, 1);
+	
+	if(numThreads > 1)
+	{
+		threadCounts.push_back(numThreads);
+	}
+	
+	bool ok = (referenceSeconds >= 0.0);
+	
+	for(uint32_t threads : threadCounts)
+	{
+		RMatrix matrix = DoCopyMatrix(*original);
+		const double seconds = DoTime(*matrix, threads, panelWidth);
+		const bool match = DoMatricesMatch(*reference, *matrix);
+		
+		std::cout << "RowReduceBlocked(), " << threads << " thread(s), panels of " << panelWidth << ": " << seconds << "s (" <<
+			(referenceSeconds / seconds) << "x), " << (match ? "same result" : "DIFFERENT RESULT") << std::endl
+		;
+		
+		ok = ok && (seconds >= 0.0) && match;
+	}
+	
+	return ok ? 0 : 1;
+}
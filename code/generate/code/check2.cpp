@@ -11,342 +11,286 @@
 // theory is human-readable (see compute1.cpp for a sample
 // program that uses that text file!)
 // ---------------------------------------------------------
-// g++ -I./h -std=c++11 -o check2.out check2.cpp -lgmp -lgmpxx -O2
+// g++ -I./h -std=c++11 -o check2.out check2.cpp utilsha256.cpp -O2 -pthread
+//
+// Usage: ./check2.out [-threads <n>] [-compress] [-stream] [-cache | -no-cache] [-reduce] [-reduce-sparse] [-reduce-blocked]
+//                     [-reduce-online] [-check-mod2] [-solve-hensel] [-enumerate <bits> [-rounds <n>]]
+//                     [-out-of-core <directory> [-resident <MiB>]]
+//        ./check2.out -diff <file 1> <file 2>
+//   -threads: number of threads decoding a block-compressed problem.dat,
+//             and reducing with -reduce-blocked (default: one per core)
+//   -compress: write the model block-compressed, to sha2_256_out.blk
+//              instead of sha2_256_out.txt (see compute1.cpp)
+//   -stream: check each row as it's read instead of building the whole
+//            matrix first, so memory use is proportional to its width
+//   -cache: take a model made from the same problem.dat out of the artifact
+//           cache instead of checking, and put the one made in it (see
+//           artifactcache.h); also on if FORMAL_CRYPTO_CACHE is set
+//   -no-cache: don't use the artifact cache, even so
+//   -reduce: after the model is written, bring the equations to echelon
+//            form (see CEchelonEngine in matrix.h) and check the result
+//            against the solution again. The matrix is saved to m0.dat before
+//            and to m1.dat after. Not with -stream.
+//   -reduce-sparse: -reduce, by sparse elimination with Markowitz pivots
+//                   (see CSparseEchelonEngine in matrix.h)
+//   -reduce-blocked: -reduce, a panel of columns at a time on several
+//                    threads (see CBlockedEchelonEngine in matrix.h)
+//   -reduce-online: -stream, with each row also reduced as it's read, and
+//                   kept only if it's independent of the rows before it
+//                   (see COnlineEchelon in matrix.h). Only m1.dat is written.
+//   -check-mod2: before any -reduce, find the rank of the equations modulo
+//                2 and whether they're consistent (see CBitEchelonEngine in
+//                matrix.h), and give up if they aren't. Not with -stream.
+//                Each row is divided by the power of two it's a multiple
+//                of first; even so, a scaled-down problem's rows keep few
+//                terms modulo 2, so "consistent" says little about them.
+//   -solve-hensel: before any -reduce, solve the equations for the inputs
+//                  and temporaries, given the constants and the hash, modulo
+//                  2 and lift the solution to one modulo 2^33 (see
+//                  CHenselSolver in matrix.h), and check it against every
+//                  row, and against the reduced rows after -reduce. The
+//                  inputs the equations determine have to be the secret's.
+//                  Not with -stream.
+//   -enumerate: -reduce, then forget the first <bits> message bits and find
+//               them again from the hash, by back substitution into the
+//               reduced rows, trying the free columns' values on one thread
+//               per core (or -threads), and confirming each candidate with
+//               the reference implementation (see CBackSubstitution in
+//               matrix.h). -rounds must be the problem's number of rounds
+//               (default: 64). Not with -stream.
+//   -out-of-core: keep the matrix in a temporary file in the given
+//                 directory instead of in memory, with -resident MiB of it
+//                 (default: 256) in memory at a time, in blocks of up to
+//                 8 MiB (see rowblockfile.h)
+//   -diff: compare two data files (e.g. two regenerated models) by their
+//          Merkle trees (see merkletree.h), showing the first row where they
+//          differ. Neither file is read, only their .merkle sidecars.
+//
+// problem.dat and the solution are checked against their Merkle trees, if
+// they have them, as they're read: each row (or block of rows) is checked
+// before it's used, and reading stops at the first one that doesn't match.
 // =========================================================
 
-#include "../include/matrix.h"
+#include "artifactcache.h"
+#include "formcheck.h"
+#include "merkletree.h"
+#include "prefetchreader.h"
+#include "utilsha256.h"
 
+#include <chrono>
 #include <map>
 #include <set>
 #include <list>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <iostream>
 
-namespace formal_crypto
-{
+#include <cstdlib>
+#include <cstring>
 
-class CAcceptRow
+namespace formal_crypto
 {
-public:
-	virtual void Begin(std::vector<uint64_t> &header) = 0;
-	virtual void AcceptRow(RMatrix dest, uint64_t position) = 0;
-	virtual void End(RMatrix matrix) = 0;
-};
 
-class CRawAcceptRow :
-	public CAcceptRow
+// This reads the rows of a sparse problem.dat through 'prefetch', from its current position ('offset').
+// returns true on success, false in case of failure.
+static bool DoReadSparseRows(CPrefetchReader &prefetch, uint64_t offset, RMatrix matrix, uint64_t numColumns, uint64_t numEquations, CAcceptRow &acceptor,
+	CMerkleVerifier &verifier)
 {
-public:
-	std::vector<uint64_t> header;
-	
-	CRawAcceptRow()
-	{
-	}
+	std::vector<uint64_t> data(3 + 2 * numColumns);
 	
-	bool CheckRawMatrix(std::string solutionFileName, RMatrix matrix, std::vector<bool> &secretValues)
+	for(;;)
 	{
-		secretValues.clear();
-		secretValues.resize(matrix->GetLogicalWidth(), 0);
-		std::vector<bool> valueIsKnown(matrix->GetLogicalWidth(), false);
+		uint64_t numRead = prefetch.Read(&data[0], 3 * sizeof(uint64_t));
 		
-		uint64_t numTemps = header[2];	// this is also the number of equations
-
-		uint64_t numInputs = header[3];
-
-		// Read solution file. This contains the secret key.
-		// We're reading this so we can check our matrix for correctness.
-		if(true)
-		{
-			std::FILE *fi = fopen(solutionFileName.c_str(), "rb");
-			
-			if(fi == nullptr)
-			{
-				std::cout << "Unable to open file for reading: " << solutionFileName << std::endl;
-				
-				return false;
-			}
-			
-			uint64_t numInputsInSolution = 0;
-			if(std::fread(&numInputsInSolution, sizeof(uint64_t), 1, fi) != 1)
-				numInputsInSolution = 0;
-			else
-			{
-				for(uint64_t i = 0; i < numInputsInSolution; ++i)
-				{
-					uint64_t x = 0;
-					if(std::fread(&x, sizeof(uint64_t), 1, fi) != 1)
-					{
-						std::cout << "Unable to read binary solution file." << std::endl;
-						
-						std::fclose(fi);
-						
-						return false;
-					}
-					
-					valueIsKnown[i] = true;
-					secretValues[i] = (x != 0);
-				}
-			}
-			
-			std::fclose(fi);
-			
-			if(numInputsInSolution != numInputs)
-			{
-				std::cout << "Invalid solution binary file." << std::endl;
-				
-				return false;
-			}
-
-			//secretValues[0] = !secretValues[0];	// purposely use an invalid key to make sure it's rejected
-		}
-
-		std::ofstream fo2("sha2_256_out.txt");
-
-		for(uint64_t i = 0; i < header[9]/*number of output temps*/; ++i)
+		if(numRead == 0 && prefetch.Failed() == false)
 		{
-			uint64_t pos = numInputs + header[9 + 1 + i];
-
-			fo2 << "Y " << i << " " << pos << std::endl;
+			return true;
 		}
-
-		fo2 << "Y -1 -1" << std::endl;
-
-		uint64_t numOutputTemps = header[9];
-		uint64_t posConstants = 9 + 1 + numOutputTemps;
-		uint64_t numConstants = header[posConstants];
-
-		fo2 << "T " << numTemps << std::endl;
-
-		fo2 << "X " << 0 << std::endl;
-
-		fo2 << "C " << numConstants << std::endl;
-
-		char s2[33];
-
-		s2[0] = s2[32] = 0;
-
-		// Load constants.
-		// [inputs, temporaries, constants, unity]
-		if(true)
+		
+		uint64_t sizeBytes = data[0];
+		uint64_t eqnNumber = data[1];
+		uint64_t count = data[2];
+		
+		if(numRead != 3 * sizeof(uint64_t) || count > numColumns || sizeBytes != (3 + 2 * count) * sizeof(uint64_t) || eqnNumber >= numEquations)
 		{
-			uint64_t nextPosition = numInputs + numTemps;
-			
-			for(uint64_t i = 0; i < numConstants; ++i)
-			{
-				if(i == 0)  continue;	// skip unity
-				
-				valueIsKnown[nextPosition] = true;
-				secretValues[nextPosition] = ((header[posConstants + 1 + i]) != 0);
-				
-				++nextPosition;
-			}
+			std::cout << "\n[5] Invalid or corrupt data file detected." << std::endl;
 			
-			// Next, let's do 'unity'.
-			valueIsKnown[nextPosition] = true;
-			secretValues[nextPosition] = 1;
+			return false;
 		}
 		
-		
-		// Now let's go through and compute our temporaries.
-		
-		std::cout << "Checking matrix..." << std::endl;
-		
-		for(uint64_t yy = 0; yy < numTemps; ++yy)
+		if(count != 0 && prefetch.Read(&data[3], 2 * sizeof(uint64_t) * count) != 2 * sizeof(uint64_t) * count)
 		{
-			std::cout << "\r" << /*y*/yy << "/" << (numTemps - 1) << std::flush;
-
-			const uint64_t y = yy;
-		
-			if(matrix->Get(y, numInputs + y).x == 0)
-			{
-				std::cout << "\nInvalid row: " << y << std::endl;
-				
-				return false;
-			}
-			
-			uword_t value = 0;
-
-			fo2 << "begin";
-			
-			for(uint64_t x = 0; x < matrix->GetLogicalWidth(); ++x)
-			{
-				uword_t coeff = matrix->Get(y, x);
-				
-				s2[0] = s2[32] = 0;
-				int s2len = sprintf(s2, "%09llx", (unsigned long long)coeff.x);
-
-				if(s2len != 9)
-				{
-					std::cout << s2len << " is not 9" << std::endl;
-
-					return 1;
-				}
-
-				fo2 << " ";
-
-				fo2 << s2;
-
-				if(x == numInputs + y)  continue;
-				
-				if(coeff.x == 0)  continue;
-				
-				if(valueIsKnown[x] == false)
-				{
-					std::cout << "\nUnknown value required, column " << x << std::endl;
-					
-					return false;
-				}
-				
-				if(secretValues[x] != 0)
-				{
-					value.x += coeff.x;
-				}
-			}
-
-			fo2 << std::endl;
+			std::cout << "\n[4] Read an incorrect number of bytes. Is the file valid? Does it end early?" << std::endl;
 			
-			if(value.x == 0)
-			{
-				valueIsKnown[numInputs + y] = true;
-				secretValues[numInputs + y] = 0;
-			}
-			else
-			{
-				uword_t check = matrix->Get(y, numInputs + y);
-				
-				check.x += value.x;
-				
-				if(check.x == 0)
-				{
-					valueIsKnown[numInputs + y] = true;
-					secretValues[numInputs + y] = 1;
-				}
-				else
-				{
-					std::cout << "\nInvalid value computed, row " << y << std::endl;
-				}
-			}
+			return false;
 		}
 		
-		std::cout << "\n\nResult:" << std::endl;
-
-		uint32_t u[8] = {0};
-
-		for(uint64_t i = 0; i < header[9]/*number of output temps*/; ++i)
+		if(verifier.Check(offset, &data[0], sizeBytes) == false)
 		{
-			uint64_t pos = numInputs + header[9 + 1 + i];
+			std::cout << "\n[6] The row at byte " << offset << " doesn't match the Merkle tree." << std::endl;
 			
-			if(valueIsKnown[pos] == false)
-			{
-				std::cout << "_";
-			}
-			else if(secretValues[pos] == 0)
-			{
-				std::cout << "0";
-			}
-			else
-			{
-				std::cout << "1";
-
-				u[i / 32] |= (1u << (i & 31));
-			}
+			return false;
 		}
 		
-		std::cout << std::endl;
-
-		for(uint32_t i = 0; i < 8; ++i)
+		offset += sizeBytes;
+		
+		if(DoLoadSparseRow(matrix, numColumns, eqnNumber, &data[3], count, acceptor) == false)
 		{
-			char s[33];
-
-			s[0] = s[32] = 0;
-
-			using namespace std;
-
-			sprintf(s, "%08x", u[i]);
-
-			std::cout << s;
+			return false;
 		}
-
-		std::cout << std::endl;
-
-		return true;
 	}
+}
 
-	virtual void Begin(std::vector<uint64_t> &headerT)
+// This hands the rows of a block-compressed problem.dat to DoLoadSparseRow().
+class CMatrixRowLoader :
+	public CBlockRowAcceptor
+{
+public:
+	CMatrixRowLoader(RMatrix matrix, uint64_t numColumns, uint64_t numEquations, CAcceptRow &acceptor) :
+		matrix(matrix),
+		numColumns(numColumns),
+		numEquations(numEquations),
+		acceptor(acceptor)
 	{
-		this->header = headerT;
 	}
-
-	virtual void AcceptRow(RMatrix dest, uint64_t position)
+	
+	virtual bool AcceptBlockRow(uint64_t rowNumber, const uint64_t *pairs, uint64_t count)
 	{
-		for(uint64_t i = 0; i < dest->GetLogicalWidth(); ++i)
+		if(rowNumber >= numEquations)
 		{
-			// accept row from invisible bottom row of matrix, to 'position'.
-			dest->Set(position, i, dest->Get(dest->GetLogicalHeight() - 1, i));
+			std::cout << "\n[5] Invalid or corrupt data file detected." << std::endl;
 			
-			// zero out bottom row.
-			dest->Set(dest->GetLogicalHeight() - 1, i, 0);
+			return false;
 		}
-	}
-	
-	virtual void End(RMatrix matrix)
-	{
-		std::cout << "\nStatistics:" << std::endl;
-		std::cout << "Raw matrix size is " << matrix->GetLogicalHeight() << "x" <<
-			matrix->GetLogicalWidth() << std::endl
-		;
-		
-		std::cout << "Active height is " << matrix->GetActiveHeight() << std::endl;
 		
-		std::cout << "There are " << header[3] << " (unknown) input variable(s)." << std::endl;
-		std::cout << "There are " << header[2] << " temporary variable(s)." << std::endl;
-		std::cout << "This includes " << header[9] << " output temporary variable(s)." << std::endl;
-		std::cout << "The number of significant operands is thus " << (header[3] + header[2] - header[9]) << "." << std::endl;
+		return DoLoadSparseRow(matrix, numColumns, rowNumber, pairs, count, acceptor);
 	}
+	
+private:
+	RMatrix matrix;
+	uint64_t numColumns;
+	uint64_t numEquations;
+	CAcceptRow &acceptor;
 };
 
-static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor)
+// This reads a problem.dat written by 'convert -compress', decoding blocks on 'numThreads' threads.
+static RMatrix DoGenerateMatrixFromBlocks(std::string inFileName, CAcceptRow &acceptor, uint32_t numThreads, const CMatrixStorage &storage,
+	CMerkleVerifier &verifier)
 {
-	RMatrix matrix = nullptr;
+	std::vector<uint64_t> headerVector;
+	CBlockReader reader;
 	
-	std::cout << "Reading " << inFileName << "..." << std::endl;
+	reader.merkle = &verifier;
 	
-	std::FILE *fi = std::fopen(inFileName.c_str(), "rb");
+	if(reader.Open(inFileName.c_str(), "problemd", headerVector) == false)
+	{
+		return nullptr;
+	}
 	
-	if(fi == nullptr)
+	if(headerVector.size() < 11 || headerVector[0] != headerVector.size() * sizeof(uint64_t) || headerVector[4] != E_ROW_FORMAT_SPARSE)
+	{
+		std::cout << "[3] Error reading file: " << inFileName << std::endl;
+		return nullptr;
+	}
+	
+	uint64_t numColumnsRequired = headerVector[8]/* number of columns, incuding unity*/;
+	uint64_t numRowsRequired = headerVector[2]/*numEquations*/ + headerVector[9]/*number of output equations*/;
+	
+	RMatrix matrix = CMatrix::Create(numRowsRequired, numColumnsRequired, storage);
+	
+	acceptor.Begin(headerVector);
+	
+	DoDemandZeroOutputs(matrix, headerVector, acceptor);
+	
+	CMatrixRowLoader loader(matrix, numColumnsRequired, headerVector[2], acceptor);
+	
+	if(reader.ReadRows(loader, numThreads) == false || verifier.CheckRest() == false)
 	{
-		std::cout << "[1] Error reading file: " << inFileName << std::endl;
-		
 		return nullptr;
 	}
 	
+	acceptor.End(matrix);
+	
+	std::cout << "\rDone reading matrix.                " << std::endl;
+	
+	return matrix;
+}
+
+// This reads the header of a (dense or sparse) problem.dat; 'fi' is left at the first row.
+// returns true on success, false in case of failure.
+static bool DoReadHeader(std::FILE *fi, std::string inFileName, std::vector<uint64_t> &headerVector, CMerkleVerifier &verifier)
+{
 	uint64_t x = 0;
 	if(std::fread(&x, sizeof(uint64_t), 1, fi) != 1)
 	{
-		std::fclose(fi);
 		std::cout << "[2] Error reading file: " << inFileName << std::endl;
-		return nullptr;
+		return false;
+	}
+	
+	if(x < 11 * sizeof(uint64_t) || (x % sizeof(uint64_t)) != 0 || x > (1uLL << 32))
+	{
+		std::cout << "[2] Error reading file: " << inFileName << std::endl;
+		return false;
 	}
 	
-	uint64_t *header = new uint64_t [x / sizeof(uint64_t)];
+	headerVector.resize(x / sizeof(uint64_t));
 	
 	rewind(fi);
 	
-	if(std::fread(header, x, 1, fi) != 1)
+	if(std::fread(headerVector.data(), x, 1, fi) != 1)
 	{
-		delete [] header;
-		std::fclose(fi);
 		std::cout << "[3] Error reading file: " << inFileName << std::endl;
+		return false;
+	}
+	
+	if(verifier.Check(0, headerVector.data(), x) == false)
+	{
+		std::cout << "[6] The header doesn't match the Merkle tree: " << inFileName << std::endl;
+		return false;
+	}
+	
+	if(headerVector[4] != E_ROW_FORMAT_DENSE && headerVector[4] != E_ROW_FORMAT_SPARSE)
+	{
+		std::cout << "[3] Unknown row format in file: " << inFileName << std::endl;
+		return false;
+	}
+	
+	return true;
+}
+
+// The matrix is kept as 'storage' says (in memory, or in a file). Each row is checked by 'verifier' before it's used.
+static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor, uint32_t numThreads, const CMatrixStorage &storage, CMerkleVerifier &verifier)
+{
+	RMatrix matrix = nullptr;
+	
+	std::cout << "Reading " << inFileName << "..." << std::endl;
+	
+	if(CBlockReader::IsBlockFile(inFileName.c_str()) == true)
+	{
+		return DoGenerateMatrixFromBlocks(inFileName, acceptor, numThreads, storage, verifier);
+	}
+	
+	std::FILE *fi = std::fopen(inFileName.c_str(), "rb");
+	
+	if(fi == nullptr)
+	{
+		std::cout << "[1] Error reading file: " << inFileName << std::endl;
+		
 		return nullptr;
 	}
 	
-	std::vector<uint64_t> headerVector(header, header + x / sizeof(uint64_t));
+	std::vector<uint64_t> headerVector;
 	
-	delete [] header;
-	header = nullptr;
+	if(DoReadHeader(fi, inFileName, headerVector, verifier) == false)
+	{
+		std::fclose(fi);
+		return nullptr;
+	}
 	
 	uint64_t numColumnsRequired = headerVector[8]/* number of columns, incuding unity*/;
+	
+	uint64_t rowFormat = headerVector[4];
 
 	// compute number of rows we need for our unreduced matrix. we're adding the number of output equations because
 	// we plan to demand those equations have a value of 0, a requirement that involves us adding a new row.
@@ -354,7 +298,38 @@ static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor)
 	
 	uint64_t size = (numColumnsRequired > numRowsRequired) ? numColumnsRequired : numRowsRequired;
 	
-	matrix = std::make_shared<CMatrix>(numRowsRequired, numColumnsRequired);
+	matrix = CMatrix::Create(numRowsRequired, numColumnsRequired, storage);
+	
+	// The rest of the file is read ahead on its own thread, so the disk is busy while the acceptor works.
+	CPrefetchReader prefetch;
+	
+	if(rowFormat == E_ROW_FORMAT_SPARSE)
+	{
+		acceptor.Begin(headerVector);
+		
+		DoDemandZeroOutputs(matrix, headerVector, acceptor);
+		
+		const uint64_t offset = ftello(fi);
+		
+		prefetch.Start(fileno(fi), offset, 1024 * 1024);
+		
+		bool ok = DoReadSparseRows(prefetch, offset, matrix, numColumnsRequired, headerVector[2]/*numEquations*/, acceptor, verifier);
+		
+		prefetch.Stop();
+		std::fclose(fi);
+		
+		if(ok == false || verifier.CheckRest() == false)
+		{
+			return nullptr;
+		}
+		
+		acceptor.End(matrix);
+		
+		std::cout << "\rDone reading matrix.                " << std::endl;
+		prefetch.Report(std::cout);
+		
+		return matrix;
+	}
 	
 	// Now let's read some data!
 	uint64_t rowSize = numColumnsRequired + 2;	// the first entry is a length in bytes; then comes the equation number.
@@ -374,32 +349,26 @@ static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor)
 	
 	acceptor.Begin(headerVector);
 	
-	// Let's start by requiring all 'output' temporaries be 0. This will be done by adding some rows demanding as much.
-	for(int64_t i = headerVector[9] - 1; i >= 0; --i)
-	{
-		uint64_t position = headerVector[10 + i];
-		
-		matrix->ZeroRow(matrix->GetLogicalHeight() - 1);
-		
-		// Let's demand this variable be 0. Just place a 1 in its position of the matrix, and leave all other values in
-		// the row 0 (including the 'unity' column). This means 1 * X = 0, so X must be 0.
-		matrix->Set(matrix->GetLogicalHeight() - 1, headerVector[3]/*numInputs*/ + position, 1);
-		
-		// These rows come after (in the unreduced matrix) the normal 'temporary equation' rows.
-		acceptor.AcceptRow(matrix, headerVector[2]/*# of regular equations*/ + i);
-	}
+	DoDemandZeroOutputs(matrix, headerVector, acceptor);
+	
+	uint64_t offset = ftello(fi);
+	
+	prefetch.Start(fileno(fi), offset, readBufferSizeBytes);
+	
+	uint64_t numBytesRead = 0;
 	
 	do
 	{
-		uint64_t numBytesRead = std::fread(buffer, 1, readBufferSizeBytes, fi);
+		numBytesRead = prefetch.Read(buffer, readBufferSizeBytes);
 		
-		if(numBytesRead == 0)
+		if(numBytesRead == 0 && prefetch.Failed() == false)
 		{
 			break;
 		}
 		
-		if((numBytesRead % (rowSize * sizeof(uint64_t))) != 0)
+		if((numBytesRead % (rowSize * sizeof(uint64_t))) != 0 || prefetch.Failed() == true)
 		{
+			prefetch.Stop();
 			delete [] buffer;
 			std::fclose(fi);
 			
@@ -408,6 +377,19 @@ static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor)
 			return nullptr;
 		}
 		
+		if(verifier.Check(offset, buffer, numBytesRead) == false)
+		{
+			prefetch.Stop();
+			delete [] buffer;
+			std::fclose(fi);
+			
+			std::cout << "\n[6] The rows from byte " << offset << " on don't match the Merkle tree." << std::endl;
+			
+			return nullptr;
+		}
+		
+		offset += numBytesRead;
+		
 		uint64_t numEqnsRead = numBytesRead / (rowSize * sizeof(uint64_t));
 		
 		// Let's go through our row now(s).
@@ -425,6 +407,7 @@ static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor)
 			// Check for validity!
 			if(sizeBytes != rowSize * sizeof(uint64_t))
 			{
+				prefetch.Stop();
 				delete [] buffer;
 				std::fclose(fi);
 				
@@ -437,10 +420,7 @@ static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor)
 			matrix->ZeroRow(matrix->GetLogicalHeight() - 1);
 			
 			// Set column data.
-			for(uint64_t j = 0; j < numColumnsRequired; ++j)
-			{
-				matrix->Set(matrix->GetLogicalHeight() - 1, j, data[2 + j]);
-			}
+			matrix->SetRow(matrix->GetLogicalHeight() - 1, data + 2, numColumnsRequired);
 			
 			// Accept the row !
 			acceptor.AcceptRow(matrix, eqnNumber);
@@ -448,42 +428,308 @@ static RMatrix GenerateMatrix(std::string inFileName, CAcceptRow &acceptor)
 			data += rowSize;
 		}
 		
-	}	while(!std::feof(fi));
+	}	while(numBytesRead == readBufferSizeBytes);
+	
+	prefetch.Stop();
 	
 	delete [] buffer;
 	
 	std::fclose(fi);
 	
+	if(verifier.CheckRest() == false)
+	{
+		return nullptr;
+	}
+	
 	acceptor.End(matrix);
 	
 	std::cout << "\rDone reading matrix.                " << std::endl;
+	prefetch.Report(std::cout);
 	
 	return matrix;
 }
 
-// Returns true if the test passed, false otherwise.
-static bool DoCheckMatrix(RMatrix matrix, std::vector<bool> &secretValues)
+// This is GenerateMatrix() for acceptors that only look at each row once, in equation order (see CStreamingCheckRow).
+// The matrix only has its invisible bottom row, which each row is read into, so memory use is proportional to the
+// width rather than the size of the matrix. Since convert writes rows in the order the equations were generated
+// (which can be backwards), the file is indexed first: the offset of each row in a plain problem.dat, or its block
+// and position within that block in a block-compressed one. Each row is checked by 'verifier' before it's used.
+// Returns nullptr in case of failure.
+static RMatrix StreamMatrix(std::string inFileName, CAcceptRow &acceptor, CMerkleVerifier &verifier)
 {
-	if(secretValues.size() < matrix->GetLogicalWidth())
-	{
-		std::cout << "\nDoCheckMatrix(): not enough known secret values to do check!" << std::endl;
-		
-		return false;
-	}
+	std::cout << "Streaming " << inFileName << "..." << std::endl;
 	
-	for(uint64_t y = 0; y < matrix->GetLogicalHeight(); ++y)
+	const bool blocked = CBlockReader::IsBlockFile(inFileName.c_str());
+	const uint64_t NO_ROW = -1uLL;
+	
+	std::vector<uint64_t> headerVector;
+	CBlockReader reader;
+	std::FILE *fi = nullptr;
+	
+	reader.merkle = &verifier;
+	
+	if(blocked == true)
 	{
-		if(matrix->RowIsAllZeros(y) == true)  continue;
-		
-		uword_t value = 0;
-		
-		for(uint64_t x = 0; x < matrix->GetLogicalWidth(); ++x)
+		if(reader.Open(inFileName.c_str(), "problemd", headerVector) == false)
 		{
-			if(matrix->Get(y, x).x == 0)  continue;
+			return nullptr;
+		}
+		
+		if(headerVector.size() < 11 || headerVector[0] != headerVector.size() * sizeof(uint64_t) || headerVector[4] != E_ROW_FORMAT_SPARSE)
+		{
+			std::cout << "[3] Error reading file: " << inFileName << std::endl;
+			return nullptr;
+		}
+	}
+	else
+	{
+		fi = std::fopen(inFileName.c_str(), "rb");
+		
+		if(fi == nullptr)
+		{
+			std::cout << "[1] Error reading file: " << inFileName << std::endl;
+			
+			return nullptr;
+		}
+		
+		if(DoReadHeader(fi, inFileName, headerVector, verifier) == false)
+		{
+			std::fclose(fi);
+			return nullptr;
+		}
+	}
+	
+	const uint64_t numColumns = headerVector[8]/* number of columns, incuding unity*/;
+	const uint64_t numEquations = headerVector[2];
+	const bool dense = (headerVector[4] == E_ROW_FORMAT_DENSE);
+	
+	// For a plain file, 'rowAt' is the offset of each row. For a block file, it's the index of its block in
+	// 'blockOffsets', and 'slotOf' its position within the block.
+	std::vector<uint64_t> rowAt(numEquations, NO_ROW);
+	std::vector<uint32_t> slotOf;
+	std::vector<uint64_t> blockOffsets;
+	CBlockRows rows;
+	const char *error = nullptr;
+	
+	if(blocked == true)
+	{
+		slotOf.resize(numEquations, 0);
+		
+		if(reader.IndexBlocks(blockOffsets) == false)
+		{
+			return nullptr;
+		}
+		
+		for(uint64_t b = 0; b < blockOffsets.size() && error == nullptr; ++b)
+		{
+			if(reader.ReadBlockAt(blockOffsets[b], rows) == false)
+			{
+				return nullptr;
+			}
+			
+			for(uint64_t r = 0; r < rows.GetNumRows(); ++r)
+			{
+				const uint64_t eqnNumber = rows.rowNumbers[r];
+				
+				if(eqnNumber >= numEquations || rowAt[eqnNumber] != NO_ROW)
+				{
+					error = "[5] Invalid or corrupt data file detected.";
+					
+					break;
+				}
+				
+				rowAt[eqnNumber] = b;
+				slotOf[eqnNumber] = r;
+			}
+		}
+	}
+	else
+	{
+		for(;;)
+		{
+			const int64_t offset = ftello(fi);
+			uint64_t words[3];
+			
+			if(std::fread(words, sizeof(uint64_t), dense ? 2 : 3, fi) != (dense ? 2u : 3u))
+			{
+				if(std::feof(fi) == 0 || offset != ftello(fi))
+				{
+					error = "[4] Read an incorrect number of bytes. Is the file valid? Does it end early?";
+				}
+				
+				break;
+			}
+			
+			const uint64_t sizeBytes = words[0];
+			const uint64_t eqnNumber = words[1];
+			const uint64_t expectedBytes = dense ? (2 + numColumns) * sizeof(uint64_t) : (3 + 2 * words[2]) * sizeof(uint64_t);
+			
+			if(sizeBytes != expectedBytes || (dense == false && words[2] > numColumns) || eqnNumber >= numEquations || rowAt[eqnNumber] != NO_ROW ||
+				fseeko(fi, offset + sizeBytes, SEEK_SET) != 0
+			)
+			{
+				error = "[5] Invalid or corrupt data file detected.";
+				
+				break;
+			}
+			
+			rowAt[eqnNumber] = offset;
+		}
+	}
+	
+	for(uint64_t y = 0; y < numEquations && error == nullptr; ++y)
+	{
+		if(rowAt[y] == NO_ROW)
+		{
+			error = "[4] Read an incorrect number of bytes. Is the file valid? Does it end early?";
+		}
+	}
+	
+	if(error != nullptr)
+	{
+		if(fi != nullptr)
+		{
+			std::fclose(fi);
+		}
+		
+		std::cout << "\n" << error << std::endl;
+		
+		return nullptr;
+	}
+	
+	RMatrix matrix = std::make_shared<CMatrix>(0, numColumns);
+	std::vector<uint64_t> data;
+	uint64_t currentBlock = NO_ROW;
+	
+	acceptor.Begin(headerVector);
+	
+	DoDemandZeroOutputs(matrix, headerVector, acceptor);
+	
+	for(uint64_t y = 0; y < numEquations && error == nullptr; ++y)
+	{
+		if(blocked == true)
+		{
+			if(rowAt[y] != currentBlock)
+			{
+				currentBlock = rowAt[y];
+				
+				if(reader.ReadBlockAt(blockOffsets[currentBlock], rows) == false)
+				{
+					return nullptr;
+				}
+			}
+			
+			const uint64_t first = rows.rowStarts[slotOf[y]];
+			
+			if(DoLoadSparseRow(matrix, numColumns, y, rows.entries.data() + 2 * first, rows.rowStarts[slotOf[y] + 1] - first, acceptor) == false)
+			{
+				return nullptr;
+			}
+			
+			continue;
+		}
+		
+		uint64_t sizeBytes = 0;
+		
+		if(fseeko(fi, rowAt[y], SEEK_SET) != 0 || std::fread(&sizeBytes, sizeof(uint64_t), 1, fi) != 1 ||
+			sizeBytes < 3 * sizeof(uint64_t) || sizeBytes > (3 + 2 * numColumns) * sizeof(uint64_t)
+		)
+		{
+			error = "[4] Read an incorrect number of bytes. Is the file valid? Does it end early?";
+			
+			break;
+		}
+		
+		data.resize(sizeBytes / sizeof(uint64_t));
+		data[0] = sizeBytes;
+		
+		if(std::fread(&data[1], sizeBytes - sizeof(uint64_t), 1, fi) != 1)
+		{
+			error = "[4] Read an incorrect number of bytes. Is the file valid? Does it end early?";
+			
+			break;
+		}
+		
+		if(verifier.Check(rowAt[y], data.data(), sizeBytes) == false)
+		{
+			error = "[6] A row doesn't match the Merkle tree.";
+			
+			break;
+		}
+		
+		if(data[1] != y || (dense == false && sizeBytes != (3 + 2 * data[2]) * sizeof(uint64_t)))
+		{
+			error = "[5] Invalid or corrupt data file detected.";
+			
+			break;
+		}
+		
+		if(dense == false)
+		{
+			if(DoLoadSparseRow(matrix, numColumns, y, &data[3], data[2], acceptor) == false)
+			{
+				std::fclose(fi);
+				
+				return nullptr;
+			}
 			
+			continue;
+		}
+		
+		std::cout << "\r" << y << "                " << std::flush;
+		
+		matrix->SetRow(matrix->GetLogicalHeight() - 1, &data[2], numColumns);
+		
+		acceptor.AcceptRow(matrix, y);
+	}
+	
+	if(fi != nullptr)
+	{
+		std::fclose(fi);
+	}
+	
+	if(error != nullptr)
+	{
+		std::cout << "\n" << error << std::endl;
+		
+		return nullptr;
+	}
+	
+	if(verifier.CheckRest() == false)
+	{
+		return nullptr;
+	}
+	
+	acceptor.End(matrix);
+	
+	std::cout << "\rDone reading matrix.                " << std::endl;
+	
+	return matrix;
+}
+
+// Returns true if the test passed, false otherwise.
+static bool DoCheckMatrix(RMatrix matrix, std::vector<bool> &secretValues)
+{
+	if(secretValues.size() < matrix->GetLogicalWidth())
+	{
+		std::cout << "\nDoCheckMatrix(): not enough known secret values to do check!" << std::endl;
+		
+		return false;
+	}
+	
+	for(uint64_t y = 0; y < matrix->GetLogicalHeight(); ++y)
+	{
+		const CMatrixRow row = matrix->GetRow(y);
+		
+		if(row.IsAllZeros() == true)  continue;
+		
+		uword_t value = 0;
+		
+		for(uint64_t x = 0; x < row.width; ++x)
+		{
 			if(secretValues[x] == 0)  continue;
 			
-			value.x += matrix->Get(y, x).x;
+			value.x += row.Get(x).x;
 		}
 		
 		if(value.x != 0)
@@ -499,14 +745,351 @@ static bool DoCheckMatrix(RMatrix matrix, std::vector<bool> &secretValues)
 	return true;
 }
 
+// This reports how problem.dat and the solution compared with their Merkle trees (see merkletree.h) once they've
+// been read. Returns true if they matched, or had nothing to be verified against. Otherwise, or if reading them
+// 'failed' for some other reason, it gives up and returns false; if a segment didn't match, the model (written up to
+// that segment at most) is removed. After a failure only the file that didn't match, if any, is reported on, since
+// reading stopped there.
+static bool DoFinishVerifiers(CMerkleVerifier verifiers[2], bool compressModel, bool failed)
+{
+	bool ok = true;
+	
+	for(uint32_t n = 0; n < 2; ++n)
+	{
+		if(failed == false || verifiers[n].Failed() == true)
+		{
+			ok = (verifiers[n].Finish(std::cout) == true) && ok;
+		}
+	}
+	
+	if(ok == true && failed == false)
+	{
+		return true;
+	}
+	
+	const char *fn = (compressModel == true) ? "sha2_256_out.blk" : "sha2_256_out.txt";
+	
+	if(ok == false && std::remove(fn) == 0)
+	{
+		CMerkleTree::Remove(fn);
+		std::cout << "\nRemoved " << fn << "." << std::endl;
+	}
+	
+	std::cout << "\nGiving up." << std::endl;
+	
+	return false;
+}
+
+// This forgets the first 'numUnknownBits' bits of the message and finds them again from its hash: the message bits
+// (bar those), the initial H values and the output temporaries (the hash) are given, and 'solver', which has the
+// unreduced rows already, adds the rows of the reduced 'matrix' and tries the rest of the free columns. Each
+// candidate's message is hashed with the reference implementation, which confirms it if the hash is the same. The
+// unknown input variables, if the problem has any (see generate008's UNKNOWN_W_BIT_COUNT), are the first message
+// bits and are never given.
+// returns true if the secret message was among the candidates confirmed, false otherwise.
+static bool DoEnumerate(const CMatrix &matrix, CBackSubstitution &solver, const std::vector<uint64_t> &header,
+	const std::vector<bool> &secretValues, uint32_t numUnknownBits, uint32_t numRounds)
+{
+	// [inputs, temporaries, constants, unity]; constant 0 is unity, then come the message bits, the initial H values
+	// and the expected output H values (see CFormalSha256).
+	const uint64_t numInputs = header[3];
+	const uint64_t numTemps = header[2];
+	const uint64_t numOutputTemps = header[9];
+	const uint64_t numConstants = header[9 + 1 + numOutputTemps];
+	const uint64_t firstConstant = numInputs + numTemps;		// the column of constant 1
+	const uint32_t wordBits = numOutputTemps / 8;
+	const uint64_t width = matrix.GetLogicalWidth();
+	std::shared_ptr<CUtilScaledSha256> reference;
+	
+	std::cout << "\nEnumerating the first " << numUnknownBits << " message bit(s), " << numRounds << " round(s)." << std::endl;
+	
+	try
+	{
+		reference = std::make_shared<CUtilScaledSha256>(wordBits);
+	}
+	catch(std::runtime_error &e)
+	{
+		std::cout << e.what() << std::endl;
+		return false;
+	}
+	
+	if(numConstants < 1 + 24 * wordBits || firstConstant + numConstants != width || numInputs > 16 * wordBits ||
+		numUnknownBits > 16 * wordBits || numRounds == 0 || numRounds > 64)
+	{
+		std::cout << "This isn't a SHA-256 problem with a whole message, or the number of bits or rounds is out of range." << std::endl;
+		return false;
+	}
+	
+	std::vector<uint64_t> messageColumns(16 * wordBits);
+	std::vector<int8_t> pins(width, CBackSubstitution::FREE);
+	
+	for(uint64_t n = 0; n < messageColumns.size(); ++n)
+	{
+		messageColumns[n] = (n < numInputs) ? n : (firstConstant + n);
+	}
+	
+	for(uint64_t x = firstConstant; x < width; ++x)
+	{
+		pins[x] = secretValues[x];
+	}
+	
+	for(uint64_t i = 0; i < numOutputTemps; ++i)
+	{
+		pins[numInputs + header[9 + 1 + i]] = secretValues[numInputs + header[9 + 1 + i]];
+	}
+	
+	for(uint64_t n = 0; n < numUnknownBits; ++n)
+	{
+		pins[messageColumns[n]] = CBackSubstitution::FREE;
+	}
+	
+	// This reads the message and the initial H values out of a column's values.
+	auto load = [&](const std::vector<uint8_t> &values, uint32_t w[16], uint32_t h[8])
+	{
+		std::fill(w, w + 16, 0);
+		
+		for(uint64_t n = 0; n < messageColumns.size(); ++n)
+		{
+			w[n / wordBits] |= uint32_t(values[messageColumns[n]]) << (n % wordBits);
+		}
+		
+		for(uint32_t n = 0; n < 8 * wordBits; ++n)
+		{
+			h[n / wordBits] |= uint32_t(secretValues[firstConstant + 16 * wordBits + n]) << (n % wordBits);
+		}
+	};
+	
+	std::vector<uint8_t> secret(secretValues.begin(), secretValues.end());
+	uint32_t secretW[16];
+	uint32_t target[8] = { 0 };
+	uint32_t hash[8] = { 0 };
+	
+	load(secret, secretW, target);
+	reference->CompSha256(target, secretW, numRounds);
+	
+	for(uint64_t i = 0; i < numOutputTemps; ++i)
+	{
+		hash[i / wordBits] |= uint32_t(secretValues[numInputs + header[9 + 1 + i]]) << (i % wordBits);
+	}
+	
+	if(std::memcmp(hash, target, sizeof(hash)) != 0)
+	{
+		std::cout << "The output temporaries aren't the " << numRounds << "-round hash of the message; check -rounds." << std::endl;
+		return false;
+	}
+	
+	std::mutex lock;
+	std::vector<std::vector<uint32_t> > messages;		// the confirmed candidates' messages
+	bool foundSecret = false;
+	
+	solver.AddRows(matrix);
+	
+	try
+	{
+		solver.Enumerate(std::cout, pins, [&](const std::vector<uint8_t> &values)
+		{
+			uint32_t w[16];
+			uint32_t h[8] = { 0 };
+			
+			load(values, w, h);
+			reference->CompSha256(h, w, numRounds);
+			
+			if(std::memcmp(h, target, sizeof(h)) != 0)
+			{
+				return false;
+			}
+			
+			std::lock_guard<std::mutex> guard(lock);
+			
+			foundSecret = foundSecret || std::equal(w, w + 16, secretW);
+			
+			if(messages.size() < 16)
+			{
+				messages.push_back(std::vector<uint32_t>(w, w + 16));
+			}
+			
+			return true;
+		});
+	}
+	catch(std::runtime_error &e)
+	{
+		std::cout << e.what() << std::endl;
+		return false;
+	}
+	
+	const double seconds = std::max(solver.GetSeconds(), 1e-9);
+	
+	std::cout << "\n" << solver.GetCandidateCount() << " candidate(s), " << solver.GetConfirmedCount() << " confirmed, in " <<
+		solver.GetSeconds() << "s: " << (solver.GetCandidateCount() / seconds) << " candidates/s, " <<
+		(solver.GetBranchCount() / seconds) << " free columns tried/s, " << (solver.GetSubstitutionCount() / seconds) <<
+		" substitutions/s." << std::endl
+	;
+	
+	for(const std::vector<uint32_t> &w : messages)
+	{
+		for(uint32_t i = 0; i < 16; ++i)
+		{
+			char s[16];
+			
+			std::sprintf(s, "%0*x", (int)((wordBits + 3) / 4), (unsigned int)w[i]);
+			std::cout << s << ((i == 15) ? "\n" : " ");
+		}
+	}
+	
+	if(foundSecret == false)
+	{
+		std::cout << "\nThe secret message wasn't among them." << std::endl;
+		return false;
+	}
+	
+	std::cout << "\nThe secret message was among them." << std::endl;
+	
+	return true;
+}
+
 }	// namespace formal_crypto
 
-int main()
+int main(int argc, char *argv[])
 {
 	using namespace formal_crypto;
 
 	std::cout << "check2" << std::endl;
 	
+	uint32_t numThreads = 0;
+	bool compressModel = false;
+	bool stream = false;
+	bool useCache = false;
+	bool noCache = false;
+	bool reduce = false;
+	bool reduceSparse = false;
+	bool reduceBlocked = false;
+	bool reduceOnline = false;
+	bool checkModTwo = false;
+	bool solveHensel = false;
+	bool enumerate = false;
+	uint32_t numUnknownBits = 0;
+	uint32_t numRounds = 64;
+	CMatrixStorage storage;
+	
+	for(int i = 1; i < argc; ++i)
+	{
+		if(std::strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+		{
+			numThreads = std::strtoul(argv[++i], nullptr, 0);
+		}
+		else if(std::strcmp(argv[i], "-compress") == 0)
+		{
+			compressModel = true;
+		}
+		else if(std::strcmp(argv[i], "-stream") == 0)
+		{
+			stream = true;
+		}
+		else if(std::strcmp(argv[i], "-cache") == 0)
+		{
+			useCache = true;
+		}
+		else if(std::strcmp(argv[i], "-no-cache") == 0)
+		{
+			noCache = true;
+		}
+		else if(std::strcmp(argv[i], "-reduce") == 0)
+		{
+			reduce = true;
+		}
+		else if(std::strcmp(argv[i], "-reduce-sparse") == 0)
+		{
+			reduce = true;
+			reduceSparse = true;
+		}
+		else if(std::strcmp(argv[i], "-reduce-blocked") == 0)
+		{
+			reduce = true;
+			reduceBlocked = true;
+		}
+		else if(std::strcmp(argv[i], "-reduce-online") == 0)
+		{
+			reduce = true;
+			reduceOnline = true;
+			stream = true;
+		}
+		else if(std::strcmp(argv[i], "-check-mod2") == 0)
+		{
+			checkModTwo = true;
+		}
+		else if(std::strcmp(argv[i], "-solve-hensel") == 0)
+		{
+			solveHensel = true;
+		}
+		else if(std::strcmp(argv[i], "-enumerate") == 0 && i + 1 < argc)
+		{
+			reduce = true;
+			enumerate = true;
+			numUnknownBits = std::strtoul(argv[++i], nullptr, 0);
+		}
+		else if(std::strcmp(argv[i], "-rounds") == 0 && i + 1 < argc)
+		{
+			numRounds = std::strtoul(argv[++i], nullptr, 0);
+		}
+		else if(std::strcmp(argv[i], "-out-of-core") == 0 && i + 1 < argc)
+		{
+			storage.directory = argv[++i];
+		}
+		else if(std::strcmp(argv[i], "-resident") == 0 && i + 1 < argc)
+		{
+			storage.maxResidentBytes = std::strtoull(argv[++i], nullptr, 0) << 20;
+		}
+		else if(std::strcmp(argv[i], "-diff") == 0 && i + 2 < argc)
+		{
+			CMerkleTree trees[2];
+			
+			for(uint32_t n = 0; n < 2; ++n)
+			{
+				if(trees[n].Read(argv[i + 1 + n]) == false)
+				{
+					std::cout << "Unable to read " << argv[i + 1 + n] << ".merkle" << std::endl;
+					return 1;
+				}
+			}
+			
+			return CMerkleTree::Compare(trees[0], trees[1], std::cout) ? 0 : 1;
+		}
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [-threads <n>] [-compress] [-stream] [-cache | -no-cache] [-reduce] [-reduce-sparse] [-reduce-blocked]" <<
+				" [-reduce-online] [-check-mod2] [-solve-hensel] [-enumerate <bits> [-rounds <n>]] [-out-of-core <directory> [-resident <MiB>]]" <<
+				std::endl
+			;
+			std::cout << "       " << argv[0] << " -diff <file 1> <file 2>" << std::endl;
+			return 1;
+		}
+	}
+	
+	// -stream and the thread count don't change the model, so they aren't part of the key. A model is only stored
+	// once the matrix has been checked against the solution.
+	CArtifactCache cache(useCache);
+	const std::string cacheDescription = std::string("check2") + (compressModel ? " -compress" : "");
+	const std::vector<std::string> cacheNames(1, compressModel ? "sha2_256_out.blk" : "sha2_256_out.txt");
+	std::vector<std::string> cacheInputs;
+	
+	cacheInputs.push_back("problem.dat");
+	cacheInputs.push_back("solution256x2-68.bin");
+	cache.enabled = cache.enabled && (noCache == false) && (reduce == false) && (checkModTwo == false) && (solveHensel == false);
+	
+	const std::string cacheKey = cache.MakeKey(cacheDescription, cacheInputs);
+	
+	if(cache.Fetch(cacheKey, cacheNames, std::cout) == true)
+	{
+		return 0;
+	}
+	
+	// The loaders below check each segment of these as they read it; nothing is stored in the cache unless both files
+	// check out.
+	CMerkleVerifier verifiers[2];
+	
+	verifiers[0].Start("problem.dat");
+	verifiers[1].Start("solution256x2-68.bin");
+	
 	RMatrix matrix;
 	
 	// This contains values (0 or 1) for each column in the matrix, based on the secret key solution
@@ -515,16 +1098,90 @@ int main()
 	
 	std::vector<uint64_t> header;
 
+	// With -stream, rows are checked as they're read and the matrix isn't kept (so the row reduction below, if
+	// enabled, has nothing to work with). With -reduce-online, they're also reduced as they're read, and only the
+	// independent ones are kept.
+	if(stream == true)
+	{
+		CStreamingReduceRow streamAcceptor("solution256x2-68.bin");
+		CStreamingCheckRow checkAcceptor("solution256x2-68.bin");
+		CStreamingCheckRow &acceptor = (reduceOnline == true) ? streamAcceptor : checkAcceptor;
+		const auto t0 = std::chrono::steady_clock::now();
+		
+		acceptor.compressModel = compressModel;
+		acceptor.solutionMerkle = &verifiers[1];
+		
+		matrix = StreamMatrix("problem.dat", acceptor, verifiers[0]);
+		
+		if(DoFinishVerifiers(verifiers, compressModel, matrix == nullptr || acceptor.failed == true) == false)
+		{
+			return 1;
+		}
+		
+		cache.Store(cacheKey, cacheDescription, cacheNames, std::cout);
+		
+		if(reduceOnline == false)
+		{
+			return 0;
+		}
+		
+		std::cout << "\nRead and reduced in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() <<
+			"s." << std::endl
+		;
+		
+		try
+		{
+			matrix = streamAcceptor.echelon->Publish(storage);
+		}
+		catch(std::runtime_error &e)		// e.g. if the -out-of-core file can't be made
+		{
+			std::cout << e.what() << "\nGiving up." << std::endl;
+			
+			return 1;
+		}
+		
+		std::cout << "\nWriting m1.dat... " << std::flush;
+		std::FILE *fo = std::fopen("m1.dat", "wb");
+		matrix->Write(fo);
+		std::fclose(fo);
+		std::cout << "done" << std::endl;
+		
+		secretValues = acceptor.GetSecretValues();
+		
+		std::cout << "\nChecking matrix..." << std::endl;
+		
+		if(DoCheckMatrix(matrix, secretValues) == false)
+		{
+			std::cout << "\nMatrix check failed." << std::endl;
+			
+			return 1;
+		}
+		
+		std::cout << "\nMatrix check passed, active height = " << matrix->GetActiveHeight() << std::endl;
+		
+		return 0;
+	}
+	
 	// Our first step is to accept (and check) the unreduced matrix. This loads 'matrix' and 'secretValues'.
 	if(true)
 	{
 		CRawAcceptRow rawAcceptor;
 		
-		matrix = GenerateMatrix("problem.dat", rawAcceptor);
+		rawAcceptor.compressModel = compressModel;
+		rawAcceptor.solutionMerkle = &verifiers[1];
+		
+		try
+		{
+			matrix = GenerateMatrix("problem.dat", rawAcceptor, numThreads, storage, verifiers[0]);
+		}
+		catch(std::runtime_error &e)		// e.g. if the -out-of-core file can't be made
+		{
+			std::cout << e.what() << std::endl;
+		}
 		
 		if(matrix == nullptr)
 		{
-			std::cout << "\nGiving up." << std::endl;
+			DoFinishVerifiers(verifiers, compressModel, true);
 			
 			return 1;
 		}
@@ -532,15 +1189,140 @@ int main()
 		header = rawAcceptor.header;
 		
 		// Let's check our unreduced matrix and also fill 'secretValues' so we can do checks later on.
-		if(rawAcceptor.CheckRawMatrix("solution256x2-68.bin", matrix, secretValues) == false)
+		const bool checked = rawAcceptor.CheckRawMatrix("solution256x2-68.bin", matrix, secretValues);
+		
+		if(DoFinishVerifiers(verifiers, compressModel, checked == false) == false)
+		{
+			return 1;
+		}
+		
+		cache.Store(cacheKey, cacheDescription, cacheNames, std::cout);
+	}
+	
+	// The rows demanding the outputs be 0 (see DoDemandZeroOutputs()) describe the hash we'd like, not the one the
+	// solution has, so the solution can't satisfy them; they're left out, or the check below would always fail.
+	if(reduce == true || checkModTwo == true || solveHensel == true)
+	{
+		for(uint64_t i = 0; i < header[9]; ++i)
+		{
+			matrix->ZeroRow(header[2] + i);
+		}
+	}
+	
+	// This takes seconds, where -reduce can take hours, and a contradiction modulo 2 is one modulo 2^33 as well.
+	if(checkModTwo == true)
+	{
+		std::cout << "\nChecking the equations modulo 2." << std::endl;
+		
+		const auto t0 = std::chrono::steady_clock::now();
+		
+		if(matrix->CheckModTwo(std::cout) == false)
 		{
-			std::cout << "\nGiving up." << std::endl;
+			std::cout << "\nThe equations are inconsistent modulo 2. Giving up." << std::endl;
 			
 			return 1;
 		}
+		
+		std::cout << "\nConsistent modulo 2 (" << std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() <<
+			"s)." << std::endl
+		;
 	}
 	
-	if(false)
+	// The values found are checked against every row here, and against the reduced rows below. The pivot rows the
+	// solver found, which have the same solutions as the rows, are checked against the solution we know of.
+	std::vector<uint64_t> henselSolution;
+	
+	if(solveHensel == true)
+	{
+		std::cout << "\nSolving the equations by Hensel lifting." << std::endl;
+		
+		// As for -enumerate, the constants (the message, the initial H values) and the output temporaries (the hash)
+		// are given, and the inputs and the other temporaries are solved for.
+		const uint64_t numInputs = header[3];
+		std::vector<int64_t> pins(matrix->GetLogicalWidth(), CHenselSolver::FREE);
+		
+		for(uint64_t x = numInputs + header[2]; x < pins.size() && x < secretValues.size(); ++x)
+		{
+			pins[x] = secretValues[x];
+		}
+		
+		for(uint64_t i = 0; i < header[9]; ++i)
+		{
+			pins[numInputs + header[9 + 1 + i]] = secretValues[numInputs + header[9 + 1 + i]];
+		}
+		
+		const auto t0 = std::chrono::steady_clock::now();
+		CHenselSolver solver(*matrix);
+		
+		if(solver.Solve(std::cout, pins) == false)
+		{
+			std::cout << "\nThe equations have no solution. Giving up." << std::endl;
+			
+			return 1;
+		}
+		
+		std::cout << "\nSolved (" << std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() << "s)." << std::endl;
+		
+		henselSolution = solver.GetSolution();
+		
+		const uint64_t numUnsolved = CHenselSolver::CountUnsolvedRows(*matrix, henselSolution);
+		
+		if(numUnsolved != 0)
+		{
+			std::cout << "\nThe values found leave " << numUnsolved << " row(s) nonzero. Giving up." << std::endl;
+			
+			return 1;
+		}
+		
+		if(DoCheckMatrix(solver.Publish(), secretValues) == false)
+		{
+			std::cout << "\nPivot row check failed." << std::endl;
+			
+			return 1;
+		}
+		
+		std::cout << "\nThe values found make every row 0, and the pivot rows check out." << std::endl;
+		
+		// The inputs are the unknown message bits, if the problem has any (see generate008's UNKNOWN_W_BIT_COUNT). The
+		// ones the equations determine have to be the secret's; the others are 0 in the values found.
+		uint64_t numDetermined = 0;
+		uint64_t numFound = 0;
+		
+		for(uint64_t x = 0; x < numInputs; ++x)
+		{
+			if(solver.IsDetermined(x) == true)
+			{
+				++numDetermined;
+				
+				if((henselSolution[x] & 1) != uint64_t(secretValues[x]))
+				{
+					std::cout << "\nInput " << x << " is determined by the equations, but isn't the secret's. Giving up." << std::endl;
+					
+					return 1;
+				}
+			}
+			
+			numFound += (henselSolution[x] == uint64_t(secretValues[x]));
+		}
+		
+		if(numInputs != 0)
+		{
+			std::cout << "\n" << numDetermined << " of " << numInputs << " input(s) are determined modulo 2 by the equations, and are " <<
+				"the secret's; " << numFound << " of the values found for the inputs are the secret's." << std::endl
+			;
+		}
+	}
+	
+	// The rows are kept as they are for -enumerate, as well as reduced (see CBackSubstitution in matrix.h).
+	CBackSubstitution solver(matrix->GetLogicalWidth());
+	
+	if(enumerate == true)
+	{
+		solver.numThreads = numThreads;
+		solver.AddRows(*matrix);
+	}
+	
+	if(reduce == true)
 	{
 		using namespace std;
 		
@@ -552,15 +1334,34 @@ int main()
 		std::cout << "done" << std::endl;
 	
 		std::cout << "\nBegin row reduce." << std::endl;
+		
+		const auto t0 = std::chrono::steady_clock::now();
+	
+		bool reduced = false;
+		
+		if(reduceSparse == true)
+		{
+			reduced = matrix->RowReduceSparse(std::cout);
+		}
+		else if(reduceBlocked == true)
+		{
+			reduced = matrix->RowReduceBlocked(std::cout, numThreads);
+		}
+		else
+		{
+			reduced = matrix->RowReduce(std::cout);
+		}
 	
-		if(matrix->RowReduce(std::cout) == false)
+		if(reduced == false)
 		{
 			std::cout << "\nRow reduce failed." << std::endl;
 			
 			return 1;
 		}
 		
-		std::cout << "\nRow reduce complete." << std::endl;
+		std::cout << "\nRow reduce complete (" << std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() <<
+			"s)." << std::endl
+		;
 		
 		std::cout << "\nWriting m1.dat... " << std::flush;
 		fo = fopen("m1.dat", "wb");
@@ -581,8 +1382,29 @@ int main()
 		std::cout << "\nMatrix check passed, active height = " <<
 			matrix->GetActiveHeight() << std::endl
 		;
+		
+		if(henselSolution.empty() == false)
+		{
+			const uint64_t numUnsolved = CHenselSolver::CountUnsolvedRows(*matrix, henselSolution);
+			
+			if(numUnsolved != 0)
+			{
+				std::cout << "\nThe values found by Hensel lifting leave " << numUnsolved << " reduced row(s) nonzero." << std::endl;
+				
+				return 1;
+			}
+			
+			std::cout << "\nThe values found by Hensel lifting make every reduced row 0 as well." << std::endl;
+		}
+		
+		if(enumerate == true && DoEnumerate(*matrix, solver, header, secretValues, numUnknownBits, numRounds) == false)
+		{
+			return 1;
+		}
 	}
 	
+	matrix->ReportStorage(std::cout);		// if it's in a file
+	
 	return 0;
 }
 
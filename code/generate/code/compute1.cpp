@@ -1,11 +1,15 @@
 // compute1.cpp - by Willow Schlanger. Released to the Public Domain in August of 2017.
 // see build.txt
 //
-// g++ -I./h -std=c++11 -o compute1.out compute1.cpp
+// g++ -I./h -std=c++11 -o compute1.out compute1.cpp utilsha256.cpp -O2 -pthread
 //
-// ./compute1.out
+// ./compute1.out [-model <file>] [-threads <n>]
 //
-// This program uses the 'sha2_256_out.txt' file as input.
+// This program uses the 'sha2_256_out.txt' file as input. A block-compressed
+// model (sha2_256_out.blk, written by 'check2 -compress') can be used instead
+// via -model; its blocks are decoded on -threads threads (default: one per core).
+// If the model has a Merkle tree (<file>.merkle, see merkletree.h), each row
+// (or block of rows) is checked against it as it's read, before it's used.
 //
 // The SHA2-256 value of the following sentence, with an appended new-line (only one 0x0a, and no x0d characters), is
 // 253736f3ba044d4373df1aa89022762663a47cae6577aefd35f3926973572302:
@@ -52,6 +56,16 @@
 
 #include <stdlib.h>
 
+#include <string>
+
+#include <sstream>
+
+#include <algorithm>
+
+#include "blockcodec.h"
+
+#include "merkletree.h"
+
 uint32_t sha256_initial_h[8] =
 {
 	0x6a09e667,
@@ -125,6 +139,11 @@ public:
 
     numY = numYa;
 
+    // the number of output Y's is 8 times the word size (i.e. 256 for SHA2-256, or less for a
+    // scaled-down analogue produced via generate008's -w option). Words are never wider than 32 bits.
+
+    wordBits = std::min(numY / 8, 32);
+
     delete [] values;
 
     delete [] known;
@@ -156,13 +175,13 @@ public:
     }
   }
 
-  // c[1..512] represent the input W values.
+  // c[1..16W] represent the input W values (W = wordBits, i.e. 32 for SHA2-256).
 
   void InitializeW(uint32_t inputW[16])
   {
-    for(uint32_t i = 0; i < 512; ++i)
+    for(uint32_t i = 0; i < 16 * wordBits; ++i)
     {
-      if(((inputW[i / 32] >> (i & 31)) & 1u) != 0)
+      if(((inputW[i / wordBits] >> (i % wordBits)) & 1u) != 0)
       {
         // note: c[0] became unity, so the first constant variable is
         // really c[1].
@@ -180,26 +199,28 @@ public:
     }
   }
 
-  // c[513..513+256-1] represents the input H values.
+  // c[16W+1..16W+8W] represents the input H values.
 
   void InitializeH(uint32_t inputH[8])
   {
-    for(uint32_t i = 0; i < 256; ++i)
+    const uint32_t base = 16 * wordBits + 1;
+
+    for(uint32_t i = 0; i < 8 * wordBits; ++i)
     {
-      if(((inputH[i / 32] >> (i & 31)) & 1u) != 0)
+      if(((inputH[i / wordBits] >> (i % wordBits)) & 1u) != 0)
       {
         // reminder: the first constant is really c[1],
         // and the 'last' constant is unity, i.e. c[0].
 
-        values[(513 + i) - 1 + numX + numT] = 1;
+        values[(base + i) - 1 + numX + numT] = 1;
 
-        known[(513 + i) - 1 + numX + numT] = true;
+        known[(base + i) - 1 + numX + numT] = true;
       }
       else
       {
-        values[(513 + i) - 1 + numX + numT] = 0;
+        values[(base + i) - 1 + numX + numT] = 0;
 
-        known[(513 + i) - 1 + numX + numT] = true;
+        known[(base + i) - 1 + numX + numT] = true;
       }
     }
   }
@@ -384,11 +405,11 @@ if(false)
   {
     memset(valueH, 0, sizeof(uint32_t) * 8);
 
-    for(uint32_t i = 0; i < 256; ++i)
+    for(uint32_t i = 0; i < 8 * wordBits; ++i)
     {
       if(values[yTemps[i]] != 0)
       {
-        valueH[i / 32] |= (1u << (i & 31));
+        valueH[i / wordBits] |= (1u << (i % wordBits));
       }
     }
   }
@@ -408,6 +429,68 @@ public: //private:
   int numC;
 
   int numY;
+
+  uint32_t wordBits;
+};
+
+// this feeds the rows of a block-compressed model to acceptRow(), in order.
+
+class CModelRowAcceptor :
+  public formal_crypto::CBlockRowAcceptor
+{
+public:
+  CModelRowAcceptor(CLinearSha2_256_Implementation &impl, uint64_t *rowa, int numColumnsa) :
+    sha2Impl(impl),
+    row(rowa),
+    numColumns(numColumnsa),
+    nextRow(0)
+  {
+  }
+
+  virtual bool AcceptBlockRow(uint64_t rowNumber, const uint64_t *pairs, uint64_t count)
+  {
+    std::cout << "\r" << nextRow << "/" << sha2Impl.numT << std::flush;
+
+    if(rowNumber != (uint64_t)nextRow)
+    {
+      std::cout << "\nInvalid file: row " << rowNumber << " out of order" << std::endl;
+
+      return false;
+    }
+
+    memset(row, 0, sizeof(uint64_t) * numColumns);
+
+    for(uint64_t i = 0; i < count; ++i)
+    {
+      if(pairs[2 * i] >= (uint64_t)numColumns)
+      {
+        std::cout << "\nInvalid file: column " << pairs[2 * i] << std::endl;
+
+        return false;
+      }
+
+      row[pairs[2 * i]] = pairs[2 * i + 1];
+    }
+
+    if(!sha2Impl.acceptRow(nextRow, row))
+    {
+      std::cout << "\nFail, row " << nextRow << std::endl;
+
+      return false;
+    }
+
+    ++nextRow;
+
+    return true;
+  }
+
+  CLinearSha2_256_Implementation &sha2Impl;
+
+  uint64_t *row;
+
+  int numColumns;
+
+  int nextRow;
 };
 
 int main(int argc, char *argv[])
@@ -415,15 +498,43 @@ int main(int argc, char *argv[])
   // You're with another special project now, Grandma!
   // 253736f3ba044d4373df1aa89022762663a47cae6577aefd35f3926973572302
 
-  std::ifstream fis("sha2_256_out.txt");
+  std::string modelFileName = "sha2_256_out.txt";
+
+  uint32_t numThreads = 0;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "-model") == 0 && i + 1 < argc)
+    {
+      modelFileName = argv[++i];
+    }
+    else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+    {
+      numThreads = strtoul(argv[++i], NULL, 0);
+    }
+    else
+    {
+      std::cout << "Usage: " << argv[0] << " [-model <file>] [-threads <n>]" << std::endl;
+
+      return 1;
+    }
+  }
+
+  std::ifstream fis(modelFileName.c_str());
 
   if(!fis)
   {
-    std::cout << "sha2_256_out.txt must exist." << std::endl;
+    std::cout << modelFileName << " must exist." << std::endl;
 
     return 1;
   }
 
+  // a block-compressed model is detected by its signature.
+
+  const bool blocked = formal_crypto::CBlockReader::IsBlockFile(modelFileName.c_str());
+
+  formal_crypto::CBlockReader blockReader;
+
   uint32_t input_w[16];
 
   memset(input_w, 0, sizeof(input_w));
@@ -433,7 +544,13 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  std::cout << "\nOpened file: sha2_256_out.txt\n" << std::endl;
+  std::cout << "\nOpened file: " << modelFileName << "\n" << std::endl;
+
+  formal_crypto::CMerkleVerifier verifier;
+
+  verifier.Start(modelFileName);
+
+  blockReader.merkle = &verifier;
 
   std::vector<int> yTemps;
 
@@ -443,8 +560,57 @@ int main(int argc, char *argv[])
 
   memset(line, 0, (numT + numX + numC) * 9 + 18);
 
-  if(fis)
+  if(blocked)
   {
+    // header words: number of Y's, their positions, T, X and C.
+
+    std::vector<uint64_t> header;
+
+    if(!blockReader.Open(modelFileName.c_str(), "sha2mdl ", header) || header.size() < 4 || header.size() != header[0] + 4)
+    {
+      std::cout << "\nError [1] with " << modelFileName << std::endl;
+
+      if(verifier.Failed())
+      {
+        verifier.Finish(std::cout);
+      }
+
+      return 1;
+    }
+
+    for(uint64_t i = 0; i < header[0]; ++i)
+    {
+      yTemps.push_back(header[1 + i]);
+    }
+
+    numT = header[header[0] + 1];
+
+    numX = header[header[0] + 2];
+
+    numC = header[header[0] + 3];
+
+    std::cout << numT << " " << numX << " " << numC << "\n" << std::endl;
+  }
+  else if(fis)
+  {
+    // the header (everything before the first row) is read whole, so it can be checked before it's used.
+
+    std::string headerText;
+
+    for(std::string text; fis.peek() != 'b' && std::getline(fis, text); )
+    {
+      headerText += text + "\n";
+    }
+
+    if(!verifier.Check(0, headerText.data(), headerText.size()))
+    {
+      verifier.Finish(std::cout);
+
+      return 1;
+    }
+
+    std::istringstream his(headerText);
+
     int count = 0;
 
     for(;;)
@@ -453,7 +619,7 @@ int main(int argc, char *argv[])
 
       char yc = 0;
 
-      fis >> yc;
+      his >> yc;
 
       if(yc != 'Y')
       {
@@ -462,9 +628,9 @@ int main(int argc, char *argv[])
         return 0;
       }
 
-      fis >> yT;
+      his >> yT;
 
-      fis >> tempT;
+      his >> tempT;
 
       if(yT == -1)  break;
 
@@ -486,25 +652,25 @@ int main(int argc, char *argv[])
 
     int xInt = 0;
 
-    fis >> cInt;
+    his >> cInt;
 
-    fis >> xInt;
+    his >> xInt;
 
     if(cInt == 'T')  numT = xInt;
     if(cInt == 'C')  numC = xInt;
 
     //std::cout << cInt << " " << xInt << std::endl;
 
-    fis >> cInt;
+    his >> cInt;
 
-    fis >> xInt;
+    his >> xInt;
 
     if(cInt == 'T')  numT = xInt;
     if(cInt == 'C')  numC = xInt;
 
-    fis >> cInt;
+    his >> cInt;
 
-    fis >> xInt;
+    his >> xInt;
 
     if(cInt == 'T')  numT = xInt;
     if(cInt == 'C')  numC = xInt;
@@ -518,15 +684,44 @@ int main(int argc, char *argv[])
 
   CLinearSha2_256_Implementation sha2Impl(yTemps);
 
-  sha2Impl.init(numT, numX, numC, 256);
+  if(yTemps.size() == 0 || (yTemps.size() % 8) != 0 || yTemps.size() > 256)
+  {
+    std::cout << "\nUnexpected number of output temps in sha2_256_out.txt: " << yTemps.size() << std::endl;
+
+    delete [] row;
+
+    delete [] line;
+
+    return 1;
+  }
+
+  sha2Impl.init(numT, numX, numC, yTemps.size());
+
+  const uint32_t wordBits = sha2Impl.wordBits;
+
+  const uint32_t wordMask = (wordBits == 32) ? 0xffffffffu : ((1u << wordBits) - 1);
 
   // This is specific to the computation we want to run.
 
   // Use default (i.e. from spec) SHA2-256 values.
   // This can be changed, if so desired.
-  sha2Impl.InitializeH(sha256_initial_h);
+  // A scaled-down analogue with W-bit words uses the top W bits of each initial value
+  // (see CUtilScaledSha256 in utilsha256.h), and its message words are truncated to W bits.
+  uint32_t initial_h[8];
+
+  for(uint32_t i = 0; i < 8; ++i)
+  {
+    initial_h[i] = sha256_initial_h[i] >> (32 - wordBits);
+  }
+
+  sha2Impl.InitializeH(initial_h);
   // End section that can be changed.
 
+  for(uint32_t i = 0; i < 16; ++i)
+  {
+    input_w[i] &= wordMask;
+  }
+
   sha2Impl.InitializeW(input_w);
 
   int remain = numT;
@@ -549,103 +744,164 @@ int main(int argc, char *argv[])
 
   int prob = 1;
 
-  for(;;)
+  if(blocked)
   {
-    std::cout << "\r" << (numT - tempsRemaining) << "/" << numT << std::flush;
+    CModelRowAcceptor modelAcceptor(sha2Impl, row, numT + numX + numC);
 
-    if(tempsRemaining-- == 0)
+    if(!blockReader.ReadRows(modelAcceptor, numThreads) || modelAcceptor.nextRow != numT)
     {
-      std::cout << "\r" << (numT - tempsRemaining + 1) << "/" << numT << std::flush;
+      std::cout << "\nInvalid file: " << modelFileName << std::endl;
+
+      if(verifier.Failed())
+      {
+        verifier.Finish(std::cout);
+      }
 
-      break;
+      delete [] row;
+
+      delete [] line;
+
+      return 1;
     }
 
-    bool cont = false;
+    std::cout << "\r" << numT << "/" << numT << std::flush;
+  }
+  else
+  {
+    for(;;)
+    {
+      std::cout << "\r" << (numT - tempsRemaining) << "/" << numT << std::flush;
+
+      if(tempsRemaining-- == 0)
+      {
+        std::cout << "\r" << (numT - tempsRemaining + 1) << "/" << numT << std::flush;
 
-    size_t columnNum = 0;
+        break;
+      }
 
-    uint64_t value = 0;
+      bool cont = false;
 
-    memset(row, 0, sizeof(uint64_t) * (numT + numX + numC));
+      size_t columnNum = 0;
 
-    bool valid = false;
+      uint64_t value = 0;
 
-    int valid_count = 0;
+      memset(row, 0, sizeof(uint64_t) * (numT + numX + numC));
 
-    for(size_t i = 0;;)
-    {
-      fis >> line;
+      bool valid = false;
+
+      int valid_count = 0;
 
-      if(strcmp(line, "begin") == 0)
+      // each row is a line, and a segment of the Merkle tree; it's checked before it's used.
+
+      const uint64_t rowOffset = fis.tellg();
+
+      std::string rowText;
+
+      std::getline(fis, rowText);
+
+      rowText += "\n";
+
+      if(!verifier.Check(rowOffset, rowText.data(), rowText.size()))
       {
-        if(valid)
+        verifier.Finish(std::cout);
+
+        delete [] row;
+
+        delete [] line;
+
+        return 1;
+      }
+
+      std::istringstream ris(rowText);
+
+      for(size_t i = 0;;)
+      {
+        ris >> line;
+
+        if(strcmp(line, "begin") == 0)
         {
-          std::cout << "Fail Case A" << std::endl;
+          if(valid)
+          {
+            std::cout << "Fail Case A" << std::endl;
+
+            return 1;
+          }
+
+          valid = true;
+
+  	valid_count = 0;
 
-          return 1;
+  	ris >> line;
         }
 
-        valid = true;
+        ++valid_count;
 
-	valid_count = 0;
+        if(strlen(line) != 9)
+        {
+            std::cout << "\nInvalid file 1: " << " " << i << " [" << (line) << "]" << std::endl;
 
-	fis >> line;
-      }
+            delete [] row;
 
-      ++valid_count;
+  	  delete [] line;
 
-      if(strlen(line) != 9)
-      {
-          std::cout << "\nInvalid file 1: " << " " << i << " [" << (line) << "]" << std::endl;
+            return 1;
+        }
+
+        value = strtoll(line, NULL, 16);
 
-          delete [] row;
+        row[columnNum++] = value;
 
-	  delete [] line;
+        if(valid_count == numT + numX + numC)
+        {
+          //std::cout << "Fail Excess" << std::endl;
 
-          return 1;
+          break;
+        }
       }
 
-      value = strtoll(line, NULL, 16);
+      if(columnNum != (numT + numX + numC))
+      {
+        std::cout << "\nInvalid file 4: " << std::endl;
 
-      row[columnNum++] = value;
+        delete [] row;
 
-      if(valid_count == numT + numX + numC)
-      {
-        //std::cout << "Fail Excess" << std::endl;
+        delete [] line;
 
-        break;
+        return 1;
       }
-    }
 
-    if(columnNum != (numT + numX + numC))
-    {
-      std::cout << "\nInvalid file 4: " << std::endl;
+      if(!sha2Impl.acceptRow(rowNum, row))
+      {
+        std::cout << "\nFail, row " << (int)rowNum << std::endl;
 
-      delete [] row;
+        delete [] row;
 
-      delete [] line;
+        delete [] line;
 
-      return 1;
-    }
+        return 1;
+      }
 
-    if(!sha2Impl.acceptRow(rowNum, row))
-    {
-      std::cout << "\nFail, row " << (int)rowNum << std::endl;
+      //line = "";
 
-      delete [] row;
+      ++rowNum;
 
-      delete [] line;
+      colNum = 0;
 
-      return 1;
+      continue;
     }
+  }
 
-    //line = "";
+  std::cout << std::endl;
 
-    ++rowNum;
+  verifier.CheckRest();
 
-    colNum = 0;
+  if(!verifier.Finish(std::cout))
+  {
+    delete [] row;
 
-    continue;
+    delete [] line;
+
+    return 1;
   }
 
   uint32_t outputH[8];
@@ -662,7 +918,7 @@ int main(int argc, char *argv[])
 
     s[0] = s[32] = 0;
     
-    sprintf(s, "%08llx", (unsigned long long)outputH[i]);
+    snprintf(s, sizeof(s), "%0*x", (int)((std::min(wordBits, 32u) + 3) / 4), outputH[i]);
 
     std::cout << s;
   }
@@ -9,7 +9,21 @@
 // a matrix from this data, without having to have two full
 // copies of the data in memory at once.
 // ---------------------------------------------------------
-// g++ -I./h -std=c++11 -o convert.out convert.cpp formproblem.cpp -lgmp -lgmpxx -O2
+// g++ -I./h -std=c++11 -o convert.out convert.cpp formproblem.cpp utilsha256.cpp -lgmp -lgmpxx -O2 -pthread
+//
+// Usage: ./convert.out [-threads <n>] [-dense | -compress] [-cache | -no-cache]
+//   -threads: number of parsing threads (default: one per core)
+//   -dense: write every column of every row (the original format) instead of
+//           only the nonzero ones
+//   -compress: write sparse rows block-compressed (see blockcodec.h)
+//   -cache: take a problem.dat made from the same input out of the artifact
+//           cache instead of converting, and put the one made in it (see
+//           artifactcache.h); also on if FORMAL_CRYPTO_CACHE is set
+//   -no-cache: don't use the artifact cache, even so
+//
+// The input is checked against its Merkle tree (problem256x2-68.bin.merkle, see
+// merkletree.h), if it has one, as it's converted: each equation before it's
+// used. problem.dat gets a tree of its own.
 // =========================================================
 
 #include <iostream>
@@ -17,271 +31,102 @@
 #include <string>
 #include <fstream>
 #include <map>
+#include <vector>
+#include <algorithm>
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-#include "formproblem.h"
+#include "artifactcache.h"
+#include "formconvert.h"
+#include "merkletree.h"
 
-namespace formal_crypto
+int main(int argc, char *argv[])
 {
-
-class CProblemConverter :
-	public CProblemAcceptor
-{
-	std::FILE *fo;
-	
-	uint64_t unityPosition;
-	
-	std::map<uint64_t, uint64_t> operandToColumn;
-	
-	uint64_t *row;
+	using namespace formal_crypto;
 	
-	bool firstEqn;
+	uint32_t numThreads = 0;
+	bool dense = false;
+	bool compress = false;
+	bool useCache = false;
+	bool noCache = false;
 	
-	uint64_t numUnknownInputs;
-
-public:
-	CProblemConverter(std::string outputFileName) :
-		fo(nullptr),
-		unityPosition(0),
-		row(nullptr),
-		firstEqn(true)
+	for(int i = 1; i < argc; ++i)
 	{
-		fo = fopen(outputFileName.c_str(), "wb");
-	}
-
-	virtual ~CProblemConverter()
-	{
-		delete [] row;
-	
-		if(fo != nullptr)
+		if(std::strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
 		{
-			std::fclose(fo);
+			numThreads = std::strtoul(argv[++i], nullptr, 0);
 		}
-	}
-	
-	virtual bool Initialize(std::vector<bool> &constantValues, std::vector<uint64_t> &targetOutputTemps, uint64_t numUnknownInputs, uint64_t numEquations, std::string magicSignature)
-	{
-		this->numUnknownInputs = numUnknownInputs;
-	
-		if(fo == nullptr)
+		else if(std::strcmp(argv[i], "-dense") == 0)
 		{
-			std::cout << "\nUnable to open output file for writing." << std::endl;
-			
-			return false;
+			dense = true;
 		}
-		
-		std::vector<uint64_t> header;
-		uint64_t x;
-		memcpy(&x, "problemd", 8);
-		
-		header.push_back(0);	// reserved for size (in bytes)
-		header.push_back(x);	// magic signature ("problemd")
-		
-		header.push_back(numEquations);
-		header.push_back(numUnknownInputs);
-		
-		// Columns in our matrix consist of:
-		// 1. (unknown) input variables  [count = 'numUnknownInputs']
-		// 2. temporary variables        [count = 'numEquations']
-		//                               note: some of these (exactly 'targetOutputTemps.size()']
-		//                               are 'output' temporaries. we want those variables to be 0.
-		//                               all other variables may be 0 or 1. the solution set is preserved
-		//                               by replacing any reference to an output temporary variable with 0
-		//                               (since output temporary variables have a target value of 0).
-		// 3. constants (excluding unity)  [count = 'constantValues.size()'].
-		//                                 note: the values of the constants in 'constantValues' can be changed.
-		// 4. unity                      [count = 1]
-		
-		// For the purpose of column layout when generating our output file, the above layout is used.
-		// This means there are temporary variables even for 'output temporaries'. Those variables must be 0, so
-		// the data file user may want to add some rows [equations] prior to reduction, to mandate the same.
-		
-		unityPosition = 0;
-		
-		operandToColumn.clear();
-		
-		for(uint64_t i = 0; i < numUnknownInputs; ++i)
+		else if(std::strcmp(argv[i], "-compress") == 0)
 		{
-			CGenerationOperand oper;
-			oper.type = 'x';
-			oper.pos = i;
-			operandToColumn[oper.GetFullValue()] = unityPosition++;
+			compress = true;
 		}
-		
-		for(uint64_t i = 0; i < numEquations; ++i)
+		else if(std::strcmp(argv[i], "-cache") == 0)
 		{
-			CGenerationOperand oper;
-			oper.type = 't';
-			oper.pos = i;
-			operandToColumn[oper.GetFullValue()] = unityPosition++;
+			useCache = true;
 		}
-		
-		for(uint64_t i = 0; i < constantValues.size(); ++i)
+		else if(std::strcmp(argv[i], "-no-cache") == 0)
 		{
-			if(i == 0)  continue;		// skip unity
-		
-			CGenerationOperand oper;
-			oper.type = 'c';
-			oper.pos = i;
-			operandToColumn[oper.GetFullValue()] = unityPosition++;
+			noCache = true;
 		}
-		
-		CGenerationOperand unityOper;
-		unityOper.type = '1';
-		unityOper.pos = 0;
-		operandToColumn[unityOper.GetFullValue()] = unityPosition;
-		
-		header.push_back(0);	// reserved for future expansion
-		header.push_back(0);
-		header.push_back(0);
-		header.push_back(0);
-
-		header.push_back(unityPosition + 1);	// this is the number of columns a matrix representation would need
-		
-		header.push_back(targetOutputTemps.size());
-		for(uint64_t i = 0; i < targetOutputTemps.size(); ++i)
+		else
 		{
-			header.push_back(targetOutputTemps[i]);
-		}
-
-		header.push_back(constantValues.size());
-		for(uint64_t i = 0; i < constantValues.size(); ++i)
-		{
-			header.push_back(constantValues[i]);
-		}
-		
-		header[0] = sizeof(uint64_t) * header.size();	// update size (in bytes)
-		
-		for(uint64_t i = 0; i < header.size(); ++i)
-		{
-			x = header[i];
-			
-			std::fwrite(&x, sizeof(uint64_t), 1, fo);
+			std::cout << "Usage: " << argv[0] << " [-threads <n>] [-dense | -compress] [-cache | -no-cache]" << std::endl;
+			return 1;
 		}
-		
-		row = new uint64_t [2 + unityPosition + 1];	// we're preceded by the size in bytes of this row, then the equation number; finally comes the column data
-		memset(row, 0, sizeof(uint64_t) * (2 + unityPosition + 1));
-		
-		return true;
 	}
 	
-	virtual bool AcceptNextEquation(const CGenerationEquation &equation, int64_t position)
+	if(true)
 	{
-		memset(row, 0, sizeof(uint64_t) * (2 + unityPosition + 1));
-		
-		row[0] = (2 + unityPosition + 1) * sizeof(uint64_t);
-		
-		row[1] = position;
+		std::string location = "./";
+		std::cout << "This program looks for its input data files here: " << location << std::endl;
+
+		std::string fn_problem = "problem256x2-68.bin";
+		//std::string fn_solution = "solution256x2-68.bin";
 		
-		row[2 + numUnknownInputs + position] = (1uLL << 32);	// this is the operand being defined
+		std::cout << "\nWe will convert " << fn_problem << " at the above location to 'problem.dat'\n";
+		std::cout << "in the current directory.\n" << std::endl;
 		
-		if(equation.divisorShift != 1)
+		if(dense == true && compress == true)
 		{
-			std::cout << "\nExpected input to be modulo 4 with fractional coefficients." << std::endl;
+			std::cout << "-dense and -compress can't be used together." << std::endl;
 			
-			return false;
+			return 1;
 		}
 		
-		for(std::list<std::pair<CGenerationOperand, mpq_class> >::const_iterator i = equation.operands.begin();
-			i != equation.operands.end();
-			++i
-		)
-		{
-			mpq_class coeff = i->second;
-			
-			const CGenerationOperand &oper = i->first;
-			
-			uint64_t positionT = oper.GetFullValue();
-			
-			if(operandToColumn.find(positionT) == operandToColumn.end())
-			{
-				std::cout << "\nUnable to find an operand (?)" << std::endl;
-				
-				return false;
-			}
-			
-			uint64_t position = operandToColumn[positionT];
-			
-			coeff *= mpz_class(2 * 1024) * mpz_class(1024 * 1024);
-			
-			if(coeff.get_den() != 1)
-			{
-				std::cout << "\nExpected input coefficients to have a 33-bit base." << std::endl;
-				
-				return false;
-			}
-			
-			mpz_class temp = coeff.get_num();
-			
-			temp = temp % (mpz_class(1) << 33);
-			if(temp < 0)
-				temp += (mpz_class(1) << 33);
-			
-			// first, let's get bit 0
-			uint64_t value = temp.get_ui() & 1;
-			
-			temp = (temp - value) / 2;
-			
-			// then lets get bits 1..32 inclusive
-			value += 2uLL * temp.get_ui();
-			
-			row[2 + position] = value;
-		}
+		// The thread count doesn't change what's written, so it isn't part of the key.
+		CArtifactCache cache(useCache);
+		const std::string cacheDescription = std::string("convert") + (dense ? " -dense" : "") + (compress ? " -compress" : "");
+		const std::vector<std::string> cacheNames(1, "problem.dat");
 		
-		if(std::fwrite(row, row[0], 1, fo) != 1)
-		{
-			std::cout << "\nError writing to output file." << std::endl;
+		cache.enabled = cache.enabled && (noCache == false);
 		
-			return false;
-		}
+		const std::string cacheKey = cache.MakeKey(cacheDescription, std::vector<std::string>(1, location + fn_problem));
 		
-		if(firstEqn == true)
+		if(cache.Fetch(cacheKey, cacheNames, std::cout) == true)
 		{
-			std::cout << std::endl;
-			
-			firstEqn = false;
+			return 0;
 		}
 		
-		std::cout << "\r" << position << "             " << std::flush;
-	
-		return true;
-	}
-	
-	virtual bool Finish()
-	{
-		if(fo != nullptr)
+		CMerkleVerifier verifier;
+		verifier.Start(location + fn_problem);
+		
+		CProblemConverter converter("problem.dat", dense, compress);
+		CProblemReader reader;
+		bool ok = reader.ReadProblem(std::string(location + fn_problem).c_str(), converter, numThreads, &verifier);
+		
+		// A segment that doesn't match stops the reading, so that's reported too.
+		if(ok == true || verifier.Failed() == true)
 		{
-			std::fclose(fo);
-			
-			fo = nullptr;
+			ok = (verifier.Finish(std::cout) == true) && ok;
 		}
-		std::cout << "\nDone writing file." << std::endl;
-
-		return true;
-	}
-};
-
-}	// namespace formal_crypto
-
-int main()
-{
-	using namespace formal_crypto;
-	
-	if(true)
-	{
-		std::string location = "./";
-		std::cout << "This program looks for its input data files here: " << location << std::endl;
-
-		std::string fn_problem = "problem256x2-68.bin";
-		//std::string fn_solution = "solution256x2-68.bin";
-		
-		std::cout << "\nWe will convert " << fn_problem << " at the above location to 'problem.dat'\n";
-		std::cout << "in the current directory.\n" << std::endl;
 		
-		CProblemConverter converter("problem.dat");
-		CProblemReader reader;
-		if(reader.ReadProblem(std::string(location + fn_problem).c_str(), converter) == false)
+		if(ok == false)
 		{
 			std::cout << "\nGiving up." << std::endl;
 			
@@ -289,6 +134,8 @@ int main()
 		}
 		
 		std::cout << "Conversion complete." << std::endl;
+		
+		cache.Store(cacheKey, cacheDescription, cacheNames, std::cout);
 
 		return 0;
 	}
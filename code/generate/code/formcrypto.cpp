@@ -5,210 +5,15 @@
 
 #include "formcrypto.h"
 
+#include <chrono>
 #include <cstdio>
 
 namespace formal_crypto
 {
 
-#include "ks0.h"
-#include "ks1.h"
-#include "hs0.h"
-#include "hs1.h"
-
-static const uint32_t sha256_initial_h[8] =
-{
-	0x6a09e667,
-	0xbb67ae85,
-	0x3c6ef372,
-	0xa54ff53a,
-	0x510e527f,
-	0x9b05688c,
-	0x1f83d9ab,
-	0x5be0cd19
-};
-
-static const uint32_t sha256_table_k[64] = {
-    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-};
-
-uint32_t CUtilSha256::GetInitialH(uint32_t n)	// 0 <= n < 8
-{
-	return sha256_initial_h[n];
-}
-
-uint32_t CUtilSha256::GetEntryK(uint32_t n)		// 0 <= n < 64
-{
-	return sha256_table_k[n];
-}
-
-// This exploits the fact that e.g. ks0(1 ^ 2 ^ 8) = ks0(1) ^ ks0(2) ^ ks0(8)
-// together with the fact that ks0(0) = 0.
-inline uint32_t Comp32Lookup(uint32_t table[32], uint32_t value)
-{
-	uint32_t result = 0;
-	
-	for(uint32_t i = 0; i < 32; ++i, value >>= 1)
-	{
-		if((value & 1u) != 0)
-		{
-			result ^= table[i];
-		}
-	}
-	
-	return result;
-}
-
-const uint32_t *CUtilSha256::GetTableHs0()
-{
-	return table_hs0;
-}
-
-const uint32_t *CUtilSha256::GetTableHs1()
-{
-	return table_hs1;
-}
-
-const uint32_t *CUtilSha256::GetTableKs0()
-{
-	return table_ks0;
-}
-
-const uint32_t *CUtilSha256::GetTableKs1()
-{
-	return table_ks1;
-}
-
-uint32_t CUtilSha256::Comp32Hs0(uint32_t x)
-{
-	return Comp32Lookup(table_hs0, x);
-}
-
-uint32_t CUtilSha256::Comp32Hs1(uint32_t x)
-{
-	return Comp32Lookup(table_hs1, x);
-}
-
-uint32_t CUtilSha256::Comp32Ks0(uint32_t x)
-{
-	return Comp32Lookup(table_ks0, x);
-}
-
-uint32_t CUtilSha256::Comp32Ks1(uint32_t x)
-{
-	return Comp32Lookup(table_ks1, x);
-}
-
-// numRounds shall be a multiple of 8, with 64 being the full standard.
-void CUtilSha256::CompSha256(uint32_t h_entry[8], const uint32_t w_entry[16], uint32_t numRounds /*= 64*/)
-{
-	enum { A, B, C, D, E, F, G, H };
-
-	uint32_t w[64];
-
-	uint32_t h[8];
-
-	for(uint32_t i = 0; i < 16; ++i)
-	{
-		w[i] = w_entry[i];
-	}
-
-	for(uint32_t i = 16; i < 64; ++i)
-	{
-		w[i] = w[i - 16] + Comp32Ks0(w[(i + 1) - 16]) + w[(i + 9) - 16] + Comp32Ks1(w[(i + 14) - 16]);
-	}
-
-	for(uint32_t i = 0; i < 8; ++i)
-	{
-		h[i] = h_entry[i];
-	}
-
-	for(uint32_t i = 0; i < numRounds; ++i)
-	{
-#undef VAR
-#define VAR(x) h[((x) - i) & 7]
-		VAR(H) += Comp32Hs1(VAR(E)) + Comp32Ch(VAR(E), VAR(F), VAR(G)) + sha256_table_k[i] + w[i];
-
-		VAR(D) += VAR(H);
-
-		VAR(H) += Comp32Hs0(VAR(A)) + Comp32Maj(VAR(A), VAR(B), VAR(C));
-#undef VAR
-	}
-
-	for(uint32_t i = 0; i < 8; ++i)
-	{
-		h_entry[i] += h[i];
-	}
-}
-
-void CUtilSha256::WriteH(std::ostream &os, uint32_t h[8], bool cStyle /*= false*/)
-{
-	for(uint32_t i = 0; i < 8; ++i)
-	{
-		char s[32 + 1];
-
-		std::sprintf(s, "%08X", (unsigned int)(h[i]));
-
-		if(cStyle == true)
-		{
-			os << "0x";
-		}
-		os << s;
-		
-		if(i != 7)
-		{
-			if(cStyle == true)
-				os << ",";
-			else
-				os << " ";
-		}
-	}        
-	os << std::endl;
-}
-
-void CUtilSha256::SelfTest(std::ostream &os, uint32_t numRounds /*= 64*/)
-{
-        uint32_t h[8];
-        uint32_t w[16];
-        
-        for(uint32_t i = 0; i < 8; ++i)
-        {
-        	h[i] = sha256_initial_h[i];
-        }
-        
-        for(uint32_t i = 0; i < 16; ++i)
-        {
-        	w[i] = 0;
-        }
-        
-        w[0] = ('t' << 0) + ('s' << 8) + ('e' << 16) + ('t' << 24);	// message to digest ("test")
-        w[1] = 0x80000000u;						// marker bit
-        w[15] = (4 * 8);						// message length, low 32 bits
-        
-        CompSha256(h, w);
-
-	os << "4092FEF0 263500F6 48BD3A9B E8A5BEE6 F662B089 96D7DCE6 30390A6E 51EFD3EA [8]\n";
-	os << "F6FEA097 241DA176 018401FD 7029A783 74866420 4242CAF1 86B6906D 7E3EF42F [16]\n";
-	os << "C5D60ADA 8ADCF131 1DA993BC A1460DBC 493C24FA 11145185 9F3F5F47 3CA160F8 [24]\n";
-	os << "5C1DE77E E5C56410 F9937A39 BF5F5F4C D6E5F802 1A8FB422 72401439 A94AB795 [32]\n";
-	os << "85454A4A BB363DB5 F69AEA15 28588B34 3B1B5DCF D330022C 63FDD7F5 2535D2F4 [40]\n";
-	os << "FBD318B4 C80A34D1 289D43E4 2B400C18 8BC0FE27 F292BC76 6702F299 A7D043E8 [48]\n";
-	os << "3407105C 0B72A53B F02BCE70 E9603A20 41541D57 81AEFD0D 3355EFF2 35F375C9 [56]\n";
-	os << "9F86D081 884C7D65 9A2FEAA0 C55AD015 A3BF4F1B 2B0B822C D15D6C15 B0F00A08 [64]\n" << std::endl;
-	
-	WriteH(os, h);
-}
-
-// ================================================================================
-
 CCryptosystem::CCryptosystem(uint32_t wordSizeBitsT /*= 32*/) :
-	CCryptosystemBase(wordSizeBitsT)
+	CCryptosystemBase(wordSizeBitsT),
+	observer(nullptr)
 {
 	// Let's create our "unity" constant operand.
 	this->unity = std::make_shared<COperand>(*this, E_OPERAND_CONSTANT, this->constantOperands.size());
@@ -519,6 +324,11 @@ bool CCryptosystem::Flatten(std::ostream &os)
 
 	this->UnvisitAll();
 	
+	if(this->observer != nullptr)
+	{
+		this->observer->OnPhase("flatten");
+	}
+	
 	return true;
 }
 
@@ -831,35 +641,35 @@ bool CCryptosystem::WriteEquationsBinary(std::FILE *fo)
 }
 
 // Returns true if successful, false in case of failure.
-bool CCryptosystem::FinalizeEquationsBinary(FILE *fo, std::ostream &os)
+bool CCryptosystem::FinalizeEquationsBinary(FILE *fo, std::ostream &os, std::vector<uint64_t> *equationOffsets /*= nullptr*/)
+{
+	CBinaryEquationSink sink(fo, equationOffsets);
+	
+	return this->FinalizeEquations(sink, os);
+}
+
+// Returns true if successful, false in case of failure.
+bool CCryptosystem::FinalizeEquations(CEquationSink &sink, std::ostream &os)
 {
 	os << "Finalizing equations..." << std::endl;
 
-	// Write 'targets ' vector, which contains the temporary node numbers for each of our 'user outputs', in order.
-	// These are the output H bits, with 0s substituted for the ones we don't care about.
-	uint64_t x = 0;
-	x = 8 + 8 + this->autoTempOperandOutputPositions.size() * 8;
-	fwrite(&x, sizeof(uint64_t), 1, fo);
-	memcpy(&x, "targets ", 8);
-	fwrite(&x, sizeof(uint64_t), 1, fo);
-	for(uint64_t i = 0; i < this->autoTempOperandOutputPositions.size(); ++i)
+	// The 'targets ' are the temporary node numbers for each of our 'user outputs', in order. These are the output H
+	// bits, with 0s substituted for the ones we don't care about.
+	if(sink.BeginEquations(this->autoTempOperandOutputPositions, this->autoTempOperands.size()) == false)
 	{
-		x = this->autoTempOperandOutputPositions[i];
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		os << "\nFailure with finalize: unable to begin writing equations!" << std::endl;
+		
+		return false;
 	}
 	
-	// Write 0 here. This would normally be the number of equations, but 0 indicates the following field is that number and
-	// our equations are to be in reverse!
-	x = 0;
-	fwrite(&x, sizeof(uint64_t), 1, fo);
+	std::vector<CEquationSinkTerm> terms;
 	
-	// Write the number of equations. This is also the number of temporaries. Each of these is numbered, starting with 0.
-	// If a position matches
-	x = this->autoTempOperands.size();
-	fwrite(&x, sizeof(uint64_t), 1, fo);
+	uint32_t nextDecile = 1;
 	
 	for(int64_t n = this->autoTempOperands.size() - 1; n >= 0; --n)
 	{
+		const std::chrono::steady_clock::time_point rowStart = std::chrono::steady_clock::now();
+		
 		os << "\r" << (this->autoTempOperands.size() - 1 - n) << "/" << (this->autoTempOperands.size() - 1) << std::flush;
 	
 		if(this->autoTempOperands[n] == nullptr)
@@ -891,7 +701,7 @@ bool CCryptosystem::FinalizeEquationsBinary(FILE *fo, std::ostream &os)
 			
 			if(iter->second.second == 0)
 			{
-				this->autoTempOperands[n]->sourceOp->flattenedVersion->childOperands.erase(iter);
+				this->autoTempOperands[n]->sourceOp->flattenedVersion->EraseOperand(iter);
 				iter = next;
 				continue;
 			}
@@ -922,7 +732,7 @@ bool CCryptosystem::FinalizeEquationsBinary(FILE *fo, std::ostream &os)
 				
 				removedTerms[iter->second.first->physicalPositionIndex] = std::pair<ROperand, mpz_class>(iter->second.first, iter->second.second.get_num());
 				
-				this->autoTempOperands[n]->sourceOp->flattenedVersion->childOperands.erase(iter);
+				this->autoTempOperands[n]->sourceOp->flattenedVersion->EraseOperand(iter);
 				iter = next;
 				continue;
 			}
@@ -971,73 +781,221 @@ bool CCryptosystem::FinalizeEquationsBinary(FILE *fo, std::ostream &os)
 			}
 		}
 		
-		uint64_t pos = n;
-		x = n;
-		fwrite(&x, sizeof(uint64_t), 1, fo);	// write equation position number, to help sure we stay on track...
+		const RFlattenedOperator &equation = this->autoTempOperands[n]->sourceOp->flattenedVersion;
 		
-		x = this->autoTempOperands[pos]->sourceOp->flattenedVersion->divisorShift;
-		fwrite(&x, sizeof(uint64_t), 1, fo);	// write out our divisor shift (will always be 0 in files we generate)
-							// the modulo is 2 << (this value) and the temporary value is to be 0
-							// or 1 << (this value) depending on its inputs [i.e. for equations
-							// we generate, 0 or 1 precisely and we're modulo 2].
+		terms.clear();
 		
-		x = this->autoTempOperands[pos]->sourceOp->flattenedVersion->childOperands.size();
-		fwrite(&x, sizeof(uint64_t), 1, fo);	// write number of child operands (!)
-		
-		for(auto iter = this->autoTempOperands[pos]->sourceOp->flattenedVersion->childOperands.begin();
-			iter != this->autoTempOperands[pos]->sourceOp->flattenedVersion->childOperands.end();
-			++iter
-		)
+		for(auto iter = equation->childOperands.begin(); iter != equation->childOperands.end(); ++iter)
 		{
-			std::string coeff = iter->second.second.get_str();
-			fwrite(coeff.c_str(), coeff.size(), 1, fo);
-			char c = '\0';
-			fwrite(&c, 1, 1, fo);
+			CEquationSinkTerm term;
+			term.pos = 0;
+			term.coefficient = &iter->second.second;
 			
 			if(iter->second.first->uid == this->GetUnity()->uid)
 			{
-				c = '1';
-				fwrite(&c, 1, 1, fo);
+				term.type = '1';
 			}
 			else if(iter->second.first->operandType == E_OPERAND_INPUT)
 			{
-				c = 'x';	// 'unknown input' variable
-				fwrite(&c, 1, 1, fo);
-				x = iter->second.first->bitIndexLabel;
-				fwrite(&x, sizeof(uint64_t), 1, fo);
+				term.type = 'x';	// 'unknown input' variable
+				term.pos = iter->second.first->bitIndexLabel;
 			}
 			else if(iter->second.first->operandType == E_OPERAND_CONSTANT)
 			{
-				c = 'c';	// 'constant' variable
-				fwrite(&c, 1, 1, fo);
-				x = iter->second.first->bitIndexLabel;
-				fwrite(&x, sizeof(uint64_t), 1, fo);
+				term.type = 'c';	// 'constant' variable
+				term.pos = iter->second.first->bitIndexLabel;
 			}
 			else if(iter->second.first->physicalPositionIndex != -1LL)
 			{
-				c = 't';	// 'temporary' variable
-				fwrite(&c, 1, 1, fo);
-				x = iter->second.first->physicalPositionIndex;
-				fwrite(&x, sizeof(uint64_t), 1, fo);
+				term.type = 't';	// 'temporary' variable
+				term.pos = iter->second.first->physicalPositionIndex;
 			}
 			else
 			{
+				os << "\nFailure with finalize: unknown physical position index for an operand!" << std::endl;
+				
 				return false;
 			}
+			
+			terms.push_back(term);
+		}
+		
+		if(sink.AcceptEquation(n, equation->divisorShift, terms.data(), terms.size()) == false)
+		{
+			os << "\nFailure with finalize: unable to write equation " << n << "!" << std::endl;
+			
+			return false;
 		}
 
 		// reclaim memory (we won't be needing this equation anymore).
+		const uint64_t nonzeros = this->autoTempOperands[n]->sourceOp->flattenedVersion->childOperands.size();
 		this->autoTempOperands[n]->sourceOp->flattenedVersion = nullptr;
+		
+		if(this->observer != nullptr)
+		{
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - rowStart).count();
+			
+			this->observer->OnFinalizeRow(*this->autoTempOperands[n], nonzeros, seconds);
+		}
+		
+		// let the observer know each time another 10% of the equations have been finalized.
+		uint64_t done = this->autoTempOperands.size() - n;
+		while(this->observer != nullptr && nextDecile <= 10 && done * 10 >= nextDecile * this->autoTempOperands.size())
+		{
+			this->observer->OnPhase("finalize " + std::to_string(nextDecile * 10) + "%");
+			++nextDecile;
+		}
 	}
 
+	if(sink.EndEquations() == false)
+	{
+		os << "\nFailure with finalize: unable to finish writing equations!" << std::endl;
+		
+		return false;
+	}
+	
+	os << "\nDone finalizing.\n" << std::endl;
+	return true;
+}
+
+// ================================================================================
+
+CBinaryEquationSink::CBinaryEquationSink(std::FILE *fo, std::vector<uint64_t> *equationOffsets /*= nullptr*/) :
+	fo(fo),
+	equationOffsets(equationOffsets)
+{
+}
+
+// Returns true if successful, false in case of failure.
+bool CBinaryEquationSink::BeginEquations(const std::vector<int64_t> &targets, uint64_t numEquations)
+{
+	// Write 'targets ' vector.
+	uint64_t x = 0;
+	x = 8 + 8 + targets.size() * 8;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	memcpy(&x, "targets ", 8);
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	for(uint64_t i = 0; i < targets.size(); ++i)
+	{
+		x = targets[i];
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+	}
+	
+	// Write 0 here. This would normally be the number of equations, but 0 indicates the following field is that number and
+	// our equations are to be in reverse!
+	x = 0;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	// Write the number of equations. This is also the number of temporaries. Each of these is numbered, starting with 0.
+	x = numEquations;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	if(equationOffsets != nullptr)
+	{
+		equationOffsets->clear();
+	}
+	
+	return ferror(fo) == 0;
+}
+
+// Returns true if successful, false in case of failure.
+bool CBinaryEquationSink::AcceptEquation(int64_t position, uint64_t divisorShift, const CEquationSinkTerm *terms, uint64_t numTerms)
+{
+	if(equationOffsets != nullptr)
+	{
+		equationOffsets->push_back(ftell(fo));
+	}
+	
+	uint64_t x = position;
+	fwrite(&x, sizeof(uint64_t), 1, fo);	// write equation position number, to help sure we stay on track...
+	
+	x = divisorShift;
+	fwrite(&x, sizeof(uint64_t), 1, fo);	// write out our divisor shift (will always be 0 in files we generate)
+						// the modulo is 2 << (this value) and the temporary value is to be 0
+						// or 1 << (this value) depending on its inputs [i.e. for equations
+						// we generate, 0 or 1 precisely and we're modulo 2].
+	
+	x = numTerms;
+	fwrite(&x, sizeof(uint64_t), 1, fo);	// write number of child operands (!)
+	
+	for(uint64_t i = 0; i < numTerms; ++i)
+	{
+		std::string coeff = terms[i].coefficient->get_str();
+		fwrite(coeff.c_str(), coeff.size(), 1, fo);
+		char c = '\0';
+		fwrite(&c, 1, 1, fo);
+		
+		c = terms[i].type;	// '1' (unity), 'x' (unknown input), 'c' (constant) or 't' (temporary)
+		fwrite(&c, 1, 1, fo);
+		
+		if(c != '1')
+		{
+			x = terms[i].pos;
+			fwrite(&x, sizeof(uint64_t), 1, fo);
+		}
+	}
+	
+	return ferror(fo) == 0;
+}
+
+// Returns true if successful, false in case of failure.
+bool CBinaryEquationSink::EndEquations()
+{
 	// Write end marker, for synchronization purposes (so we can make sure we read everything properly).
+	uint64_t x = 0;
 	memcpy(&x, "endend  ", 8);
 	fwrite(&x, sizeof(uint64_t), 1, fo);
 	
-	os << "\nDone finalizing.\n" << std::endl;
+	return ferror(fo) == 0;
+}
+
+// ================================================================================
+
+// Returns true if successful, false in case of failure.
+bool CEquationTee::BeginEquations(const std::vector<int64_t> &targets, uint64_t numEquations)
+{
+	for(uint64_t i = 0; i < this->sinks.size(); ++i)
+	{
+		if(this->sinks[i]->BeginEquations(targets, numEquations) == false)
+		{
+			return false;
+		}
+	}
+	
 	return true;
 }
 
+// Returns true if successful, false in case of failure.
+bool CEquationTee::AcceptEquation(int64_t position, uint64_t divisorShift, const CEquationSinkTerm *terms, uint64_t numTerms)
+{
+	for(uint64_t i = 0; i < this->sinks.size(); ++i)
+	{
+		if(this->sinks[i]->AcceptEquation(position, divisorShift, terms, numTerms) == false)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// Returns true if successful, false in case of failure.
+bool CEquationTee::EndEquations()
+{
+	for(uint64_t i = 0; i < this->sinks.size(); ++i)
+	{
+		if(this->sinks[i]->EndEquations() == false)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// ================================================================================
+
+
 // Returns true if successful, false in case of failure.
 bool CCryptosystem::WriteEquationsText(std::ostream &os, bool showUids /*= false*/)
 {
@@ -0,0 +1,544 @@
+// formpipeline.cpp - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// The fused generate -> convert -> check pipeline (see formpipeline.h).
+// ================================================================================
+
+#include "formpipeline.h"
+#include "formconvert.h"
+#include "formcheck.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace formal_crypto
+{
+// ================================================================================
+
+static double DoGetSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A queue of at most 'capacity' items between two threads. Push() waits while it's full and Pop() while it's empty;
+// once Close() has been called, Pop() returns false when it's empty. Abort() makes both return false from then on,
+// so when a stage fails the others don't wait for it forever. The time spent waiting on either side is recorded.
+template<class T>
+class CBoundedQueue
+{
+public:
+	double pushWaitSeconds;
+	double popWaitSeconds;
+
+	CBoundedQueue(uint64_t capacity) :
+		pushWaitSeconds(0.0),
+		popWaitSeconds(0.0),
+		capacity(capacity),
+		closed(false),
+		aborted(false)
+	{
+	}
+
+	// Returns true on success, false if the queue was aborted.
+	bool Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		const double t0 = DoGetSeconds();
+
+		this->notFull.wait(lock, [this]() { return this->items.size() < this->capacity || this->aborted == true; });
+		this->pushWaitSeconds += DoGetSeconds() - t0;
+
+		if(this->aborted == true)
+		{
+			return false;
+		}
+
+		this->items.push_back(std::move(item));
+		this->notEmpty.notify_one();
+
+		return true;
+	}
+
+	// Returns true if an item was popped, false at the end of the queue (or if it was aborted; see IsAborted()).
+	bool Pop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		const double t0 = DoGetSeconds();
+
+		this->notEmpty.wait(lock, [this]() { return this->items.empty() == false || this->closed == true || this->aborted == true; });
+		this->popWaitSeconds += DoGetSeconds() - t0;
+
+		if(this->aborted == true || this->items.empty() == true)
+		{
+			return false;
+		}
+
+		item = std::move(this->items.front());
+		this->items.pop_front();
+		this->notFull.notify_one();
+
+		return true;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		this->closed = true;
+		this->notEmpty.notify_all();
+	}
+
+	void Abort()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		this->aborted = true;
+		this->items.clear();
+		this->notEmpty.notify_all();
+		this->notFull.notify_all();
+	}
+
+	bool IsAborted()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		return this->aborted;
+	}
+
+private:
+	uint64_t capacity;
+	bool closed;
+	bool aborted;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+};
+
+// A batch of equations on their way to convert, as CProblemReader would have handed them over.
+struct CViewBatch
+{
+	std::vector<CEquationTerm> terms;
+	std::vector<CEquationView> views;
+	std::vector<uint64_t> firstTerms;
+	std::deque<std::string> texts;		// coefficients too large to decode (see CEquationTerm::text); a deque doesn't move them
+
+	// This points the views at their terms; call it once the batch is complete ('terms' may have moved until then).
+	void Publish()
+	{
+		for(uint64_t n = 0; n < this->views.size(); ++n)
+		{
+			this->views[n].terms = this->terms.data() + this->firstTerms[n];
+		}
+	}
+};
+
+typedef std::unique_ptr<CViewBatch> RViewBatch;
+typedef std::unique_ptr<CBlockRows> RRowBatch;
+
+// This adds a term to the last equation of 'batch', doing to its coefficient what CProblemReader does to one read as
+// text (see DoDecodeCoefficient() in formproblem.cpp): it's doubled, since we're modulo 4, and kept as numerator /
+// 2^shift whenever that fits. Terms with a 0 coefficient are left out, as they are by the reader.
+static void DoAddTerm(const CEquationSinkTerm &src, CViewBatch &batch)
+{
+	const mpq_class &coeff = *src.coefficient;
+
+	if(sgn(coeff) == 0)
+	{
+		return;
+	}
+
+	CEquationTerm term;
+	term.operand.type = src.type;
+	term.operand.pos = src.pos;
+	term.numerator = 0;
+	term.shift = 0;
+	term.text = nullptr;
+
+	mpz_srcptr num = coeff.get_num_mpz_t();
+	mpz_srcptr den = coeff.get_den_mpz_t();
+
+	if(mpz_popcount(den) == 1 && mpz_sizeinbase(num, 2) < 62)
+	{
+		const uint32_t shift = mpz_scan1(den, 0);
+
+		// we're mod 4 now
+		term.numerator = (shift > 0) ? mpz_get_si(num) : 2 * mpz_get_si(num);
+		term.shift = (shift > 0) ? shift - 1 : 0;
+	}
+	else
+	{
+		batch.texts.push_back(coeff.get_str());
+		term.text = batch.texts.back().c_str();
+	}
+
+	batch.terms.push_back(term);
+	++batch.views.back().numTerms;
+}
+
+// This collects the rows convert hands on (see CProblemConverter::rowAcceptor) into batches for the check stage.
+class CRowBatcher :
+	public CBlockRowAcceptor
+{
+public:
+	enum { ENTRIES_PER_BATCH = 1 << 16 };
+
+	CBoundedQueue<RRowBatch> *queue;
+
+	CRowBatcher() :
+		queue(nullptr)
+	{
+	}
+
+	virtual bool AcceptBlockRow(uint64_t rowNumber, const uint64_t *pairs, uint64_t count)
+	{
+		if(this->batch == nullptr)
+		{
+			this->batch.reset(new CBlockRows());
+		}
+
+		this->batch->AddRow(rowNumber, pairs, count);
+
+		return (this->batch->entries.size() < 2 * ENTRIES_PER_BATCH) ? true : this->Flush();
+	}
+
+	// Returns true on success, false if the check stage has given up.
+	bool Flush()
+	{
+		return (this->batch == nullptr) ? true : this->queue->Push(std::move(this->batch));
+	}
+
+private:
+	RRowBatch batch;
+};
+
+// ================================================================================
+
+class CFusedPipelineStages
+{
+public:
+	enum { EQUATIONS_PER_BATCH = 64 };
+	enum { QUEUE_BATCHES = 16 };
+
+	std::vector<bool> constantValues;
+	uint64_t numUnknownInputs;
+	uint64_t numEquations;
+	std::string solutionFileName;
+	bool compressModel;
+
+	CBoundedQueue<RViewBatch> equations;
+	CBoundedQueue<RRowBatch> rows;
+	std::unique_ptr<CProblemConverter> converter;
+	CRowBatcher batcher;
+	RViewBatch batch;		// being filled by the generating thread
+
+	std::thread convertThread;
+	std::thread checkThread;
+	bool convertOk;			// these are written by their stage's thread and read after it's joined
+	bool checkOk;
+
+	double startSeconds;
+	double endSeconds;
+	double checkSeconds;		// the time taken by the check itself, i.e. once all rows were there
+	uint64_t rawBytes;		// the rows the check stage kept, as a sparse problem.dat would store them
+	uint64_t keptBytes;		// ... and block compressed
+
+	CFusedPipelineStages() :
+		numUnknownInputs(0),
+		numEquations(0),
+		compressModel(false),
+		equations(QUEUE_BATCHES),
+		rows(QUEUE_BATCHES),
+		convertOk(false),
+		checkOk(false),
+		startSeconds(0.0),
+		endSeconds(0.0),
+		checkSeconds(0.0),
+		rawBytes(0),
+		keptBytes(0)
+	{
+	}
+
+	~CFusedPipelineStages()
+	{
+		this->equations.Abort();	// nothing happens if the stages are done already
+		this->rows.Abort();
+		this->Join();
+	}
+
+	void Join()
+	{
+		if(this->convertThread.joinable() == true)
+		{
+			this->convertThread.join();
+		}
+
+		if(this->checkThread.joinable() == true)
+		{
+			this->checkThread.join();
+		}
+	}
+
+	// This runs on the convert thread.
+	void RunConvert()
+	{
+		RViewBatch next;
+
+		this->convertOk = true;
+
+		while(this->convertOk == true && this->equations.Pop(next) == true)
+		{
+			this->convertOk = this->converter->AcceptEquations(next->views.data(), next->views.size());
+		}
+
+		if(this->convertOk == true && this->equations.IsAborted() == false && this->batcher.Flush() == true && this->converter->Finish() == true)
+		{
+			this->rows.Close();
+
+			return;
+		}
+
+		this->convertOk = false;
+		this->equations.Abort();
+		this->rows.Abort();
+	}
+
+	// This runs on the check thread.
+	void RunCheck()
+	{
+		this->checkOk = (this->DoCheck() == true);
+
+		if(this->checkOk == false)
+		{
+			this->equations.Abort();
+			this->rows.Abort();
+		}
+	}
+
+private:
+	// Returns true if the check passed, false otherwise.
+	bool DoCheck()
+	{
+		const uint64_t NO_ROW = -1uLL;
+
+		// Each batch is kept block compressed; 'rowAt' is the block holding each row and 'slotOf' its position there.
+		std::vector<std::vector<uint8_t> > blocks;
+		std::vector<uint64_t> blockRows;
+		std::vector<uint64_t> rowAt(this->numEquations, NO_ROW);
+		std::vector<uint32_t> slotOf(this->numEquations, 0);
+		RRowBatch next;
+
+		while(this->rows.Pop(next) == true)
+		{
+			for(uint64_t r = 0; r < next->GetNumRows(); ++r)
+			{
+				const uint64_t eqnNumber = next->rowNumbers[r];
+
+				if(eqnNumber >= this->numEquations || rowAt[eqnNumber] != NO_ROW)
+				{
+					std::cout << "\nInvalid row from convert: " << eqnNumber << std::endl;
+
+					return false;
+				}
+
+				rowAt[eqnNumber] = blocks.size();
+				slotOf[eqnNumber] = r;
+			}
+
+			blocks.push_back(std::vector<uint8_t>());
+			blockRows.push_back(next->GetNumRows());
+
+			if(CBlockCodec::Encode(*next, blocks.back()) == false)
+			{
+				return false;
+			}
+
+			this->rawBytes += sizeof(uint64_t) * (3 * next->GetNumRows() + next->entries.size());
+			this->keptBytes += blocks.back().size();
+		}
+
+		if(this->rows.IsAborted() == true)
+		{
+			return false;	// convert has given up
+		}
+
+		for(uint64_t y = 0; y < this->numEquations; ++y)
+		{
+			if(rowAt[y] == NO_ROW)
+			{
+				std::cout << "\nMissing row from convert: " << y << std::endl;
+
+				return false;
+			}
+		}
+
+		const double t0 = DoGetSeconds();
+
+		// From here on, this is check2 -stream (see StreamMatrix() in check2.cpp).
+		std::vector<uint64_t> header = this->converter->GetHeader();
+		const uint64_t numColumns = header[8]/* number of columns, incuding unity*/;
+
+		RMatrix matrix = std::make_shared<CMatrix>(0, numColumns);
+		CStreamingCheckRow checker(this->solutionFileName);
+		CBlockRows decoded;
+		uint64_t currentBlock = NO_ROW;
+
+		checker.compressModel = this->compressModel;
+
+		std::cout << "\nChecking " << this->numEquations << " row(s) kept in " << (this->keptBytes >> 10) << " KiB..." << std::endl;
+
+		checker.Begin(header);
+
+		DoDemandZeroOutputs(matrix, header, checker);
+
+		for(uint64_t y = 0; y < this->numEquations && checker.failed == false; ++y)
+		{
+			if(rowAt[y] != currentBlock)
+			{
+				currentBlock = rowAt[y];
+
+				const std::vector<uint8_t> &block = blocks[currentBlock];
+
+				if(CBlockCodec::Decode(block.data(), block.size(), blockRows[currentBlock], decoded) == false)
+				{
+					std::cout << "\nUnable to decode rows kept for the check." << std::endl;
+
+					return false;
+				}
+			}
+
+			const uint64_t first = decoded.rowStarts[slotOf[y]];
+
+			if(DoLoadSparseRow(matrix, numColumns, y, decoded.entries.data() + 2 * first, decoded.rowStarts[slotOf[y] + 1] - first, checker) == false)
+			{
+				return false;
+			}
+		}
+
+		checker.End(matrix);
+
+		this->checkSeconds = DoGetSeconds() - t0;
+
+		return checker.failed == false;
+	}
+};
+
+// ================================================================================
+
+CFusedPipeline::CFusedPipeline(const std::vector<bool> &constantValues, uint64_t numUnknownInputs) :
+	compressModel(false),
+	stages(new CFusedPipelineStages())
+{
+	this->stages->constantValues = constantValues;
+	this->stages->numUnknownInputs = numUnknownInputs;
+}
+
+CFusedPipeline::~CFusedPipeline()
+{
+}
+
+// Returns true if successful, false otherwise.
+bool CFusedPipeline::BeginEquations(const std::vector<int64_t> &targets, uint64_t numEquations)
+{
+	CFusedPipelineStages &s = *this->stages;
+	std::vector<uint64_t> targetOutputTemps(targets.begin(), targets.end());
+
+	s.startSeconds = DoGetSeconds();
+	s.numEquations = numEquations;
+	s.solutionFileName = this->solutionFileName;
+	s.compressModel = this->compressModel;
+
+	s.converter.reset(new CProblemConverter(this->problemDatFileName, false, false));
+	s.converter->rowAcceptor = &s.batcher;
+	s.converter->showProgress = false;
+	s.batcher.queue = &s.rows;
+
+	if(s.converter->Initialize(s.constantValues, targetOutputTemps, s.numUnknownInputs, numEquations, "sha256x2-64equ68") == false)
+	{
+		return false;
+	}
+
+	s.convertThread = std::thread([&s]() { s.RunConvert(); });
+	s.checkThread = std::thread([&s]() { s.RunCheck(); });
+
+	return true;
+}
+
+// Returns true if successful, false otherwise.
+bool CFusedPipeline::AcceptEquation(int64_t position, uint64_t divisorShift, const CEquationSinkTerm *terms, uint64_t numTerms)
+{
+	CFusedPipelineStages &s = *this->stages;
+
+	if(divisorShift != 0)
+	{
+		// we expect our equations to be all 'mod 2' (see DoReadEquation() in formproblem.cpp).
+		std::cout << "\nIncorrect divisorShift (expected 0)" << std::endl;
+
+		return false;
+	}
+
+	if(s.batch == nullptr)
+	{
+		s.batch.reset(new CViewBatch());
+	}
+
+	CEquationView view;
+	view.position = position;
+	view.divisorShift = 1;		// we're changing everything to mod 4
+	view.terms = nullptr;
+	view.numTerms = 0;
+
+	s.batch->views.push_back(view);
+	s.batch->firstTerms.push_back(s.batch->terms.size());
+
+	for(uint64_t k = 0; k < numTerms; ++k)
+	{
+		DoAddTerm(terms[k], *s.batch);
+	}
+
+	if(s.batch->views.size() < CFusedPipelineStages::EQUATIONS_PER_BATCH)
+	{
+		return true;
+	}
+
+	s.batch->Publish();
+
+	return s.equations.Push(std::move(s.batch));
+}
+
+// Returns true if successful, false otherwise.
+bool CFusedPipeline::EndEquations()
+{
+	CFusedPipelineStages &s = *this->stages;
+	bool ok = true;
+
+	if(s.batch != nullptr)
+	{
+		s.batch->Publish();
+
+		ok = s.equations.Push(std::move(s.batch));
+	}
+
+	s.equations.Close();
+	s.Join();
+
+	s.endSeconds = DoGetSeconds();
+
+	return ok == true && s.convertOk == true && s.checkOk == true;
+}
+
+void CFusedPipeline::Report(std::ostream &os) const
+{
+	const CFusedPipelineStages &s = *this->stages;
+
+	os << "Fused pipeline: " << s.numEquations << " equation(s) in " << (s.endSeconds - s.startSeconds) << "s. Generating waited " <<
+		s.equations.pushWaitSeconds << "s for convert, which waited " << s.equations.popWaitSeconds << "s for equations and " <<
+		s.rows.pushWaitSeconds << "s for check." << std::endl;
+	os << "The check kept " << (s.rawBytes >> 10) << " KiB of rows in " << (s.keptBytes >> 10) << " KiB and took " <<
+		s.checkSeconds << "s once the last one had arrived." << std::endl;
+}
+
+}	// namespace formal_crypto
@@ -2,59 +2,806 @@
 // ===========================================================================
 
 #include "formproblem.h"
+#include "merkletree.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace formal_crypto
 {
 
 // ========================================================================
 
+// This walks a problem file (memory mapped, or read into memory if mapping isn't possible) front to back. Every read
+// is bounds checked, so a truncated or corrupt file is reported as such instead of being read past its end.
+//
+// When mapped, only a window of the file is kept resident: each time the cursor moves past another WINDOW_BYTES, the
+// pages behind it are dropped (MADV_DONTNEED) and the next window is requested (MADV_WILLNEED). Since the file is
+// only ever read forward, the resident set stays at roughly two windows whatever the file size.
+//
+// View() returns a cursor over part of the same memory, i.e. for a worker thread; views don't own the memory and
+// don't give any advice. Pages read through views are dropped by calling Release() on the owner.
+class CProblemCursor
+{
+public:
+	enum { WINDOW_BYTES = 16 * 1024 * 1024 };
+
+	CProblemCursor() :
+		base(nullptr),
+		size(0),
+		offset(0),
+		mapped(false),
+		owner(false),
+		nextAdvise(0),
+		released(0)
+	{
+	}
+
+	~CProblemCursor()
+	{
+		this->Close();
+	}
+
+	// Returns true on success, false otherwise.
+	bool Open(const char *fn)
+	{
+		int fd = ::open(fn, O_RDONLY);
+		if(fd < 0)
+		{
+			return false;
+		}
+
+		struct stat st;
+		if(::fstat(fd, &st) != 0 || st.st_size < 8)
+		{
+			::close(fd);
+
+			return false;
+		}
+
+		this->size = st.st_size;
+
+		void *ptr = ::mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if(ptr != MAP_FAILED)
+		{
+			this->base = (const uint8_t *)(ptr);
+			this->mapped = true;
+
+			::madvise(ptr, this->size, MADV_SEQUENTIAL);
+		}
+		else
+		{
+			// e.g. a pipe or a file system without mmap() support: read it all in, as we used to.
+			uint8_t *buffer = new uint8_t [this->size];
+			uint64_t done = 0;
+
+			while(done < this->size)
+			{
+				ssize_t count = ::read(fd, buffer + done, this->size - done);
+
+				if(count <= 0)
+				{
+					delete [] buffer;
+					::close(fd);
+
+					return false;
+				}
+
+				done += count;
+			}
+
+			this->base = buffer;
+		}
+
+		::close(fd);
+
+		this->owner = true;
+		this->offset = 0;
+		this->nextAdvise = 0;
+		this->released = 0;
+		this->Advise();
+
+		return true;
+	}
+
+	void Close()
+	{
+		if(this->base == nullptr || this->owner == false)
+		{
+			return;
+		}
+
+		if(this->mapped == true)
+		{
+			::munmap((void *)(this->base), this->size);
+		}
+		else
+		{
+			delete [] this->base;
+		}
+
+		this->base = nullptr;
+		this->mapped = false;
+	}
+
+	// The view starts at 'begin' and ends at 'end' (exclusive), which must be within our bounds.
+	CProblemCursor View(uint64_t begin, uint64_t end) const
+	{
+		CProblemCursor view;
+
+		view.base = this->base;
+		view.size = end;
+		view.offset = begin;
+
+		return view;
+	}
+
+	// This drops the pages before 'end' (rounded down to a page boundary), if mapped.
+	void Release(uint64_t end)
+	{
+		if(this->mapped == false)
+		{
+			return;
+		}
+
+		const uint64_t pageSize = ::sysconf(_SC_PAGESIZE);
+		const uint64_t dropEnd = (std::min(end, this->size) / pageSize) * pageSize;
+
+		if(dropEnd > this->released)
+		{
+			::madvise((void *)(this->base + this->released), dropEnd - this->released, MADV_DONTNEED);
+			this->released = dropEnd;
+		}
+	}
+
+	uint64_t Size() const
+	{
+		return this->size;
+	}
+
+	// This is the file's memory, e.g. for checking what was read (views share their owner's).
+	const uint8_t *Data() const
+	{
+		return this->base;
+	}
+
+	uint64_t Offset() const
+	{
+		return this->offset;
+	}
+
+	uint64_t Remaining() const
+	{
+		return this->size - this->offset;
+	}
+
+	// Returns true on success, false if 'to' is out of bounds. Pages from 'to' on that were already dropped will be
+	// dropped again once we're done with them.
+	bool Seek(uint64_t to)
+	{
+		if(to > this->size)
+		{
+			return false;
+		}
+
+		const uint64_t pageSize = ::sysconf(_SC_PAGESIZE);
+
+		this->offset = to;
+		this->released = std::min(this->released, (to / pageSize) * pageSize);
+		this->nextAdvise = 0;
+
+		return true;
+	}
+
+	// Returns true on success, false if there aren't enough bytes left.
+	bool ReadU64(uint64_t &value)
+	{
+		if(this->Remaining() < 8)
+		{
+			return false;
+		}
+
+		memcpy(&value, this->base + this->offset, 8);	// not necessarily aligned
+		this->offset += 8;
+		this->Advise();
+
+		return true;
+	}
+
+	bool ReadByte(uint8_t &value)
+	{
+		if(this->Remaining() < 1)
+		{
+			return false;
+		}
+
+		value = this->base[this->offset++];
+		this->Advise();
+
+		return true;
+	}
+
+	// This returns a pointer to the NUL-terminated string at the cursor (in the mapping), or nullptr if the file
+	// ends before the terminator.
+	const char *ReadString()
+	{
+		const uint8_t *start = this->base + this->offset;
+		const void *end = memchr(start, '\0', this->Remaining());
+
+		if(end == nullptr)
+		{
+			return nullptr;
+		}
+
+		this->offset += (const uint8_t *)(end) - start + 1;
+		this->Advise();
+
+		return (const char *)(start);
+	}
+
+	// Returns true on success, false if there aren't enough bytes left.
+	bool Read(void *dest, uint64_t count)
+	{
+		if(this->Remaining() < count)
+		{
+			return false;
+		}
+
+		memcpy(dest, this->base + this->offset, count);
+		this->offset += count;
+		this->Advise();
+
+		return true;
+	}
+
+private:
+	const uint8_t *base;
+	uint64_t size;
+	uint64_t offset;
+	bool mapped;
+	bool owner;
+	uint64_t nextAdvise;		// offset at which to slide the window next
+	uint64_t released;		// everything before this offset has been dropped
+
+	void Advise()
+	{
+		if(this->mapped == false || this->offset < this->nextAdvise)
+		{
+			return;
+		}
+
+		const uint64_t windowStart = (this->offset / WINDOW_BYTES) * WINDOW_BYTES;
+
+		// Drop everything more than a window behind us.
+		if(windowStart >= WINDOW_BYTES)
+		{
+			this->Release(windowStart - WINDOW_BYTES);
+		}
+
+		// Ask for the next window to be read ahead.
+		const uint64_t aheadStart = windowStart + WINDOW_BYTES;
+
+		if(aheadStart < this->size)
+		{
+			uint64_t aheadSize = std::min<uint64_t>(WINDOW_BYTES, this->size - aheadStart);
+
+			::madvise((void *)(this->base + aheadStart), aheadSize, MADV_WILLNEED);
+		}
+
+		this->nextAdvise = aheadStart;
+	}
+};
+
+// ========================================================================
+
+// This decodes a coefficient as written by generate008 (a reduced fraction, such as "-3/4", with a power-of-2
+// denominator) and doubles it, since we're modulo 4. Returns true if the result fits numerator / 2^shift, with
+// the numerator in an int64_t; false if it doesn't (or isn't of that form), in which case GMP is needed.
+static bool DoDecodeCoefficient(const char *text, int64_t &numerator, uint32_t &shift)
+{
+	const uint64_t limit = (uint64_t)INT64_MAX;
+	bool negative = false;
+	uint64_t num = 0;
+	uint64_t den = 1;
+
+	if(*text == '-')
+	{
+		negative = true;
+		++text;
+	}
+
+	for(int part = 0; part < 2; ++part)
+	{
+		uint64_t &value = (part == 0) ? num : den;
+
+		if(*text < '0' || *text > '9')
+		{
+			return false;
+		}
+
+		for(value = 0; *text >= '0' && *text <= '9'; ++text)
+		{
+			if(value > (limit - (*text - '0')) / 10)
+			{
+				return false;
+			}
+
+			value = value * 10 + (*text - '0');
+		}
+
+		if(part != 0 || *text != '/')
+		{
+			break;
+		}
+
+		++text;
+	}
+
+	if(*text != '\0' || den == 0 || (den & (den - 1)) != 0)
+	{
+		return false;
+	}
+
+	shift = 0;
+
+	for(; den > 1; den >>= 1)
+	{
+		++shift;
+	}
+
+	while(shift > 0 && (num & 1) == 0)
+	{
+		num >>= 1;
+		--shift;
+	}
+
+	// we're mod 4 now
+	if(shift > 0)
+	{
+		--shift;
+	}
+	else if(num > limit / 2)
+	{
+		return false;
+	}
+	else
+	{
+		num *= 2;
+	}
+
+	numerator = (negative == true) ? -(int64_t)num : (int64_t)num;
+
+	return true;
+}
+
+// This holds a batch of decoded equations. It's reused from batch to batch, so once it has grown to the size of the
+// largest batch no more memory is allocated.
+class CEquationBatch
+{
+public:
+	std::vector<CEquationTerm> terms;
+	std::vector<CEquationView> views;
+
+	void Clear()
+	{
+		this->terms.clear();
+		this->views.clear();
+		this->firstTerms.clear();
+	}
+
+	void BeginEquation(int64_t position)
+	{
+		CEquationView view;
+		view.position = position;
+		view.divisorShift = 1;
+		view.terms = nullptr;
+		view.numTerms = 0;
+
+		this->views.push_back(view);
+		this->firstTerms.push_back(this->terms.size());
+	}
+
+	void AddTerm(const CEquationTerm &term)
+	{
+		this->terms.push_back(term);
+		++this->views.back().numTerms;
+	}
+
+	// This points the views at their terms; call it once the batch is complete ('terms' may have moved until then).
+	void Publish()
+	{
+		for(uint64_t n = 0; n < this->views.size(); ++n)
+		{
+			this->views[n].terms = this->terms.data() + this->firstTerms[n];
+		}
+	}
+
+private:
+	std::vector<uint64_t> firstTerms;
+};
+
+// This parses the equation at the cursor, which is to define temporary 'i', appending it to 'batch'. If 'batch' is
+// nullptr the equation is only checked and skipped, i.e. to find equation boundaries quickly.
+// Returns nullptr on success, or else a description of the error.
+static const char *DoReadEquation(CProblemCursor &cursor, int64_t i, CEquationBatch *batch)
+{
+	uint64_t synchValue = 0;
+	uint64_t divisorShift = 0;
+	uint64_t operandCount = 0;
+
+	if(cursor.ReadU64(synchValue) == false || synchValue != (uint64_t)i ||
+		cursor.ReadU64(divisorShift) == false || cursor.ReadU64(operandCount) == false
+	)
+	{
+		return "File format error";
+	}
+
+	if(divisorShift != 0)
+	{
+		// we expect our input file equations to be all 'mod 2'.
+		return "Incorrect divisorShift in input file (expected 0)";
+	}
+
+	if(batch != nullptr)
+	{
+		batch->BeginEquation(i);	// we're changing everything to mod 4 (so divisorShift is to become 1)
+	}
+
+	// iterate through operands. if there are none, that means we have a value of 0.
+	for(uint64_t j = 0; j < operandCount; ++j)
+	{
+		const char *coeffT = cursor.ReadString();
+		uint8_t type = 0;
+
+		if(coeffT == nullptr || cursor.ReadByte(type) == false)
+		{
+			return "File format error (truncated operand)";
+		}
+
+		CEquationTerm term;
+		term.operand.type = type;
+		term.operand.pos = 0;
+
+		if(term.operand.type == '1')
+			;	// unity
+		else if(term.operand.type == 'x' || term.operand.type == 'c' || term.operand.type == 't')	// variable, constant or temporary
+		{
+			uint64_t pos = 0;
+
+			if(cursor.ReadU64(pos) == false)
+			{
+				return "File format error (truncated operand)";
+			}
+
+			term.operand.pos = pos;
+
+			if(term.operand.type == 't' && pos >= (uint64_t)i)
+			{
+				return "File format error (possibly cyclic)";
+			}
+		}
+		else
+		{
+			return "File format error (unknown operand type)";
+		}
+
+		if(batch == nullptr)
+		{
+			continue;
+		}
+
+		term.text = nullptr;
+
+		if(DoDecodeCoefficient(coeffT, term.numerator, term.shift) == false)
+		{
+			// too large for us (or not a dyadic fraction); leave it to GMP.
+			mpq_class coeff;
+			if(coeff.set_str(coeffT, 10) != 0)
+			{
+				return "File format error (invalid coefficient)";
+			}
+
+			if(coeff == 0)
+			{
+				continue;
+			}
+
+			term.text = coeffT;
+			term.numerator = 0;
+			term.shift = 0;
+		}
+		else if(term.numerator == 0)
+		{
+			continue;
+		}
+
+		batch->AddTerm(term);
+	}
+
+	return nullptr;
+}
+
+// A run of consecutive equations (in file order), parsed by one worker.
+struct CProblemChunk
+{
+	uint64_t begin;			// byte offsets
+	uint64_t end;
+	uint64_t firstIndex;		// file order index of the first equation
+	uint64_t count;
+	std::unique_ptr<CEquationBatch> batch;
+	const char *error;
+	bool done;
+};
+
+// This reads the optional 'eqindex ' atom at the cursor: the stride, the number of entries and, for every 'stride'th
+// equation in file order, its byte offset. The offsets must match the equations section: they're to start at
+// 'firstOffset', increase and stay below 'endOffset'. Returns true if a valid index was read, false otherwise.
+static bool DoReadIndex(CProblemCursor &cursor, uint64_t numEquations, uint64_t firstOffset, uint64_t endOffset, uint64_t &stride, std::vector<uint64_t> &offsets)
+{
+	uint64_t sizeBytes = 0;
+	uint64_t index8cc = 0;
+	uint64_t numEntries = 0;
+
+	if(cursor.ReadU64(sizeBytes) == false || cursor.ReadU64(index8cc) == false || memcmp(&index8cc, "eqindex ", 8) != 0 ||
+		cursor.ReadU64(stride) == false || cursor.ReadU64(numEntries) == false || stride == 0 ||
+		numEntries != (numEquations + stride - 1) / stride || numEntries > cursor.Remaining() / 8 || sizeBytes != 8 * (4 + numEntries)
+	)
+	{
+		return false;
+	}
+
+	offsets.resize(numEntries);
+
+	for(uint64_t n = 0; n < numEntries; ++n)
+	{
+		cursor.ReadU64(offsets[n]);		// in bounds (see above)
+
+		if((n == 0 && offsets[n] != firstOffset) || (n != 0 && offsets[n] <= offsets[n - 1]) || offsets[n] >= endOffset)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// This hands the equations in [firstOffset, endOffset) to 'acceptor', parsing chunks of them on 'numThreads' worker
+// threads. 'offsets' holds the byte offset of every 'stride'th equation in file order. Chunks are delivered in file
+// order, and at most MAX_IN_FLIGHT_PER_THREAD chunks per worker are parsed ahead of the one being delivered, which
+// bounds memory use; delivered batches go back to a pool to be reused. If there's a 'verifier', each chunk is checked
+// by the worker that parses it. Returns true on success, false otherwise.
+static bool DoParseParallel(CProblemCursor &cursor, CProblemAcceptor &acceptor, const char *fn, uint64_t numEquations, bool backwards,
+	uint64_t stride, const std::vector<uint64_t> &offsets, uint64_t endOffset, uint32_t numThreads, CMerkleVerifier *verifier)
+{
+	enum { MAX_IN_FLIGHT_PER_THREAD = 2 };
+
+	std::vector<CProblemChunk> chunks(offsets.size());
+
+	for(uint64_t n = 0; n < chunks.size(); ++n)
+	{
+		chunks[n].begin = offsets[n];
+		chunks[n].end = (n + 1 < offsets.size()) ? offsets[n + 1] : endOffset;
+		chunks[n].firstIndex = n * stride;
+		chunks[n].count = std::min(stride, numEquations - n * stride);
+		chunks[n].error = nullptr;
+		chunks[n].done = false;
+	}
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	uint64_t next = 0;		// next chunk to be claimed by a worker
+	uint64_t delivered = 0;		// chunks handed to the acceptor so far
+	bool abort = false;
+	std::vector<std::unique_ptr<CEquationBatch> > pool;
+	const uint64_t maxInFlight = (uint64_t)MAX_IN_FLIGHT_PER_THREAD * numThreads;
+
+	auto worker = [&]()
+	{
+		for(;;)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			changed.wait(lock, [&]() { return abort == true || next >= chunks.size() || next < delivered + maxInFlight; });
+
+			if(abort == true || next >= chunks.size())
+			{
+				return;
+			}
+
+			CProblemChunk &chunk = chunks[next++];
+			std::unique_ptr<CEquationBatch> batch;
+
+			if(pool.empty() == false)
+			{
+				batch = std::move(pool.back());
+				pool.pop_back();
+			}
+			else
+			{
+				batch.reset(new CEquationBatch());
+			}
+
+			lock.unlock();
+
+			CProblemCursor view = cursor.View(chunk.begin, chunk.end);
+			const char *error = nullptr;
+
+			// The end marker is part of the last equation's segment.
+			const uint64_t checkEnd = (&chunk == &chunks.back()) ? endOffset + 8 : chunk.end;
+
+			if(verifier != nullptr && verifier->Check(chunk.begin, cursor.Data() + chunk.begin, checkEnd - chunk.begin) == false)
+			{
+				error = "The equations don't match the Merkle tree";
+			}
+
+			for(uint64_t k = 0; k < chunk.count && error == nullptr; ++k)
+			{
+				const uint64_t fileIndex = chunk.firstIndex + k;
+				const int64_t position = (backwards == true) ? (numEquations - 1 - fileIndex) : fileIndex;
+
+				error = DoReadEquation(view, position, batch.get());
+			}
+
+			if(error == nullptr && view.Remaining() != 0)
+			{
+				error = "File format error (equation index doesn't match the equations)";
+			}
+
+			batch->Publish();
+
+			lock.lock();
+			chunk.batch = std::move(batch);
+			chunk.error = error;
+			chunk.done = true;
+			changed.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+
+	for(uint32_t n = 0; n < numThreads; ++n)
+	{
+		threads.push_back(std::thread(worker));
+	}
+
+	const char *error = nullptr;
+
+	for(uint64_t n = 0; n < chunks.size() && error == nullptr; ++n)
+	{
+		std::unique_ptr<CEquationBatch> batch;
+
+		if(true)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			changed.wait(lock, [&]() { return chunks[n].done == true; });
+
+			error = chunks[n].error;
+			batch = std::move(chunks[n].batch);
+		}
+
+		if(error == nullptr && acceptor.AcceptEquations(batch->views.data(), batch->views.size()) == false)
+		{
+			error = "Error from AcceptEquations() while reading file";
+		}
+
+		batch->Clear();
+
+		if(true)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			pool.push_back(std::move(batch));
+			delivered = n + 1;
+			abort = (error != nullptr);
+			changed.notify_all();
+		}
+
+		cursor.Release(chunks[n].end);
+	}
+
+	for(uint64_t n = 0; n < threads.size(); ++n)
+	{
+		threads[n].join();
+	}
+
+	if(error != nullptr)
+	{
+		std::cerr << "\n" << error << ": " << fn << std::endl;
+
+		return false;
+	}
+
+	return true;
+}
+
+// ========================================================================
+
+mpq_class CEquationTerm::GetValue() const
+{
+	mpq_class value;
+
+	if(this->text != nullptr)
+	{
+		value.set_str(this->text, 10);
+		value *= 2;	// we're mod 4 now
+	}
+	else
+	{
+		value = mpq_class(mpz_class(this->numerator), mpz_class(1) << this->shift);
+		value.canonicalize();
+	}
+
+	return value;
+}
+
+// returns true on success, false in case of failure.
+bool CProblemAcceptor::AcceptEquations(const CEquationView *views, uint64_t count)
+{
+	for(uint64_t n = 0; n < count; ++n)
+	{
+		CGenerationEquation equation;
+		equation.divisorShift = views[n].divisorShift;
+		equation.zeroTarget = false;
+
+		for(uint64_t k = 0; k < views[n].numTerms; ++k)
+		{
+			equation.operands.push_back(std::pair<CGenerationOperand, mpq_class>(views[n].terms[k].operand, views[n].terms[k].GetValue()));
+		}
+
+		if(this->AcceptNextEquation(equation, views[n].position) == false)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// ========================================================================
+
 // returns true on success, false in case of failure.
-bool CProblemReader::ReadProblem(const char *fn, CProblemAcceptor &acceptor)
+bool CProblemReader::ReadProblem(const char *fn, CProblemAcceptor &acceptor, uint32_t numThreads /*= 0*/, CMerkleVerifier *verifier /*= nullptr*/)
 {
-	using namespace std;
-	
-	FILE *fi = fopen(fn, "rb");
-	if(fi == nullptr)
+	CProblemCursor cursor;
+
+	if(cursor.Open(fn) == false)
 	{
 		std::cerr << "\nFatal: unable to open file for reading: " << fn << std::endl;
-		
+
 		return false;
 	}
-	
+
 	uint64_t fsize = 0;
-	if(fread(&fsize, sizeof(uint64_t), 1, fi) != 1 || fsize < 8)
+	if(cursor.ReadU64(fsize) == false || fsize < 8 || fsize > cursor.Size())
 	{
-		fclose(fi);
 		std::cerr << "\nFatal: invalid file format: " << fn << std::endl;
 
 		return false;
 	}
-	
-	std::cout << "Reading " << (fsize + 1024 * 1024 - 1) / (1024 * 1024) << " MB from " << fn << "... " << std::flush;
-	
-	uint64_t *data = new uint64_t [(fsize + 7) / 8];
-	
-	rewind(fi);
-	if(fread(data, fsize, 1, fi) != 1)
+
+	std::cout << "Streaming " << (fsize + 1024 * 1024 - 1) / (1024 * 1024) << " MB from " << fn << std::endl;
+
+	char magic[17] = {0};
+	uint64_t numUnknownBits = 0;
+	uint64_t constantVectorSizeBytes = 0;
+
+	if(cursor.Read(magic, 16) == false || cursor.ReadU64(numUnknownBits) == false || cursor.ReadU64(constantVectorSizeBytes) == false)
 	{
-		fclose(fi);
-	
-		delete [] data;
-		
-		std::cout << "fail!" << std::endl;
+		std::cerr << "\nFile format error (truncated header): " << fn << std::endl;
 
 		return false;
 	}
-	
-	std::cout << "done" << std::endl;
-	
-	fclose(fi);
-
-	const uint8_t *rawdata = (const uint8_t *)(data);
 
-	char magic[17] = {0};
-	memcpy(magic, rawdata + 8, 16);
-	
 	if(memcmp(magic, "sha256x2", 8) != 0)
 	{
 		std::cout << "Warning: magic signature not recognized: " << magic << std::endl;
@@ -63,235 +810,253 @@ bool CProblemReader::ReadProblem(const char *fn, CProblemAcceptor &acceptor)
 	{
 		std::cout << "Magic signature: " << magic << std::endl;
 	}
-	
-	rawdata += 8 + 16;
-	
-	uint64_t numUnknownBits = *(const uint64_t *)(rawdata);
-	rawdata += 8;
-	
+
 	std::cout << "Number of unknown bits: " << numUnknownBits << std::endl;
-	
-	uint64_t constantVectorSizeBytes = *(const uint64_t *)(rawdata);
+
+	uint64_t constant8cc = 0;
+	if(constantVectorSizeBytes < 8 + 8 || constantVectorSizeBytes % 8 != 0 || constantVectorSizeBytes - 8 > cursor.Remaining() ||
+		cursor.ReadU64(constant8cc) == false || memcmp(&constant8cc, "constant", 8) != 0
+	)
+	{
+		std::cerr << "\nFile format error (missing or misplaced 'constant' atom): " << fn << std::endl;
+
+		return false;
+	}
 
 	// note: constant number 0 is always 1 (it's where our 'unity' operand value lives).
 	uint64_t numConstantItems = (constantVectorSizeBytes - 8 - 8) / 8;
-	
+
 	std::vector<bool> constantValues(numConstantItems, 0);
-	
+
 	for(uint64_t i = 0; i < numConstantItems; ++i)
 	{
-		uint64_t value = *(const uint64_t *)(rawdata + 8 + 8 + 8 * i);
-		
+		uint64_t value = 0;
+		cursor.ReadU64(value);		// in bounds (see above)
+
 		constantValues[i] = (value != 0);
 	}
-	
+
 	std::cout << "Number of constant bits: " << constantValues.size() << std::endl;
 
-	rawdata += constantVectorSizeBytes;
-	
-	rawdata += 8;	// skip equations atom size
-	
-	uint64_t equatns8cc = *(const uint64_t *)(rawdata);
-	
-	if(memcmp(&equatns8cc, "equatns ", 8) != 0)
+	const uint64_t equatnsOffset = cursor.Offset();
+	uint64_t equatnsSizeBytes = 0;
+	uint64_t equatns8cc = 0;
+
+	if(cursor.ReadU64(equatnsSizeBytes) == false || cursor.ReadU64(equatns8cc) == false || memcmp(&equatns8cc, "equatns ", 8) != 0)
 	{
-		delete [] data;
-		
 		std::cerr << "\nFile format error (missing or misplaced 'equatns ' atom): " << fn << std::endl;
-		
+
 		return false;
 	}
-	
-	rawdata += 8;
-	
+
 	// Our next step is to read in the equations, themselves!
-	
-	uint64_t targetsSizeBytes = *(const uint64_t *)(rawdata);
-	
-	uint64_t targets8cc = *(const uint64_t *)(rawdata + 8);
-	if(memcmp(&targets8cc, "targets ", 8) != 0)
-	{
-		delete [] data;
-		
+
+	uint64_t targetsSizeBytes = 0;
+	uint64_t targets8cc = 0;
+
+	if(cursor.ReadU64(targetsSizeBytes) == false || cursor.ReadU64(targets8cc) == false || memcmp(&targets8cc, "targets ", 8) != 0 ||
+		targetsSizeBytes < 8 + 8 || targetsSizeBytes % 8 != 0 || targetsSizeBytes - 8 - 8 > cursor.Remaining()
+	)
+	{
 		std::cerr << "\nFile format error (missing or misplaced 'targets ' atom): " << fn << std::endl;
-		
+
 		return false;
 	}
-	
+
 	uint64_t numOutputTarget = (targetsSizeBytes - 8 - 8) / 8;
-	
+
 	std::vector<uint64_t> targetOutputTemps(numOutputTarget, 0);
-	
+
 	for(uint64_t i = 0; i < numOutputTarget; ++i)
 	{
-		uint64_t tempPos = *(const uint64_t *)(rawdata + 8 + 8 + 8 * i);
-		
-		targetOutputTemps[i] = tempPos;
+		cursor.ReadU64(targetOutputTemps[i]);		// in bounds (see above)
 	}
-	
-	rawdata += targetsSizeBytes;
-	
+
 	bool backwards = false;
-	
-	uint64_t numEquations = *(const uint64_t *)(rawdata);
-	
-	rawdata += 8;
-	
+
+	uint64_t numEquations = 0;
+
+	if(cursor.ReadU64(numEquations) == false)
+	{
+		std::cerr << "\nFile format error (truncated equation count): " << fn << std::endl;
+
+		return false;
+	}
+
 	if(numEquations == 0)
 	{
-		backwards = true;
-		
-		numEquations = *(const uint64_t *)(rawdata);
-		
-		rawdata += 8;
+		backwards = true;	// a 0 count means the next field is the count and our equations are in reverse
+
+		if(cursor.ReadU64(numEquations) == false)
+		{
+			std::cerr << "\nFile format error (truncated equation count): " << fn << std::endl;
+
+			return false;
+		}
 	}
-	
-	std::cout << "Preparing " << numEquations << " equations... " << std::flush;
-	
-	if(acceptor.Initialize(constantValues, targetOutputTemps, numUnknownBits, numEquations, std::string(magic)) == false)
+
+	// Each equation takes at least 3 words, so this rules out absurd counts before the acceptor allocates for them.
+	if(numEquations > cursor.Remaining() / (3 * 8))
 	{
-		delete [] data;
-		
-		std::cerr << "\nInitialize() failed. Giving up reading file: " << fn << std::endl;
-		
+		std::cerr << "\nFile format error (equation count exceeds file size): " << fn << std::endl;
+
 		return false;
 	}
-	
-	for(int64_t i = (backwards == true) ? (numEquations) : -1; ;)
+
+	const uint64_t firstOffset = cursor.Offset();
+
+	if(numThreads == 0)
 	{
-		if(backwards)
-		{
-			--i;
-			if(i < 0)
-			{
-				break;
-			}
-		}
-		else
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// To parse in parallel we need to know where the equations start. That's what the 'eqindex ' atom following the
+	// 'equatns ' atom is for; files without one get a quick pre-scan instead (no coefficients are converted).
+	uint64_t stride = 0;
+	std::vector<uint64_t> offsets;
+	uint64_t endOffset = 0;		// the offset of the end marker
+
+	if(numThreads > 1 && numEquations != 0)
+	{
+		endOffset = equatnsOffset + equatnsSizeBytes - 8;
+
+		if(equatnsSizeBytes < 8 || endOffset < firstOffset || cursor.Seek(endOffset + 8) == false ||
+			DoReadIndex(cursor, numEquations, firstOffset, endOffset, stride, offsets) == false
+		)
 		{
-			++i;
-			if(i >= numEquations)
+			enum { SCAN_STRIDE = 16 };
+
+			std::cout << "No equation index, scanning... " << std::flush;
+
+			stride = SCAN_STRIDE;
+			offsets.clear();
+			cursor.Seek(firstOffset);
+
+			for(uint64_t n = 0; n < numEquations; ++n)
 			{
-				break;
+				if(n % stride == 0)
+				{
+					offsets.push_back(cursor.Offset());
+				}
+
+				const char *error = DoReadEquation(cursor, (backwards == true) ? (numEquations - 1 - n) : n, nullptr);
+
+				if(error != nullptr)
+				{
+					std::cerr << "\n" << error << ": " << fn << std::endl;
+
+					return false;
+				}
 			}
+
+			endOffset = cursor.Offset();
+
+			std::cout << "done" << std::endl;
 		}
-	
-		const uint64_t synchValue = *(const uint64_t *)(rawdata);
-		
-		if(synchValue != i)
+
+		cursor.Seek(firstOffset);
+	}
+
+	if(verifier != nullptr && verifier->Check(0, cursor.Data(), firstOffset) == false)
+	{
+		std::cerr << "\nThe header doesn't match the Merkle tree: " << fn << std::endl;
+
+		return false;
+	}
+
+	std::cout << "Preparing " << numEquations << " equations... " << std::flush;
+
+	if(acceptor.Initialize(constantValues, targetOutputTemps, numUnknownBits, numEquations, std::string(magic)) == false)
+	{
+		std::cerr << "\nInitialize() failed. Giving up reading file: " << fn << std::endl;
+
+		return false;
+	}
+
+	if(offsets.empty() == false)
+	{
+		if(DoParseParallel(cursor, acceptor, fn, numEquations, backwards, stride, offsets, endOffset, numThreads, verifier) == false)
 		{
-			delete [] data;
-			
-			std::cerr << "\nFile format error: " << fn << std::endl;
-			
-			return false;
-		}
-		
-		rawdata += 8;
-		
-		uint64_t divisorShift = *(const uint64_t *)(rawdata);
-		
-		rawdata += 8;
-		
-		uint64_t operandCount = *(const uint64_t *)(rawdata);
-		
-		rawdata += 8;
-		
-		if(divisorShift != 0)
-		{
-			delete [] data;
-			
-			// we expect our input file equations to be all 'mod 2'.
-			std::cerr << "\nIncorrect divisorShift in input file (expected 0): " << fn << std::endl;
-			
 			return false;
 		}
-		
-		CGenerationEquation equation;
-		equation.divisorShift = 1;	// we're changing everything to mod 4 (so divisorShift is to become 1)
-		
-		// iterate through operands. if there are none, that means we have a value of 0.
-		for(uint64_t j = 0; j < operandCount; ++j)
+
+		cursor.Seek(endOffset);
+	}
+	else
+	{
+		enum { BATCH_EQUATIONS = 16 };
+
+		CEquationBatch batch;
+		uint64_t batchOffset = cursor.Offset();
+
+		for(uint64_t n = 0; n < numEquations; ++n)
 		{
-			const char *coeffT = (const char *)(rawdata);
-			
-			mpq_class coeff;
-			coeff.set_str(coeffT, 10);
-			
-			rawdata += std::strlen(coeffT) + 1;
-			
-			CGenerationOperand operand;
-			operand.type = *(const char *)(rawdata);
-			++rawdata;
-			
-			operand.pos = 0;
-			
-			if(operand.type == '1')
-				;	// unity
-			else if(operand.type == 'x' || operand.type == 'c')	// variable or constant
+			const int64_t i = (backwards == true) ? (numEquations - 1 - n) : n;
+			const char *error = DoReadEquation(cursor, i, &batch);
+
+			if(error != nullptr)
 			{
-				operand.pos = *(const uint64_t *)(rawdata);
-				
-				rawdata += 8;
+				std::cerr << "\n" << error << ": " << fn << std::endl;
+
+				return false;
 			}
-			else if(operand.type == 't')
+
+			if(batch.views.size() == BATCH_EQUATIONS || n + 1 == numEquations)
 			{
-				operand.pos = *(const uint64_t *)(rawdata);
-				
-				rawdata += 8;
-				
-				if(operand.pos >= i)
+				// The end marker is part of the last equation's segment.
+				const uint64_t checkEnd = std::min(cursor.Offset() + ((n + 1 == numEquations) ? 8 : 0), cursor.Size());
+
+				if(verifier != nullptr && verifier->Check(batchOffset, cursor.Data() + batchOffset, checkEnd - batchOffset) == false)
 				{
-					delete [] data;
-					
-					std::cerr << "\nFile format error (possibly cyclic): " << fn << std::endl;
-					
+					std::cerr << "\nThe equations don't match the Merkle tree: " << fn << std::endl;
+
 					return false;
 				}
-			}
-			
-			if(coeff != 0)
-			{
-				coeff *= 2;	// we're mod 4 now
-				
-				equation.operands.push_back(std::pair<CGenerationOperand, mpq_class>(operand, coeff));
+
+				batchOffset = cursor.Offset();
+				batch.Publish();
+
+				if(acceptor.AcceptEquations(batch.views.data(), batch.views.size()) == false)
+				{
+					std::cerr << "\nError from AcceptEquations() while reading file: " << fn << std::endl;
+
+					return false;
+				}
+
+				batch.Clear();
 			}
 		}
-		
-		equation.zeroTarget = false;
-		
-		if(acceptor.AcceptNextEquation(equation, i) == false)
-		{
-			delete [] data;
-			
-			std::cerr << "\nError from AcceptNextEquation() while reading file: " << fn << std::endl;
-			
-			return false;
-		}
 	}
-	
-	if(memcmp(rawdata, "endend  ", 8) != 0)
+
+	char endMarker[8];
+
+	if(cursor.Read(endMarker, 8) == false || memcmp(endMarker, "endend  ", 8) != 0)
 	{
-		delete [] data;
-		
 		std::cerr << "\nFile format error (missing end marker): " << fn << std::endl;
-		
+
 		return false;
 	}
-	
+
 	std::cout << "done" << std::endl;
 
+	if(verifier != nullptr && verifier->Check(cursor.Offset(), cursor.Data() + cursor.Offset(), cursor.Remaining()) == false)
+	{
+		std::cerr << "\nThe trailer doesn't match the Merkle tree: " << fn << std::endl;
+
+		return false;
+	}
+
 	std::cout << "Finishing up... " << std::flush;
 
-	delete [] data;
+	cursor.Close();
 
 	if(acceptor.Finish() == false)
 	{
 		std::cerr << "\nError from Finish() while reading file: " << fn << std::endl;
-		
+
 		return false;
 	}
-	
+
 	std::cout << "done\n" << std::endl;
 
 	return true;
@@ -300,4 +1065,3 @@ bool CProblemReader::ReadProblem(const char *fn, CProblemAcceptor &acceptor)
 // ========================================================================
 
 }	// namespace formal_crypto
-
@@ -0,0 +1,283 @@
+// formprofile.cpp - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Memory and cost attribution for the formal analysis pipeline (see formprofile.h).
+// ================================================================================
+
+#include "formprofile.h"
+
+#include <gmp.h>
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+namespace formal_crypto
+{
+// ================================================================================
+
+bool CMemoryProfile::enabled = false;
+int64_t CMemoryProfile::liveObjects[E__MEMORY_COUNT] = {0};
+int64_t CMemoryProfile::liveBytes[E__MEMORY_COUNT] = {0};
+std::vector<CMemoryProfile::CSnapshot> CMemoryProfile::snapshots;
+double CMemoryProfile::startSeconds = 0.0;
+
+static void *(*gmpAlloc)(size_t) = nullptr;
+static void *(*gmpRealloc)(void *, size_t, size_t) = nullptr;
+static void (*gmpFree)(void *, size_t) = nullptr;
+
+static void *DoGmpAlloc(size_t size)
+{
+	void *ptr = gmpAlloc(size);
+
+	CMemoryProfile::Add(E_MEMORY_GMP, 1, size);
+
+	return ptr;
+}
+
+static void *DoGmpRealloc(void *ptr, size_t oldSize, size_t newSize)
+{
+	void *result = gmpRealloc(ptr, oldSize, newSize);
+
+	CMemoryProfile::Add(E_MEMORY_GMP, 0, (int64_t)newSize - (int64_t)oldSize);
+
+	return result;
+}
+
+static void DoGmpFree(void *ptr, size_t size)
+{
+	gmpFree(ptr, size);
+
+	CMemoryProfile::Add(E_MEMORY_GMP, -1, -(int64_t)size);
+}
+
+static double DoGetSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ================================================================================
+
+void CMemoryProfile::Enable()
+{
+	enabled = true;
+	startSeconds = DoGetSeconds();
+}
+
+void CMemoryProfile::InstallGmpHooks()
+{
+	if(gmpAlloc != nullptr)
+	{
+		return;		// already installed
+	}
+
+	mp_get_memory_functions(&gmpAlloc, &gmpRealloc, &gmpFree);
+	mp_set_memory_functions(DoGmpAlloc, DoGmpRealloc, DoGmpFree);
+}
+
+uint64_t CMemoryProfile::PeakRssBytes()
+{
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+
+	return (uint64_t)usage.ru_maxrss * 1024;	// Linux reports kilobytes
+}
+
+const char *CMemoryProfile::GetCategoryName(int category)
+{
+	static const char *names[E__MEMORY_COUNT] =
+	{
+		"COperator", "COperand", "CFlattenedOperator", "CScatterWord", "childMapEntries", "gmp"
+	};
+
+	return (category >= 0 && category < E__MEMORY_COUNT) ? names[category] : "?";
+}
+
+void CMemoryProfile::Snapshot(const std::string &phase)
+{
+	if(enabled == false)
+	{
+		return;
+	}
+
+	CSnapshot snapshot;
+	snapshot.phase = phase;
+	snapshot.seconds = DoGetSeconds() - startSeconds;
+	snapshot.peakRssBytes = PeakRssBytes();
+
+	for(int i = 0; i < E__MEMORY_COUNT; ++i)
+	{
+		snapshot.objects[i] = liveObjects[i];
+		snapshot.bytes[i] = liveBytes[i];
+	}
+
+	snapshots.push_back(snapshot);
+}
+
+// Returns true on success, false otherwise.
+bool CMemoryProfile::WriteJson(std::ostream &os)
+{
+	os << "{\n";
+	os << "\t\"peakRssBytes\": " << PeakRssBytes() << ",\n";
+	os << "\t\"snapshots\": [\n";
+
+	for(uint64_t n = 0; n < snapshots.size(); ++n)
+	{
+		const CSnapshot &snapshot = snapshots[n];
+		char seconds[64];
+
+		std::snprintf(seconds, sizeof(seconds), "%.3f", snapshot.seconds);
+
+		os << "\t\t{ \"phase\": \"" << snapshot.phase << "\", \"seconds\": " << seconds << ", \"peakRssBytes\": " << snapshot.peakRssBytes << ",\n";
+
+		for(int pass = 0; pass < 2; ++pass)
+		{
+			os << ((pass == 0) ? "\t\t  \"objects\": { " : "\t\t  \"bytes\": { ");
+
+			for(int i = 0; i < E__MEMORY_COUNT; ++i)
+			{
+				os << "\"" << GetCategoryName(i) << "\": " << ((pass == 0) ? snapshot.objects[i] : snapshot.bytes[i]);
+				os << ((i + 1 < E__MEMORY_COUNT) ? ", " : " }");
+			}
+
+			os << ((pass == 0) ? ",\n" : "\n");
+		}
+
+		os << "\t\t}" << ((n + 1 < snapshots.size()) ? "," : "") << "\n";
+	}
+
+	os << "\t]\n";
+	os << "}" << std::endl;
+
+	return !os.fail();
+}
+
+void CMemoryProfile::WriteSummary(std::ostream &os)
+{
+	if(snapshots.empty() == true)
+	{
+		return;
+	}
+
+	const CSnapshot &snapshot = snapshots.back();
+
+	os << "Memory profile (" << snapshot.phase << "): peak RSS " << (PeakRssBytes() >> 20) << " MiB" << std::endl;
+
+	for(int i = 0; i < E__MEMORY_COUNT; ++i)
+	{
+		os << "  " << GetCategoryName(i) << ": " << snapshot.objects[i] << " object(s), " << (snapshot.bytes[i] >> 10) << " KiB" << std::endl;
+	}
+}
+
+// ================================================================================
+
+void CProvenanceProfile::Add(uint64_t position, CProvenance provenance, uint64_t nonzeros, double seconds)
+{
+	CRow row;
+	row.position = position;
+	row.provenance = provenance;
+	row.nonzeros = nonzeros;
+	row.seconds = seconds;
+
+	this->rows.push_back(row);
+}
+
+const char *CProvenanceProfile::GetKindName(int kind)
+{
+	static const char *names[E__PROVENANCE_COUNT] =
+	{
+		"unknown", "Ch", "Maj", "Sigma0", "Sigma1", "sigma0", "sigma1", "add", "output"
+	};
+
+	return (kind >= 0 && kind < E__PROVENANCE_COUNT) ? names[kind] : "?";
+}
+
+const char *CProvenanceProfile::GetStageName(int stage)
+{
+	static const char *names[E__STAGE_COUNT] =
+	{
+		"setup", "expansion", "round", "final"
+	};
+
+	return (stage >= 0 && stage < E__STAGE_COUNT) ? names[stage] : "?";
+}
+
+// Returns true on success, false otherwise.
+bool CProvenanceProfile::WriteSidecar(std::ostream &os) const
+{
+	os << "# position round stage kind bit nonzeros microseconds\n";
+
+	for(uint64_t n = 0; n < this->rows.size(); ++n)
+	{
+		const CRow &row = this->rows[n];
+
+		os << "t" << row.position << " " << row.provenance.round << " " << GetStageName(row.provenance.stage) << " ";
+		os << GetKindName(row.provenance.kind) << " " << row.provenance.bit << " " << row.nonzeros << " ";
+		os << (uint64_t)(row.seconds * 1e6 + 0.5) << "\n";
+	}
+
+	os << std::flush;
+
+	return !os.fail();
+}
+
+void CProvenanceProfile::WriteReport(std::ostream &os) const
+{
+	struct CTotal
+	{
+		uint64_t rows;
+		uint64_t nonzeros;
+		double seconds;
+	};
+
+	std::map<std::pair<int, int>, CTotal> totals;		// (stage, kind) -> totals (value-initialized, i.e. zero)
+	CTotal all = { 0, 0, 0.0 };
+
+	for(uint64_t n = 0; n < this->rows.size(); ++n)
+	{
+		const CRow &row = this->rows[n];
+		CTotal &total = totals[std::make_pair((int)row.provenance.stage, (int)row.provenance.kind)];
+
+		++total.rows;
+		total.nonzeros += row.nonzeros;
+		total.seconds += row.seconds;
+
+		++all.rows;
+		all.nonzeros += row.nonzeros;
+		all.seconds += row.seconds;
+	}
+
+	if(all.rows == 0)
+	{
+		return;
+	}
+
+	os << "Equation cost by operation (" << all.rows << " row(s), " << all.nonzeros << " nonzero(s), " << all.seconds << "s in Finalize):" << std::endl;
+
+	char line[256];
+
+	std::snprintf(line, sizeof(line), "  %-10s %-8s %10s %7s %12s %7s %9s %10s %7s", "stage", "kind", "rows", "%", "nonzeros", "%", "per row", "seconds", "%");
+	os << line << std::endl;
+
+	for(auto i = totals.begin(); i != totals.end(); ++i)
+	{
+		const CTotal &total = i->second;
+
+		std::snprintf(line, sizeof(line), "  %-10s %-8s %10llu %6.2f%% %12llu %6.2f%% %9.1f %10.3f %6.2f%%",
+			GetStageName(i->first.first), GetKindName(i->first.second),
+			(unsigned long long)total.rows, 100.0 * total.rows / all.rows,
+			(unsigned long long)total.nonzeros, (all.nonzeros != 0) ? 100.0 * total.nonzeros / all.nonzeros : 0.0,
+			(double)total.nonzeros / total.rows,
+			total.seconds, (all.seconds > 0.0) ? 100.0 * total.seconds / all.seconds : 0.0
+		);
+		os << line << std::endl;
+	}
+}
+
+}	// namespace formal_crypto
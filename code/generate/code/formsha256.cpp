@@ -15,7 +15,8 @@ namespace formal_crypto
 // 'unknownW' exists for historical purposes and should be 0 (an effort to cryptanalyze SHA2-256 with an effective number
 // of rounds of only 2 was made; note that there are better ways to 'break' SHA2-256 once it's been reduced to only two
 // rounds, and the full spec specifies 64 rounds).
-// 'targetH' refers to the number of output H bits we need. the rest will be discarded. 256 is for a complete hash output.
+// 'targetH' refers to the number of output H bits we need. the rest will be discarded. 8 * W is for a complete hash output,
+// where W is the cryptosystem's word size in bits (32 for SHA-256; see CUtilScaledSha256 for smaller word sizes).
 // 'applyCount' is the number of times we're applying the SHA-256 algorithm. 1 means we're doing a straight-forward hash.
 // many of these variables exist for historical reasons only, and aren't too useful in actuality as they'd take us into
 // P vs. NP terrotiroy, an area we'd like not to venture. =)
@@ -24,25 +25,30 @@ namespace formal_crypto
 //
 // c[] = constant variables, to have a value provided by the user.
 // x[] = (unknown) input variables, to be solved for.
-// t[] = temporary variables. some of these are "user outputs". the first 256 "user outputs" (some may be simply wired to 0,
-//       if targetH isn't 256), repesent the final output h's. the remaining "user outputs" are simply things that "must be 0",
+// t[] = temporary variables. some of these are "user outputs". the first 8W "user outputs" (some may be simply wired to 0,
+//       if targetH isn't 8W), repesent the final output h's. the remaining "user outputs" are simply things that "must be 0",
 //       created if appropriate. see also CCryptosystem::autoTempOperandOutputPositions[] in formcrypto.h.
-// c[1..512] represent the input W values. use 0 for the first 'unknownW' bits (those won't be used, anyway).
-// c[513..513+256-1] represents the input H values.
-// c[513+256..513+256+256-1] is reserved for the expected output H values. use 0 for discarded output H's (see 'targetH').
+// c[1..16W] represent the input W values. use 0 for the first 'unknownW' bits (those won't be used, anyway).
+// c[16W+1..16W+8W] represents the input H values.
+// c[24W+1..24W+8W] is reserved for the expected output H values. use 0 for discarded output H's (see 'targetH').
 // x[0..'unknownW'-1] are the bits we're trying to solve for.
 // see note above regarding t[].
-CFormalSha256::CFormalSha256(CCryptosystem &cSystem, uint32_t unknownW /*bits*/, uint32_t targetH /*bits*/, uint32_t applyCount /*= 1*/, uint32_t numRounds /*= 64*/)
+CFormalSha256::CFormalSha256(CCryptosystem &cSystem, uint32_t unknownW /*bits*/, uint32_t targetH /*bits*/, uint32_t applyCount /*= 1*/, uint32_t numRounds /*= 64*/) :
+	constants(cSystem.WordSizeBits())
 {
-	if(unknownW > 512 || targetH > 256 || applyCount == 0 || numRounds > 64)
+	const uint32_t wordBits = cSystem.WordSizeBits();
+	const uint32_t numWBits = 16 * wordBits;	// 512 for SHA-256
+	const uint32_t numHBits = 8 * wordBits;		// 256 for SHA-256
+
+	if(unknownW > numWBits || targetH > numHBits || applyCount == 0 || numRounds > 64)
 	{
 		throw std::runtime_error("CFormalSha256::CFormalSha256(): invalid configuration detected.");
 	}
 	
 	// Let's start by creating our initial w[] words.
 	CWord w[64];
-	ROperator wBits[512];	
-	for(uint32_t i = 0; i < 512; ++i)
+	ROperator wBits[16 * WORD_SIZE_BITS_MAX];
+	for(uint32_t i = 0; i < numWBits; ++i)
 	{
 		cSystem.constantOperands.push_back(cSystem.CreateOperand(E_OPERAND_CONSTANT, i + 1));	// constant 0 is unity (built-in to the system)
 		wBits[i] = cSystem.CreateOperator(cSystem.constantOperands.back());
@@ -55,36 +61,38 @@ CFormalSha256::CFormalSha256(CCryptosystem &cSystem, uint32_t unknownW /*bits*/,
 	}
 	for(uint32_t i = 0; i < 16; ++i)
 	{
-		w[i] = CWord::Gather(cSystem, wBits + 32 * i, 32);
+		w[i] = CWord::Gather(cSystem, wBits + wordBits * i, wordBits);
 	}
 	
 	// Next, let's create the initial h[] words.
 	CWord h[8];
 	
-	ROperator hBits[256];
-	for(uint32_t i = 0; i < 256; ++i)
+	ROperator hBits[8 * WORD_SIZE_BITS_MAX];
+	for(uint32_t i = 0; i < numHBits; ++i)
 	{
-		cSystem.constantOperands.push_back(cSystem.CreateOperand(E_OPERAND_CONSTANT, i + 512 + 1));
+		cSystem.constantOperands.push_back(cSystem.CreateOperand(E_OPERAND_CONSTANT, i + numWBits + 1));
 		hBits[i] = cSystem.CreateOperator(cSystem.constantOperands.back());
 	}
 	for(uint32_t i = 0; i < 8; ++i)
 	{
-		h[i] = CWord::Gather(cSystem, hBits + 32 * i, 32);
+		h[i] = CWord::Gather(cSystem, hBits + wordBits * i, wordBits);
 	}
 	
-	// Let's allow the user to provide 256 "expected" output values. They should just use 0 for discarded output bits, e.g. any bits after the first targetH.
-	ROperand hTargetOperand[256];
-	for(uint32_t i = 0; i < 256; ++i)
+	// Let's allow the user to provide 8W "expected" output values. They should just use 0 for discarded output bits, e.g. any bits after the first targetH.
+	ROperand hTargetOperand[8 * WORD_SIZE_BITS_MAX];
+	for(uint32_t i = 0; i < numHBits; ++i)
 	{
-		hTargetOperand[i] = cSystem.CreateOperand(E_OPERAND_CONSTANT, i + 512 + 1 + 256);
+		hTargetOperand[i] = cSystem.CreateOperand(E_OPERAND_CONSTANT, i + numWBits + 1 + numHBits);
 		cSystem.constantOperands.push_back(hTargetOperand[i]);
 	}
 	
 	// Let's create our output operands now.
-	std::vector<ROperand> outH(256);
+	std::vector<ROperand> outH(numHBits);
 	
-	for(uint32_t i = 0; i < 256; ++i)
+	cSystem.SetProvenance(numRounds, E_STAGE_FINAL, E_PROVENANCE_OUTPUT);
+	for(uint32_t i = 0; i < numHBits; ++i)
 	{
+		cSystem.provenance.bit = i;
 		outH[i] = cSystem.CreateOperand(E_OPERAND_TEMP, i);
 		outH[i]->sourceOp = cSystem.GetZero();	// to be overwritten by the code below
 	}
@@ -103,34 +111,34 @@ CFormalSha256::CFormalSha256(CCryptosystem &cSystem, uint32_t unknownW /*bits*/,
 			// Prepare for next iteration.
 			for(uint32_t i = 0; i < 8; ++i)
 			{
-				ROperator bits[32];				
-				for(uint32_t j = 0; j < 32; ++j)
+				ROperator bits[WORD_SIZE_BITS_MAX];
+				for(uint32_t j = 0; j < wordBits; ++j)
 				{
 					bits[j] = h[i].GetBit(j);
 				}
-				w[i] = CWord::Gather(cSystem, bits, 32);
+				w[i] = CWord::Gather(cSystem, bits, wordBits);
 				
 				//@w[i] = h[i];				// copy h[0..7] to w[0..7] -- doesn't work, "node creep"
 
 				w[i + 8] = CWord(cSystem, 0);		// zero out w[8..15]
 			}
-			w[8] = CWord(cSystem, 0x80000000u);		// marker bit
-			w[15] = CWord(cSystem, 256);			// message length (always 256 bits -- same as hash output length in bits)
+			w[8] = CWord(cSystem, mpz_class(1) << (wordBits - 1));	// marker bit
+			w[15] = CWord(cSystem, numHBits);			// message length (always 8W bits -- same as hash output length in bits)
 
 			for(uint32_t i = 0; i < 8; ++i)
 			{
-				h[i] = CWord(cSystem, CUtilSha256::GetInitialH(i));
+				h[i] = CWord(cSystem, this->constants.GetInitialH(i));
 			}
 		}
 	}
 	
 	// Discard "don't care" outH[] bits (set to 0). Note: this likely requires taking into account the proper target endian-ness scheme.
-	// That is to say, it can only be considered 'correct' as it presently is, if targetH is a multiple of 32; otherwise we need to do some shuffling here.
-	for(uint32_t i = 0; i < 256; ++i)
+	// That is to say, it can only be considered 'correct' as it presently is, if targetH is a multiple of W; otherwise we need to do some shuffling here.
+	for(uint32_t i = 0; i < numHBits; ++i)
 	{
 		bool discard = (i >= targetH);		// this line is WRONG! TODO, needs to be reworked once target endianness is better understood.
 		
-		outH[i]->sourceOp = (discard) ? cSystem.GetZero() : h[i / 32].GetBit(i & 31);
+		outH[i]->sourceOp = (discard) ? cSystem.GetZero() : h[i / wordBits].GetBit(i % wordBits);
 	}
 	
 	// Accept output operands.
@@ -145,6 +153,8 @@ CFormalSha256::CFormalSha256(CCryptosystem &cSystem, uint32_t unknownW /*bits*/,
 		
 		cSystem.userOutputOperands.push_back(outH[i]);
 	}
+	
+	cSystem.provenance = CProvenance();
 }
 
 // ================================================================================
@@ -154,9 +164,9 @@ CWord CFormalSha256::Sha256Ch(CCryptosystem &cSystem, CWord &e, CWord &f, CWord
 	// 2 * Ch(e, f, g)  = f + g + T(e + g) - T(e + f)
 	// T(x) means (x mod 2)
 	
-	ROperator dest[32];
+	ROperator dest[WORD_SIZE_BITS_MAX];
 
-	for(uint32_t i = 0; i < 32; ++i)
+	for(uint32_t i = 0; i < cSystem.WordSizeBits(); ++i)
 	{
 		ROperator tempFG = cSystem.CreateOperator();
 		tempFG->Add(f.GetBit(i), mpq_class(1, 2));
@@ -172,6 +182,7 @@ CWord CFormalSha256::Sha256Ch(CCryptosystem &cSystem, CWord &e, CWord &f, CWord
 		
 		dest[i] = cSystem.CreateOperator(tempFG);
 		
+		cSystem.provenance.bit = i;
 		ROperand tempEG1 = cSystem.CreateOperand(E_OPERAND_TEMP);
 		tempEG1->sourceOp = tempEG;
 		dest[i]->AddOperand(tempEG1, mpq_class(1, 2));
@@ -181,7 +192,7 @@ CWord CFormalSha256::Sha256Ch(CCryptosystem &cSystem, CWord &e, CWord &f, CWord
 		dest[i]->AddOperand(tempEF1, mpq_class(-1, 2));
 	}
 
-	CWord result = CWord::Gather(cSystem, dest, 32);
+	CWord result = CWord::Gather(cSystem, dest, cSystem.WordSizeBits());
 	
 	return result;
 }
@@ -191,15 +202,16 @@ CWord CFormalSha256::Sha256Maj(CCryptosystem &cSystem, CWord &a, CWord &b, CWord
 	// 2 * Maj(a, b, c) = a + b + c - T(a + b + c)
 	// T(x) means (x mod 2)
 	
-	ROperator dest[32];
+	ROperator dest[WORD_SIZE_BITS_MAX];
 
-	for(uint32_t i = 0; i < 32; ++i)
+	for(uint32_t i = 0; i < cSystem.WordSizeBits(); ++i)
 	{
 		ROperator temp = cSystem.CreateOperator();
 		temp->Add(a.GetBit(i));
 		temp->Add(b.GetBit(i));
 		temp->Add(c.GetBit(i));
 		
+		cSystem.provenance.bit = i;
 		ROperand tempT = cSystem.CreateOperand(E_OPERAND_TEMP);
 		tempT->sourceOp = cSystem.CreateOperator(temp);
 		
@@ -210,7 +222,7 @@ CWord CFormalSha256::Sha256Maj(CCryptosystem &cSystem, CWord &a, CWord &b, CWord
 		dest[i]->Add(c.GetBit(i), mpq_class(1, 2));
 	}
 
-	CWord result = CWord::Gather(cSystem, dest, 32);
+	CWord result = CWord::Gather(cSystem, dest, cSystem.WordSizeBits());
 	
 	return result;
 }
@@ -238,21 +250,26 @@ void CFormalSha256::Sha256Update(CCryptosystem &cSystem, CWord hEntry[8], CWord
 		CWord newH = h[VAR(H)];
 		CWord newD = h[VAR(D)];
 		
-		newH = newH.AddUnary32Bits(h[VAR(E)], CUtilSha256::GetTableHs1(), 32);
+		// Word additions attribute their own temporaries (see CWord::DoScatter()).
+		cSystem.SetProvenance(i, E_STAGE_ROUND, E_PROVENANCE_SIGMA1);
+		newH = newH.AddUnary32Bits(h[VAR(E)], this->constants.GetTableHs1(), cSystem.WordSizeBits());
 		
+		cSystem.SetProvenance(i, E_STAGE_ROUND, E_PROVENANCE_CH);
 		CWord valueCh = Sha256Ch(cSystem, h[VAR(E)], h[VAR(F)], h[VAR(G)]);
 		newH = newH.AddIdentity(valueCh);
 		
 		// H += K[i]
-		newH = newH.AddIdentity(CWord(cSystem, CUtilSha256::GetEntryK(i)));
+		newH = newH.AddIdentity(CWord(cSystem, this->constants.GetEntryK(i)));
 
 		// H += W[i]
 		newH = newH.AddIdentity(w[i]);
 		
 		newD = newD.AddIdentity(newH);
 		
-		newH = newH.AddUnary32Bits(h[VAR(A)], CUtilSha256::GetTableHs0(), 32);
+		cSystem.SetProvenance(i, E_STAGE_ROUND, E_PROVENANCE_SIGMA0);
+		newH = newH.AddUnary32Bits(h[VAR(A)], this->constants.GetTableHs0(), cSystem.WordSizeBits());
 
+		cSystem.SetProvenance(i, E_STAGE_ROUND, E_PROVENANCE_MAJ);
 		CWord valueMaj = Sha256Maj(cSystem, h[VAR(A)], h[VAR(B)], h[VAR(C)]);
 		newH = newH.AddIdentity(valueMaj);
 		
@@ -261,6 +278,7 @@ void CFormalSha256::Sha256Update(CCryptosystem &cSystem, CWord hEntry[8], CWord
 #undef VAR
 	}
 	
+	cSystem.SetProvenance(numRounds, E_STAGE_FINAL, E_PROVENANCE_ADD);
 	for(uint32_t i = 0; i < 8; ++i)
 	{
 		hEntry[i] = hEntry[i].AddIdentity(h[i]);
@@ -276,14 +294,17 @@ void CFormalSha256::ExpandW(CCryptosystem &cSystem, CWord w[64], uint32_t numRou
 	
 	for(uint64_t i = 16; i < numRounds; ++i)
 	{
+		cSystem.SetProvenance(i, E_STAGE_EXPANSION, E_PROVENANCE_ADD);
 		w[i] = w[i - 16].AddIdentity(w[i - 16 + 9]);
 		
 		CWord operandKs0 = w[i - 16 + 1];
 		CWord operandKs1 = w[i - 16 + 14];
 
-		w[i] = w[i].AddUnary32Bits(operandKs0, CUtilSha256::GetTableKs0(), 32);
+		cSystem.SetProvenance(i, E_STAGE_EXPANSION, E_PROVENANCE_EXPAND_SIGMA0);
+		w[i] = w[i].AddUnary32Bits(operandKs0, this->constants.GetTableKs0(), cSystem.WordSizeBits());
 
-		w[i] = w[i].AddUnary32Bits(operandKs1, CUtilSha256::GetTableKs1(), 32);
+		cSystem.SetProvenance(i, E_STAGE_EXPANSION, E_PROVENANCE_EXPAND_SIGMA1);
+		w[i] = w[i].AddUnary32Bits(operandKs1, this->constants.GetTableKs1(), cSystem.WordSizeBits());
 	}
 }
 
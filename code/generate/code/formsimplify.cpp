@@ -0,0 +1,385 @@
+// formsimplify.cpp - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Algebraic simplification of a flattened equation system (see formsimplify.h).
+// ================================================================================
+
+#include "formcrypto.h"
+#include "formsimplify.h"
+
+#include <set>
+
+namespace formal_crypto
+{
+// ================================================================================
+
+// Returns 'src' reduced to [0, 2). This doesn't change the meaning of a coefficient, modulo 2.
+static mpq_class DoReduceMod2(const mpq_class &src)
+{
+	mpz_class modulo = src.get_den() * 2;
+	mpz_class remainder;
+
+	mpz_fdiv_r(remainder.get_mpz_t(), src.get_num().get_mpz_t(), modulo.get_mpz_t());
+
+	mpq_class result(remainder, src.get_den());
+	result.canonicalize();
+
+	return result;
+}
+
+// This is an FNV-1a style hash over a (canonical) definition.
+static uint64_t DoHashRow(RFlattenedOperator row)
+{
+	uint64_t hash = 14695981039346656037uLL;
+
+	for(auto iter = row->childOperands.begin(); iter != row->childOperands.end(); ++iter)
+	{
+		uint64_t words[4] =
+		{
+			iter->first.Get(0),
+			iter->first.Get(1),
+			mpz_get_ui(iter->second.second.get_num_mpz_t()),
+			mpz_get_ui(iter->second.second.get_den_mpz_t())
+		};
+
+		for(uint32_t i = 0; i < 4; ++i)
+		{
+			hash ^= words[i];
+			hash *= 1099511628211uLL;
+		}
+	}
+
+	return hash;
+}
+
+static bool DoRowsEqual(RFlattenedOperator a, RFlattenedOperator b)
+{
+	if(a->childOperands.size() != b->childOperands.size())
+	{
+		return false;
+	}
+
+	for(auto i = a->childOperands.begin(), j = b->childOperands.begin(); i != a->childOperands.end(); ++i, ++j)
+	{
+		if(i->first != j->first || i->second.second != j->second.second)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// ================================================================================
+
+CSystemSimplifier::CSystemSimplifier(CCryptosystem &cSystemT) :
+	cSystem(cSystemT),
+	totalRowsRemoved(0),
+	totalNonzerosRemoved(0)
+{
+}
+
+// Returns true on success, false otherwise.
+bool CSystemSimplifier::PinConstant(int32_t bitIndexLabel, bool value)
+{
+	if(bitIndexLabel <= 0 || bitIndexLabel == this->cSystem.GetUnity()->bitIndexLabel || bitIndexLabel >= (int32_t)this->cSystem.constantOperands.size())
+	{
+		return false;
+	}
+
+	this->pinnedConstants[bitIndexLabel] = value;
+
+	return true;
+}
+
+uint64_t CSystemSimplifier::DoCountNonzeros() const
+{
+	uint64_t count = 0;
+
+	for(uint64_t n = 0; n < this->cSystem.autoTempOperands.size(); ++n)
+	{
+		count += this->cSystem.autoTempOperands[n]->sourceOp->flattenedVersion->childOperands.size();
+	}
+
+	return count;
+}
+
+// Returns true on success, false otherwise.
+bool CSystemSimplifier::Run(std::ostream &os, uint32_t maxIterations /*= 16*/)
+{
+	for(uint64_t n = 0; n < this->cSystem.autoTempOperands.size(); ++n)
+	{
+		if(this->cSystem.autoTempOperands[n] == nullptr || this->cSystem.autoTempOperands[n]->sourceOp == nullptr ||
+			this->cSystem.autoTempOperands[n]->sourceOp->flattenedVersion == nullptr
+		)
+		{
+			os << "\nCSystemSimplifier::Run(): nullptr encountered (has the system been flattened?)" << std::endl;
+
+			return false;
+		}
+	}
+
+	os << "Simplifying equations: " << this->cSystem.autoTempOperands.size() << " row(s), " << this->DoCountNonzeros() << " nonzero(s), ";
+	os << this->pinnedConstants.size() << " pinned constant(s)." << std::endl;
+
+	for(uint32_t iteration = 0; iteration < maxIterations; ++iteration)
+	{
+		uint64_t removedThisIteration = 0;
+
+		for(int passType = 0; passType < E__SIMPLIFY_COUNT; ++passType)
+		{
+			uint64_t rowsRemoved = 0;
+
+			if(this->DoPass(os, passType, rowsRemoved) == false)
+			{
+				return false;
+			}
+
+			removedThisIteration += rowsRemoved;
+		}
+
+		if(removedThisIteration == 0)
+		{
+			break;
+		}
+	}
+
+	os << "Done simplifying: removed " << this->totalRowsRemoved << " row(s) and " << this->totalNonzerosRemoved << " nonzero(s); ";
+	os << this->cSystem.autoTempOperands.size() << " row(s) and " << this->DoCountNonzeros() << " nonzero(s) remain.\n" << std::endl;
+
+	return true;
+}
+
+// Returns true on success, false otherwise.
+bool CSystemSimplifier::DoPass(std::ostream &os, int passType, uint64_t &rowsRemoved)
+{
+	static const char *passNames[E__SIMPLIFY_COUNT] = { "constant folding", "copy propagation", "duplicate elimination" };
+
+	const uint64_t rowsBefore = this->cSystem.autoTempOperands.size();
+	const uint64_t nonzerosBefore = this->DoCountNonzeros();
+
+	std::vector<bool> isOutput(rowsBefore, false);
+	for(uint64_t i = 0; i < this->cSystem.autoTempOperandOutputPositions.size(); ++i)
+	{
+		int64_t pos = this->cSystem.autoTempOperandOutputPositions[i];
+
+		if(pos < 0 || (uint64_t)pos >= rowsBefore)
+		{
+			os << "\nCSystemSimplifier::DoPass(): invalid output position!" << std::endl;
+
+			return false;
+		}
+
+		isOutput[pos] = true;
+	}
+
+	std::vector<CReplacement> replacements(rowsBefore);
+	std::map<uint64_t, std::vector<uint64_t> > buckets;		// hash -> positions of kept definitions with that hash
+	rowsRemoved = 0;
+
+	// Temporaries only refer to temporaries to their left, so by the time we get to a definition, every temporary it
+	// refers to has already been dealt with (and its own definition is final).
+	for(uint64_t n = 0; n < rowsBefore; ++n)
+	{
+		if(this->DoSubstitute(this->cSystem.autoTempOperands[n]->sourceOp->flattenedVersion, n, replacements) == false)
+		{
+			os << "\nCSystemSimplifier::DoPass(): reference to a temporary with an invalid physical position (row " << n << ")!" << std::endl;
+
+			return false;
+		}
+
+		if(isOutput[n] == true)
+		{
+			continue;		// user outputs stay put
+		}
+
+		if(this->DoClassify(passType, n, replacements, buckets) == true)
+		{
+			++rowsRemoved;
+		}
+	}
+
+	this->DoCompact(replacements);
+
+	const uint64_t nonzerosRemoved = nonzerosBefore - this->DoCountNonzeros();
+	this->totalRowsRemoved += rowsRemoved;
+	this->totalNonzerosRemoved += nonzerosRemoved;
+
+	os << "  " << passNames[passType] << ": removed " << rowsRemoved << " row(s) and " << nonzerosRemoved << " nonzero(s); ";
+	os << this->cSystem.autoTempOperands.size() << " row(s) remain." << std::endl;
+
+	return true;
+}
+
+// This substitutes removed temporaries and pinned constants in 'row', which defines temporary 'n', then reduces its
+// coefficients to [0, 2). Returns true on success, false otherwise.
+bool CSystemSimplifier::DoSubstitute(RFlattenedOperator row, uint64_t n, std::vector<CReplacement> &replacements)
+{
+	std::vector<std::pair<ROperand, mpq_class> > additions;
+
+	for(auto iter = row->childOperands.begin(); iter != row->childOperands.end(); )
+	{
+		auto next = iter;
+		++next;
+
+		ROperand oper = iter->second.first;
+
+		if(oper->operandType == E_OPERAND_TEMP)
+		{
+			if(oper->physicalPositionIndex < 0 || (uint64_t)oper->physicalPositionIndex >= n)
+			{
+				return false;
+			}
+
+			CReplacement &replacement = replacements[oper->physicalPositionIndex];
+
+			if(replacement.removed == true)
+			{
+				if(replacement.operand != nullptr)
+				{
+					additions.push_back(std::make_pair(replacement.operand, iter->second.second));
+				}
+				else if(replacement.value == true)
+				{
+					additions.push_back(std::make_pair(this->cSystem.GetUnity(), iter->second.second));
+				}
+
+				row->EraseOperand(iter);
+			}
+		}
+		else if(oper->operandType == E_OPERAND_CONSTANT && oper->uid != this->cSystem.GetUnity()->uid)
+		{
+			auto pin = this->pinnedConstants.find(oper->bitIndexLabel);
+
+			if(pin != this->pinnedConstants.end())
+			{
+				if(pin->second == true)
+				{
+					additions.push_back(std::make_pair(this->cSystem.GetUnity(), iter->second.second));
+				}
+
+				row->EraseOperand(iter);
+			}
+		}
+
+		iter = next;
+	}
+
+	for(uint64_t i = 0; i < additions.size(); ++i)
+	{
+		row->AddOperand(additions[i].first, additions[i].second, true);
+	}
+
+	for(auto iter = row->childOperands.begin(); iter != row->childOperands.end(); )
+	{
+		auto next = iter;
+		++next;
+
+		iter->second.second = DoReduceMod2(iter->second.second);
+
+		if(iter->second.second == 0)
+		{
+			row->EraseOperand(iter);
+		}
+
+		iter = next;
+	}
+
+	return true;
+}
+
+// Returns true if temporary 'n' is to be removed (in which case its replacement has been recorded).
+bool CSystemSimplifier::DoClassify(int passType, uint64_t n, std::vector<CReplacement> &replacements, std::map<uint64_t, std::vector<uint64_t> > &buckets)
+{
+	RFlattenedOperator row = this->cSystem.autoTempOperands[n]->sourceOp->flattenedVersion;
+	CReplacement &replacement = replacements[n];
+
+	if(passType == E_SIMPLIFY_FOLD_CONSTANTS)
+	{
+		if(row->childOperands.empty() == true)
+		{
+			replacement.removed = true;
+			replacement.value = false;
+		}
+		else if(row->childOperands.size() == 1 && row->childOperands.begin()->first == this->cSystem.GetUnity()->uid &&
+			row->childOperands.begin()->second.second.get_den() == 1
+		)
+		{
+			replacement.removed = true;
+			replacement.value = (row->childOperands.begin()->second.second.get_num() % 2) != 0;
+		}
+	}
+	else if(passType == E_SIMPLIFY_PROPAGATE_COPIES)
+	{
+		// After reduction, an integral coefficient can only be 1 here.
+		if(row->childOperands.size() == 1 && row->childOperands.begin()->second.second.get_den() == 1)
+		{
+			replacement.removed = true;
+			replacement.operand = row->childOperands.begin()->second.first;
+		}
+	}
+	else if(passType == E_SIMPLIFY_ELIMINATE_DUPLICATES)
+	{
+		std::vector<uint64_t> &bucket = buckets[DoHashRow(row)];
+
+		for(uint64_t i = 0; i < bucket.size(); ++i)
+		{
+			if(DoRowsEqual(row, this->cSystem.autoTempOperands[bucket[i]]->sourceOp->flattenedVersion) == true)
+			{
+				replacement.removed = true;
+				replacement.operand = this->cSystem.autoTempOperands[bucket[i]];
+
+				return true;
+			}
+		}
+
+		bucket.push_back(n);
+	}
+
+	return replacement.removed;
+}
+
+// This drops removed temporaries and renumbers the remaining ones.
+void CSystemSimplifier::DoCompact(std::vector<CReplacement> &replacements)
+{
+	std::vector<ROperand> kept;
+	std::set<CFlattenedOperator *> keptRows;
+
+	for(uint64_t n = 0; n < replacements.size(); ++n)
+	{
+		if(replacements[n].removed == false)
+		{
+			kept.push_back(this->cSystem.autoTempOperands[n]);
+			keptRows.insert(this->cSystem.autoTempOperands[n]->sourceOp->flattenedVersion.get());
+		}
+	}
+
+	for(uint64_t n = 0; n < replacements.size(); ++n)
+	{
+		if(replacements[n].removed == true)
+		{
+			ROperand oper = this->cSystem.autoTempOperands[n];
+
+			oper->physicalPositionIndex = -1LL;
+
+			// reclaim memory, unless the definition is shared with a temporary we're keeping.
+			if(keptRows.find(oper->sourceOp->flattenedVersion.get()) == keptRows.end())
+			{
+				oper->sourceOp->flattenedVersion = nullptr;
+			}
+		}
+	}
+
+	for(uint64_t n = 0; n < kept.size(); ++n)
+	{
+		kept[n]->physicalPositionIndex = n;
+	}
+
+	this->cSystem.autoTempOperands.swap(kept);
+
+	for(uint64_t i = 0; i < this->cSystem.userOutputOperands.size(); ++i)
+	{
+		this->cSystem.autoTempOperandOutputPositions[i] = this->cSystem.userOutputOperands[i]->physicalPositionIndex;
+	}
+}
+
+}	// namespace formal_crypto
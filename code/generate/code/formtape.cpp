@@ -0,0 +1,325 @@
+// formtape.cpp - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Compiled (bit-parallel) evaluation of a formal cryptosystem (see formtape.h).
+// ================================================================================
+
+#include "formcrypto.h"
+#include "formtape.h"
+
+#include <algorithm>
+
+namespace formal_crypto
+{
+// ================================================================================
+
+typedef std::map<uint32_t, mpq_class> CTapeForm;		// slot -> coefficient
+
+// This puts the temporaries 'node' depends on into 'order' (dependencies first), assigning each its slot. 'uses'
+// counts the references to each operator (from other operators, and from temporaries it's the source of).
+static void DoOrder(COperator *node, std::map<COperator *, uint64_t> &uses, std::map<COperand *, uint32_t> &slots, std::vector<ROperand> &order, uint32_t firstTempSlot)
+{
+	if(uses[node]++ != 0)
+	{
+		return;		// already visited
+	}
+
+	for(auto i = node->childOperators.begin(); i != node->childOperators.end(); ++i)
+	{
+		DoOrder(i->second.first.get(), uses, slots, order, firstTempSlot);
+	}
+
+	for(auto i = node->childOperands.begin(); i != node->childOperands.end(); ++i)
+	{
+		ROperand oper = i->second.first;
+
+		if(oper->sourceOp != nullptr && slots.find(oper.get()) == slots.end())
+		{
+			DoOrder(oper->sourceOp.get(), uses, slots, order, firstTempSlot);
+
+			slots[oper.get()] = firstTempSlot + order.size();
+			order.push_back(oper);
+		}
+	}
+}
+
+// This releases the expansion of 'node' once its last user is done with it.
+static void DoRelease(COperator *node, std::map<COperator *, CTapeForm> &memo, std::map<COperator *, uint64_t> &uses)
+{
+	if(--uses[node] == 0)
+	{
+		memo.erase(node);
+	}
+}
+
+// This expands 'node' down to operands. Expansions are kept in 'memo' until all of their users are done (see
+// DoRelease()), since e.g. a word computed from other words is shared by many temporaries.
+static const CTapeForm &DoExpand(COperator *node, std::map<COperator *, CTapeForm> &memo, std::map<COperator *, uint64_t> &uses,
+	std::map<COperand *, uint32_t> &slots, uint32_t numConstants, uint32_t numInputs)
+{
+	auto found = memo.find(node);
+
+	if(found != memo.end())
+	{
+		return found->second;
+	}
+
+	CTapeForm form;
+
+	for(auto i = node->childOperators.begin(); i != node->childOperators.end(); ++i)
+	{
+		const CTapeForm &sub = DoExpand(i->second.first.get(), memo, uses, slots, numConstants, numInputs);
+
+		for(auto j = sub.begin(); j != sub.end(); ++j)
+		{
+			form[j->first] += j->second * i->second.second;
+		}
+
+		DoRelease(i->second.first.get(), memo, uses);
+	}
+
+	for(auto i = node->childOperands.begin(); i != node->childOperands.end(); ++i)
+	{
+		ROperand oper = i->second.first;
+		uint32_t slot = 0;
+
+		if(oper->sourceOp != nullptr)
+		{
+			auto s = slots.find(oper.get());
+
+			if(s == slots.end())
+			{
+				throw std::runtime_error("CComputeTape::Compile(): temporary used before being defined.");
+			}
+
+			slot = s->second;
+		}
+		else if(oper->operandType == E_OPERAND_INPUT)
+		{
+			if(oper->bitIndexLabel < 0 || (uint32_t)oper->bitIndexLabel >= numInputs)
+			{
+				throw std::runtime_error("CComputeTape::Compile(): input operand with an invalid label.");
+			}
+
+			slot = numConstants + oper->bitIndexLabel;
+		}
+		else if(oper->operandType == E_OPERAND_CONSTANT)
+		{
+			if(oper->bitIndexLabel < 0 || (uint32_t)oper->bitIndexLabel >= numConstants)
+			{
+				throw std::runtime_error("CComputeTape::Compile(): constant operand with an invalid label.");
+			}
+
+			slot = oper->bitIndexLabel;
+		}
+		else
+		{
+			throw std::runtime_error("CComputeTape::Compile(): temporary without a source operator.");
+		}
+
+		form[slot] += i->second.second;
+	}
+
+	for(auto i = form.begin(); i != form.end(); )
+	{
+		auto next = i;
+		++next;
+
+		i->second.canonicalize();
+
+		if(i->second == 0)
+		{
+			form.erase(i);
+		}
+
+		i = next;
+	}
+
+	CTapeForm &result = memo[node];
+	result.swap(form);
+
+	return result;
+}
+
+// ================================================================================
+
+CComputeTape::CComputeTape() :
+	numConstants(0),
+	numInputs(0)
+{
+}
+
+// Returns true on success, false otherwise.
+bool CComputeTape::Compile(CCryptosystem &cSystem, std::ostream &os)
+{
+	this->numConstants = cSystem.constantOperands.size();
+	this->numInputs = cSystem.inputOperands.size();
+	this->terms.clear();
+	this->instructions.clear();
+	this->outputSlots.clear();
+
+	const uint32_t firstTempSlot = this->numConstants + this->numInputs;
+
+	std::map<COperator *, uint64_t> uses;
+	std::map<COperator *, CTapeForm> memo;
+	std::map<COperand *, uint32_t> slots;
+	std::vector<ROperand> order;
+
+	try
+	{
+		for(uint64_t n = 0; n < cSystem.userOutputOperands.size(); ++n)
+		{
+			ROperand oper = cSystem.userOutputOperands[n];
+
+			if(oper->sourceOp == nullptr)
+			{
+				throw std::runtime_error("CComputeTape::Compile(): unspecified source operator.");
+			}
+
+			if(slots.find(oper.get()) == slots.end())
+			{
+				DoOrder(oper->sourceOp.get(), uses, slots, order, firstTempSlot);
+
+				slots[oper.get()] = firstTempSlot + order.size();
+				order.push_back(oper);
+			}
+
+			this->outputSlots.push_back(slots[oper.get()]);
+		}
+
+		for(uint64_t n = 0; n < order.size(); ++n)
+		{
+			const CTapeForm &form = DoExpand(order[n]->sourceOp.get(), memo, uses, slots, this->numConstants, this->numInputs);
+
+			// Find 's', i.e. the exponent of our largest denominator.
+			uint32_t shift = 0;
+
+			for(auto i = form.begin(); i != form.end(); ++i)
+			{
+				const mpz_class &den = i->second.get_den();
+
+				if(mpz_popcount(den.get_mpz_t()) != 1)
+				{
+					throw std::runtime_error("CComputeTape::Compile(): coefficient denominator isn't a power of 2.");
+				}
+
+				uint32_t bits = mpz_sizeinbase(den.get_mpz_t(), 2) - 1;
+
+				if(bits > shift)
+				{
+					shift = bits;
+				}
+			}
+
+			if(shift >= 63)
+			{
+				throw std::runtime_error("CComputeTape::Compile(): coefficient denominator too large.");
+			}
+
+			CInstruction instruction;
+			instruction.firstTerm = this->terms.size();
+			instruction.numTerms = 0;
+			instruction.shift = shift;
+
+			const mpz_class modulo = mpz_class(1) << (shift + 1);
+
+			for(auto i = form.begin(); i != form.end(); ++i)
+			{
+				mpz_class scaled = i->second.get_num() * (modulo / 2) / i->second.get_den();
+				mpz_class reduced;
+
+				mpz_fdiv_r(reduced.get_mpz_t(), scaled.get_mpz_t(), modulo.get_mpz_t());
+
+				if(reduced == 0)
+				{
+					continue;
+				}
+
+				CTerm term;
+				term.coefficient = mpz_get_ui(reduced.get_mpz_t());
+				term.source = i->first;
+				this->terms.push_back(term);
+				++instruction.numTerms;
+			}
+
+			this->instructions.push_back(instruction);
+
+			DoRelease(order[n]->sourceOp.get(), memo, uses);
+		}
+	}
+	catch(std::runtime_error &e)
+	{
+		os << "\n" << e.what() << std::endl;
+
+		return false;
+	}
+
+	os << "Compiled evaluation tape: " << this->instructions.size() << " instruction(s), " << this->terms.size() << " term(s)." << std::endl;
+
+	return true;
+}
+
+// Returns true on success, false otherwise.
+bool CComputeTape::Evaluate(const std::vector<uint64_t> &inputLanes, const std::vector<uint64_t> &constantLanes, std::vector<uint64_t> &outputLanes) const
+{
+	if(inputLanes.size() != this->numInputs || constantLanes.size() != this->numConstants)
+	{
+		return false;
+	}
+
+	std::vector<uint64_t> slots(this->numConstants + this->numInputs + this->instructions.size(), 0);
+
+	std::copy(constantLanes.begin(), constantLanes.end(), slots.begin());
+	std::copy(inputLanes.begin(), inputLanes.end(), slots.begin() + this->numConstants);
+
+	uint64_t *dest = &slots[this->numConstants + this->numInputs];
+	uint64_t acc[64];
+
+	for(uint64_t n = 0; n < this->instructions.size(); ++n)
+	{
+		const CInstruction &instruction = this->instructions[n];
+		const CTerm *term = &this->terms[instruction.firstTerm];
+		const uint32_t shift = instruction.shift;
+
+		for(uint32_t p = 0; p <= shift; ++p)
+		{
+			acc[p] = 0;
+		}
+
+		for(uint32_t i = 0; i < instruction.numTerms; ++i, ++term)
+		{
+			const uint64_t lanes = slots[term->source];
+
+			if(lanes == 0)
+			{
+				continue;
+			}
+
+			// Add 'coefficient' into the accumulator of each lane that has this operand set, one bit at a time
+			// (ripple carry; bits above 'shift' are discarded since we're modulo 2^(shift+1)).
+			for(uint64_t c = term->coefficient; c != 0; c &= c - 1)
+			{
+				uint64_t carry = lanes;
+
+				for(uint32_t p = __builtin_ctzll(c); p <= shift && carry != 0; ++p)
+				{
+					uint64_t next = acc[p] & carry;
+					acc[p] ^= carry;
+					carry = next;
+				}
+			}
+		}
+
+		dest[n] = acc[shift];
+	}
+
+	outputLanes.resize(this->outputSlots.size());
+
+	for(uint64_t n = 0; n < this->outputSlots.size(); ++n)
+	{
+		outputLanes[n] = slots[this->outputSlots[n]];
+	}
+
+	return true;
+}
+
+}	// namespace formal_crypto
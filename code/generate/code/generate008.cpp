@@ -10,34 +10,515 @@
 //    sudo apt-get install libgmp-dev libgmpxx4ldbl
 //
 // To build:
-// g++ -I./h -std=c++11 -o generate008.out generate008.cpp formcrypto.cpp formsha256.cpp -lgmp -lgmpxx -O2
+// g++ -I./h -std=c++11 -o generate008.out generate008.cpp formcrypto.cpp formsha256.cpp formsimplify.cpp formtape.cpp formprofile.cpp formproblem.cpp formpipeline.cpp utilsha256.cpp -lgmp -lgmpxx -O2 -pthread
+//
+// Usage:
+// ./generate008.out [-w <word size bits>] [-r <rounds>] [-simplify] [-fold-iv] [-fold-padding] [-selfcheck <passes>] [-profile] [-provenance]
+//                   [-fused [-tap-bin] [-tap-dat] [-compress-model]] [-cache | -no-cache]
+//
+// -w selects the word size of the SHA-256 analogue to formalize (8..32, default 32; see CUtilScaledSha256).
+// -r selects the number of rounds (1..64, default 64). Something like '-w 8 -r 8' produces a complete
+//    problem in seconds, which is handy for exercising convert/check2/compute1 end-to-end.
+// -simplify runs CSystemSimplifier (see formsimplify.h) between flattening and finalizing. The result is
+//    equivalent to the unsimplified system for any constant values.
+// -fold-iv and -fold-padding (both imply -simplify) additionally pin the initial H bits, respectively the
+//    message words from the marker word onward, to the values used below. The resulting problem is then
+//    only good for messages sharing those values (compute1's sample input has a different length!)
+// -selfcheck compiles the formal representation into a CComputeTape (see formtape.h) and runs that many passes
+//    of 64 random messages each through it, comparing against the reference implementation (and, for the
+//    first message of each pass, against CCryptosystem::Compute()) before anything is written.
+// -profile counts live objects and bytes per category (see formprofile.h) and takes a snapshot after construction,
+//    flattening, simplification and each 10% of finalization. The snapshots and the peak RSS are written to
+//    problem256x2-68.bin.profile.json.
+// -provenance records the size and Finalize time of each equation along with where its temporary came from (round,
+//    operation and bit; see CProvenance in formprofile.h). The rows are written to problem256x2-68.bin.provenance.txt
+//    and a breakdown by operation is printed.
+// -fused runs convert and check2 in this process as the equations are finalized (see formpipeline.h), producing the
+//    model (sha2_256_out.txt) without writing problem256x2-68.bin or problem.dat. -tap-bin and -tap-dat still write
+//    those files; -compress-model writes the model as sha2_256_out.blk (as 'check2.out -compress' would).
+// -cache makes a run whose parameters match an earlier one's take that run's files out of the artifact cache (see
+//    artifactcache.h) instead of generating them, and puts the files it does generate in the cache. It's also on if
+//    FORMAL_CRYPTO_CACHE is set; -no-cache turns it off even so. -selfcheck, -profile and -provenance imply -no-cache.
+//
+// Every data file written also gets a Merkle tree of its rows, "<file>.merkle" (see merkletree.h), which the tools
+// that read the file check it against.
 // ---------------------------------------------------------------------------------
 // Formal representation for SHA-256 (applied twice, presently with 68 target bits).
 // =================================================================================
 
+#include "artifactcache.h"
 #include "formcrypto.h"
+#include "formpipeline.h"
 #include "formsha256.h"
+#include "formsimplify.h"
+#include "formtape.h"
+#include "merkletree.h"
 
 #include <iostream>
 #include <fstream>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+
+using namespace formal_crypto;
+
+// This records a memory profile snapshot at each of the cryptosystem's phase boundaries and, if 'provenance' isn't
+// nullptr, the cost of each equation.
+class CProfileObserver :
+	public CCryptosystemObserver
+{
+public:
+	CProvenanceProfile *provenance;
+	
+	CProfileObserver() :
+		provenance(nullptr)
+	{
+	}
+	
+	virtual void OnPhase(const std::string &phase)
+	{
+		CMemoryProfile::Snapshot(phase);
+	}
+	
+	virtual void OnFinalizeRow(const COperand &temp, uint64_t nonzeros, double seconds)
+	{
+		if(this->provenance != nullptr)
+		{
+			this->provenance->Add(temp.physicalPositionIndex, temp.provenance, nonzeros, seconds);
+		}
+	}
+};
+
+// This runs 'numPasses' batches of CComputeTape::LANES random messages through 'tape' and checks the results
+// against 'reference' (and the first message of each batch against CCryptosystem::Compute()). 'constantValues'
+// provides everything but the message bits. The first 'unknownBits' message bits are inputs, the rest constants.
+// Returns true on success, false otherwise.
+static bool DoTapeSelfCheck(CCryptosystem &cSystem, const CComputeTape &tape, const CUtilScaledSha256 &reference, uint32_t numRounds,
+	uint32_t unknownBits, const std::vector<bool> &constantValues, uint32_t numPasses)
+{
+	const uint32_t wordBits = reference.WordSizeBits();
+	const uint32_t numWBits = 16 * wordBits;
+	const uint32_t numHBits = 8 * wordBits;
+	uint32_t seed = 0x2017u;
+	double tapeSeconds = 0.0;
+	double computeSeconds = 0.0;
+	
+	std::vector<uint64_t> inputLanes(cSystem.inputOperands.size(), 0);
+	std::vector<uint64_t> constantLanes(constantValues.size(), 0);
+	std::vector<uint64_t> outputLanes;
+	
+	for(uint32_t pass = 0; pass < numPasses; ++pass)
+	{
+		uint32_t w[CComputeTape::LANES][16];
+		
+		for(uint64_t n = 0; n < constantValues.size(); ++n)
+		{
+			constantLanes[n] = (constantValues[n] == true) ? ~0uLL : 0uLL;
+		}
+		for(uint32_t lane = 0; lane < CComputeTape::LANES; ++lane)
+		{
+			for(uint32_t i = 0; i < 16; ++i)
+			{
+				seed = seed * 1103515245u + 12345u;
+				w[lane][i] = (seed ^ (seed >> 16)) & reference.GetMask();
+			}
+		}
+		for(uint32_t n = 0; n < numWBits; ++n)
+		{
+			uint64_t lanes = 0;
+			
+			for(uint32_t lane = 0; lane < CComputeTape::LANES; ++lane)
+			{
+				lanes |= (uint64_t)((w[lane][n / wordBits] >> (n % wordBits)) & 1u) << lane;
+			}
+			
+			if(n < unknownBits)
+			{
+				inputLanes[n] = lanes;
+				constantLanes[n + 1] = 0;
+			}
+			else
+			{
+				constantLanes[n + 1] = lanes;		// constant bit 0 is reserved for unity
+			}
+		}
+		
+		std::clock_t start = std::clock();
+		
+		if(tape.Evaluate(inputLanes, constantLanes, outputLanes) == false)
+		{
+			std::cout << "Tape evaluation failure" << std::endl;
+			return false;
+		}
+		
+		tapeSeconds += (double)(std::clock() - start) / CLOCKS_PER_SEC;
+		
+		for(uint32_t lane = 0; lane < CComputeTape::LANES; ++lane)
+		{
+			uint32_t h[8];
+			
+			for(uint32_t i = 0; i < 8; ++i)
+			{
+				h[i] = reference.GetInitialH(i);
+			}
+			reference.CompSha256(h, w[lane], numRounds);
+			
+			for(uint32_t i = 0; i < numHBits; ++i)
+			{
+				if(((outputLanes[i] >> lane) & 1u) != ((h[i / wordBits] >> (i % wordBits)) & 1u))
+				{
+					std::cout << "Tape mismatch with reference implementation: pass " << pass << ", lane " << lane << ", output bit " << i << std::endl;
+					return false;
+				}
+			}
+		}
+		
+		// Compute() is much slower, so only the first lane is checked against it.
+		std::vector<bool> inputValues(inputLanes.size());
+		std::vector<bool> laneConstants(constantLanes.size());
+		std::vector<bool> outputValues(cSystem.userOutputOperands.size(), 0);
+		
+		for(uint64_t n = 0; n < inputLanes.size(); ++n)
+		{
+			inputValues[n] = (inputLanes[n] & 1u) != 0;
+		}
+		for(uint64_t n = 0; n < constantLanes.size(); ++n)
+		{
+			laneConstants[n] = (constantLanes[n] & 1u) != 0;
+		}
+		
+		start = std::clock();
+		
+		if(cSystem.Compute(inputValues, laneConstants, outputValues) == false)
+		{
+			std::cout << "Compute failure" << std::endl;
+			return false;
+		}
+		
+		computeSeconds += (double)(std::clock() - start) / CLOCKS_PER_SEC;
+		
+		for(uint64_t n = 0; n < outputValues.size(); ++n)
+		{
+			if((bool)(outputLanes[n] & 1u) != outputValues[n])
+			{
+				std::cout << "Tape mismatch with Compute(): pass " << pass << ", output " << n << std::endl;
+				return false;
+			}
+		}
+	}
+	
+	std::cout << "Tape self-check passed: " << (numPasses * CComputeTape::LANES) << " message(s) in " << tapeSeconds << "s (Compute() took ";
+	std::cout << computeSeconds << "s for " << numPasses << " message(s))." << std::endl;
+	
+	return true;
+}
+
+// This writes the start of problem256x2-68.bin, up to the equations (see CBinaryEquationSink). Returns the offset of
+// the 'equatns ' atom, whose size DoWriteProblemTrailer() fills in.
+static uint64_t DoWriteProblemHeader(FILE *fo, const std::vector<bool> &savedInputValues, const std::vector<bool> &savedConstantValues)
+{
+	uint64_t x = 0;
+	
+	// reserve space for total file size
+	x = 0;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	// write first magic signature, "sha256x2". this represents SHA-256 applied twice.
+	memcpy(&x, "sha256x2", 8);		// this is for human consumption only and can be changed without notice
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	// number of actual unknown input bits (64) and the number of known target equations (68).
+	memcpy(&x, "-64equ68", 8);		// this is the human-readable description and might be wrong (i.e. we could be mislabeled)
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	// let's write a second, definitive machine-readable version of the number of unknown bits.
+	x = savedInputValues.size();
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	// let's write out the constant vector next.
+	x = 8 + 8 + savedConstantValues.size() * 8;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	memcpy(&x, "constant", 8);
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	for(uint64_t i = 0; i < savedConstantValues.size(); ++i)
+	{
+		x = savedConstantValues[i];
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+	}
+	
+	uint64_t equatnsPos = ftell(fo);
+	x = 0;
+	fwrite(&x, sizeof(uint64_t), 1, fo);	// placeholder for 'equatns ' size
+	memcpy(&x, "equatns ", 8);
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	
+	return equatnsPos;
+}
 
-int main()
+// This finishes problem256x2-68.bin once the equations have been written.
+static void DoWriteProblemTrailer(FILE *fo, uint64_t equatnsPos, const std::vector<uint64_t> &equationOffsets)
+{
+	uint64_t x = 0;
+	
+	x = ftell(fo) - equatnsPos;
+	fseek(fo, equatnsPos, SEEK_SET);
+	fwrite(&x, sizeof(uint64_t), 1, fo);	// overwrite 'equatns ' size
+	fseek(fo, 0, SEEK_END);
+	
+	// write the 'eqindex ' atom: the file offset of every EQUATION_INDEX_STRIDE'th equation (in file order), so
+	// readers can split the equations between threads without parsing them first (see CProblemReader).
+	enum { EQUATION_INDEX_STRIDE = 16 };
+	const uint64_t numIndexEntries = (equationOffsets.size() + EQUATION_INDEX_STRIDE - 1) / EQUATION_INDEX_STRIDE;
+	x = 8 + 8 + 8 + 8 + numIndexEntries * 8;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	memcpy(&x, "eqindex ", 8);
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	x = EQUATION_INDEX_STRIDE;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	x = numIndexEntries;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+	for(uint64_t i = 0; i < equationOffsets.size(); i += EQUATION_INDEX_STRIDE)
+	{
+		x = equationOffsets[i];
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+	}
+	
+	uint64_t y = ftell(fo);
+
+	// overwrite total file size
+	rewind(fo);
+	x = y;
+	fwrite(&x, sizeof(uint64_t), 1, fo);
+}
+
+// This writes the Merkle tree of a file written here (see merkletree.h). For problem256x2-68.bin, each equation is a
+// segment, with the header before the first one and the trailer from 'trailerPos' on. Returns true if successful,
+// false otherwise.
+static bool DoWriteMerkleTree(const char *fn, const std::vector<uint64_t> &equationOffsets, uint64_t trailerPos)
+{
+	CMerkleTree tree;
+	
+	for(uint64_t i = 0; i < equationOffsets.size(); ++i)
+	{
+		tree.Mark(equationOffsets[i], 1);
+	}
+	
+	if(equationOffsets.empty() == false)
+	{
+		tree.Mark(trailerPos, 0);
+	}
+	
+	if(tree.Build(fn, 0) == false || tree.Write(fn) == false)
+	{
+		return false;
+	}
+	
+	std::cout << "Merkle root of " << fn << ": " << tree.GetRootHex() << std::endl;
+	
+	return true;
+}
+
+int main(int argc, char *argv[])
 {
 	bool fullProblem = false;
-	using namespace formal_crypto;
 
+	uint32_t wordBits = 32;
+	uint32_t numRounds = 64;		/*examples: 8, 16, or 24*/
+	bool simplify = false;
+	bool foldIV = false;
+	bool foldPadding = false;
+	uint32_t selfCheckPasses = 0;
+	bool profile = false;
+	bool provenance = false;
+	bool fused = false;
+	bool tapBin = false;
+	bool tapDat = false;
+	bool compressModel = false;
+	bool useCache = false;
+	bool noCache = false;
+	
+	for(int i = 1; i < argc; ++i)
+	{
+		if(std::strcmp(argv[i], "-profile") == 0)
+		{
+			profile = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-provenance") == 0)
+		{
+			provenance = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-selfcheck") == 0 && i + 1 < argc)
+		{
+			selfCheckPasses = std::strtoul(argv[++i], nullptr, 0);
+		}
+		else
+		if(std::strcmp(argv[i], "-simplify") == 0)
+		{
+			simplify = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-fold-iv") == 0)
+		{
+			simplify = foldIV = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-fold-padding") == 0)
+		{
+			simplify = foldPadding = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+		{
+			wordBits = std::strtoul(argv[++i], nullptr, 0);
+		}
+		else
+		if(std::strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+		{
+			numRounds = std::strtoul(argv[++i], nullptr, 0);
+		}
+		else
+		if(std::strcmp(argv[i], "-fused") == 0)
+		{
+			fused = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-tap-bin") == 0)
+		{
+			tapBin = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-tap-dat") == 0)
+		{
+			tapDat = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-compress-model") == 0)
+		{
+			compressModel = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-cache") == 0)
+		{
+			useCache = true;
+		}
+		else
+		if(std::strcmp(argv[i], "-no-cache") == 0)
+		{
+			noCache = true;
+		}
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [-w <word size bits>] [-r <rounds>] [-simplify] [-fold-iv] [-fold-padding] [-selfcheck <passes>] [-profile] [-provenance]" <<
+				" [-fused [-tap-bin] [-tap-dat] [-compress-model]] [-cache | -no-cache]" << std::endl;
+			return 1;
+		}
+	}
+	if(numRounds == 0 || numRounds > 64)
+	{
+		std::cout << "Invalid number of rounds: " << numRounds << std::endl;
+		return 1;
+	}
+	if(fused == false && (tapBin == true || tapDat == true || compressModel == true))
+	{
+		std::cout << "-tap-bin, -tap-dat and -compress-model go with -fused." << std::endl;
+		return 1;
+	}
+	
+	// These select the problem (see CFormalSha256).
+	enum { UNKNOWN_W_BIT_COUNT = 0, APPLY_COUNT = 1 };
+	const uint32_t TARGET_H_BIT_COUNT = 8 * wordBits;		// all of H
+	
+	// The artifact cache key covers everything above that changes what's written. Diagnostic runs are never served
+	// from the cache (nor stored in it), since their point is to run.
+	CArtifactCache cache(useCache);
+	std::ostringstream cacheDescription;
+	std::vector<std::string> cacheNames;
+	
+	cache.enabled = cache.enabled && (noCache == false && selfCheckPasses == 0 && profile == false && provenance == false);
+	
+	cacheDescription << "generate008 -w " << wordBits << " -r " << numRounds << " unknown-w " << UNKNOWN_W_BIT_COUNT <<
+		" target-h " << TARGET_H_BIT_COUNT << " apply " << APPLY_COUNT << (simplify ? " -simplify" : "") <<
+		(foldIV ? " -fold-iv" : "") << (foldPadding ? " -fold-padding" : "");
+	cacheNames.push_back("solution256x2-68.bin");
+	
+	if(fused == false || tapBin == true)
+	{
+		cacheNames.push_back("problem256x2-68.bin");
+	}
+	
+	if(fused == true)
+	{
+		cacheDescription << " -fused" << (tapBin ? " -tap-bin" : "") << (tapDat ? " -tap-dat" : "") << (compressModel ? " -compress-model" : "");
+		
+		if(tapDat == true)
+		{
+			cacheNames.push_back("problem.dat");
+		}
+		
+		cacheNames.push_back(compressModel ? "sha2_256_out.blk" : "sha2_256_out.txt");
+	}
+	
+	const std::string cacheKey = cache.MakeKey(cacheDescription.str(), std::vector<std::string>());
+	
+	if(cache.Fetch(cacheKey, cacheNames, std::cout) == true)
+	{
+		return 0;
+	}
+	
+	// Profiling has to start before any GMP number or formal object is created (see formprofile.h).
+	CProfileObserver profileObserver;
+	CProvenanceProfile provenanceProfile;
+	if(profile == true)
+	{
+		CMemoryProfile::InstallGmpHooks();
+		CMemoryProfile::Enable();
+	}
+	
 	/* This works.
 	CUtilSha256::SelfTest(std::cout);
 	*/
 	
-	CCryptosystem cSystem;
-	enum { UNKNOWN_W_BIT_COUNT = 0 };
-	enum { TARGET_H_BIT_COUNT = 256 };
-	CFormalSha256 cSha256(cSystem, UNKNOWN_W_BIT_COUNT, TARGET_H_BIT_COUNT, 1, 64 /*examples: 8, 16, or 24*/);
+	std::shared_ptr<CUtilScaledSha256> reference;
+	try
+	{
+		reference = std::make_shared<CUtilScaledSha256>(wordBits);
+	}
+	catch(std::runtime_error &e)
+	{
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+	if(wordBits != 32 && CUtilScaledSha256::SelfTest(std::cout) == false)
+	{
+		return 1;
+	}
+	
+	CCryptosystem cSystem(wordBits);
+	const uint32_t numWBits = 16 * wordBits;	// 512 for SHA-256
+	const uint32_t numHBits = 8 * wordBits;		// 256 for SHA-256
+	const uint32_t wordMask = reference->GetMask();
+	CFormalSha256 cSha256(cSystem, UNKNOWN_W_BIT_COUNT, TARGET_H_BIT_COUNT, APPLY_COUNT, numRounds);
+	
+	if(profile == true)
+	{
+		cSystem.observer = &profileObserver;
+		profileObserver.OnPhase("construction");
+	}
+	if(provenance == true)
+	{
+		cSystem.observer = &profileObserver;
+		profileObserver.provenance = &provenanceProfile;
+	}
 
 	std::vector<bool> savedInputValues;
 	std::vector<bool> savedConstantValues;
+	uint32_t paddingFirstWord = 16;		// index of the message word with the marker bit (see below)
 	
 	if(true)
 	{
@@ -55,6 +536,7 @@ int main()
 			wSecret[1] = 0x80000000u;						// marker bit
 			wSecret[14] = 0;							// message length in bits (high part)
 			wSecret[15] = (4 * 8);							// message length in bits (low part)
+			paddingFirstWord = 1;
 		}
 		else
 		{
@@ -63,11 +545,18 @@ int main()
 			wSecret[2] = 0x80000000u;						// marker bit
 			wSecret[14] = 0;							// message length in bits (high part)
 			wSecret[15] = 64;							// message length in bits (low part)
+			paddingFirstWord = 2;
+		}
+
+		// With a smaller word size, each message word is simply truncated to its low bits.
+		for(uint32_t i = 0; i < 16; ++i)
+		{
+			wSecret[i] &= wordMask;
 		}
 
-		for(uint32_t n = 0; n < 512; ++n)
+		for(uint32_t n = 0; n < numWBits; ++n)
 		{
-			bool value = ((wSecret[n / 32] >> (n & 31)) & 1u);
+			bool value = ((wSecret[n / wordBits] >> (n % wordBits)) & 1u);
 		
 			if(n < UNKNOWN_W_BIT_COUNT)
 			{
@@ -80,11 +569,11 @@ int main()
 		}
 		
 		// For now, let's use the default initial value for h[].
-		for(uint32_t n = 0; n < 256; ++n)
+		for(uint32_t n = 0; n < numHBits; ++n)
 		{
-			bool value = ((CUtilSha256::GetInitialH(n / 32) >> (n & 31)) & 1u);
+			bool value = ((reference->GetInitialH(n / wordBits) >> (n % wordBits)) & 1u);
 			
-			constantValues[513 + n] = value;
+			constantValues[numWBits + 1 + n] = value;
 		}
 		
 		// Let's set our expected output values.
@@ -92,15 +581,15 @@ int main()
 		uint32_t expectedOutputHFull[8] = {0};
 		uint32_t *expectedOutputH = (fullProblem == true) ? expectedOutputHFull : expectedOutputHSimple;
 		
-		for(uint32_t i = TARGET_H_BIT_COUNT; i < 256; ++i)
+		for(uint32_t i = TARGET_H_BIT_COUNT; i < numHBits; ++i)
 		{
-			expectedOutputH[i / 32] &= ~(1u << (i & 31));
+			expectedOutputH[i / wordBits] &= ~(1u << (i % wordBits));
 		}
-		for(uint32_t i = 0; i < 256; ++i)
+		for(uint32_t i = 0; i < numHBits; ++i)
 		{
-			bool value = ((expectedOutputH[i / 32] >> (i & 31)) & 1u);
+			bool value = ((expectedOutputH[i / wordBits] >> (i % wordBits)) & 1u);
 		
-			constantValues[513 + 256 + i] = value;				
+			constantValues[numWBits + 1 + numHBits + i] = value;				
 		}
 		
 		savedInputValues = inputValues;
@@ -116,11 +605,11 @@ int main()
 		
 		for(uint32_t i = 0; i < outputValues.size(); ++i)
 		{
-			if(i >= 32 * 8)  break;
+			if(i >= numHBits)  break;
 			
 			if(outputValues[i] == 0)  continue;
 			
-			result[i / 32] |= (1u << (i & 31));
+			result[i / wordBits] |= (1u << (i % wordBits));
 		}
 		
 		// output.
@@ -129,10 +618,41 @@ int main()
 			char s[256];
 			s[255] = '\0';
 			
-			std::sprintf(s, "%08X", (unsigned int)result[i]);
+			std::sprintf(s, "%0*X", (int)((wordBits + 3) / 4), (unsigned int)result[i]);
 			std::cout << s << " ";
 		}
 		std::cout << std::endl;
+		
+		// Let's make sure the formal representation agrees with the procedural one.
+		uint32_t expected[8];
+		for(uint32_t i = 0; i < 8; ++i)
+		{
+			expected[i] = reference->GetInitialH(i);
+		}
+		reference->CompSha256(expected, wSecret, numRounds);
+		for(uint32_t i = 0; i < 8; ++i)
+		{
+			if(expected[i] != result[i])
+			{
+				std::cout << "Mismatch with reference implementation at h[" << i << "]" << std::endl;
+				return 1;
+			}
+		}
+	}
+	
+	if(selfCheckPasses != 0)
+	{
+		CComputeTape tape;
+		
+		if(tape.Compile(cSystem, std::cout) == false)
+		{
+			return 1;
+		}
+		
+		if(DoTapeSelfCheck(cSystem, tape, *reference, numRounds, UNKNOWN_W_BIT_COUNT, savedConstantValues, selfCheckPasses) == false)
+		{
+			return 1;
+		}
 	}
 	
 	std::cout << "\nFlattening..." << std::endl;
@@ -141,14 +661,42 @@ int main()
 		return 1;
 	}
 	std::cout << "Done flattening.\n" << std::endl;
+	
+	if(simplify == true)
+	{
+		CSystemSimplifier simplifier(cSystem);
+		
+		// constant bit 0 is unity, so message bit n is constant n + 1 and initial H bit n is constant numWBits + 1 + n.
+		for(uint32_t n = 0; foldIV == true && n < numHBits; ++n)
+		{
+			simplifier.PinConstant(numWBits + 1 + n, savedConstantValues[numWBits + 1 + n]);
+		}
+		for(uint32_t n = paddingFirstWord * wordBits; foldPadding == true && n < numWBits; ++n)
+		{
+			if(n >= UNKNOWN_W_BIT_COUNT)
+			{
+				simplifier.PinConstant(n + 1, savedConstantValues[n + 1]);
+			}
+		}
+		
+		if(simplifier.Run(std::cout) == false)
+		{
+			return 1;
+		}
+		
+		if(profile == true)
+		{
+			profileObserver.OnPhase("simplify");
+		}
+	}
 
+	// The fused pipeline (see formpipeline.h) checks the problem against this.
 	if(true)
-	{	
+	{
 		using namespace std;
-		
-		uint64_t x = 0;
-		
-		const char *fn = "problem256x2-68.bin";
+
+		const char *fn = "solution256x2-68.bin";
+		CMerkleTree::Remove(fn);
 		FILE *fo = fopen(fn, "wb");
 		if(fo == nullptr)
 		{
@@ -156,62 +704,97 @@ int main()
 			
 			return 1;
 		}
-		std::cout << "Writing file: " << fn << std::endl;
-		
-		// reserve space for total file size
-		x = 0;
+		std::cout << "Writing " << fn << "... " << std::flush;
+		uint64_t x = savedInputValues.size();
 		fwrite(&x, sizeof(uint64_t), 1, fo);
 		
-		// write first magic signature, "sha256x2". this represents SHA-256 applied twice.
-		memcpy(&x, "sha256x2", 8);		// this is for human consumption only and can be changed without notice
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		for(uint64_t i = 0; i < savedInputValues.size(); ++i)
+		{
+			x = savedInputValues[i];
+			fwrite(&x, sizeof(uint64_t), 1, fo);
+		}
 		
-		// number of actual unknown input bits (64) and the number of known target equations (68).
-		memcpy(&x, "-64equ68", 8);		// this is the human-readable description and might be wrong (i.e. we could be mislabeled)
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		fclose(fo);
+		std::cout << "done" << std::endl;
 		
-		// let's write a second, definitive machine-readable version of the number of unknown bits.
-		x = savedInputValues.size();
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		if(DoWriteMerkleTree(fn, std::vector<uint64_t>(), 0) == false)
+		{
+			return 1;
+		}
+	}
+	
+	if(true)
+	{
+		const char *fn = "problem256x2-68.bin";
+		FILE *fo = nullptr;
+		uint64_t equatnsPos = 0;
+		std::vector<uint64_t> equationOffsets;
 		
-		// let's write out the constant vector next.
-		x = 8 + 8 + savedConstantValues.size() * 8;
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		// With -fused, problem256x2-68.bin is only written if asked for.
+		if(fused == false || tapBin == true)
+		{
+			CMerkleTree::Remove(fn);
+			fo = fopen(fn, "wb");
+			if(fo == nullptr)
+			{
+				std::cout << "Unable to open output file for writing: " << fn << std::endl;
+				
+				return 1;
+			}
+			std::cout << "Writing file: " << fn << std::endl;
+			
+			equatnsPos = DoWriteProblemHeader(fo, savedInputValues, savedConstantValues);
+		}
 		
-		memcpy(&x, "constant", 8);
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		CBinaryEquationSink fileSink(fo, &equationOffsets);
+		CFusedPipeline pipeline(savedConstantValues, savedInputValues.size());
+		CEquationTee tee;
 		
-		for(uint64_t i = 0; i < savedConstantValues.size(); ++i)
+		if(fo != nullptr)
 		{
-			x = savedConstantValues[i];
-			fwrite(&x, sizeof(uint64_t), 1, fo);
+			tee.sinks.push_back(&fileSink);
 		}
 		
-		uint64_t equatnsPos = ftell(fo);
-		x = 0;
-		fwrite(&x, sizeof(uint64_t), 1, fo);	// placeholder for 'equatns ' size
-		memcpy(&x, "equatns ", 8);
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		if(fused == true)
+		{
+			pipeline.solutionFileName = "solution256x2-68.bin";
+			pipeline.problemDatFileName = (tapDat == true) ? "problem.dat" : "";
+			pipeline.compressModel = compressModel;
+			
+			tee.sinks.push_back(&pipeline);
+		}
 		
-		if(cSystem.FinalizeEquationsBinary(fo, std::cout) == false)
+		if(cSystem.FinalizeEquations(tee, std::cout) == false)
 		{
 			std::cout << "\nGiving up." << std::endl;
+			
+			if(fo != nullptr)
+			{
+				fclose(fo);
+			}
 		
 			return 1;
 		}
 		
-		uint64_t y = ftell(fo);
-		x = ftell(fo) - equatnsPos;
-		fseek(fo, equatnsPos, SEEK_SET);
-		fwrite(&x, sizeof(uint64_t), 1, fo);	// overwrite 'equatns ' size
-
-		// overwrite total file size
-		rewind(fo);
-		x = y;
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		if(fo != nullptr)
+		{
+			const uint64_t trailerPos = ftell(fo);
+			
+			DoWriteProblemTrailer(fo, equatnsPos, equationOffsets);
+			
+			std::cout << "done" << std::endl;		
+			fclose(fo);
+			
+			if(DoWriteMerkleTree(fn, equationOffsets, trailerPos) == false)
+			{
+				return 1;
+			}
+		}
 		
-		std::cout << "done" << std::endl;		
-		fclose(fo);
+		if(fused == true)
+		{
+			pipeline.Report(std::cout);
+		}
 	}
 
 	if(false && fullProblem == true && savedInputValues.empty() == false)
@@ -242,31 +825,40 @@ int main()
 		std::cout << "done\n" << std::endl;
 	}
 	
-	if(true)
+	if(provenance == true)
 	{
-		using namespace std;
-
-		const char *fn = "solution256x2-68.bin";
-		FILE *fo = fopen(fn, "wb");
-		if(fo == nullptr)
+		const char *fn = "problem256x2-68.bin.provenance.txt";
+		
+		provenanceProfile.WriteReport(std::cout);
+		
+		std::ofstream fo(fn);
+		if(!fo || provenanceProfile.WriteSidecar(fo) == false)
 		{
-			std::cout << "Unable to open output file for writing: " << fn << std::endl;
+			std::cout << "Unable to write equation provenance: " << fn << std::endl;
 			
 			return 1;
 		}
-		std::cout << "Writing " << fn << "... " << std::flush;
-		uint64_t x = savedInputValues.size();
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		std::cout << "Wrote equation provenance: " << fn << std::endl;
+	}
+	
+	if(profile == true)
+	{
+		const char *fn = "problem256x2-68.bin.profile.json";
 		
-		for(uint64_t i = 0; i < savedInputValues.size(); ++i)
+		profileObserver.OnPhase("done");
+		CMemoryProfile::WriteSummary(std::cout);
+		
+		std::ofstream fo(fn);
+		if(!fo || CMemoryProfile::WriteJson(fo) == false)
 		{
-			x = savedInputValues[i];
-			fwrite(&x, sizeof(uint64_t), 1, fo);
+			std::cout << "Unable to write memory profile: " << fn << std::endl;
+			
+			return 1;
 		}
-		
-		fclose(fo);
-		std::cout << "done" << std::endl;
+		std::cout << "Wrote memory profile: " << fn << std::endl;
 	}
+	
+	cache.Store(cacheKey, cacheDescription.str(), cacheNames, std::cout);
 
 	return 0;
 }
@@ -0,0 +1,742 @@
+// artifactcache.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// A local cache of the files the tools produce, keyed by what they were produced from.
+// ================================================================================
+
+#ifndef l_artifactcache_h__included_formal_crypto
+#define l_artifactcache_h__included_formal_crypto
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+namespace formal_crypto
+{
+
+// This is a 64-bit FNV-1a hash that can be fed in pieces (see CBlockCodec::Checksum() for the one-shot version).
+class CArtifactHash
+{
+public:
+	CArtifactHash() :
+		hash(0xcbf29ce484222325uLL)
+	{
+	}
+
+	void Add(const void *data, uint64_t size)
+	{
+		const uint8_t *p = (const uint8_t *)data;
+
+		for(uint64_t i = 0; i < size; ++i)
+		{
+			this->hash = (this->hash ^ p[i]) * 0x100000001b3uLL;
+		}
+	}
+
+	void Add(const std::string &s)
+	{
+		this->Add(s.data(), s.size());
+		this->Add("\n", 1);		// so "ab" + "c" and "a" + "bc" differ
+	}
+
+	uint64_t Get() const
+	{
+		return this->hash;
+	}
+
+	std::string GetHex() const
+	{
+		char s[32];
+
+		std::snprintf(s, sizeof(s), "%016llx", (unsigned long long)this->hash);
+
+		return s;
+	}
+
+private:
+	uint64_t hash;
+};
+
+// Each entry is a directory named after its key, holding the files a tool wrote plus a manifest. The key is a hash of
+// the tool's own build (see GetCodeVersion()), a description of the tool and every option that changes what it writes,
+// and the keys of the files it read. So a run that would reproduce an entry can copy the entry's files instead (see
+// Fetch()), and rebuilding a tool from changed sources starts it on fresh entries.
+//
+// The key of a file is remembered in a sidecar, "<file>.key", along with the file's size and modification time. A
+// file written by a tool (or fetched from the cache) has a key derived from its entry's; any other file, or one
+// that changed since its sidecar was written, is keyed by a hash of its contents. So the author-supplied
+// problem256x2-68.bin is hashed once, and from then on generate008 -> convert -> check2 are each looked up without
+// reading their inputs.
+//
+// The cache is only used if a tool is asked to ('-cache'), or if $FORMAL_CRYPTO_CACHE is set, since its entries
+// are as big as the files themselves. It's kept in $FORMAL_CRYPTO_CACHE, or else in $HOME/.cache/formal_crypto, and
+// holds at most $FORMAL_CRYPTO_CACHE_MIB MiB of files (DEFAULT_MAX_MIB by default): after an entry is stored, the
+// entries used least recently are removed until the rest fit.
+//
+// Files are put into an entry, and taken out, as reflinks (copy-on-write clones) where the filesystem has them, else
+// as hard links, else as copies; so a file in the cache and in the current directory usually takes the space of
+// one. A tool about to write files it didn't get from the cache first unlinks any of them that are linked to an
+// entry (see Fetch()), so writing them can't change the entry, and each file is checked against its manifest as
+// it's taken out. An entry that fails the check is removed.
+class CArtifactCache
+{
+public:
+	enum { DEFAULT_MAX_MIB = 16 * 1024 };
+
+	bool enabled;		// tools clear this for '-no-cache'
+
+	// 'requested' is true for '-cache'.
+	CArtifactCache(bool requested) :
+		enabled(false),
+		maxBytes(uint64_t(DEFAULT_MAX_MIB) << 20)
+	{
+		const char *dir = std::getenv("FORMAL_CRYPTO_CACHE");
+		const char *home = std::getenv("HOME");
+		const char *mib = std::getenv("FORMAL_CRYPTO_CACHE_MIB");
+
+		if(dir != nullptr && *dir != '\0')
+		{
+			this->directory = dir;
+			this->enabled = true;
+		}
+		else
+		if(home != nullptr && *home != '\0')
+		{
+			this->directory = std::string(home) + "/.cache/formal_crypto";
+			this->enabled = requested;
+		}
+
+		if(mib != nullptr && *mib != '\0')
+		{
+			this->maxBytes = std::strtoull(mib, nullptr, 0) << 20;
+		}
+	}
+
+	const std::string &GetDirectory() const
+	{
+		return this->directory;
+	}
+
+	// This returns the key of an entry, or an empty string if the cache isn't enabled or some input can't be read (the
+	// tool will then fail on its own). 'description' should name the tool and every option that changes its output,
+	// but not ones that don't (such as thread counts).
+	std::string MakeKey(const std::string &description, const std::vector<std::string> &inputs) const
+	{
+		if(this->enabled == false)
+		{
+			return "";
+		}
+
+		CArtifactHash hash;
+
+		hash.Add("formal_crypto artifact cache, " + GetCodeVersion());
+		hash.Add(description);
+
+		for(const std::string &fn : inputs)
+		{
+			const std::string fileKey = GetFileKey(fn);
+
+			if(fileKey.empty() == true)
+			{
+				return "";
+			}
+
+			hash.Add(fn + "=" + fileKey);
+		}
+
+		return hash.GetHex();
+	}
+
+	// This puts the files in 'names' from entry 'key' in the current directory, along with their Merkle trees (see
+	// merkletree.h) if they were stored with them. Returns true if all of them were found (and intact). Otherwise
+	// (also if the cache isn't enabled) it unlinks any of them in the current directory that are linked to some
+	// entry, as the tool is about to write them, and returns false.
+	bool Fetch(const std::string &key, const std::vector<std::string> &names, std::ostream &os) const
+	{
+		if(this->enabled == false || key.empty() == true)
+		{
+			DoUnlinkShared(names);
+
+			return false;
+		}
+
+		const std::string entry = this->directory + "/" + key;
+		std::vector<CManifestItem> manifest;
+
+		if(DoReadManifest(entry + "/manifest.txt", manifest) == false)
+		{
+			os << "Artifact cache: no entry " << key << " in " << this->directory << std::endl;
+			DoUnlinkShared(names);
+
+			return false;
+		}
+
+		for(const std::string &name : names)
+		{
+			const std::string tree = name + ".merkle";
+
+			if(DoFetchFile(entry, manifest, name, true) == false || DoFetchFile(entry, manifest, tree, false) == false)
+			{
+				os << "Artifact cache: entry " << key << " is missing or has a damaged " << name << "; removing it." << std::endl;
+				DoRemoveEntry(entry);
+				DoUnlinkShared(names);
+
+				return false;
+			}
+
+			WriteSidecar(name, DoGetArtifactKey(key, name));
+		}
+
+		// Its manifest's modification time is when an entry was last used (see DoEvict()).
+		utime((entry + "/manifest.txt").c_str(), nullptr);
+
+		os << "Artifact cache: fetched";
+		for(const std::string &name : names)
+		{
+			os << " " << name;
+		}
+		os << " from entry " << key << " in " << this->directory << std::endl;
+
+		return true;
+	}
+
+	// This puts the files in 'names' (and their Merkle trees, where there are any), from the current directory, into
+	// entry 'key' and gives them sidecars, then evicts entries until the cache fits its limit. Returns true if
+	// successful, false otherwise (the files are still there; they just won't be cached).
+	bool Store(const std::string &key, const std::string &description, const std::vector<std::string> &names, std::ostream &os) const
+	{
+		if(this->enabled == false || key.empty() == true)
+		{
+			return false;
+		}
+
+		const std::string entry = this->directory + "/" + key;
+		const std::string temp = entry + ".tmp" + std::to_string((long long)getpid());
+		std::ostringstream manifest;
+		std::vector<std::string> files = names;
+		bool ok = DoMakeDirectories(this->directory) && (mkdir(temp.c_str(), 0777) == 0);
+
+		for(const std::string &name : names)
+		{
+			struct stat st;
+
+			if(stat((name + ".merkle").c_str(), &st) == 0)
+			{
+				files.push_back(name + ".merkle");
+			}
+		}
+
+		manifest << DoGetManifestSignature() << "\n" << description << "\n";
+
+		for(uint64_t i = 0; ok == true && i < files.size(); ++i)
+		{
+			uint64_t size = 0;
+			uint64_t checksum = 0;
+
+			ok = DoPlace(files[i], temp + "/" + files[i], size, checksum);
+
+			manifest << files[i] << " " << size << " " << checksum << "\n";
+		}
+
+		if(ok == true)
+		{
+			std::ofstream fo(temp + "/manifest.txt");
+
+			fo << manifest.str();
+			ok = fo.good();
+		}
+
+		// The entry only appears, complete, when it's renamed into place. If another run got there first, its
+		// entry is kept.
+		if(ok == true && std::rename(temp.c_str(), entry.c_str()) != 0)
+		{
+			struct stat st;
+
+			ok = (stat((entry + "/manifest.txt").c_str(), &st) == 0);
+		}
+
+		if(ok == false)
+		{
+			os << "Artifact cache: unable to store entry " << key << " in " << this->directory << std::endl;
+		}
+
+		DoRemoveDirectory(temp, files);
+
+		for(const std::string &name : names)
+		{
+			WriteSidecar(name, DoGetArtifactKey(key, name));
+		}
+
+		if(ok == true)
+		{
+			os << "Artifact cache: stored entry " << key << " in " << this->directory << std::endl;
+			ok = this->DoEvict(key, os);
+		}
+
+		return ok;
+	}
+
+	// This returns the key of file 'fn': the one in its sidecar if the file hasn't changed since, otherwise a hash of
+	// its contents (and a sidecar is written, so it isn't hashed again). Returns an empty string if 'fn' can't be read.
+	static std::string GetFileKey(const std::string &fn)
+	{
+		std::string stamp;
+
+		if(DoGetStamp(fn, stamp) == false)
+		{
+			return "";
+		}
+
+		std::ifstream fi(fn + ".key");
+		std::string fileKey;
+		std::string rest;
+
+		if(fi >> fileKey && std::getline(fi, rest) && rest == " " + stamp)
+		{
+			return fileKey;
+		}
+
+		uint64_t size = 0;
+		uint64_t checksum = 0;
+
+		if(DoCopy(fn, "", size, checksum) == false)
+		{
+			return "";
+		}
+
+		CArtifactHash hash;
+
+		hash.Add("contents " + std::to_string((unsigned long long)size) + " " + std::to_string((unsigned long long)checksum));
+		WriteSidecar(fn, hash.GetHex());
+
+		return hash.GetHex();
+	}
+
+	// This identifies the build of the running tool: a hash of its executable, so any change to the sources it's built
+	// from (or to how it's built) gives it different keys, with no version number to remember to bump. If the
+	// executable can't be read, the time the tool's main file was compiled is used instead.
+	static const std::string &GetCodeVersion()
+	{
+		static const std::string version = DoGetCodeVersion();
+
+		return version;
+	}
+
+	// Returns true if successful, false otherwise.
+	static bool WriteSidecar(const std::string &fn, const std::string &fileKey)
+	{
+		std::string stamp;
+
+		if(DoGetStamp(fn, stamp) == false)
+		{
+			return false;
+		}
+
+		std::ofstream fo(fn + ".key");
+
+		fo << fileKey << " " << stamp << "\n";
+
+		return fo.good();
+	}
+
+private:
+	struct CManifestItem
+	{
+		std::string name;
+		uint64_t size;
+		uint64_t checksum;
+	};
+
+	static const char *DoGetManifestSignature()
+	{
+		return "formal_crypto artifact cache entry";
+	}
+
+	static std::string DoGetCodeVersion()
+	{
+		uint64_t size = 0;
+		uint64_t checksum = 0;
+
+		if(DoCopy("/proc/self/exe", "", size, checksum) == true && size != 0)
+		{
+			return "executable " + std::to_string((unsigned long long)size) + " " + std::to_string((unsigned long long)checksum);
+		}
+
+		return "compiled " __DATE__ " " __TIME__;
+	}
+
+	static std::string DoGetArtifactKey(const std::string &key, const std::string &name)
+	{
+		CArtifactHash hash;
+
+		hash.Add(key + "/" + name);
+
+		return hash.GetHex();
+	}
+
+	// The size and modification time of 'fn', as text. Returns true if successful, false otherwise.
+	static bool DoGetStamp(const std::string &fn, std::string &stamp)
+	{
+		struct stat st;
+
+		if(stat(fn.c_str(), &st) != 0 || S_ISREG(st.st_mode) == 0)
+		{
+			return false;
+		}
+
+		stamp = std::to_string((unsigned long long)st.st_size) + " " + std::to_string((long long)st.st_mtim.tv_sec) + "." +
+			std::to_string((long long)st.st_mtim.tv_nsec);
+
+		return true;
+	}
+
+	// This copies 'name' out of 'entry', checking it against the manifest. If it isn't in the entry and isn't
+	// 'required', any copy in the current directory is removed instead (it would belong to some other file). Returns
+	// true if successful, false otherwise.
+	static bool DoFetchFile(const std::string &entry, const std::vector<CManifestItem> &manifest, const std::string &name, bool required)
+	{
+		const CManifestItem *item = nullptr;
+
+		for(const CManifestItem &x : manifest)
+		{
+			if(x.name == name)
+			{
+				item = &x;
+			}
+		}
+
+		if(item == nullptr)
+		{
+			if(required == false)
+			{
+				std::remove(name.c_str());
+			}
+
+			return (required == false);
+		}
+
+		uint64_t size = 0;
+		uint64_t checksum = 0;
+
+		if(DoPlace(entry + "/" + name, name + ".part", size, checksum) == false || size != item->size || checksum != item->checksum ||
+			std::rename((name + ".part").c_str(), name.c_str()) != 0)
+		{
+			std::remove((name + ".part").c_str());
+
+			return false;
+		}
+
+		// If 'name' was already linked to the entry's file, the rename did nothing.
+		std::remove((name + ".part").c_str());
+
+		return true;
+	}
+
+	// Returns true if successful, false otherwise.
+	static bool DoReadManifest(const std::string &fn, std::vector<CManifestItem> &manifest)
+	{
+		std::ifstream fi(fn);
+		std::string signature;
+		std::string description;
+		CManifestItem item;
+
+		if(!std::getline(fi, signature) || signature != DoGetManifestSignature() || !std::getline(fi, description))
+		{
+			return false;
+		}
+
+		while(fi >> item.name >> item.size >> item.checksum)
+		{
+			manifest.push_back(item);
+		}
+
+		return fi.eof();
+	}
+
+	// This copies 'src' to 'dest' (or just reads it, if 'dest' is empty), returning its size and FNV-1a checksum.
+	// Returns true if successful, false otherwise.
+	static bool DoCopy(const std::string &src, const std::string &dest, uint64_t &size, uint64_t &checksum)
+	{
+		std::FILE *fi = std::fopen(src.c_str(), "rb");
+		std::FILE *fo = nullptr;
+
+		if(fi == nullptr)
+		{
+			return false;
+		}
+
+		if(dest.empty() == false && (fo = std::fopen(dest.c_str(), "wb")) == nullptr)
+		{
+			std::fclose(fi);
+
+			return false;
+		}
+
+		std::vector<uint8_t> buffer(1 << 20);
+		CArtifactHash hash;
+		bool ok = true;
+
+		size = 0;
+
+		for(;;)
+		{
+			const size_t n = std::fread(buffer.data(), 1, buffer.size(), fi);
+
+			if(n == 0)
+			{
+				ok = (std::ferror(fi) == 0);
+
+				break;
+			}
+
+			hash.Add(buffer.data(), n);
+			size += n;
+
+			if(fo != nullptr && std::fwrite(buffer.data(), 1, n, fo) != n)
+			{
+				ok = false;
+
+				break;
+			}
+		}
+
+		std::fclose(fi);
+
+		if(fo != nullptr && std::fclose(fo) != 0)
+		{
+			ok = false;
+		}
+
+		checksum = hash.Get();
+
+		return ok;
+	}
+
+	// This puts a reflink of 'src' at 'dest' if it can, or else a hard link, or else a copy, returning its size and
+	// FNV-1a checksum. Returns true if successful, false otherwise.
+	static bool DoPlace(const std::string &src, const std::string &dest, uint64_t &size, uint64_t &checksum)
+	{
+		bool placed = false;
+
+		std::remove(dest.c_str());
+
+#ifdef FICLONE
+		const int fi = open(src.c_str(), O_RDONLY);
+
+		if(fi != -1)
+		{
+			const int fo = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+			if(fo != -1)
+			{
+				placed = (ioctl(fo, FICLONE, fi) == 0);
+				placed = (close(fo) == 0) && placed;
+			}
+
+			close(fi);
+		}
+
+		if(placed == false)
+		{
+			std::remove(dest.c_str());
+		}
+#endif
+
+		if(placed == false)
+		{
+			placed = (link(src.c_str(), dest.c_str()) == 0);
+		}
+
+		return (placed == true) ? DoCopy(dest, "", size, checksum) : DoCopy(src, dest, size, checksum);
+	}
+
+	// This unlinks the files in 'names', and their Merkle trees, that have other links (into an entry, most likely).
+	static void DoUnlinkShared(const std::vector<std::string> &names)
+	{
+		for(const std::string &name : names)
+		{
+			const std::string fns[2] = { name, name + ".merkle" };
+
+			for(const std::string &fn : fns)
+			{
+				struct stat st;
+
+				if(lstat(fn.c_str(), &st) == 0 && S_ISREG(st.st_mode) != 0 && st.st_nlink > 1)
+				{
+					std::remove(fn.c_str());
+				}
+			}
+		}
+	}
+
+	// This removes an entry directory and everything in it.
+	static void DoRemoveEntry(const std::string &entry)
+	{
+		DIR *dir = opendir(entry.c_str());
+
+		if(dir != nullptr)
+		{
+			while(const struct dirent *de = readdir(dir))
+			{
+				const std::string name = de->d_name;
+
+				if(name != "." && name != "..")
+				{
+					std::remove((entry + "/" + name).c_str());
+				}
+			}
+
+			closedir(dir);
+		}
+
+		rmdir(entry.c_str());
+	}
+
+	// This removes the entries used least recently, other than 'keep', until the rest hold at most 'maxBytes' of files
+	// (each counted in full, linked or not), and then 'keep' too if they still don't fit. Returns false if 'keep' was
+	// removed, true otherwise.
+	bool DoEvict(const std::string &keep, std::ostream &os) const
+	{
+		if(this->maxBytes == 0)
+		{
+			return true;		// no limit
+		}
+
+		DIR *dir = opendir(this->directory.c_str());
+		std::vector<std::pair<std::pair<int64_t, int64_t>, std::string> > entries;		// (last used, key)
+		std::vector<uint64_t> sizes;
+		uint64_t total = 0;
+
+		if(dir == nullptr)
+		{
+			return true;
+		}
+
+		while(const struct dirent *de = readdir(dir))
+		{
+			const std::string key = de->d_name;
+			const std::string manifestName = this->directory + "/" + key + "/manifest.txt";
+			std::vector<CManifestItem> manifest;
+			struct stat st;
+
+			// Entries being stored are named "<key>.tmp<pid>", and are left alone.
+			if(key.size() != 16 || key.find_first_not_of("0123456789abcdef") != std::string::npos ||
+				stat(manifestName.c_str(), &st) != 0 || DoReadManifest(manifestName, manifest) == false)
+			{
+				continue;
+			}
+
+			entries.push_back(std::make_pair(std::make_pair((int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec), key));
+		}
+
+		closedir(dir);
+		std::sort(entries.begin(), entries.end());
+
+		for(const auto &e : entries)
+		{
+			std::vector<CManifestItem> manifest;
+			uint64_t size = 0;
+
+			DoReadManifest(this->directory + "/" + e.second + "/manifest.txt", manifest);
+
+			for(const CManifestItem &item : manifest)
+			{
+				size += item.size;
+			}
+
+			sizes.push_back(size);
+			total += size;
+		}
+
+		uint64_t numEvicted = 0;
+
+		for(uint64_t i = 0; i < entries.size() && total > this->maxBytes; ++i)
+		{
+			if(entries[i].second != keep)
+			{
+				DoRemoveEntry(this->directory + "/" + entries[i].second);
+				total -= sizes[i];
+				++numEvicted;
+			}
+		}
+
+		const bool kept = (total <= this->maxBytes);
+
+		if(kept == false)
+		{
+			DoRemoveEntry(this->directory + "/" + keep);
+		}
+
+		if(numEvicted != 0)
+		{
+			os << "Artifact cache: removed " << numEvicted << " entry(ies) used least recently, to stay within " <<
+				(this->maxBytes >> 20) << " MiB (see FORMAL_CRYPTO_CACHE_MIB)" << std::endl
+			;
+		}
+
+		if(kept == false)
+		{
+			os << "Artifact cache: entry " << keep << " alone is bigger than that, so it was removed too." << std::endl;
+		}
+
+		return kept;
+	}
+
+	// Like 'mkdir -p'. Returns true if successful, false otherwise.
+	static bool DoMakeDirectories(const std::string &path)
+	{
+		for(size_t pos = 1; pos <= path.size(); ++pos)
+		{
+			if(pos == path.size() || path[pos] == '/')
+			{
+				struct stat st;
+				const std::string prefix = path.substr(0, pos);
+
+				if(stat(prefix.c_str(), &st) != 0 && mkdir(prefix.c_str(), 0777) != 0)
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// This removes a temporary entry directory (if it's still there) and the files in it.
+	static void DoRemoveDirectory(const std::string &path, const std::vector<std::string> &names)
+	{
+		for(const std::string &name : names)
+		{
+			std::remove((path + "/" + name).c_str());
+		}
+
+		std::remove((path + "/manifest.txt").c_str());
+		rmdir(path.c_str());
+	}
+
+	std::string directory;
+	uint64_t maxBytes;		// 0 for no limit
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_artifactcache_h__included_formal_crypto
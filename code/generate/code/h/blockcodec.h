@@ -0,0 +1,859 @@
+// blockcodec.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Block-compressed storage of sparse rows (problem.dat and the sha2_256_out model).
+// ================================================================================
+
+#ifndef l_blockcodec_h__included_formal_crypto
+#define l_blockcodec_h__included_formal_crypto
+
+#include "merkletree.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace formal_crypto
+{
+
+// Row formats of problem.dat (see header[4]), as written by convert.cpp. Files written before there was a choice
+// have 0 there, i.e. are dense. Block files always hold sparse rows.
+enum
+{
+	E_ROW_FORMAT_DENSE = 0,		// [size in bytes][equation number][one value per column]
+	E_ROW_FORMAT_SPARSE = 1		// [size in bytes][equation number][count][(column, value) x count], by increasing column
+};
+
+// A block file looks like this (all words are little-endian uint64_t):
+//   "fcblocks", kind (8 characters, e.g. "problemd"), number of header words, header words
+//   blocks: [encoded size in bytes][number of rows][checksum (FNV-1a of the encoded bytes)][encoded bytes]
+//   an all-zero block frame, marking the end (so a truncated file is detected as such)
+//
+// Each block holds about BLOCK_BYTES worth of sparse rows (as a sparse problem.dat would store them), and can be
+// decoded without any other block. Its encoding is a sequence of LEB128 varints:
+//   dictionary size, dictionary values (most frequent first)
+//   for each row: row number (zigzag, relative to the previous row number + 1), number of entries, then for each
+//   entry: the column (relative to the previous column + 1, the first one absolute) and the value's dictionary
+//   index + 1, or 0 followed by the value itself for values not in the dictionary.
+// Rows are sparse and columns increase, so most gaps take one byte; coefficients come from a small set (mostly
+// powers of 2 modulo 2^33), so most values take one byte as well.
+
+// A decoded block: 'entries' holds (column, value) pairs, by increasing column within each row.
+struct CBlockRows
+{
+	std::vector<uint64_t> rowNumbers;
+	std::vector<uint64_t> rowStarts;	// index of each row's first pair, plus one past the end
+	std::vector<uint64_t> entries;
+
+	CBlockRows()
+	{
+		this->Clear();
+	}
+
+	void Clear()
+	{
+		this->rowNumbers.clear();
+		this->rowStarts.assign(1, 0);
+		this->entries.clear();
+	}
+
+	uint64_t GetNumRows() const
+	{
+		return this->rowNumbers.size();
+	}
+
+	void AddRow(uint64_t rowNumber, const uint64_t *pairs, uint64_t count)
+	{
+		this->rowNumbers.push_back(rowNumber);
+		this->entries.insert(this->entries.end(), pairs, pairs + 2 * count);
+		this->rowStarts.push_back(this->entries.size() / 2);
+	}
+};
+
+class CBlockCodec
+{
+public:
+	enum { MAX_DICTIONARY = 1 << 16 };
+
+	static void PutVarint(std::vector<uint8_t> &out, uint64_t x)
+	{
+		while(x >= 0x80)
+		{
+			out.push_back((uint8_t)(x | 0x80));
+			x >>= 7;
+		}
+
+		out.push_back((uint8_t)x);
+	}
+
+	// Returns true on success, false if the varint is truncated or too long.
+	static bool GetVarint(const uint8_t *&p, const uint8_t *end, uint64_t &x)
+	{
+		x = 0;
+
+		for(uint32_t shift = 0; shift < 64; shift += 7)
+		{
+			if(p == end)
+			{
+				return false;
+			}
+
+			uint8_t byte = *p++;
+
+			x |= (uint64_t)(byte & 0x7f) << shift;
+
+			if((byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static uint64_t Checksum(const uint8_t *p, uint64_t size)
+	{
+		uint64_t hash = 0xcbf29ce484222325uLL;
+
+		for(uint64_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ p[i]) * 0x100000001b3uLL;
+		}
+
+		return hash;
+	}
+
+	// Returns true on success, false if some row's columns don't strictly increase.
+	static bool Encode(const CBlockRows &rows, std::vector<uint8_t> &out)
+	{
+		out.clear();
+
+		// Build the dictionary: values seen more than once, most frequent first.
+		std::unordered_map<uint64_t, uint64_t> frequency;
+
+		for(uint64_t i = 1; i < rows.entries.size(); i += 2)
+		{
+			++frequency[rows.entries[i]];
+		}
+
+		std::vector<std::pair<uint64_t, uint64_t> > byFrequency;		// (count, value)
+
+		for(auto i = frequency.begin(); i != frequency.end(); ++i)
+		{
+			if(i->second > 1)
+			{
+				byFrequency.push_back(std::make_pair(i->second, i->first));
+			}
+		}
+
+		std::sort(byFrequency.begin(), byFrequency.end(),
+			[](const std::pair<uint64_t, uint64_t> &a, const std::pair<uint64_t, uint64_t> &b)
+			{
+				return (a.first != b.first) ? (a.first > b.first) : (a.second < b.second);
+			}
+		);
+
+		if(byFrequency.size() > MAX_DICTIONARY)
+		{
+			byFrequency.resize(MAX_DICTIONARY);
+		}
+
+		std::unordered_map<uint64_t, uint64_t> code;		// value -> dictionary index + 1
+
+		PutVarint(out, byFrequency.size());
+
+		for(uint64_t i = 0; i < byFrequency.size(); ++i)
+		{
+			PutVarint(out, byFrequency[i].second);
+			code[byFrequency[i].second] = i + 1;
+		}
+
+		uint64_t nextRowNumber = 0;
+
+		for(uint64_t r = 0; r < rows.GetNumRows(); ++r)
+		{
+			const int64_t delta = (int64_t)(rows.rowNumbers[r] - nextRowNumber);
+
+			PutVarint(out, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));		// zigzag
+			nextRowNumber = rows.rowNumbers[r] + 1;
+
+			const uint64_t first = rows.rowStarts[r];
+			const uint64_t count = rows.rowStarts[r + 1] - first;
+
+			PutVarint(out, count);
+
+			uint64_t nextColumn = 0;
+
+			for(uint64_t k = 0; k < count; ++k)
+			{
+				const uint64_t column = rows.entries[2 * (first + k)];
+				const uint64_t value = rows.entries[2 * (first + k) + 1];
+
+				if(column < nextColumn)
+				{
+					return false;
+				}
+
+				PutVarint(out, column - nextColumn);
+				nextColumn = column + 1;
+
+				auto found = code.find(value);
+
+				if(found != code.end())
+				{
+					PutVarint(out, found->second);
+				}
+				else
+				{
+					PutVarint(out, 0);
+					PutVarint(out, value);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// Returns true on success, false if the block is corrupt.
+	static bool Decode(const uint8_t *p, uint64_t size, uint64_t numRows, CBlockRows &rows)
+	{
+		const uint8_t *end = p + size;
+		uint64_t dictionarySize = 0;
+
+		rows.Clear();
+
+		if(GetVarint(p, end, dictionarySize) == false || dictionarySize > MAX_DICTIONARY || dictionarySize > size)
+		{
+			return false;
+		}
+
+		std::vector<uint64_t> dictionary(dictionarySize);
+
+		for(uint64_t i = 0; i < dictionarySize; ++i)
+		{
+			if(GetVarint(p, end, dictionary[i]) == false)
+			{
+				return false;
+			}
+		}
+
+		uint64_t nextRowNumber = 0;
+
+		for(uint64_t r = 0; r < numRows; ++r)
+		{
+			uint64_t zigzag = 0;
+			uint64_t count = 0;
+
+			if(GetVarint(p, end, zigzag) == false || GetVarint(p, end, count) == false || count > (uint64_t)(end - p))
+			{
+				return false;
+			}
+
+			rows.rowNumbers.push_back(nextRowNumber + (uint64_t)((zigzag >> 1) ^ (0 - (zigzag & 1))));
+			nextRowNumber = rows.rowNumbers.back() + 1;
+
+			uint64_t nextColumn = 0;
+
+			for(uint64_t k = 0; k < count; ++k)
+			{
+				uint64_t gap = 0;
+				uint64_t index = 0;
+				uint64_t value = 0;
+
+				if(GetVarint(p, end, gap) == false || GetVarint(p, end, index) == false || index > dictionarySize)
+				{
+					return false;
+				}
+
+				if(index != 0)
+				{
+					value = dictionary[index - 1];
+				}
+				else if(GetVarint(p, end, value) == false)
+				{
+					return false;
+				}
+
+				rows.entries.push_back(nextColumn + gap);
+				rows.entries.push_back(value);
+				nextColumn += gap + 1;
+			}
+
+			rows.rowStarts.push_back(rows.entries.size() / 2);
+		}
+
+		return p == end;
+	}
+};
+
+// ================================================================================
+
+// This writes a block file. Rows are buffered until there are about BLOCK_BYTES of them, then encoded and written.
+class CBlockWriter
+{
+public:
+	enum { BLOCK_BYTES = 1024 * 1024 };
+
+	// If set, each block (and the end marker) is marked in this as it's written, for the file's Merkle tree.
+	CMerkleTree *merkle;
+
+	CBlockWriter() :
+		merkle(nullptr),
+		fo(nullptr),
+		pendingBytes(0),
+		rawBytes(0),
+		writtenBytes(0)
+	{
+	}
+
+	virtual ~CBlockWriter()
+	{
+		if(fo != nullptr)
+		{
+			std::fclose(fo);
+		}
+	}
+
+	// 'kind' is 8 characters identifying the contents. Returns true on success, false otherwise.
+	bool Open(const char *fn, const char *kind, const std::vector<uint64_t> &header)
+	{
+		fo = std::fopen(fn, "wb");
+
+		if(fo == nullptr)
+		{
+			std::cerr << "\nUnable to open file for writing: " << fn << std::endl;
+
+			return false;
+		}
+
+		uint64_t words[3];
+
+		memcpy(&words[0], "fcblocks", 8);
+		memcpy(&words[1], kind, 8);
+		words[2] = header.size();
+
+		return this->DoWrite(words, sizeof(words)) && (header.empty() == true || this->DoWrite(header.data(), header.size() * sizeof(uint64_t)));
+	}
+
+	// 'pairs' holds 'count' (column, value) pairs, by increasing column. Returns true on success, false otherwise.
+	bool AddRow(uint64_t rowNumber, const uint64_t *pairs, uint64_t count)
+	{
+		rows.AddRow(rowNumber, pairs, count);
+
+		pendingBytes += (3 + 2 * count) * sizeof(uint64_t);
+		rawBytes += (3 + 2 * count) * sizeof(uint64_t);
+
+		return (pendingBytes < BLOCK_BYTES) || this->DoFlush();
+	}
+
+	// This writes any buffered rows and the end marker. Returns true on success, false otherwise.
+	bool Close()
+	{
+		if(fo == nullptr)
+		{
+			return false;
+		}
+
+		const uint64_t frame[3] = { 0, 0, 0 };
+		bool ok = this->DoFlush();
+
+		if(merkle != nullptr)
+		{
+			merkle->Mark(writtenBytes, 0);
+		}
+
+		ok = ok && this->DoWrite(frame, sizeof(frame));
+
+		if(std::fclose(fo) != 0)
+		{
+			ok = false;
+		}
+
+		fo = nullptr;
+
+		return ok;
+	}
+
+	// These are the size the rows would have in a sparse problem.dat, and the number of bytes written so far.
+	uint64_t GetRawBytes() const
+	{
+		return rawBytes;
+	}
+
+	uint64_t GetWrittenBytes() const
+	{
+		return writtenBytes;
+	}
+
+private:
+	bool DoWrite(const void *data, uint64_t size)
+	{
+		if(fo == nullptr || std::fwrite(data, 1, size, fo) != size)
+		{
+			std::cerr << "\nError writing block file." << std::endl;
+
+			return false;
+		}
+
+		writtenBytes += size;
+
+		return true;
+	}
+
+	bool DoFlush()
+	{
+		if(rows.GetNumRows() == 0)
+		{
+			return true;
+		}
+
+		if(CBlockCodec::Encode(rows, encoded) == false)
+		{
+			std::cerr << "\nBlock writer: row columns must strictly increase." << std::endl;
+
+			return false;
+		}
+
+		const uint64_t frame[3] = { encoded.size(), rows.GetNumRows(), CBlockCodec::Checksum(encoded.data(), encoded.size()) };
+
+		if(merkle != nullptr)
+		{
+			merkle->Mark(writtenBytes, rows.GetNumRows());
+		}
+
+		rows.Clear();
+		pendingBytes = 0;
+
+		return this->DoWrite(frame, sizeof(frame)) && this->DoWrite(encoded.data(), encoded.size());
+	}
+
+	std::FILE *fo;
+	CBlockRows rows;
+	std::vector<uint8_t> encoded;
+	uint64_t pendingBytes;
+	uint64_t rawBytes;
+	uint64_t writtenBytes;
+};
+
+// ================================================================================
+
+class CBlockRowAcceptor
+{
+public:
+	// 'pairs' holds 'count' (column, value) pairs, by increasing column. Returns true to continue, false to stop.
+	virtual bool AcceptBlockRow(uint64_t rowNumber, const uint64_t *pairs, uint64_t count) = 0;
+};
+
+// This reads a block file. Blocks are read in order on the calling thread and decoded by worker threads, up to
+// MAX_IN_FLIGHT_PER_THREAD blocks per worker ahead of the one being delivered; rows are delivered in file order.
+class CBlockReader
+{
+public:
+	enum { MAX_IN_FLIGHT_PER_THREAD = 2 };
+	enum { MAX_BLOCK_BYTES = 1 << 30 };
+
+	// If set, the header, each block and the end marker are checked against the file's Merkle tree as they're read,
+	// before anything is made of them (see CMerkleVerifier).
+	CMerkleVerifier *merkle;
+
+	CBlockReader() :
+		merkle(nullptr),
+		fi(nullptr)
+	{
+	}
+
+	virtual ~CBlockReader()
+	{
+		if(fi != nullptr)
+		{
+			std::fclose(fi);
+		}
+	}
+
+	// Returns true if 'fn' exists and is a block file.
+	static bool IsBlockFile(const char *fn)
+	{
+		std::FILE *f = std::fopen(fn, "rb");
+		char magic[8];
+		bool result = false;
+
+		if(f != nullptr)
+		{
+			result = (std::fread(magic, 8, 1, f) == 1 && memcmp(magic, "fcblocks", 8) == 0);
+			std::fclose(f);
+		}
+
+		return result;
+	}
+
+	// This reads everything up to the first block. Returns true on success, false otherwise.
+	bool Open(const char *fn, const char *kind, std::vector<uint64_t> &header)
+	{
+		fi = std::fopen(fn, "rb");
+
+		if(fi == nullptr)
+		{
+			std::cerr << "\nUnable to open file for reading: " << fn << std::endl;
+
+			return false;
+		}
+
+		uint64_t words[3];
+
+		if(std::fread(words, sizeof(words), 1, fi) != 1 || memcmp(&words[0], "fcblocks", 8) != 0 || memcmp(&words[1], kind, 8) != 0 ||
+			words[2] > MAX_BLOCK_BYTES / sizeof(uint64_t)
+		)
+		{
+			std::cerr << "\nFile format error (not a block file of the expected kind): " << fn << std::endl;
+
+			return false;
+		}
+
+		header.resize(words[2]);
+
+		if(header.empty() == false && std::fread(header.data(), sizeof(uint64_t), header.size(), fi) != header.size())
+		{
+			std::cerr << "\nFile format error (header ends early): " << fn << std::endl;
+
+			return false;
+		}
+
+		if(merkle != nullptr)
+		{
+			std::vector<uint64_t> start(words, words + 3);
+
+			start.insert(start.end(), header.begin(), header.end());
+
+			if(merkle->Check(0, start.data(), start.size() * sizeof(uint64_t)) == false)
+			{
+				std::cerr << "\nThe header doesn't match the Merkle tree: " << fn << std::endl;
+
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// This hands every row to 'acceptor', decoding on 'numThreads' worker threads (0 means one per core; with 1, blocks
+	// are decoded on the calling thread). Returns true on success, false otherwise.
+	bool ReadRows(CBlockRowAcceptor &acceptor, uint32_t numThreads = 0)
+	{
+		if(numThreads == 0)
+		{
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		std::deque<std::unique_ptr<CJob> > inFlight;		// in file order
+		std::deque<CJob *> pending;			// read, not yet claimed by a worker
+		std::vector<std::unique_ptr<CJob> > pool;
+		std::mutex mutex;
+		std::condition_variable changed;
+		bool finished = false;
+		bool atEnd = false;
+		const char *error = nullptr;
+
+		auto worker = [&]()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			for(;;)
+			{
+				changed.wait(lock, [&]() { return finished == true || pending.empty() == false; });
+
+				if(pending.empty() == true)
+				{
+					return;
+				}
+
+				CJob *job = pending.front();
+				pending.pop_front();
+
+				lock.unlock();
+				job->DoDecode();
+				lock.lock();
+
+				job->done = true;
+				changed.notify_all();
+			}
+		};
+
+		std::vector<std::thread> threads;
+
+		if(numThreads > 1)
+		{
+			for(uint32_t n = 0; n < numThreads; ++n)
+			{
+				threads.push_back(std::thread(worker));
+			}
+		}
+
+		const uint64_t maxInFlight = (uint64_t)MAX_IN_FLIGHT_PER_THREAD * numThreads;
+
+		while(error == nullptr)
+		{
+			// Read ahead.
+			while(atEnd == false && inFlight.size() < maxInFlight && error == nullptr)
+			{
+				std::unique_ptr<CJob> job;
+
+				if(pool.empty() == false)
+				{
+					job = std::move(pool.back());
+					pool.pop_back();
+				}
+				else
+				{
+					job.reset(new CJob());
+				}
+
+				error = this->DoReadFrame(*job, atEnd);
+
+				if(error != nullptr || atEnd == true)
+				{
+					break;
+				}
+
+				if(threads.empty() == true)
+				{
+					job->DoDecode();
+					job->done = true;
+					inFlight.push_back(std::move(job));
+				}
+				else
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+
+					pending.push_back(job.get());
+					inFlight.push_back(std::move(job));
+					changed.notify_all();
+				}
+			}
+
+			if(error != nullptr || inFlight.empty() == true)
+			{
+				break;
+			}
+
+			std::unique_ptr<CJob> job = std::move(inFlight.front());
+			inFlight.pop_front();
+
+			if(threads.empty() == false)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+
+				changed.wait(lock, [&]() { return job->done == true; });
+			}
+
+			if(job->ok == false)
+			{
+				error = this->DoBlockError();
+
+				break;
+			}
+
+			const CBlockRows &rows = job->rows;
+
+			for(uint64_t r = 0; r < rows.GetNumRows(); ++r)
+			{
+				const uint64_t first = rows.rowStarts[r];
+
+				if(acceptor.AcceptBlockRow(rows.rowNumbers[r], rows.entries.data() + 2 * first, rows.rowStarts[r + 1] - first) == false)
+				{
+					error = "Error from AcceptBlockRow() while reading file";
+
+					break;
+				}
+			}
+
+			pool.push_back(std::move(job));
+		}
+
+		if(threads.empty() == false)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			// Claimed jobs still reference 'inFlight', so let the workers finish those before it goes away.
+			pending.clear();
+			finished = true;
+			changed.notify_all();
+		}
+
+		for(uint64_t n = 0; n < threads.size(); ++n)
+		{
+			threads[n].join();
+		}
+
+		std::fclose(fi);
+		fi = nullptr;
+
+		if(error != nullptr)
+		{
+			std::cerr << "\n" << error << std::endl;
+
+			return false;
+		}
+
+		return true;
+	}
+
+	// These give random access to the blocks, after Open(). IndexBlocks() finds the offset of every block (in file
+	// order) without decoding any; ReadBlockAt() reads and decodes the block at one of those offsets. Both return true
+	// on success, false otherwise.
+	bool IndexBlocks(std::vector<uint64_t> &offsets)
+	{
+		offsets.clear();
+
+		for(;;)
+		{
+			const int64_t offset = ftello(fi);
+			uint64_t frame[3];
+			bool atEnd = false;
+			const char *error = this->DoReadFrameHeader(frame, atEnd);
+
+			if(error == nullptr && atEnd == true)
+			{
+				return true;
+			}
+
+			if(error == nullptr && fseeko(fi, frame[0], SEEK_CUR) != 0)
+			{
+				error = "File format error (block file ends early)";
+			}
+
+			if(error != nullptr)
+			{
+				std::cerr << "\n" << error << std::endl;
+
+				return false;
+			}
+
+			offsets.push_back(offset);
+		}
+	}
+
+	bool ReadBlockAt(uint64_t offset, CBlockRows &rows)
+	{
+		bool atEnd = false;
+		const char *error = (fseeko(fi, offset, SEEK_SET) != 0) ? "File format error (invalid block offset)" : this->DoReadFrame(job, atEnd);
+
+		if(error == nullptr && atEnd == false)
+		{
+			job.DoDecode();
+
+			if(job.ok == true)
+			{
+				rows.rowNumbers.swap(job.rows.rowNumbers);
+				rows.rowStarts.swap(job.rows.rowStarts);
+				rows.entries.swap(job.rows.entries);
+
+				return true;
+			}
+		}
+
+		std::cerr << "\n" << ((error != nullptr) ? error : this->DoBlockError()) << std::endl;
+
+		return false;
+	}
+
+private:
+	enum { FRAME_BYTES = 3 * sizeof(uint64_t) };
+
+	struct CJob
+	{
+		std::vector<uint8_t> bytes;		// the block as it is in the file: its frame, then the encoded rows
+		uint64_t offset;
+		uint64_t numRows;
+		uint64_t checksum;
+		CMerkleVerifier *merkle;
+		CBlockRows rows;
+		bool ok;
+		bool done;
+
+		void DoDecode()
+		{
+			const uint8_t *encoded = this->bytes.data() + FRAME_BYTES;
+			const uint64_t size = this->bytes.size() - FRAME_BYTES;
+
+			this->ok = (this->merkle == nullptr || this->merkle->Check(this->offset, this->bytes.data(), this->bytes.size()) == true) &&
+				CBlockCodec::Checksum(encoded, size) == this->checksum && CBlockCodec::Decode(encoded, size, this->numRows, this->rows);
+		}
+	};
+
+	const char *DoBlockError() const
+	{
+		return (merkle != nullptr && merkle->Failed() == true) ? "A block doesn't match the Merkle tree" : "File format error (corrupt block)";
+	}
+
+	// Returns nullptr on success, or an error message.
+	const char *DoReadFrameHeader(uint64_t frame[3], bool &atEnd)
+	{
+		const int64_t offset = ftello(fi);
+
+		if(std::fread(frame, FRAME_BYTES, 1, fi) != 1)
+		{
+			return "File format error (block file ends early)";
+		}
+
+		if(frame[0] == 0 && frame[1] == 0 && frame[2] == 0)
+		{
+			atEnd = true;
+
+			return (merkle == nullptr || merkle->Check(offset, frame, FRAME_BYTES) == true) ? nullptr : "The end marker doesn't match the Merkle tree";
+		}
+
+		// Every row takes at least 2 bytes.
+		if(frame[0] > MAX_BLOCK_BYTES || frame[1] == 0 || frame[1] > frame[0] / 2)
+		{
+			return "File format error (invalid block frame)";
+		}
+
+		return nullptr;
+	}
+
+	// Returns nullptr on success, or an error message.
+	const char *DoReadFrame(CJob &job, bool &atEnd)
+	{
+		uint64_t frame[3];
+		const int64_t offset = ftello(fi);
+		const char *error = this->DoReadFrameHeader(frame, atEnd);
+
+		if(error != nullptr || atEnd == true)
+		{
+			return error;
+		}
+
+		job.bytes.resize(FRAME_BYTES + frame[0]);
+		memcpy(job.bytes.data(), frame, FRAME_BYTES);
+		job.offset = offset;
+		job.numRows = frame[1];
+		job.checksum = frame[2];
+		job.merkle = merkle;
+		job.ok = false;
+		job.done = false;
+
+		if(std::fread(job.bytes.data() + FRAME_BYTES, 1, frame[0], fi) != frame[0])
+		{
+			return "File format error (block file ends early)";
+		}
+
+		return nullptr;
+	}
+
+	std::FILE *fi;
+	CJob job;		// for ReadBlockAt()
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_blockcodec_h__included_formal_crypto
@@ -0,0 +1,607 @@
+// formcheck.h - Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Checking problem.dat rows against the solution and writing the sha2_256_out model (see check2.cpp). These are
+// shared with the fused pipeline (see formpipeline.h).
+// ================================================================================
+
+#ifndef l_formcheck_h__included_formal_crypto
+#define l_formcheck_h__included_formal_crypto
+
+#include "../../include/matrix.h"
+#include "blockcodec.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace formal_crypto
+{
+
+class CAcceptRow
+{
+public:
+	virtual void Begin(std::vector<uint64_t> &header) = 0;
+	virtual void AcceptRow(RMatrix dest, uint64_t position) = 0;
+	virtual void End(RMatrix matrix) = 0;
+};
+
+class CRawAcceptRow :
+	public CAcceptRow
+{
+public:
+	std::vector<uint64_t> header;
+	
+	// If set, the model is written block-compressed to sha2_256_out.blk (see blockcodec.h) instead of as text. The
+	// header words are: number of Y's, their positions, T, X and C; each row holds the nonzero coefficients.
+	bool compressModel;
+	
+	// If set, the solution is checked against its Merkle tree (see CMerkleVerifier) once it's read, before it's used.
+	CMerkleVerifier *solutionMerkle;
+	
+	CRawAcceptRow() :
+		compressModel(false),
+		solutionMerkle(nullptr),
+		numTemps(0),
+		numInputs(0)
+	{
+	}
+	
+	bool CheckRawMatrix(std::string solutionFileName, RMatrix matrix, std::vector<bool> &secretValuesOut)
+	{
+		if(this->BeginCheck(solutionFileName, matrix->GetLogicalWidth()) == false)
+		{
+			return false;
+		}
+		
+		for(uint64_t y = 0; y < numTemps; ++y)
+		{
+			if(this->CheckRow(matrix, y, y) == false)
+			{
+				return false;
+			}
+		}
+		
+		secretValuesOut = secretValues;
+		
+		return this->EndCheck();
+	}
+	
+	// This reads the solution, loads the constants and writes the model's header. 'width' is the number of columns.
+	// returns true on success, false in case of failure.
+	bool BeginCheck(std::string solutionFileName, uint64_t width)
+	{
+		secretValues.clear();
+		secretValues.resize(width, 0);
+		valueIsKnown.assign(width, false);
+		
+		numTemps = header[2];	// this is also the number of equations
+
+		numInputs = header[3];
+
+		// Read solution file. This contains the secret key.
+		// We're reading this so we can check our matrix for correctness.
+		if(true)
+		{
+			std::FILE *fi = fopen(solutionFileName.c_str(), "rb");
+			
+			if(fi == nullptr)
+			{
+				std::cout << "Unable to open file for reading: " << solutionFileName << std::endl;
+				
+				return false;
+			}
+			
+			// It's small, so it's read whole, to be checked in one piece.
+			std::vector<uint64_t> solution;
+			uint64_t x = 0;
+			
+			while(std::fread(&x, sizeof(uint64_t), 1, fi) == 1)
+			{
+				solution.push_back(x);
+			}
+			
+			std::fclose(fi);
+			
+			if(solutionMerkle != nullptr && solutionMerkle->Check(0, solution.data(), solution.size() * sizeof(uint64_t)) == false)
+			{
+				std::cout << "The solution doesn't match the Merkle tree." << std::endl;
+				
+				return false;
+			}
+			
+			uint64_t numInputsInSolution = solution.empty() ? 0 : solution[0];
+			
+			if(numInputsInSolution > solution.size() - 1 || numInputsInSolution > width)
+			{
+				std::cout << "Unable to read binary solution file." << std::endl;
+				
+				return false;
+			}
+			
+			for(uint64_t i = 0; i < numInputsInSolution; ++i)
+			{
+				valueIsKnown[i] = true;
+				secretValues[i] = (solution[1 + i] != 0);
+			}
+			
+			if(numInputsInSolution != numInputs)
+			{
+				std::cout << "Invalid solution binary file." << std::endl;
+				
+				return false;
+			}
+
+			//secretValues[0] = !secretValues[0];	// purposely use an invalid key to make sure it's rejected
+		}
+
+		std::vector<uint64_t> modelHeader;
+
+		// Each row of the model is a segment of its Merkle tree (or, compressed, each block of rows).
+		CMerkleTree::Remove(this->GetModelFileName());
+		modelMerkle.Clear();
+		modelWriter.merkle = &modelMerkle;
+
+		if(compressModel == false)
+		{
+			fo2.open("sha2_256_out.txt");
+		}
+
+		modelHeader.push_back(header[9]);
+
+		for(uint64_t i = 0; i < header[9]/*number of output temps*/; ++i)
+		{
+			uint64_t pos = numInputs + header[9 + 1 + i];
+
+			fo2 << "Y " << i << " " << pos << std::endl;
+
+			modelHeader.push_back(pos);
+		}
+
+		fo2 << "Y -1 -1" << std::endl;
+
+		uint64_t numOutputTemps = header[9];
+		uint64_t posConstants = 9 + 1 + numOutputTemps;
+		uint64_t numConstants = header[posConstants];
+
+		fo2 << "T " << numTemps << std::endl;
+
+		fo2 << "X " << 0 << std::endl;
+
+		fo2 << "C " << numConstants << std::endl;
+
+		modelHeader.push_back(numTemps);
+		modelHeader.push_back(0);
+		modelHeader.push_back(numConstants);
+
+		if(compressModel == true && modelWriter.Open("sha2_256_out.blk", "sha2mdl ", modelHeader) == false)
+		{
+			return false;
+		}
+
+		// Load constants.
+		// [inputs, temporaries, constants, unity]
+		if(true)
+		{
+			uint64_t nextPosition = numInputs + numTemps;
+			
+			for(uint64_t i = 0; i < numConstants; ++i)
+			{
+				if(i == 0)  continue;	// skip unity
+				
+				valueIsKnown[nextPosition] = true;
+				secretValues[nextPosition] = ((header[posConstants + 1 + i]) != 0);
+				
+				++nextPosition;
+			}
+			
+			// Next, let's do 'unity'.
+			valueIsKnown[nextPosition] = true;
+			secretValues[nextPosition] = 1;
+		}
+		
+		
+		// Now let's go through and compute our temporaries.
+		
+		std::cout << "Checking matrix..." << std::endl;
+		
+		return true;
+	}
+	
+	// This computes temporary 'y' from row 'row' of 'matrix', using the values of the temporaries before it (so they
+	// must be checked in order), and writes the row to the model. returns true on success, false in case of failure.
+	bool CheckRow(RMatrix matrix, uint64_t row, uint64_t y)
+	{
+		char s2[33];
+
+		s2[0] = s2[32] = 0;
+
+		std::cout << "\r" << y << "/" << (numTemps - 1) << std::flush;
+		
+		const CMatrixRow rowView = matrix->GetRow(row);
+	
+		if(rowView.Get(numInputs + y).x == 0)
+		{
+			std::cout << "\nInvalid row: " << y << std::endl;
+			
+			return false;
+		}
+		
+		uword_t value = 0;
+
+		if(compressModel == false)
+		{
+			modelMerkle.Mark(fo2.tellp(), 1);
+		}
+
+		fo2 << "begin";
+
+		modelRow.clear();
+		
+		for(uint64_t x = 0; x < rowView.width; ++x)
+		{
+			uword_t coeff = rowView.Get(x);
+
+			if(compressModel == true)
+			{
+				if(coeff.x != 0)
+				{
+					modelRow.push_back(x);
+					modelRow.push_back(coeff.x);
+				}
+			}
+			else
+			{
+				s2[0] = s2[32] = 0;
+				int s2len = sprintf(s2, "%09llx", (unsigned long long)coeff.x);
+
+				if(s2len != 9)
+				{
+					std::cout << s2len << " is not 9" << std::endl;
+
+					return false;
+				}
+
+				fo2 << " ";
+
+				fo2 << s2;
+			}
+
+			if(x == numInputs + y)  continue;
+			
+			if(coeff.x == 0)  continue;
+			
+			if(valueIsKnown[x] == false)
+			{
+				std::cout << "\nUnknown value required, column " << x << std::endl;
+				
+				return false;
+			}
+			
+			if(secretValues[x] != 0)
+			{
+				value.x += coeff.x;
+			}
+		}
+
+		fo2 << std::endl;
+
+		if(compressModel == true && modelWriter.AddRow(y, modelRow.data(), modelRow.size() / 2) == false)
+		{
+			return false;
+		}
+		
+		if(value.x == 0)
+		{
+			valueIsKnown[numInputs + y] = true;
+			secretValues[numInputs + y] = 0;
+		}
+		else
+		{
+			uword_t check = rowView.Get(numInputs + y);
+			
+			check.x += value.x;
+			
+			if(check.x == 0)
+			{
+				valueIsKnown[numInputs + y] = true;
+				secretValues[numInputs + y] = 1;
+			}
+			else
+			{
+				std::cout << "\nInvalid value computed, row " << y << std::endl;
+			}
+		}
+		
+		return true;
+	}
+	
+	// This finishes the model and shows the output temporaries. returns true on success, false in case of failure.
+	bool EndCheck()
+	{
+		if(compressModel == true && modelWriter.Close() == false)
+		{
+			return false;
+		}
+		
+		fo2.close();
+		
+		if(modelMerkle.Build(this->GetModelFileName(), 0) == false || modelMerkle.Write(this->GetModelFileName()) == false)
+		{
+			return false;
+		}
+		
+		std::cout << "\n\nWrote " << this->GetModelFileName() << " (Merkle root " << modelMerkle.GetRootHex() << ")." << std::endl;
+		
+		std::cout << "\nResult:" << std::endl;
+
+		uint32_t u[8] = {0};
+		
+		// There are 8 output words; the word size is 32 bits for SHA2-256, but it might be less
+		// for a scaled-down analogue (see generate008's -w option).
+		uint32_t wordBits = header[9] / 8;
+		if(wordBits == 0 || wordBits > 32)
+		{
+			wordBits = 32;
+		}
+
+		for(uint64_t i = 0; i < header[9]/*number of output temps*/; ++i)
+		{
+			uint64_t pos = numInputs + header[9 + 1 + i];
+			
+			if(valueIsKnown[pos] == false)
+			{
+				std::cout << "_";
+			}
+			else if(secretValues[pos] == 0)
+			{
+				std::cout << "0";
+			}
+			else
+			{
+				std::cout << "1";
+
+				if(i < 8 * wordBits)
+				{
+					u[i / wordBits] |= (1u << (i % wordBits));
+				}
+			}
+		}
+		
+		std::cout << std::endl;
+
+		for(uint32_t i = 0; i < 8; ++i)
+		{
+			char s[33];
+
+			s[0] = s[32] = 0;
+
+			using namespace std;
+
+			sprintf(s, "%0*x", (int)((wordBits + 3) / 4), u[i]);
+
+			std::cout << s;
+		}
+
+		std::cout << std::endl;
+
+		return true;
+	}
+
+	virtual void Begin(std::vector<uint64_t> &headerT)
+	{
+		this->header = headerT;
+	}
+
+	virtual void AcceptRow(RMatrix dest, uint64_t position)
+	{
+		// accept row from invisible bottom row of matrix, to 'position', and zero out bottom row.
+		dest->MoveRow(position, dest->GetLogicalHeight() - 1);
+	}
+	
+	virtual void End(RMatrix matrix)
+	{
+		std::cout << "\nStatistics:" << std::endl;
+		std::cout << "Raw matrix size is " << matrix->GetLogicalHeight() << "x" <<
+			matrix->GetLogicalWidth() << std::endl
+		;
+		
+		std::cout << "Active height is " << matrix->GetActiveHeight() << std::endl;
+		
+		std::cout << "There are " << header[3] << " (unknown) input variable(s)." << std::endl;
+		std::cout << "There are " << header[2] << " temporary variable(s)." << std::endl;
+		std::cout << "This includes " << header[9] << " output temporary variable(s)." << std::endl;
+		std::cout << "The number of significant operands is thus " << (header[3] + header[2] - header[9]) << "." << std::endl;
+	}
+
+protected:
+	std::vector<bool> secretValues;		// for each column, based on the secret key solution
+	std::vector<bool> valueIsKnown;
+	uint64_t numTemps;
+	uint64_t numInputs;
+	std::ofstream fo2;
+	CBlockWriter modelWriter;
+	CMerkleTree modelMerkle;
+	std::vector<uint64_t> modelRow;
+
+	const char *GetModelFileName() const
+	{
+		return (compressModel == true) ? "sha2_256_out.blk" : "sha2_256_out.txt";
+	}
+};
+
+// This checks each row as it's read, instead of keeping the matrix (see StreamMatrix()). Rows must come in equation
+// order.
+class CStreamingCheckRow :
+	public CRawAcceptRow
+{
+public:
+	std::string solutionFileName;
+	bool failed;
+	
+	CStreamingCheckRow(std::string solutionFileName) :
+		solutionFileName(solutionFileName),
+		failed(false),
+		nextRow(0)
+	{
+	}
+	
+	virtual void Begin(std::vector<uint64_t> &headerT)
+	{
+		CRawAcceptRow::Begin(headerT);
+		
+		failed = (this->BeginCheck(solutionFileName, header[8]/* number of columns, incuding unity*/) == false);
+	}
+	
+	virtual void AcceptRow(RMatrix dest, uint64_t position)
+	{
+		if(failed == true || position >= header[2])
+		{
+			return;		// the rows demanding outputs be 0 aren't needed for the check
+		}
+		
+		if(position != nextRow)
+		{
+			std::cout << "\nRow " << position << " is out of order." << std::endl;
+			
+			failed = true;
+			
+			return;
+		}
+		
+		failed = (this->CheckRow(dest, dest->GetLogicalHeight() - 1, position) == false);
+		
+		++nextRow;
+	}
+	
+	virtual void End(RMatrix /*matrix*/)
+	{
+		if(failed == false && nextRow != header[2])
+		{
+			std::cout << "\nOnly " << nextRow << " of " << header[2] << " row(s) were read." << std::endl;
+			
+			failed = true;
+		}
+		
+		if(failed == false)
+		{
+			failed = (this->EndCheck() == false);
+		}
+		
+		std::cout << "\nStatistics:" << std::endl;
+		std::cout << "There are " << header[3] << " (unknown) input variable(s)." << std::endl;
+		std::cout << "There are " << header[2] << " temporary variable(s)." << std::endl;
+		std::cout << "This includes " << header[9] << " output temporary variable(s)." << std::endl;
+	}
+	
+	// This is the value (0 or 1) of each column, based on the solution, once End() has been called.
+	const std::vector<bool> &GetSecretValues() const
+	{
+		return secretValues;
+	}
+	
+private:
+	uint64_t nextRow;
+};
+
+// This is CStreamingCheckRow that also adds each row it checks to a COnlineEchelon, so the equations are brought to
+// echelon form while they're read and only the independent ones are kept (see check2's -reduce-online). As with
+// -reduce, the rows demanding outputs be 0 are left out.
+class CStreamingReduceRow :
+	public CStreamingCheckRow
+{
+public:
+	std::shared_ptr<COnlineEchelon> echelon;
+	
+	CStreamingReduceRow(std::string solutionFileName) :
+		CStreamingCheckRow(solutionFileName)
+	{
+	}
+	
+	virtual void Begin(std::vector<uint64_t> &headerT)
+	{
+		CStreamingCheckRow::Begin(headerT);
+		
+		echelon = std::make_shared<COnlineEchelon>(header[8]/* number of columns, incuding unity*/);
+	}
+	
+	virtual void AcceptRow(RMatrix dest, uint64_t position)
+	{
+		CStreamingCheckRow::AcceptRow(dest, position);
+		
+		if(failed == true || position >= header[2])
+		{
+			return;
+		}
+		
+		if(echelon->AddRow(dest->GetRow(dest->GetLogicalHeight() - 1)) == COnlineEchelon::E_ADD_CONTRADICTION)
+		{
+			std::cout << "\nRow " << position << " contradicts the rows before it." << std::endl;
+			
+			failed = true;
+		}
+	}
+	
+	virtual void End(RMatrix matrix)
+	{
+		CStreamingCheckRow::End(matrix);
+		
+		echelon->Report(std::cout);
+	}
+};
+
+// Let's start by requiring all 'output' temporaries be 0. This will be done by adding some rows demanding as much.
+inline void DoDemandZeroOutputs(RMatrix matrix, std::vector<uint64_t> &headerVector, CAcceptRow &acceptor)
+{
+	for(int64_t i = headerVector[9] - 1; i >= 0; --i)
+	{
+		uint64_t position = headerVector[10 + i];
+		
+		matrix->ZeroRow(matrix->GetLogicalHeight() - 1);
+		
+		// Let's demand this variable be 0. Just place a 1 in its position of the matrix, and leave all other values in
+		// the row 0 (including the 'unity' column). This means 1 * X = 0, so X must be 0.
+		matrix->Set(matrix->GetLogicalHeight() - 1, headerVector[3]/*numInputs*/ + position, 1);
+		
+		// These rows come after (in the unreduced matrix) the normal 'temporary equation' rows.
+		acceptor.AcceptRow(matrix, headerVector[2]/*# of regular equations*/ + i);
+	}
+}
+
+// This puts one sparse row ('count' column, value pairs) in the invisible bottom row of the matrix and accepts it.
+// returns true on success, false in case of failure.
+inline bool DoLoadSparseRow(RMatrix matrix, uint64_t numColumns, uint64_t eqnNumber, const uint64_t *pairs, uint64_t count, CAcceptRow &acceptor)
+{
+	// Display status.
+	std::cout << "\r" << eqnNumber << "                " << std::flush;
+	
+	// Zero out destination row, then set the columns we have.
+	matrix->ZeroRow(matrix->GetLogicalHeight() - 1);
+	
+	for(uint64_t j = 0; j < count; ++j)
+	{
+		if(pairs[2 * j] >= numColumns)
+		{
+			std::cout << "\n[5] Invalid or corrupt data file detected." << std::endl;
+			
+			return false;
+		}
+	}
+	
+	if(matrix->SetRowPairs(matrix->GetLogicalHeight() - 1, pairs, count) == false)
+	{
+		std::cout << "\n[5] Invalid or corrupt data file detected." << std::endl;
+		
+		return false;
+	}
+	
+	// Accept the row !
+	acceptor.AcceptRow(matrix, eqnNumber);
+	
+	return true;
+}
+
+}	// namespace formal_crypto
+
+#endif	// l_formcheck_h__included_formal_crypto
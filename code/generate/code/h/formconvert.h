@@ -0,0 +1,495 @@
+// formconvert.h - Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Converting the equations of problem256x2-68.bin to problem.dat rows (see convert.cpp). This is shared with the
+// fused pipeline (see formpipeline.h).
+// ================================================================================
+
+#ifndef l_formconvert_h__included_formal_crypto
+#define l_formconvert_h__included_formal_crypto
+
+#include "formproblem.h"
+#include "blockcodec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace formal_crypto
+{
+
+class CProblemConverter :
+	public CProblemAcceptor
+{
+	std::FILE *fo;
+	
+	uint64_t unityPosition;
+	
+	uint64_t *row;
+	
+	bool firstEqn;
+	
+	uint64_t numUnknownInputs;
+	
+	uint64_t numEquations;
+	
+	uint64_t numConstants;
+	
+	bool dense;
+	
+	std::vector<std::pair<uint64_t, uint64_t> > entries;	// (column, value) for the current sparse row, in the order set
+	
+	std::vector<uint64_t> sparseRow;
+	
+	std::string outputFileName;
+	
+	std::unique_ptr<CBlockWriter> blockWriter;	// when compressing
+	
+	std::vector<uint64_t> header;
+	
+	CMerkleTree merkle;		// each row (or block of rows) of the output file; see Finish()
+	
+	uint64_t writtenBytes;		// when not compressing
+
+public:
+	// If set, each (sparse) row is also handed to this as it's converted. With an empty 'outputFileName', that's
+	// the only place rows go.
+	CBlockRowAcceptor *rowAcceptor;
+	
+	bool showProgress;	// shows the number of each equation as it's converted
+	
+	CProblemConverter(std::string outputFileName, bool dense, bool compress) :
+		fo(nullptr),
+		unityPosition(0),
+		row(nullptr),
+		firstEqn(true),
+		dense(dense),
+		outputFileName(outputFileName),
+		writtenBytes(0),
+		rowAcceptor(nullptr),
+		showProgress(true)
+	{
+		if(outputFileName.empty() == false)
+		{
+			CMerkleTree::Remove(outputFileName);
+		}
+		
+		if(outputFileName.empty() == true)
+			;	// no file
+		else if(compress == true)
+		{
+			blockWriter.reset(new CBlockWriter());
+			blockWriter->merkle = &merkle;
+		}
+		else
+		{
+			fo = fopen(outputFileName.c_str(), "wb");
+		}
+	}
+
+	virtual ~CProblemConverter()
+	{
+		delete [] row;
+	
+		if(fo != nullptr)
+		{
+			std::fclose(fo);
+		}
+	}
+	
+	virtual bool Initialize(std::vector<bool> &constantValues, std::vector<uint64_t> &targetOutputTemps, uint64_t numUnknownInputs, uint64_t numEquations, std::string magicSignature)
+	{
+		this->numUnknownInputs = numUnknownInputs;
+		this->numEquations = numEquations;
+		this->numConstants = constantValues.size();
+	
+		if(fo == nullptr && blockWriter == nullptr && outputFileName.empty() == false)
+		{
+			std::cout << "\nUnable to open output file for writing." << std::endl;
+			
+			return false;
+		}
+		
+		if(rowAcceptor != nullptr && dense == true)
+		{
+			std::cout << "\nOnly sparse rows can be handed on." << std::endl;
+			
+			return false;
+		}
+		
+		header.clear();
+		uint64_t x;
+		memcpy(&x, "problemd", 8);
+		
+		header.push_back(0);	// reserved for size (in bytes)
+		header.push_back(x);	// magic signature ("problemd")
+		
+		header.push_back(numEquations);
+		header.push_back(numUnknownInputs);
+		
+		// Columns in our matrix consist of:
+		// 1. (unknown) input variables  [count = 'numUnknownInputs']
+		// 2. temporary variables        [count = 'numEquations']
+		//                               note: some of these (exactly 'targetOutputTemps.size()']
+		//                               are 'output' temporaries. we want those variables to be 0.
+		//                               all other variables may be 0 or 1. the solution set is preserved
+		//                               by replacing any reference to an output temporary variable with 0
+		//                               (since output temporary variables have a target value of 0).
+		// 3. constants (excluding unity)  [count = 'constantValues.size()'].
+		//                                 note: the values of the constants in 'constantValues' can be changed.
+		// 4. unity                      [count = 1]
+		
+		// For the purpose of column layout when generating our output file, the above layout is used.
+		// This means there are temporary variables even for 'output temporaries'. Those variables must be 0, so
+		// the data file user may want to add some rows [equations] prior to reduction, to mandate the same.
+		
+		// See DoGetColumn().
+		unityPosition = numUnknownInputs + numEquations + ((constantValues.empty() == false) ? constantValues.size() - 1 : 0);
+		
+		header.push_back(dense ? E_ROW_FORMAT_DENSE : E_ROW_FORMAT_SPARSE);
+		header.push_back(0);	// reserved for future expansion
+		header.push_back(0);
+		header.push_back(0);
+
+		header.push_back(unityPosition + 1);	// this is the number of columns a matrix representation would need
+		
+		header.push_back(targetOutputTemps.size());
+		for(uint64_t i = 0; i < targetOutputTemps.size(); ++i)
+		{
+			header.push_back(targetOutputTemps[i]);
+		}
+
+		header.push_back(constantValues.size());
+		for(uint64_t i = 0; i < constantValues.size(); ++i)
+		{
+			header.push_back(constantValues[i]);
+		}
+		
+		header[0] = sizeof(uint64_t) * header.size();	// update size (in bytes)
+		
+		if(blockWriter != nullptr)
+		{
+			return blockWriter->Open(outputFileName.c_str(), "problemd", header);
+		}
+		
+		for(uint64_t i = 0; fo != nullptr && i < header.size(); ++i)
+		{
+			x = header[i];
+			
+			std::fwrite(&x, sizeof(uint64_t), 1, fo);
+		}
+		
+		writtenBytes = header.size() * sizeof(uint64_t);
+		
+		if(dense == true)
+		{
+			row = new uint64_t [2 + unityPosition + 1];	// we're preceded by the size in bytes of this row, then the equation number; finally comes the column data
+			memset(row, 0, sizeof(uint64_t) * (2 + unityPosition + 1));
+		}
+		
+		return true;
+	}
+	
+	virtual bool AcceptNextEquation(const CGenerationEquation &equation, int64_t position)
+	{
+		this->DoBeginRow(position);
+		
+		if(equation.divisorShift != 1)
+		{
+			std::cout << "\nExpected input to be modulo 4 with fractional coefficients." << std::endl;
+			
+			return false;
+		}
+		
+		for(std::list<std::pair<CGenerationOperand, mpq_class> >::const_iterator i = equation.operands.begin();
+			i != equation.operands.end();
+			++i
+		)
+		{
+			mpq_class coeff = i->second;
+			
+			uint64_t position = 0;
+			
+			if(this->DoGetColumn(i->first, position) == false)
+			{
+				std::cout << "\nUnable to find an operand (?)" << std::endl;
+				
+				return false;
+			}
+			
+			coeff *= mpz_class(2 * 1024) * mpz_class(1024 * 1024);
+			
+			if(coeff.get_den() != 1)
+			{
+				std::cout << "\nExpected input coefficients to have a 33-bit base." << std::endl;
+				
+				return false;
+			}
+			
+			mpz_class temp = coeff.get_num();
+			
+			temp = temp % (mpz_class(1) << 33);
+			if(temp < 0)
+				temp += (mpz_class(1) << 33);
+			
+			// first, let's get bit 0
+			uint64_t value = temp.get_ui() & 1;
+			
+			temp = (temp - value) / 2;
+			
+			// then lets get bits 1..32 inclusive
+			value += 2uLL * temp.get_ui();
+			
+			this->DoSetColumn(position, value);
+		}
+		
+		return this->DoEndRow(position);
+	}
+	
+	// This does the same as AcceptNextEquation() without GMP whenever a coefficient was decoded to numerator / 2^shift:
+	// multiplying by 2^31 and reducing modulo 2^33 is then a shift and a mask (two's complement takes care of the sign).
+	virtual bool AcceptEquations(const CEquationView *views, uint64_t count)
+	{
+		const uint64_t mask33 = (1uLL << 33) - 1;
+		
+		for(uint64_t n = 0; n < count; ++n)
+		{
+			const CEquationView &view = views[n];
+			
+			if(view.divisorShift != 1)
+			{
+				std::cout << "\nExpected input to be modulo 4 with fractional coefficients." << std::endl;
+				
+				return false;
+			}
+			
+			this->DoBeginRow(view.position);
+			
+			for(uint64_t k = 0; k < view.numTerms; ++k)
+			{
+				const CEquationTerm &term = view.terms[k];
+				uint64_t position = 0;
+				
+				if(this->DoGetColumn(term.operand, position) == false)
+				{
+					std::cout << "\nUnable to find an operand (?)" << std::endl;
+					
+					return false;
+				}
+				
+				if(term.text != nullptr)
+				{
+					// too large to have been decoded; take the long way.
+					mpq_class coeff = term.GetValue() * (mpz_class(1) << 31);
+					
+					if(coeff.get_den() != 1)
+					{
+						std::cout << "\nExpected input coefficients to have a 33-bit base." << std::endl;
+						
+						return false;
+					}
+					
+					mpz_class reduced;
+					mpz_fdiv_r_2exp(reduced.get_mpz_t(), coeff.get_num_mpz_t(), 33);
+					
+					this->DoSetColumn(position, reduced.get_ui());
+					
+					continue;
+				}
+				
+				if(term.shift > 31)
+				{
+					std::cout << "\nExpected input coefficients to have a 33-bit base." << std::endl;
+					
+					return false;
+				}
+				
+				this->DoSetColumn(position, ((uint64_t)term.numerator << (31 - term.shift)) & mask33);
+			}
+			
+			if(this->DoEndRow(view.position) == false)
+			{
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	// This is problem.dat's header (see Initialize()).
+	const std::vector<uint64_t> &GetHeader() const
+	{
+		return header;
+	}
+	
+	virtual bool Finish()
+	{
+		if(blockWriter != nullptr)
+		{
+			if(blockWriter->Close() == false)
+			{
+				return false;
+			}
+			
+			std::cout << "\nCompressed " << blockWriter->GetRawBytes() << " byte(s) of sparse rows to a " << blockWriter->GetWrittenBytes() << " byte file." << std::endl;
+		}
+		
+		if(fo != nullptr)
+		{
+			std::fclose(fo);
+			
+			fo = nullptr;
+		}
+		
+		if(outputFileName.empty() == false)
+		{
+			if(merkle.Build(outputFileName, 0) == false || merkle.Write(outputFileName) == false)
+			{
+				return false;
+			}
+			
+			std::cout << "\nDone writing file (Merkle root " << merkle.GetRootHex() << ")." << std::endl;
+		}
+
+		return true;
+	}
+
+private:
+	// Columns are laid out as described in Initialize(): inputs, temporaries, constants (excluding unity) and unity.
+	// Returns true on success, false if there's no such operand.
+	bool DoGetColumn(const CGenerationOperand &oper, uint64_t &column) const
+	{
+		switch(oper.type)
+		{
+		case 'x':
+			column = oper.pos;
+			return oper.pos < this->numUnknownInputs;
+		case 't':
+			column = this->numUnknownInputs + oper.pos;
+			return oper.pos < this->numEquations;
+		case 'c':
+			column = this->numUnknownInputs + this->numEquations + oper.pos - 1;
+			return oper.pos != 0 && oper.pos < this->numConstants;		// constant 0 is unity
+		case '1':
+			column = this->unityPosition;
+			return oper.pos == 0;
+		}
+		
+		return false;
+	}
+	
+	void DoBeginRow(int64_t position)
+	{
+		if(dense == true)
+		{
+			memset(row, 0, sizeof(uint64_t) * (2 + unityPosition + 1));
+			
+			row[0] = (2 + unityPosition + 1) * sizeof(uint64_t);
+			
+			row[1] = position;
+		}
+		else
+		{
+			entries.clear();
+		}
+		
+		this->DoSetColumn(numUnknownInputs + position, (1uLL << 32));	// this is the operand being defined
+	}
+	
+	// As with a dense row, setting a column twice keeps the last value.
+	void DoSetColumn(uint64_t column, uint64_t value)
+	{
+		if(dense == true)
+		{
+			row[2 + column] = value;
+		}
+		else
+		{
+			entries.push_back(std::make_pair(column, value));
+		}
+	}
+	
+	// This sorts the current sparse row by column, keeping the last value set for each column and dropping zeros.
+	const uint64_t *DoPackSparseRow(int64_t position)
+	{
+		std::stable_sort(entries.begin(), entries.end(),
+			[](const std::pair<uint64_t, uint64_t> &a, const std::pair<uint64_t, uint64_t> &b) { return a.first < b.first; }
+		);
+		
+		sparseRow.resize(3);
+		
+		for(uint64_t i = 0; i < entries.size(); ++i)
+		{
+			if(i + 1 < entries.size() && entries[i + 1].first == entries[i].first)
+			{
+				continue;	// overwritten
+			}
+			
+			if(entries[i].second != 0)
+			{
+				sparseRow.push_back(entries[i].first);
+				sparseRow.push_back(entries[i].second);
+			}
+		}
+		
+		sparseRow[0] = sparseRow.size() * sizeof(uint64_t);
+		sparseRow[1] = position;
+		sparseRow[2] = (sparseRow.size() - 3) / 2;
+		
+		return &sparseRow[0];
+	}
+	
+	// returns true on success, false in case of failure.
+	bool DoEndRow(int64_t position)
+	{
+		const uint64_t *data = (dense == true) ? row : this->DoPackSparseRow(position);
+		
+		if(blockWriter != nullptr)
+		{
+			if(blockWriter->AddRow(position, data + 3, data[2]) == false)
+			{
+				return false;
+			}
+		}
+		else if(fo != nullptr)
+		{
+			if(std::fwrite(data, data[0], 1, fo) != 1)
+			{
+				std::cout << "\nError writing to output file." << std::endl;
+			
+				return false;
+			}
+			
+			merkle.Mark(writtenBytes, 1);
+			writtenBytes += data[0];
+		}
+		
+		if(rowAcceptor != nullptr && rowAcceptor->AcceptBlockRow(position, data + 3, data[2]) == false)
+		{
+			return false;
+		}
+		
+		if(showProgress == false)
+		{
+			return true;
+		}
+		
+		if(firstEqn == true)
+		{
+			std::cout << std::endl;
+			
+			firstEqn = false;
+		}
+		
+		std::cout << "\r" << position << "             " << std::flush;
+	
+		return true;
+	}
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_formconvert_h__included_formal_crypto
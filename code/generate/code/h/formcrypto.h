@@ -6,126 +6,24 @@
 #ifndef l_formcrypto_h__included_formal_crypto
 #define l_formcrypto_h__included_formal_crypto
 
+#include "formprofile.h"
+#include "utilsha256.h"
+
 #include <gmpxx.h>
 
 #include <stdint.h>
 #include <string.h>
 
+#include <cstdio>
 #include <iostream>
 #include <memory>
+#include <string>
 #include <vector>
 #include <map>
 
 namespace formal_crypto
 {
 
-enum	// this should be no less than 32 and should be increased only if necessary
-{
-	WORD_SIZE_BITS_MAX = 32
-};
-
-class CUtilSha256
-{
-public:
-	static uint32_t GetInitialH(uint32_t n);	// 0 <= n < 8
-	static uint32_t GetEntryK(uint32_t n);		// 0 <= n < 64
-	static const uint32_t *GetTableHs0();		// there are 32 elements in the returned array
-	static const uint32_t *GetTableHs1();		// there are 32 elements in the returned array
-	static const uint32_t *GetTableKs0();		// there are 32 elements in the returned array
-	static const uint32_t *GetTableKs1();		// there are 32 elements in the returned array
-	static uint32_t Comp32Hs0(uint32_t x);
-	static uint32_t Comp32Hs1(uint32_t x);
-	static uint32_t Comp32Ks0(uint32_t x);
-	static uint32_t Comp32Ks1(uint32_t x);
-	
-	// This updates h_entry[] to contain the result of hashing w_entry using the input h_entry initial
-	// values. numRounds shall be a multiple of 8.
-	static void CompSha256(uint32_t h_entry[8], const uint32_t w_entry[16], uint32_t numRounds = 64);
-	
-	// This tests the SHA-256 implementation. numRounds shall be a multiple of 8.
-	static void SelfTest(std::ostream &os, uint32_t numRounds = 64);
-	
-	// Diagnostic function.
-	static void WriteH(std::ostream &os, uint32_t h[8], bool cStyle = false);
-};
-
-// Rotate-left function.
-inline uint32_t Comp32ROTL(uint32_t x, uint32_t y)
-{
-    y &= 31;
-    
-    uint32_t left = x << y;
-    
-    
-    y = (32 - y) & 31;
-    uint32_t right = x >> y;
-    
-    return left | right;
-}
-
-// Rotate-right function.
-inline uint32_t Comp32ROTR(uint32_t x, uint32_t y)
-{
-    y &= 31;
-    
-    uint32_t left = x >> y;
-    
-    y = (32 - y) & 31;
-    
-    uint32_t right = x << y;
-    
-    return left | right;
-}
-
-// S(X) = (X >> 1). Only allowed if (X mod 2) is 0. "Shift" operator.
-// This operates on a single bit.
-inline uint32_t Comp32S(uint32_t x)
-{
-	return x >> 1;
-}
-
-// T(X) = (X mod 2). This is our so-called "nonlinear" operator.
-// This operates on a single bit.
-inline uint32_t Comp32T(uint32_t x)
-{
-	return x & 1;
-}
-
-// This is the same as Comp32Ch(), but it operates on a single bit.
-inline uint32_t Comp32ChBit(uint32_t e, uint32_t f, uint32_t g)
-{
-    return Comp32S(f + g + Comp32T(e + g) - Comp32T(e + f));
-}
-
-// This is the same as Comp32Maj() function, but it operates on a single bit.
-inline uint32_t Comp32MajBit(uint32_t a, uint32_t b, uint32_t c)
-{
-    return Comp32S(a + b + c - Comp32T(a + b + c));
-}
-
-// Comp32BitQuest(s, x, y) returns ((s) ? x : y) for each bit, in a bitwise way.
-inline uint32_t Comp32BitQuest(uint32_t s, uint32_t x, uint32_t y)
-{
-    // The two terms being xor'd together here are mutually exclusive,
-    // so for example, | could be used instead of | here.
-    return (s & x) ^ (y & ~s);
-}
-
-// Alternative definition: 2 * Ch(e, f, g)  = f + g + T(e + g) - T(e + f)
-inline uint32_t Comp32Ch(uint32_t e, uint32_t f, uint32_t g)
-{
-    // an example alternate form for this is: return g + (e & f) - (e & g);
-    return Comp32BitQuest(e, f, g);
-}
-
-// Alternative definition: 2 * Maj(a, b, c) = a + b + c - T(a + b + c)
-inline uint32_t Comp32Maj(uint32_t a, uint32_t b, uint32_t c)
-{
-    // original form:  return (a & b) ^ (a & c) ^ (b & c);
-    // alternate form: return bitquest(a, b | c, b & c);
-    return Comp32BitQuest(b ^ c, a, b);
-}
-
 // ================================================================================
 
 // Constants: unity is a constant; so are the known input variables.
@@ -155,6 +53,18 @@ protected:
 	uint32_t wordSizeBits;
 
 public:
+	// This is given to each operand created from now on (see COperand::provenance). The code building the system
+	// (i.e. CFormalSha256 and CWord) keeps it up to date.
+	CProvenance provenance;
+
+	void SetProvenance(uint32_t round, uint32_t stage, uint32_t kind)
+	{
+		this->provenance.round = round;
+		this->provenance.stage = stage;
+		this->provenance.kind = kind;
+		this->provenance.bit = 0;
+	}
+
 	ROperator GetZero() const
 	{
 		return this->zero;
@@ -274,15 +184,29 @@ public:
 	// with a 'targetOp'. This is used for instance to set required outputs.
 	ROperator targetOp;
 	
+	// Where this operand came from, for attributing equation cost to the operations of the algorithm.
+	CProvenance provenance;
+	
 	COperand(CCryptosystemBase &csBase, int operandTypeT, int32_t bitIndexLabelT = -1) :
 		uid(csBase),
 		operandType(operandTypeT),
 		bitIndexLabel(bitIndexLabelT),
-		physicalPositionIndex(-1LL)
+		physicalPositionIndex(-1LL),
+		provenance(csBase.provenance)
 	{
+		CMemoryProfile::Add(E_MEMORY_OPERAND, 1, sizeof(COperand));
+	}
+	
+	~COperand()
+	{
+		CMemoryProfile::Add(E_MEMORY_OPERAND, -1, -(int64_t)sizeof(COperand));
 	}
 };
 
+// This is our estimate of the size of a childOperands[] or childOperators[] entry (the tree node has a color and
+// three links besides the value).
+enum { CHILD_ENTRY_BYTES = sizeof(std::pair<const CUniversalId, std::pair<ROperand, mpq_class> >) + 4 * sizeof(void *) };
+
 class COperatorBase
 {
 public:
@@ -305,6 +229,7 @@ public:
 	
 	virtual ~COperatorBase()
 	{
+		CMemoryProfile::Add(E_MEMORY_CHILD_ENTRY, -(int64_t)childOperands.size(), -(int64_t)childOperands.size() * CHILD_ENTRY_BYTES);
 	}
 	
 	void ClearFlags()
@@ -327,6 +252,7 @@ public:
 		{
 			childOperands[src->uid].first = src;
 			childOperands[src->uid].second = 0;
+			CMemoryProfile::Add(E_MEMORY_CHILD_ENTRY, 1, CHILD_ENTRY_BYTES);
 		}
 		
 		childOperands[src->uid].second = DoNormalize(childOperands[src->uid].second + scalar, isMod2);
@@ -334,9 +260,18 @@ public:
 		if(childOperands[src->uid].second == 0)
 		{
 			childOperands.erase(src->uid);
+			CMemoryProfile::Add(E_MEMORY_CHILD_ENTRY, -1, -(int64_t)CHILD_ENTRY_BYTES);
 		}
 	}
 	
+	// Use this rather than childOperands.erase(), so the entry is accounted for. Returns the next entry.
+	std::map<CUniversalId, std::pair<ROperand, mpq_class> >::iterator EraseOperand(std::map<CUniversalId, std::pair<ROperand, mpq_class> >::iterator iter)
+	{
+		CMemoryProfile::Add(E_MEMORY_CHILD_ENTRY, -1, -(int64_t)CHILD_ENTRY_BYTES);
+		
+		return childOperands.erase(iter);
+	}
+	
 protected:	
 	mpq_class DoNormalize(mpq_class src, bool isMod2 = false)
 	{
@@ -396,6 +331,12 @@ public:
 		COperatorBase(cBaseT),
 		divisorShift(0)
 	{
+		CMemoryProfile::Add(E_MEMORY_FLATTENED_OPERATOR, 1, sizeof(CFlattenedOperator));
+	}
+	
+	virtual ~CFlattenedOperator()
+	{
+		CMemoryProfile::Add(E_MEMORY_FLATTENED_OPERATOR, -1, -(int64_t)sizeof(CFlattenedOperator));
 	}
 };
 
@@ -414,6 +355,13 @@ public:
 	COperator(CCryptosystemBase &cBaseT) :
 		COperatorBase(cBaseT)
 	{
+		CMemoryProfile::Add(E_MEMORY_OPERATOR, 1, sizeof(COperator));
+	}
+	
+	virtual ~COperator()
+	{
+		CMemoryProfile::Add(E_MEMORY_OPERATOR, -1, -(int64_t)sizeof(COperator));
+		CMemoryProfile::Add(E_MEMORY_CHILD_ENTRY, -(int64_t)childOperators.size(), -(int64_t)childOperators.size() * CHILD_ENTRY_BYTES);
 	}
 
 	bool IsZero() const
@@ -434,6 +382,7 @@ public:
 		{
 			childOperators[src->uid].first = src;
 			childOperators[src->uid].second = 0;
+			CMemoryProfile::Add(E_MEMORY_CHILD_ENTRY, 1, CHILD_ENTRY_BYTES);
 		}
 		
 		childOperators[src->uid].second = DoNormalize(childOperators[src->uid].second + scalar);
@@ -441,14 +390,95 @@ public:
 		if(childOperators[src->uid].second == 0)
 		{
 			childOperators.erase(src->uid);
+			CMemoryProfile::Add(E_MEMORY_CHILD_ENTRY, -1, -(int64_t)CHILD_ENTRY_BYTES);
 		}
 	}
 };
 
+// This receives progress notifications from CCryptosystem (see CCryptosystem::observer), i.e. for profiling.
+class CCryptosystemObserver
+{
+public:
+	virtual ~CCryptosystemObserver()
+	{
+	}
+	
+	// Called at phase boundaries, e.g. "flatten" or "finalize 10%".
+	virtual void OnPhase(const std::string &phase) = 0;
+	
+	// Called by FinalizeEquations() after each equation is handed to its sink. 'temp' is the equation's temporary,
+	// 'nonzeros' the number of terms written and 'seconds' the time it took.
+	virtual void OnFinalizeRow(const COperand & /*temp*/, uint64_t /*nonzeros*/, double /*seconds*/)
+	{
+	}
+};
+
+// One term of an equation handed to a CEquationSink. 'type' is '1' for unity, 'x' for an unknown input, 'c' for a
+// constant or 't' for a temporary, and 'pos' is the variable's label or the temporary's physical position index (0
+// for unity), as in the file (see CGenerationOperand in formproblem.h). The coefficient is a reduced fraction with a
+// power-of-2 denominator; it belongs to the cryptosystem and is only valid during the call.
+struct CEquationSinkTerm
+{
+	uint8_t type;
+	uint64_t pos;
+	const mpq_class *coefficient;
+};
+
+// This receives the equations from CCryptosystem::FinalizeEquations(), i.e. to write them to a file (see
+// CBinaryEquationSink) or to hand them to the next stage of the pipeline without one (see formpipeline.h).
+class CEquationSink
+{
+public:
+	virtual ~CEquationSink()
+	{
+	}
+	
+	// Called once, before the equations. 'targets' holds the temporary for each user output, in order.
+	// Returns true if successful, false otherwise.
+	virtual bool BeginEquations(const std::vector<int64_t> &targets, uint64_t numEquations) = 0;
+	
+	// Called for each equation, from the last temporary ('position') to the first.
+	// Returns true if successful, false otherwise.
+	virtual bool AcceptEquation(int64_t position, uint64_t divisorShift, const CEquationSinkTerm *terms, uint64_t numTerms) = 0;
+	
+	// Returns true if successful, false otherwise.
+	virtual bool EndEquations() = 0;
+};
+
+// This writes the equations as the body of the 'equatns ' atom of problem256x2-68.bin. If 'equationOffsets' isn't
+// nullptr, it receives the file offset of each equation, in the order written.
+class CBinaryEquationSink :
+	public CEquationSink
+{
+public:
+	CBinaryEquationSink(std::FILE *fo, std::vector<uint64_t> *equationOffsets = nullptr);
+	
+	virtual bool BeginEquations(const std::vector<int64_t> &targets, uint64_t numEquations);
+	virtual bool AcceptEquation(int64_t position, uint64_t divisorShift, const CEquationSinkTerm *terms, uint64_t numTerms);
+	virtual bool EndEquations();
+
+private:
+	std::FILE *fo;
+	std::vector<uint64_t> *equationOffsets;
+};
+
+// This hands each equation to every one of 'sinks', in turn.
+class CEquationTee :
+	public CEquationSink
+{
+public:
+	std::vector<CEquationSink *> sinks;
+	
+	virtual bool BeginEquations(const std::vector<int64_t> &targets, uint64_t numEquations);
+	virtual bool AcceptEquation(int64_t position, uint64_t divisorShift, const CEquationSinkTerm *terms, uint64_t numTerms);
+	virtual bool EndEquations();
+};
+
 class CCryptosystem :
 	public CCryptosystemBase
 {
 public:
+	CCryptosystemObserver *observer;		// nullptr unless the user wants notifications
 	RFlattenedOperator flattenedZero;
 	RFlattenedOperator flattenedOne;
 
@@ -502,8 +532,13 @@ public:
 	// Returns true if successful, false otherwise.	
 	bool Flatten(std::ostream &os);
 	
+	// This hands each equation to 'sink', from the last temporary to the first, releasing its flattened form.
 	// Returns true if successful, false otherwise.
-	bool FinalizeEquationsBinary(FILE *fo, std::ostream &os);
+	bool FinalizeEquations(CEquationSink &sink, std::ostream &os);
+	
+	// This is FinalizeEquations() with a CBinaryEquationSink.
+	// Returns true if successful, false otherwise.
+	bool FinalizeEquationsBinary(FILE *fo, std::ostream &os, std::vector<uint64_t> *equationOffsets = nullptr);
 	
 	bool WriteEquationsText(std::ostream &os, bool showUids = false);
 	bool WriteEquationsBinary(std::FILE *fo);
@@ -531,10 +566,13 @@ public:
 		{
 			this->bits[i] = cSystem.GetZero();
 		}
+		
+		CMemoryProfile::Add(E_MEMORY_SCATTER_WORD, 1, sizeof(CScatterWord));
 	}
 	
 	virtual ~CScatterWord()
 	{
+		CMemoryProfile::Add(E_MEMORY_SCATTER_WORD, -1, -(int64_t)sizeof(CScatterWord));
 	}
 };
 
@@ -696,6 +734,7 @@ public:
 			}
 			
 			// Our final step is to introduce an 'operand' and use its value (i.e. effectively do modulo 2).
+			this->cSystem->provenance.bit = y;
 			ROperand tempOperand = this->cSystem->CreateOperand(E_OPERAND_TEMP);
 			tempOperand->sourceOp = temp;
 			
@@ -720,11 +759,16 @@ private:
 		}
 	}
 	
-	// This is the inverse operation of DoGather().
+	// This is the inverse operation of DoGather(). The temporaries created here are attributed to a word addition,
+	// whatever the current provenance's kind.
 	void DoScatter()
 	{
 		this->scatterNode = std::make_shared<CScatterWord>(*this->cSystem);
 		
+		const uint32_t savedKind = this->cSystem->provenance.kind;
+		this->cSystem->provenance.kind = E_PROVENANCE_ADD;
+		this->cSystem->provenance.bit = 0;
+		
 		ROperand tempOperand = this->cSystem->CreateOperand(E_OPERAND_TEMP);
 		tempOperand->sourceOp = this->cSystem->CreateOperator(this->gatherNode, mpz_class(1) << 31);
 
@@ -739,12 +783,15 @@ private:
 				temp->Add(this->scatterNode->bits[j], mpq_class(-1, mpz_class(1) << (i - j))); // @
 			}
 		
+			this->cSystem->provenance.bit = i;
 			tempOperand = this->cSystem->CreateOperand(E_OPERAND_TEMP);
 
 			tempOperand->sourceOp = this->cSystem->CreateOperator(temp);
 			this->scatterNode->bits[i] = this->cSystem->CreateOperator();
 			this->scatterNode->bits[i]->AddOperand(tempOperand);
 		}
+		
+		this->cSystem->provenance.kind = savedKind;
 	}
 };
 
@@ -0,0 +1,59 @@
+// formpipeline.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Running convert and check2 on the equations as generate008 finalizes them, without the files in between.
+// ================================================================================
+
+#ifndef l_formpipeline_h__included_formal_crypto
+#define l_formpipeline_h__included_formal_crypto
+
+#include "formcrypto.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace formal_crypto
+{
+
+class CFusedPipelineStages;	// see formpipeline.cpp
+
+// This is a CEquationSink that runs the rest of the pipeline (see build.txt) on the equations as they're finalized:
+//   generate (the calling thread) -> convert (CProblemConverter) -> check (CStreamingCheckRow) -> model
+// Convert and check each run on a thread of their own. The stages are connected by bounded queues of batches, so a
+// stage that falls behind holds up the ones before it instead of letting memory grow. Nothing is written but the
+// model and, if asked for, problem.dat (see 'problemDatFileName'); to also write problem256x2-68.bin, put this and
+// a CBinaryEquationSink in a CEquationTee.
+//
+// Equations are finalized from the last temporary to the first, but the check computes each temporary from the ones
+// before it. So the check stage keeps the rows it's handed, block compressed (see blockcodec.h), and checks them in
+// order once they've all arrived.
+//
+// Only formcrypto.h is included here, since matrix.h (which the check stage needs) has a CWord of its own.
+class CFusedPipeline :
+	public CEquationSink
+{
+public:
+	std::string solutionFileName;		// the secret key, for the check stage (see check2.cpp)
+	std::string problemDatFileName;		// if not empty, problem.dat is written as well (with sparse rows)
+	bool compressModel;			// if set, the model goes to sha2_256_out.blk instead of sha2_256_out.txt
+
+	// 'constantValues' and 'numUnknownInputs' are the ones written to problem256x2-68.bin.
+	CFusedPipeline(const std::vector<bool> &constantValues, uint64_t numUnknownInputs);
+
+	virtual ~CFusedPipeline();
+
+	virtual bool BeginEquations(const std::vector<int64_t> &targets, uint64_t numEquations);
+	virtual bool AcceptEquation(int64_t position, uint64_t divisorShift, const CEquationSinkTerm *terms, uint64_t numTerms);
+	virtual bool EndEquations();
+
+	// This shows how long the stages spent waiting for each other. Call after EndEquations().
+	void Report(std::ostream &os) const;
+
+private:
+	std::unique_ptr<CFusedPipelineStages> stages;
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_formpipeline_h__included_formal_crypto
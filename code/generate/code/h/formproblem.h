@@ -20,6 +20,8 @@
 namespace formal_crypto
 {
 
+class CMerkleVerifier;
+
 // ========================================================================
 
 class CGenerationOperand
@@ -69,6 +71,32 @@ public:
 	std::list<std::pair<CGenerationOperand, mpq_class> > operands;
 };
 
+// One term of a CEquationView. The coefficient has the same meaning as in CGenerationEquation (i.e. it's already
+// been doubled, since we're modulo 4). It's numerator / 2^shift, decoded straight from the file, whenever that fits;
+// 'text' is nullptr in that case. Otherwise 'text' is the coefficient as written in the file (before doubling) and
+// 'numerator' and 'shift' are 0; GetValue() works either way.
+class CEquationTerm
+{
+public:
+	CGenerationOperand operand;
+	int64_t numerator;
+	uint32_t shift;
+	const char *text;
+
+	mpq_class GetValue() const;
+};
+
+// This is a decoded equation that refers to memory owned by the reader. Terms with a 0 coefficient are left out, as
+// for CGenerationEquation; 'divisorShift' is always 1 (modulo 4) and the equation defines temporary 'position'.
+class CEquationView
+{
+public:
+	int64_t position;
+	uint64_t divisorShift;
+	const CEquationTerm *terms;
+	uint64_t numTerms;
+};
+
 class CProblemAcceptor
 {
 public:
@@ -76,13 +104,28 @@ public:
 	virtual bool Initialize(std::vector<bool> &constantValues, std::vector<uint64_t> &targetOutputTemps, uint64_t numUnknownInputs, uint64_t numEquations, std::string magicSignature) = 0;
 	virtual bool AcceptNextEquation(const CGenerationEquation &equation, int64_t position) = 0;
 	virtual bool Finish() = 0;
+
+	// The reader hands equations over in batches through this. The views (and the memory they refer to) are only
+	// valid during the call, as the reader reuses its buffers. The default implementation builds a
+	// CGenerationEquation for each view and calls AcceptNextEquation(); acceptors that override this avoid those
+	// allocations (and the GMP arithmetic) altogether.
+	// returns true on success, false in case of failure.
+	virtual bool AcceptEquations(const CEquationView *views, uint64_t count);
 };
 
 class CProblemReader
 {
 public:
+	// The file is memory mapped and walked front to back, handing each equation to the acceptor as soon as it's
+	// parsed; only a sliding window of the file is kept resident (see CProblemCursor in formproblem.cpp), so memory
+	// use doesn't grow with the file size.
+	// With more than one thread (0 means one per core), chunks of equations are parsed on worker threads, using the
+	// file's 'eqindex ' atom to find them (or a quick pre-scan if there isn't one). The acceptor is still called
+	// from the calling thread only, in the same order as with a single thread.
+	// If there's a 'verifier' (see merkletree.h), each equation is checked against the file's Merkle tree, from the
+	// mapped file, before it reaches the acceptor; reading stops at the first one that doesn't match.
 	// returns true on success, false in case of failure.
-	static bool ReadProblem(const char *fn, CProblemAcceptor &acceptor);
+	static bool ReadProblem(const char *fn, CProblemAcceptor &acceptor, uint32_t numThreads = 0, CMerkleVerifier *verifier = nullptr);
 };
 
 // ========================================================================
@@ -0,0 +1,167 @@
+// formprofile.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Memory and cost attribution for the formal analysis pipeline.
+// ================================================================================
+
+#ifndef l_formprofile_h__included_formal_crypto
+#define l_formprofile_h__included_formal_crypto
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace formal_crypto
+{
+
+enum
+{
+	E_MEMORY_OPERATOR,			// COperator
+	E_MEMORY_OPERAND,			// COperand
+	E_MEMORY_FLATTENED_OPERATOR,		// CFlattenedOperator
+	E_MEMORY_SCATTER_WORD,			// CScatterWord
+	E_MEMORY_CHILD_ENTRY,			// childOperands[] and childOperators[] map entries
+	E_MEMORY_GMP,				// GMP allocations (limbs), once InstallGmpHooks() has been called
+	E__MEMORY_COUNT
+};
+
+// This counts live objects and bytes per category. Counting is off until Enable() is called, so there is only the
+// cost of a branch when not profiling. Byte counts are shallow, i.e. sizeof() the object (for map entries, the
+// entry plus an estimate of the tree node overhead); memory owned by GMP numbers is counted separately, as
+// E_MEMORY_GMP. Snapshot() records the counts, along with the peak RSS, at a phase boundary.
+class CMemoryProfile
+{
+public:
+	struct CSnapshot
+	{
+		std::string phase;
+		double seconds;			// since Enable()
+		int64_t objects[E__MEMORY_COUNT];
+		int64_t bytes[E__MEMORY_COUNT];
+		uint64_t peakRssBytes;
+	};
+
+	static bool enabled;
+	static int64_t liveObjects[E__MEMORY_COUNT];
+	static int64_t liveBytes[E__MEMORY_COUNT];
+
+	static void Enable();
+
+	// This routes GMP's allocations through counting wrappers. It must be called before any GMP number is created,
+	// since memory obtained through the previous functions would later be released through ours.
+	static void InstallGmpHooks();
+
+	static inline void Add(int category, int64_t objects, int64_t bytes)
+	{
+		if(enabled == true)
+		{
+			liveObjects[category] += objects;
+			liveBytes[category] += bytes;
+		}
+	}
+
+	static void Snapshot(const std::string &phase);
+
+	static uint64_t PeakRssBytes();
+
+	static const char *GetCategoryName(int category);
+
+	static const std::vector<CSnapshot> &GetSnapshots()
+	{
+		return snapshots;
+	}
+
+	// Writes all snapshots as a JSON document. Returns true on success, false otherwise.
+	static bool WriteJson(std::ostream &os);
+
+	// This also writes a short human-readable summary of the last snapshot.
+	static void WriteSummary(std::ostream &os);
+
+private:
+	static std::vector<CSnapshot> snapshots;
+	static double startSeconds;
+};
+
+// ================================================================================
+
+// What a temporary computes (see CProvenance::kind). The sigma tables are named as in FIPS 180-4: Sigma0/Sigma1 are
+// used by the rounds, sigma0/sigma1 by the message expansion.
+enum
+{
+	E_PROVENANCE_UNKNOWN,
+	E_PROVENANCE_CH,
+	E_PROVENANCE_MAJ,
+	E_PROVENANCE_SIGMA0,
+	E_PROVENANCE_SIGMA1,
+	E_PROVENANCE_EXPAND_SIGMA0,
+	E_PROVENANCE_EXPAND_SIGMA1,
+	E_PROVENANCE_ADD,			// the scatter (carry) bits of a word addition
+	E_PROVENANCE_OUTPUT,			// a user output operand
+	E__PROVENANCE_COUNT
+};
+
+// Where in the algorithm a temporary was created (see CProvenance::stage).
+enum
+{
+	E_STAGE_SETUP,
+	E_STAGE_EXPANSION,
+	E_STAGE_ROUND,
+	E_STAGE_FINAL,				// the final h[] additions and the outputs
+	E__STAGE_COUNT
+};
+
+// This records where an operand came from, packed into 32 bits (see COperand::provenance). 'round' is the round
+// (or, for the message expansion, the w[] index) and 'bit' the bit within the word being computed.
+struct CProvenance
+{
+	uint32_t round : 12;
+	uint32_t stage : 4;
+	uint32_t kind : 8;
+	uint32_t bit : 8;
+
+	CProvenance() :
+		round(0),
+		stage(E_STAGE_SETUP),
+		kind(E_PROVENANCE_UNKNOWN),
+		bit(0)
+	{
+	}
+};
+
+// This collects the size and Finalize time of each equation (row), along with the provenance of its temporary, and
+// breaks them down by operation.
+class CProvenanceProfile
+{
+public:
+	struct CRow
+	{
+		uint64_t position;		// the temporary's physical position index
+		CProvenance provenance;
+		uint64_t nonzeros;
+		double seconds;
+	};
+
+	void Add(uint64_t position, CProvenance provenance, uint64_t nonzeros, double seconds);
+
+	const std::vector<CRow> &GetRows() const
+	{
+		return this->rows;
+	}
+
+	static const char *GetKindName(int kind);
+	static const char *GetStageName(int stage);
+
+	// Writes one line per row, in the order they were added. Returns true on success, false otherwise.
+	bool WriteSidecar(std::ostream &os) const;
+
+	// This writes rows, nonzeros and time per (stage, kind) pair.
+	void WriteReport(std::ostream &os) const;
+
+private:
+	std::vector<CRow> rows;
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_formprofile_h__included_formal_crypto
@@ -0,0 +1,95 @@
+// formsimplify.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Algebraic simplification of a flattened equation system.
+// ================================================================================
+
+#ifndef l_formsimplify_h__included_formal_crypto
+#define l_formsimplify_h__included_formal_crypto
+
+#include "formcrypto.h"
+
+#include <gmpxx.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <map>
+
+namespace formal_crypto
+{
+
+// This runs between CCryptosystem::Flatten() and CCryptosystem::FinalizeEquations(), removing redundant
+// temporaries (rows) from the flattened system. Recall each temporary t is defined as t = (sum of q[i] v[i]) mod 2
+// where every v[i] is 0 or 1; a removed temporary is substituted, wherever it's referenced, by something having
+// precisely the same 0 or 1 value:
+//
+// 1. Constant folding: a definition that reduces to a unity term alone (or to nothing) is a known 0 or 1. Constants
+//    pinned via PinConstant() are substituted first, so that i.e. the IV and padding bits can take part in this.
+// 2. Copy propagation: a definition with a single odd integer coefficient is a copy of the operand it refers to.
+// 3. Duplicate elimination: temporaries with identical (canonical) definitions share a value, so later ones are
+//    replaced by the first one. Definitions are hashed to find candidates.
+//
+// Coefficients are kept reduced to [0, 2) (this doesn't change any definition, modulo 2). User outputs are never
+// removed. Once a pass is done, temporaries are renumbered (see COperand::physicalPositionIndex and
+// CCryptosystem::autoTempOperandOutputPositions). The passes repeat until nothing more is removed.
+//
+// Note that pinning a constant bakes its value into the equations: the resulting system is then only good for
+// inputs where that constant has the pinned value. Without pinned constants, the system is equivalent to the
+// original for any constant values.
+class CSystemSimplifier
+{
+public:
+	CSystemSimplifier(CCryptosystem &cSystemT);
+
+	// Pins constant c['bitIndexLabel'] to 'value' for constant folding. Unity can't be pinned.
+	// Returns true on success, false otherwise.
+	bool PinConstant(int32_t bitIndexLabel, bool value);
+
+	// Returns true on success, false otherwise.
+	bool Run(std::ostream &os, uint32_t maxIterations = 16);
+
+	uint64_t RowsRemoved() const
+	{
+		return this->totalRowsRemoved;
+	}
+
+	uint64_t NonzerosRemoved() const
+	{
+		return this->totalNonzerosRemoved;
+	}
+
+private:
+	enum { E_SIMPLIFY_FOLD_CONSTANTS, E_SIMPLIFY_PROPAGATE_COPIES, E_SIMPLIFY_ELIMINATE_DUPLICATES, E__SIMPLIFY_COUNT };
+
+	// What a removed temporary is to be replaced with: 'operand' if non-nullptr, otherwise 'value' times unity.
+	struct CReplacement
+	{
+		bool removed;
+		ROperand operand;
+		bool value;
+
+		CReplacement() :
+			removed(false),
+			value(false)
+		{
+		}
+	};
+
+	CCryptosystem &cSystem;
+	std::map<int32_t, bool> pinnedConstants;
+	uint64_t totalRowsRemoved;
+	uint64_t totalNonzerosRemoved;
+
+	uint64_t DoCountNonzeros() const;
+	bool DoPass(std::ostream &os, int passType, uint64_t &rowsRemoved);
+	bool DoSubstitute(RFlattenedOperator row, uint64_t n, std::vector<CReplacement> &replacements);
+	bool DoClassify(int passType, uint64_t n, std::vector<CReplacement> &replacements, std::map<uint64_t, std::vector<uint64_t> > &buckets);
+	void DoCompact(std::vector<CReplacement> &replacements);
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_formsimplify_h__included_formal_crypto
@@ -0,0 +1,83 @@
+// formtape.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Compiled (bit-parallel) evaluation of a formal cryptosystem.
+// ================================================================================
+
+#ifndef l_formtape_h__included_formal_crypto
+#define l_formtape_h__included_formal_crypto
+
+#include "formcrypto.h"
+
+#include <gmpxx.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <map>
+
+namespace formal_crypto
+{
+
+// This is a compiled version of CCryptosystem::Compute(). Compile() linearizes the operator DAG into a flat tape with
+// one instruction per temporary, in evaluation order. Each instruction is the temporary's source operator expanded
+// all the way down to operands (constants, inputs and earlier temporaries):
+//   t = (sum of q[i] v[i]) mod 2
+// where every q[i] has a power-of-2 denominator. Multiplying through by 2^s (2^s being the largest denominator)
+// gives integral coefficients, so that t is bit s of (sum of (2^s q[i] mod 2^(s+1)) v[i]) mod 2^(s+1).
+//
+// Evaluate() then runs 64 input vectors at once: bit 'lane' of each uint64_t belongs to vector 'lane', and each
+// instruction is computed with a bit-sliced (s+1)-bit accumulator, one uint64_t per bit position.
+class CComputeTape
+{
+public:
+	enum { LANES = 64 };
+
+	CComputeTape();
+
+	// Returns true on success, false otherwise.
+	bool Compile(CCryptosystem &cSystem, std::ostream &os);
+
+	// Bit 'lane' of inputLanes[n] (constantLanes[n]) is input (constant) n of vector 'lane'; bit 'lane' of
+	// outputLanes[n] receives user output n of vector 'lane', as CCryptosystem::Compute() would compute it.
+	// Returns true on success, false otherwise.
+	bool Evaluate(const std::vector<uint64_t> &inputLanes, const std::vector<uint64_t> &constantLanes, std::vector<uint64_t> &outputLanes) const;
+
+	uint64_t NumInstructions() const
+	{
+		return this->instructions.size();
+	}
+
+	uint64_t NumTerms() const
+	{
+		return this->terms.size();
+	}
+
+private:
+	// A tape slot holds one 0 or 1 value per lane. Slots [0, numConstants) are the constants (by bitIndexLabel), the
+	// next numInputs slots are the inputs, and the rest are temporaries, one per instruction.
+	struct CTerm
+	{
+		uint64_t coefficient;
+		uint32_t source;
+	};
+
+	struct CInstruction
+	{
+		uint64_t firstTerm;
+		uint32_t numTerms;
+		uint32_t shift;		// 's' above
+	};
+
+	uint32_t numConstants;
+	uint32_t numInputs;
+	std::vector<CTerm> terms;
+	std::vector<CInstruction> instructions;
+	std::vector<uint32_t> outputSlots;		// outputSlots[n] is the slot of user output operand n
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_formtape_h__included_formal_crypto
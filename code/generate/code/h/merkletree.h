@@ -0,0 +1,719 @@
+// merkletree.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Per-row SHA-256 digests of the data files, kept in a Merkle tree next to each file, for checking their integrity.
+// ================================================================================
+
+#ifndef l_merkletree_h__included_formal_crypto
+#define l_merkletree_h__included_formal_crypto
+
+#include "utilsha256.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace formal_crypto
+{
+
+// A leaf covers one segment of a file: a row, a block of rows (see blockcodec.h), or a header or trailer (no rows).
+struct CMerkleLeaf
+{
+	uint64_t offset;
+	uint64_t size;
+	uint64_t firstRow;		// rows are numbered in file order
+	uint64_t numRows;
+	uint8_t digest[CSha256Stream::DIGEST_BYTES];
+};
+
+// A writer marks where each segment of its file starts as it writes; once the file is closed, Build() hashes the
+// segments (in parallel) and Write() saves the tree as "<file>.merkle". That's a text file: the file size, the root,
+// then each leaf's offset, size, rows and digest. A file written without marks (such as the solution) is split into
+// BLOCK_BYTES pieces instead.
+//
+// Leaves are SHA-256(0x00 | segment) and inner nodes SHA-256(0x01 | left | right); an odd node out is carried up a
+// level as it is. Comparing the trees of two files (see Compare()) then finds the first segment, i.e. the first row,
+// where they differ without reading either file. CMerkleVerifier checks a file against its tree as it's loaded.
+class CMerkleTree
+{
+public:
+	enum { BLOCK_BYTES = 1024 * 1024 };
+
+	CMerkleTree() :
+		fileSize(0)
+	{
+	}
+
+	void Clear()
+	{
+		this->marks.clear();
+		this->leaves.clear();
+		this->levels.clear();
+		this->fileSize = 0;
+	}
+
+	// A segment of 'numRows' rows (0 for a header or trailer) starts at 'offset'. Segments must be marked in order;
+	// if the first one doesn't start at 0, what comes before it is a header.
+	void Mark(uint64_t offset, uint64_t numRows)
+	{
+		this->marks.push_back(std::make_pair(offset, numRows));
+	}
+
+	// This hashes file 'fn' into one leaf per segment, on 'numThreads' threads (0 for one per core). Returns true if
+	// successful, false otherwise.
+	bool Build(const std::string &fn, uint32_t numThreads)
+	{
+		struct stat st;
+		const int fd = open(fn.c_str(), O_RDONLY);
+
+		if(fd < 0 || fstat(fd, &st) != 0)
+		{
+			std::cout << "\nUnable to read " << fn << " to build its Merkle tree." << std::endl;
+
+			if(fd >= 0)
+			{
+				close(fd);
+			}
+
+			return false;
+		}
+
+		this->fileSize = st.st_size;
+		this->leaves.clear();
+
+		if(this->DoMakeLeaves() == false)
+		{
+			std::cout << "\nThe rows marked in " << fn << " don't fit in the file." << std::endl;
+			close(fd);
+
+			return false;
+		}
+
+		std::atomic<uint64_t> next(0);
+		std::atomic<bool> failed(false);
+		std::vector<std::thread> threads;
+
+		for(uint32_t n = 0; n < GetNumThreads(numThreads); ++n)
+		{
+			threads.push_back(std::thread([this, fd, &next, &failed]()
+			{
+				std::vector<uint8_t> buffer;
+
+				for(uint64_t i = next++; i < this->leaves.size(); i = next++)
+				{
+					if(HashSegment(fd, this->leaves[i].offset, this->leaves[i].size, this->leaves[i].digest, buffer) == false)
+					{
+						failed = true;
+					}
+				}
+			}));
+		}
+
+		for(std::thread &thread : threads)
+		{
+			thread.join();
+		}
+
+		close(fd);
+		this->DoComputeLevels();
+
+		if(failed == true)
+		{
+			std::cout << "\nError reading " << fn << " to build its Merkle tree." << std::endl;
+		}
+
+		return failed == false;
+	}
+
+	// This writes the tree to "<fn>.merkle". Returns true if successful, false otherwise.
+	bool Write(const std::string &fn) const
+	{
+		std::ofstream fo(fn + ".merkle");
+
+		fo << GetSignature() << "\n";
+		fo << "file " << this->fileSize << " leaves " << this->leaves.size() << "\n";
+		fo << "root " << this->GetRootHex() << "\n";
+
+		for(const CMerkleLeaf &leaf : this->leaves)
+		{
+			fo << leaf.offset << " " << leaf.size << " " << leaf.firstRow << " " << leaf.numRows << " " << CSha256Stream::ToHex(leaf.digest) << "\n";
+		}
+
+		if(!fo)
+		{
+			std::cout << "\nUnable to write " << fn << ".merkle" << std::endl;
+
+			return false;
+		}
+
+		return true;
+	}
+
+	// This reads "<fn>.merkle". Returns true if successful, false if it's missing or malformed (including a root that
+	// doesn't match its leaves).
+	bool Read(const std::string &fn)
+	{
+		std::ifstream fi(fn + ".merkle");
+		std::string signature;
+		std::string word1;
+		std::string word2;
+		std::string rootHex;
+		uint64_t numLeaves = 0;
+
+		this->Clear();
+
+		if(!std::getline(fi, signature) || signature != GetSignature() || !(fi >> word1 >> this->fileSize >> word2 >> numLeaves) ||
+			word1 != "file" || word2 != "leaves" || !(fi >> word1 >> rootHex) || word1 != "root")
+		{
+			return false;
+		}
+
+		for(uint64_t i = 0; i < numLeaves; ++i)
+		{
+			CMerkleLeaf leaf;
+			std::string hex;
+
+			if(!(fi >> leaf.offset >> leaf.size >> leaf.firstRow >> leaf.numRows >> hex) || DoParseHex(hex, leaf.digest) == false)
+			{
+				return false;
+			}
+
+			this->leaves.push_back(leaf);
+		}
+
+		this->DoComputeLevels();
+
+		return this->GetRootHex() == rootHex;
+	}
+
+	// This removes "<fn>.merkle", so a writer that's about to replace 'fn' doesn't leave a stale tree behind.
+	static void Remove(const std::string &fn)
+	{
+		std::remove((fn + ".merkle").c_str());
+	}
+
+	uint64_t GetFileSize() const
+	{
+		return this->fileSize;
+	}
+
+	const std::vector<CMerkleLeaf> &GetLeaves() const
+	{
+		return this->leaves;
+	}
+
+	std::string GetRootHex() const
+	{
+		return CSha256Stream::ToHex(this->levels.back()[0].data);
+	}
+
+	// This compares the trees of two files and shows where they first differ. Returns true if they're identical,
+	// false otherwise.
+	static bool Compare(const CMerkleTree &a, const CMerkleTree &b, std::ostream &os)
+	{
+		if(a.fileSize == b.fileSize && a.GetRootHex() == b.GetRootHex())
+		{
+			os << "The files are identical (Merkle root " << a.GetRootHex() << ")." << std::endl;
+
+			return true;
+		}
+
+		uint64_t i = 0;
+		uint64_t comparisons = 0;
+		bool sameShape = (a.leaves.size() == b.leaves.size());
+
+		for(uint64_t n = 0; sameShape == true && n < a.leaves.size(); ++n)
+		{
+			sameShape = (a.leaves[n].offset == b.leaves[n].offset && a.leaves[n].size == b.leaves[n].size);
+		}
+
+		if(sameShape == true)
+		{
+			// Descend from the root, into the left child whenever it differs.
+			for(uint64_t level = a.levels.size() - 1; level > 0; --level)
+			{
+				const uint64_t left = 2 * i;
+
+				++comparisons;
+				i = (memcmp(a.levels[level - 1][left].data, b.levels[level - 1][left].data, CSha256Stream::DIGEST_BYTES) != 0) ? left : left + 1;
+			}
+		}
+		else
+		{
+			// The segments don't line up (e.g. a row changed size), so the first one that differs is as far as the
+			// trees can take us.
+			while(i < a.leaves.size() && i < b.leaves.size() && DoSameLeaf(a.leaves[i], b.leaves[i]) == true)
+			{
+				++comparisons;
+				++i;
+			}
+		}
+
+		os << "The files differ (Merkle roots " << a.GetRootHex() << " and " << b.GetRootHex() << ")." << std::endl;
+
+		if(i >= a.leaves.size() || i >= b.leaves.size())
+		{
+			const CMerkleTree &longer = (i < a.leaves.size()) ? a : b;
+
+			os << "They agree for " << i << " segment(s); only the " << ((&longer == &a) ? "first" : "second") << " file goes on";
+			if(i < longer.leaves.size())
+			{
+				os << ", from byte " << longer.leaves[i].offset << " (row " << longer.leaves[i].firstRow << ")";
+			}
+			os << "." << std::endl;
+
+			return false;
+		}
+
+		const CMerkleLeaf &leaf = a.leaves[i];
+
+		os << "First divergent segment: #" << i << " (found after comparing " << comparisons << " digest(s)), bytes " << leaf.offset <<
+			" to " << (leaf.offset + leaf.size);
+
+		if(leaf.numRows == 0)
+		{
+			os << ", which holds no rows (a header or trailer)." << std::endl;
+		}
+		else
+		if(leaf.numRows == 1)
+		{
+			os << ": row " << leaf.firstRow << "." << std::endl;
+		}
+		else
+		{
+			os << ": rows " << leaf.firstRow << " to " << (leaf.firstRow + leaf.numRows - 1) << "." << std::endl;
+		}
+
+		return false;
+	}
+
+	// This reads 'size' bytes of 'fd' at 'offset' (through 'buffer') and writes their leaf digest. Returns true if
+	// successful, false otherwise.
+	static bool HashSegment(int fd, uint64_t offset, uint64_t size, uint8_t digest[CSha256Stream::DIGEST_BYTES], std::vector<uint8_t> &buffer)
+	{
+		const uint8_t prefix = 0x00;
+		CSha256Stream stream;
+
+		buffer.resize(BLOCK_BYTES);
+		stream.Add(&prefix, 1);
+
+		while(size != 0)
+		{
+			const ssize_t n = pread(fd, buffer.data(), std::min<uint64_t>(size, buffer.size()), offset);
+
+			if(n <= 0)
+			{
+				return false;
+			}
+
+			stream.Add(buffer.data(), n);
+			offset += n;
+			size -= n;
+		}
+
+		stream.Finish(digest);
+
+		return true;
+	}
+
+	// This writes the leaf digest of the 'size' bytes at 'data'.
+	static void HashBytes(const uint8_t *data, uint64_t size, uint8_t digest[CSha256Stream::DIGEST_BYTES])
+	{
+		const uint8_t prefix = 0x00;
+		CSha256Stream stream;
+
+		stream.Add(&prefix, 1);
+		stream.Add(data, size);
+		stream.Finish(digest);
+	}
+
+	// Returns 'numThreads', or the number of cores if that's 0.
+	static uint32_t GetNumThreads(uint32_t numThreads)
+	{
+		if(numThreads == 0)
+		{
+			numThreads = std::thread::hardware_concurrency();
+		}
+
+		return (numThreads == 0) ? 1 : numThreads;
+	}
+
+private:
+	struct CDigest
+	{
+		uint8_t data[CSha256Stream::DIGEST_BYTES];
+	};
+
+	static const char *GetSignature()
+	{
+		return "formal_crypto merkle tree v1";
+	}
+
+	static bool DoSameLeaf(const CMerkleLeaf &a, const CMerkleLeaf &b)
+	{
+		return a.offset == b.offset && a.size == b.size && memcmp(a.digest, b.digest, sizeof(a.digest)) == 0;
+	}
+
+	static bool DoParseHex(const std::string &hex, uint8_t digest[CSha256Stream::DIGEST_BYTES])
+	{
+		if(hex.size() != 2 * CSha256Stream::DIGEST_BYTES)
+		{
+			return false;
+		}
+
+		for(uint32_t i = 0; i < CSha256Stream::DIGEST_BYTES; ++i)
+		{
+			unsigned int x = 0;
+
+			if(std::sscanf(hex.c_str() + 2 * i, "%2x", &x) != 1)
+			{
+				return false;
+			}
+
+			digest[i] = (uint8_t)x;
+		}
+
+		return true;
+	}
+
+	// This turns the marks (or, without any, BLOCK_BYTES pieces) into leaves. Returns false if a mark is out of order
+	// or past the end of the file.
+	bool DoMakeLeaves()
+	{
+		std::vector<std::pair<uint64_t, uint64_t> > segments = this->marks;
+
+		if(segments.empty() == true)
+		{
+			for(uint64_t offset = 0; offset < this->fileSize; offset += BLOCK_BYTES)
+			{
+				segments.push_back(std::make_pair(offset, 0));
+			}
+		}
+
+		if(segments.empty() == true || segments[0].first != 0)
+		{
+			segments.insert(segments.begin(), std::make_pair(0, 0));
+		}
+
+		uint64_t row = 0;
+
+		for(uint64_t i = 0; i < segments.size(); ++i)
+		{
+			const uint64_t end = (i + 1 < segments.size()) ? segments[i + 1].first : this->fileSize;
+
+			if(end < segments[i].first || end > this->fileSize)
+			{
+				return false;
+			}
+
+			if(end == segments[i].first && segments[i].second == 0 && segments.size() > 1)
+			{
+				continue;		// e.g. an empty header
+			}
+
+			CMerkleLeaf leaf;
+
+			leaf.offset = segments[i].first;
+			leaf.size = end - segments[i].first;
+			leaf.firstRow = row;
+			leaf.numRows = segments[i].second;
+			memset(leaf.digest, 0, sizeof(leaf.digest));
+
+			this->leaves.push_back(leaf);
+			row += leaf.numRows;
+		}
+
+		return true;
+	}
+
+	void DoComputeLevels()
+	{
+		this->levels.assign(1, std::vector<CDigest>(this->leaves.size()));
+
+		for(uint64_t i = 0; i < this->leaves.size(); ++i)
+		{
+			memcpy(this->levels[0][i].data, this->leaves[i].digest, CSha256Stream::DIGEST_BYTES);
+		}
+
+		if(this->leaves.empty() == true)
+		{
+			const uint8_t prefix = 0x00;
+			CSha256Stream stream;
+
+			stream.Add(&prefix, 1);
+			this->levels[0].resize(1);
+			stream.Finish(this->levels[0][0].data);
+		}
+
+		while(this->levels.back().size() > 1)
+		{
+			const std::vector<CDigest> &below = this->levels.back();
+			std::vector<CDigest> above((below.size() + 1) / 2);
+
+			for(uint64_t i = 0; i < above.size(); ++i)
+			{
+				if(2 * i + 1 == below.size())
+				{
+					above[i] = below[2 * i];
+
+					continue;
+				}
+
+				const uint8_t prefix = 0x01;
+				CSha256Stream stream;
+
+				stream.Add(&prefix, 1);
+				stream.Add(below[2 * i].data, CSha256Stream::DIGEST_BYTES);
+				stream.Add(below[2 * i + 1].data, CSha256Stream::DIGEST_BYTES);
+				stream.Finish(above[i].data);
+			}
+
+			this->levels.push_back(above);
+		}
+	}
+
+	std::vector<std::pair<uint64_t, uint64_t> > marks;		// (offset, number of rows)
+	std::vector<CMerkleLeaf> leaves;
+	std::vector<std::vector<CDigest> > levels;		// levels[0] are the leaves; levels.back() is the root
+	uint64_t fileSize;
+};
+
+// ================================================================================
+
+// This checks a file against its "<file>.merkle" from the loader's own buffers, so the bytes hashed are the bytes
+// parsed and the file is only read once. The loader hands each segment it reads (the header, a row, a block, or a run
+// of them) to Check() before using it, and gives up at the first one that doesn't match; CheckRest() reads whatever
+// the loader had no use for (e.g. an end marker). Finish() reports on the check.
+class CMerkleVerifier
+{
+public:
+	CMerkleVerifier() :
+		firstBad(UINT64_MAX),
+		started(false),
+		restBytes(0)
+	{
+	}
+
+	// This prepares to check 'fn'. Returns true if it will be checked, false if there's nothing to check it against
+	// (no sidecar), in which case Check() accepts anything and Finish() just says so.
+	bool Start(const std::string &fn)
+	{
+		struct stat st;
+
+		this->fileName = fn;
+
+		if(this->tree.Read(fn) == false)
+		{
+			return false;
+		}
+
+		this->started = true;
+		this->checked.assign(this->tree.GetLeaves().size(), 0);
+
+		if(stat(fn.c_str(), &st) != 0 || (uint64_t)st.st_size != this->tree.GetFileSize())
+		{
+			this->firstBad = this->tree.GetLeaves().size();
+		}
+
+		return true;
+	}
+
+	// This checks the 'size' bytes at 'data', read from 'offset' in the file. They must start and end on segment
+	// boundaries (or the file doesn't have the layout its tree says). Different segments can be checked on different
+	// threads at once. Returns false if a segment checked so far didn't match.
+	bool Check(uint64_t offset, const void *data, uint64_t size)
+	{
+		if(this->started == false || size == 0)
+		{
+			return this->Failed() == false;
+		}
+
+		const std::vector<CMerkleLeaf> &leaves = this->tree.GetLeaves();
+		const uint64_t end = offset + size;
+		uint64_t i = std::upper_bound(leaves.begin(), leaves.end(), offset, [](uint64_t x, const CMerkleLeaf &leaf) { return x < leaf.offset; }) - leaves.begin();
+
+		if(i == 0 || leaves[i - 1].offset != offset)
+		{
+			this->DoFail((i == 0 || offset >= this->tree.GetFileSize()) ? leaves.size() : i - 1);
+
+			return false;
+		}
+
+		for(--i; i < leaves.size() && leaves[i].offset < end; ++i)
+		{
+			uint8_t digest[CSha256Stream::DIGEST_BYTES];
+
+			if(leaves[i].offset + leaves[i].size > end)
+			{
+				this->DoFail(i);		// a segment split in two
+
+				return false;
+			}
+
+			CMerkleTree::HashBytes((const uint8_t *)data + (leaves[i].offset - offset), leaves[i].size, digest);
+
+			if(memcmp(digest, leaves[i].digest, sizeof(digest)) != 0)
+			{
+				this->DoFail(i);
+
+				return false;
+			}
+
+			this->checked[i] = 1;
+		}
+
+		if(end > this->tree.GetFileSize())
+		{
+			this->DoFail(leaves.size());
+		}
+
+		return this->Failed() == false;
+	}
+
+	// This reads and checks the segments Check() wasn't given. Returns false if a segment checked so far didn't match.
+	bool CheckRest()
+	{
+		if(this->started == false || this->Failed() == true)
+		{
+			return this->Failed() == false;
+		}
+
+		const std::vector<CMerkleLeaf> &leaves = this->tree.GetLeaves();
+		const int fd = open(this->fileName.c_str(), O_RDONLY);
+		std::vector<uint8_t> buffer;
+
+		for(uint64_t i = 0; i < leaves.size(); ++i)
+		{
+			uint8_t digest[CSha256Stream::DIGEST_BYTES];
+
+			if(this->checked[i] != 0)
+			{
+				continue;
+			}
+
+			if(fd < 0 || CMerkleTree::HashSegment(fd, leaves[i].offset, leaves[i].size, digest, buffer) == false ||
+				memcmp(digest, leaves[i].digest, sizeof(digest)) != 0)
+			{
+				this->DoFail(i);
+
+				break;
+			}
+
+			this->checked[i] = 1;
+			this->restBytes += leaves[i].size;
+		}
+
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+
+		return this->Failed() == false;
+	}
+
+	// Returns true if a mismatch has been found so far.
+	bool Failed() const
+	{
+		return this->firstBad != UINT64_MAX;
+	}
+
+	// This reports on the check. Returns true if every segment was checked and matched (or there was no tree to check
+	// against), false otherwise.
+	bool Finish(std::ostream &os)
+	{
+		if(this->started == false)
+		{
+			os << "No " << this->fileName << ".merkle; " << this->fileName << " wasn't verified." << std::endl;
+
+			return true;
+		}
+
+		const std::vector<CMerkleLeaf> &leaves = this->tree.GetLeaves();
+		const uint64_t numChecked = std::count(this->checked.begin(), this->checked.end(), 1);
+
+		if(this->Failed() == false && numChecked == leaves.size())
+		{
+			os << "Verified " << this->fileName << " (" << leaves.size() << " segment(s), " << (this->tree.GetFileSize() >> 20) << " MiB";
+
+			if(this->restBytes != 0)
+			{
+				os << "; " << this->restBytes << " byte(s) the loader skipped were read for it";
+			}
+
+			os << ") against Merkle root " << this->tree.GetRootHex() << "." << std::endl;
+
+			return true;
+		}
+
+		if(this->Failed() == false)
+		{
+			os << "\nOnly " << numChecked << " of " << leaves.size() << " segment(s) of " << this->fileName << " were checked against " <<
+				this->fileName << ".merkle." << std::endl;
+
+			return false;
+		}
+
+		os << "\n" << this->fileName << " doesn't match " << this->fileName << ".merkle: ";
+
+		if(this->firstBad >= leaves.size())
+		{
+			os << "its size should be " << this->tree.GetFileSize() << " bytes";
+		}
+		else
+		{
+			const CMerkleLeaf &leaf = leaves[this->firstBad];
+
+			os << "segment #" << this->firstBad << " (bytes " << leaf.offset << " to " << (leaf.offset + leaf.size);
+
+			if(leaf.numRows == 1)
+			{
+				os << ", row " << leaf.firstRow;
+			}
+			else
+			if(leaf.numRows != 0)
+			{
+				os << ", rows " << leaf.firstRow << " to " << (leaf.firstRow + leaf.numRows - 1);
+			}
+
+			os << ") differs";
+		}
+
+		os << ". The file is damaged, or was replaced without its sidecar (delete " << this->fileName << ".merkle if so)." << std::endl;
+
+		return false;
+	}
+
+private:
+	void DoFail(uint64_t i)
+	{
+		// Keep the first bad segment, whichever thread finds one first.
+		uint64_t bad = this->firstBad;
+
+		while(i < bad && this->firstBad.compare_exchange_weak(bad, i) == false)
+		{
+		}
+	}
+
+	std::string fileName;
+	CMerkleTree tree;
+	std::vector<uint8_t> checked;		// for each leaf; each is only written by the thread checking that segment
+	std::atomic<uint64_t> firstBad;
+	bool started;
+	uint64_t restBytes;		// read by CheckRest()
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_merkletree_h__included_formal_crypto
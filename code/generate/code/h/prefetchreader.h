@@ -0,0 +1,297 @@
+// prefetchreader.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Reading a file ahead of its consumer, on a dedicated thread.
+// ================================================================================
+
+#ifndef l_prefetchreader_h__included_formal_crypto
+#define l_prefetchreader_h__included_formal_crypto
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace formal_crypto
+{
+
+// A fixed-size lock-free queue for exactly one producer thread and one consumer thread. It holds up to N - 1 items.
+template<class T, uint32_t N>
+class CSpscQueue
+{
+public:
+	CSpscQueue() :
+		head(0),
+		tail(0)
+	{
+	}
+
+	// Producer only. Returns false if the queue is full.
+	bool Push(const T &item)
+	{
+		const uint32_t t = this->tail.load(std::memory_order_relaxed);
+		const uint32_t next = (t + 1) % N;
+
+		if(next == this->head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		this->items[t] = item;
+		this->tail.store(next, std::memory_order_release);
+
+		return true;
+	}
+
+	// Consumer only. Returns false if the queue is empty.
+	bool Pop(T &item)
+	{
+		const uint32_t h = this->head.load(std::memory_order_relaxed);
+
+		if(h == this->tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		item = this->items[h];
+		this->head.store((h + 1) % N, std::memory_order_release);
+
+		return true;
+	}
+
+private:
+	T items[N];
+	std::atomic<uint32_t> head;		// next item to pop
+	std::atomic<uint32_t> tail;		// next slot to push into
+};
+
+// This reads a file from a given offset to its end with pread() on its own thread, NUM_BUFFERS buffers at a time,
+// so the disk stays busy while the consumer works on what was read before. Filled buffers are handed to the
+// consumer, and empty ones back to the reader thread, through two CSpscQueues; neither side takes a lock. A side
+// with nothing to do spins briefly, then sleeps in short intervals (so a single core isn't spent waiting).
+//
+// Read() looks like fread(). The time the reader thread spent in pread() and the time the consumer spent waiting
+// for it are recorded; the difference is the I/O that overlapped with the consumer's own work (see Report()).
+class CPrefetchReader
+{
+public:
+	enum { NUM_BUFFERS = 2 };		// one being read from, one being filled
+
+	CPrefetchReader() :
+		fd(-1),
+		bufferBytes(0),
+		current(nullptr),
+		currentPos(0),
+		atEnd(false),
+		stop(false),
+		failed(false),
+		bytesRead(0),
+		ioSeconds(0.0),
+		waitSeconds(0.0),
+		startSeconds(0.0),
+		stopSeconds(0.0)
+	{
+	}
+
+	virtual ~CPrefetchReader()
+	{
+		this->Stop();
+	}
+
+	// This starts reading 'fd' at 'offset', in pieces of 'bufferBytes'. The descriptor must stay open until Stop().
+	void Start(int fd, uint64_t offset, uint64_t bufferBytes)
+	{
+		this->fd = fd;
+		this->bufferBytes = bufferBytes;
+		this->startSeconds = DoGetSeconds();
+
+		for(uint32_t n = 0; n < NUM_BUFFERS; ++n)
+		{
+			this->buffers[n].data.resize(bufferBytes);
+			this->freeBuffers.Push(&this->buffers[n]);
+		}
+
+		this->thread = std::thread([this, offset]() { this->DoRead(offset); });
+	}
+
+	// This copies up to 'size' bytes to 'dest'. Returns the number of bytes copied, which is less than 'size' only at
+	// the end of the file or if reading failed (see Failed()).
+	uint64_t Read(void *dest, uint64_t size)
+	{
+		uint64_t copied = 0;
+
+		while(copied < size)
+		{
+			if(this->current == nullptr || this->currentPos == this->current->size)
+			{
+				if(this->DoNextBuffer() == false)
+				{
+					break;
+				}
+
+				continue;
+			}
+
+			const uint64_t n = std::min(size - copied, this->current->size - this->currentPos);
+
+			memcpy((uint8_t *)dest + copied, this->current->data.data() + this->currentPos, n);
+			this->currentPos += n;
+			copied += n;
+		}
+
+		return copied;
+	}
+
+	// This stops the reader thread (e.g. if the consumer gives up early). It's safe to call more than once.
+	void Stop()
+	{
+		if(this->thread.joinable() == true)
+		{
+			this->stop = true;
+			this->thread.join();
+			this->stopSeconds = DoGetSeconds();
+		}
+	}
+
+	bool Failed() const
+	{
+		return this->failed;
+	}
+
+	// This shows how much I/O time was hidden behind the consumer's work. Call after Stop().
+	void Report(std::ostream &os) const
+	{
+		const double totalSeconds = this->stopSeconds - this->startSeconds;
+		const double hidden = (this->ioSeconds > this->waitSeconds) ? (this->ioSeconds - this->waitSeconds) : 0.0;
+
+		os << "Prefetch: read " << (this->bytesRead >> 20) << " MiB in " << this->ioSeconds << "s of I/O; waited " << this->waitSeconds <<
+			"s for it, so " << hidden << "s of I/O overlapped " << (totalSeconds - this->waitSeconds) << "s of compute." << std::endl;
+	}
+
+private:
+	struct CBuffer
+	{
+		std::vector<uint8_t> data;
+		uint64_t size;		// bytes filled; less than the buffer size at the end of the file
+	};
+
+	static double DoGetSeconds()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void DoBackOff(uint32_t &spins)
+	{
+		if(++spins < 64)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+
+	// This runs on the reader thread.
+	void DoRead(uint64_t offset)
+	{
+		for(;;)
+		{
+			CBuffer *buffer = nullptr;
+
+			for(uint32_t spins = 0; this->freeBuffers.Pop(buffer) == false; DoBackOff(spins))
+			{
+				if(this->stop == true)
+				{
+					return;
+				}
+			}
+
+			const double t0 = DoGetSeconds();
+			uint64_t size = 0;
+
+			while(size < this->bufferBytes)
+			{
+				const ssize_t n = pread(this->fd, buffer->data.data() + size, this->bufferBytes - size, offset + size);
+
+				if(n <= 0)
+				{
+					this->failed = (n < 0);
+
+					break;
+				}
+
+				size += n;
+			}
+
+			this->ioSeconds += DoGetSeconds() - t0;
+			this->bytesRead += size;
+
+			buffer->size = size;
+			offset += size;
+
+			this->filledBuffers.Push(buffer);		// can't be full: there are only NUM_BUFFERS buffers
+
+			if(size < this->bufferBytes)
+			{
+				return;		// end of file (or error)
+			}
+		}
+	}
+
+	// Returns true if there's another buffer to read from, false at the end of the file.
+	bool DoNextBuffer()
+	{
+		if(this->current != nullptr)
+		{
+			const bool last = (this->current->size < this->bufferBytes);
+
+			this->freeBuffers.Push(this->current);
+			this->current = nullptr;
+			this->atEnd = last;
+		}
+
+		if(this->atEnd == true || this->thread.joinable() == false)
+		{
+			return false;
+		}
+
+		const double t0 = DoGetSeconds();
+
+		for(uint32_t spins = 0; this->filledBuffers.Pop(this->current) == false; DoBackOff(spins))
+		{
+		}
+
+		this->waitSeconds += DoGetSeconds() - t0;
+		this->currentPos = 0;
+
+		return true;
+	}
+
+	int fd;
+	uint64_t bufferBytes;
+	CBuffer buffers[NUM_BUFFERS];
+	CSpscQueue<CBuffer *, NUM_BUFFERS + 1> freeBuffers;		// consumer -> reader thread
+	CSpscQueue<CBuffer *, NUM_BUFFERS + 1> filledBuffers;		// reader thread -> consumer
+	CBuffer *current;		// consumer only
+	uint64_t currentPos;
+	bool atEnd;
+	std::thread thread;
+	std::atomic<bool> stop;
+	std::atomic<bool> failed;
+	uint64_t bytesRead;		// written by the reader thread, read after Stop()
+	double ioSeconds;
+	double waitSeconds;
+	double startSeconds;
+	double stopSeconds;
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_prefetchreader_h__included_formal_crypto
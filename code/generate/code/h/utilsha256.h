@@ -0,0 +1,235 @@
+// utilsha256.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// The reference SHA-256 implementation, and its scaled-down analogue (see formcrypto.h for the formal one). This
+// doesn't need GMP, so the tools that only read data files can use it too.
+// ================================================================================
+
+#ifndef l_utilsha256_h__included_formal_crypto
+#define l_utilsha256_h__included_formal_crypto
+
+#include <stdint.h>
+#include <string.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace formal_crypto
+{
+
+class CUtilSha256
+{
+public:
+	static uint32_t GetInitialH(uint32_t n);	// 0 <= n < 8
+	static uint32_t GetEntryK(uint32_t n);		// 0 <= n < 64
+	static const uint32_t *GetTableHs0();		// there are 32 elements in the returned array
+	static const uint32_t *GetTableHs1();		// there are 32 elements in the returned array
+	static const uint32_t *GetTableKs0();		// there are 32 elements in the returned array
+	static const uint32_t *GetTableKs1();		// there are 32 elements in the returned array
+	static uint32_t Comp32Hs0(uint32_t x);
+	static uint32_t Comp32Hs1(uint32_t x);
+	static uint32_t Comp32Ks0(uint32_t x);
+	static uint32_t Comp32Ks1(uint32_t x);
+	
+	// This updates h_entry[] to contain the result of hashing w_entry using the input h_entry initial
+	// values. numRounds shall be a multiple of 8.
+	static void CompSha256(uint32_t h_entry[8], const uint32_t w_entry[16], uint32_t numRounds = 64);
+	
+	// This tests the SHA-256 implementation. numRounds shall be a multiple of 8.
+	static void SelfTest(std::ostream &os, uint32_t numRounds = 64);
+	
+	// Diagnostic function.
+	static void WriteH(std::ostream &os, uint32_t h[8], bool cStyle = false);
+};
+
+// This exploits the fact that e.g. ks0(1 ^ 2 ^ 8) = ks0(1) ^ ks0(2) ^ ks0(8)
+// together with the fact that ks0(0) = 0.
+inline uint32_t Comp32Lookup(const uint32_t table[32], uint32_t value)
+{
+	uint32_t result = 0;
+	
+	for(uint32_t i = 0; i < 32; ++i, value >>= 1)
+	{
+		if((value & 1u) != 0)
+		{
+			result ^= table[i];
+		}
+	}
+	
+	return result;
+}
+
+// Rotate-left function.
+inline uint32_t Comp32ROTL(uint32_t x, uint32_t y)
+{
+    y &= 31;
+    
+    uint32_t left = x << y;
+    
+    
+    y = (32 - y) & 31;
+    uint32_t right = x >> y;
+    
+    return left | right;
+}
+
+// Rotate-right function.
+inline uint32_t Comp32ROTR(uint32_t x, uint32_t y)
+{
+    y &= 31;
+    
+    uint32_t left = x >> y;
+    
+    y = (32 - y) & 31;
+    
+    uint32_t right = x << y;
+    
+    return left | right;
+}
+
+// S(X) = (X >> 1). Only allowed if (X mod 2) is 0. "Shift" operator.
+// This operates on a single bit.
+inline uint32_t Comp32S(uint32_t x)
+{
+	return x >> 1;
+}
+
+// T(X) = (X mod 2). This is our so-called "nonlinear" operator.
+// This operates on a single bit.
+inline uint32_t Comp32T(uint32_t x)
+{
+	return x & 1;
+}
+
+// This is the same as Comp32Ch(), but it operates on a single bit.
+inline uint32_t Comp32ChBit(uint32_t e, uint32_t f, uint32_t g)
+{
+    return Comp32S(f + g + Comp32T(e + g) - Comp32T(e + f));
+}
+
+// This is the same as Comp32Maj() function, but it operates on a single bit.
+inline uint32_t Comp32MajBit(uint32_t a, uint32_t b, uint32_t c)
+{
+    return Comp32S(a + b + c - Comp32T(a + b + c));
+}
+
+// Comp32BitQuest(s, x, y) returns ((s) ? x : y) for each bit, in a bitwise way.
+inline uint32_t Comp32BitQuest(uint32_t s, uint32_t x, uint32_t y)
+{
+    // The two terms being xor'd together here are mutually exclusive,
+    // so for example, | could be used instead of | here.
+    return (s & x) ^ (y & ~s);
+}
+
+// Alternative definition: 2 * Ch(e, f, g)  = f + g + T(e + g) - T(e + f)
+inline uint32_t Comp32Ch(uint32_t e, uint32_t f, uint32_t g)
+{
+    // an example alternate form for this is: return g + (e & f) - (e & g);
+    return Comp32BitQuest(e, f, g);
+}
+
+// Alternative definition: 2 * Maj(a, b, c) = a + b + c - T(a + b + c)
+inline uint32_t Comp32Maj(uint32_t a, uint32_t b, uint32_t c)
+{
+    // original form:  return (a & b) ^ (a & c) ^ (b & c);
+    // alternate form: return bitquest(a, b | c, b & c);
+    return Comp32BitQuest(b ^ c, a, b);
+}
+
+// ================================================================================
+
+enum	// this should be no less than 32 and should be increased only if necessary
+{
+	WORD_SIZE_BITS_MAX = 32
+};
+
+// This is a scaled-down analogue of SHA-256 that operates on 'wordSizeBits'-bit words, so that a complete
+// generate/convert/check2/compute1 run can be done in seconds. Each rotate or shift amount r becomes
+// round(r * wordSizeBits / 32), and the initial h[] values and k[] entries are the top 'wordSizeBits' bits of their
+// SHA-256 counterparts. With 32-bit words, this is precisely SHA-256.
+class CUtilScaledSha256
+{
+	uint32_t wordSizeBits;
+	uint32_t mask;
+	uint32_t initialH[8];
+	uint32_t tableK[64];
+	uint32_t tableHs0[WORD_SIZE_BITS_MAX];
+	uint32_t tableHs1[WORD_SIZE_BITS_MAX];
+	uint32_t tableKs0[WORD_SIZE_BITS_MAX];
+	uint32_t tableKs1[WORD_SIZE_BITS_MAX];
+
+public:
+	// Throws std::runtime_error if the word size is out of range (8..32) or if the scaled rotate amounts of any
+	// sigma function collapse (e.g. two rotations by the same amount, which would cancel out).
+	CUtilScaledSha256(uint32_t wordSizeBitsT = 32);
+
+	uint32_t WordSizeBits() const
+	{
+		return this->wordSizeBits;
+	}
+
+	uint32_t GetMask() const
+	{
+		return this->mask;
+	}
+
+	uint32_t GetInitialH(uint32_t n) const		// 0 <= n < 8
+	{
+		return this->initialH[n];
+	}
+
+	uint32_t GetEntryK(uint32_t n) const		// 0 <= n < 64
+	{
+		return this->tableK[n];
+	}
+
+	// There are 'wordSizeBits' significant elements in each of the returned arrays (the rest are 0).
+	const uint32_t *GetTableHs0() const  { return this->tableHs0; }
+	const uint32_t *GetTableHs1() const  { return this->tableHs1; }
+	const uint32_t *GetTableKs0() const  { return this->tableKs0; }
+	const uint32_t *GetTableKs1() const  { return this->tableKs1; }
+
+	// Same as CUtilSha256::CompSha256(), but on 'wordSizeBits'-bit words. Bits of w_entry[] and h_entry[] above the
+	// word size are ignored. numRounds shall be a multiple of 8.
+	void CompSha256(uint32_t h_entry[8], const uint32_t w_entry[16], uint32_t numRounds = 64) const;
+
+	// This checks that the 32-bit instance matches CUtilSha256 for every supported number of rounds.
+	// Returns true if the test passed, false otherwise.
+	static bool SelfTest(std::ostream &os);
+};
+
+// ================================================================================
+
+// This is the SHA-256 digest of a byte stream, fed in pieces, using CUtilSha256::CompSha256() for each 64-byte block.
+class CSha256Stream
+{
+public:
+	enum { DIGEST_BYTES = 32 };
+
+	CSha256Stream();
+
+	void Reset();
+
+	void Add(const void *data, uint64_t size);
+
+	// This pads the message and writes its digest (big-endian, as usual). Call Reset() before using this again.
+	void Finish(uint8_t digest[DIGEST_BYTES]);
+
+	// This checks the digests of a few standard test messages. Returns true if the test passed, false otherwise.
+	static bool SelfTest(std::ostream &os);
+
+	// This returns 'digest' in hexadecimal.
+	static std::string ToHex(const uint8_t digest[DIGEST_BYTES]);
+
+private:
+	void DoBlock(const uint8_t *p);
+
+	uint32_t h[8];
+	uint8_t block[64];
+	uint32_t blockBytes;
+	uint64_t totalBytes;
+};
+
+}	// namespace formal_crypto
+
+#endif	// l_utilsha256_h__included_formal_crypto
@@ -0,0 +1,537 @@
+// utilsha256.cpp - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// The reference SHA-256 implementation (see utilsha256.h).
+// ================================================================================
+
+#include "utilsha256.h"
+
+#include <cstdio>
+
+namespace formal_crypto
+{
+
+#include "ks0.h"
+#include "ks1.h"
+#include "hs0.h"
+#include "hs1.h"
+
+static const uint32_t sha256_initial_h[8] =
+{
+	0x6a09e667,
+	0xbb67ae85,
+	0x3c6ef372,
+	0xa54ff53a,
+	0x510e527f,
+	0x9b05688c,
+	0x1f83d9ab,
+	0x5be0cd19
+};
+
+static const uint32_t sha256_table_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+uint32_t CUtilSha256::GetInitialH(uint32_t n)	// 0 <= n < 8
+{
+	return sha256_initial_h[n];
+}
+
+uint32_t CUtilSha256::GetEntryK(uint32_t n)		// 0 <= n < 64
+{
+	return sha256_table_k[n];
+}
+
+// Since the sigma functions are linear (see Comp32Lookup()), each can also be computed a byte at a time, from four
+// 256-entry tables built from its 32-entry one. That's 4 lookups instead of up to 32, which matters to CSha256Stream.
+class CUtilSha256ByteTables
+{
+public:
+	explicit CUtilSha256ByteTables(const uint32_t table[32])
+	{
+		for(uint32_t k = 0; k < 4; ++k)
+		{
+			for(uint32_t b = 0; b < 256; ++b)
+			{
+				this->bytes[k][b] = Comp32Lookup(table, b << (8 * k));
+			}
+		}
+	}
+
+	uint32_t Lookup(uint32_t x) const
+	{
+		return this->bytes[0][x & 0xff] ^ this->bytes[1][(x >> 8) & 0xff] ^ this->bytes[2][(x >> 16) & 0xff] ^ this->bytes[3][x >> 24];
+	}
+
+private:
+	uint32_t bytes[4][256];
+};
+
+enum { BYTE_TABLE_HS0, BYTE_TABLE_HS1, BYTE_TABLE_KS0, BYTE_TABLE_KS1 };
+
+static const CUtilSha256ByteTables &DoGetByteTables(uint32_t n)
+{
+	static const CUtilSha256ByteTables tables[4] =
+	{
+		CUtilSha256ByteTables(table_hs0),
+		CUtilSha256ByteTables(table_hs1),
+		CUtilSha256ByteTables(table_ks0),
+		CUtilSha256ByteTables(table_ks1)
+	};
+
+	return tables[n];
+}
+
+const uint32_t *CUtilSha256::GetTableHs0()
+{
+	return table_hs0;
+}
+
+const uint32_t *CUtilSha256::GetTableHs1()
+{
+	return table_hs1;
+}
+
+const uint32_t *CUtilSha256::GetTableKs0()
+{
+	return table_ks0;
+}
+
+const uint32_t *CUtilSha256::GetTableKs1()
+{
+	return table_ks1;
+}
+
+uint32_t CUtilSha256::Comp32Hs0(uint32_t x)
+{
+	return DoGetByteTables(BYTE_TABLE_HS0).Lookup(x);
+}
+
+uint32_t CUtilSha256::Comp32Hs1(uint32_t x)
+{
+	return DoGetByteTables(BYTE_TABLE_HS1).Lookup(x);
+}
+
+uint32_t CUtilSha256::Comp32Ks0(uint32_t x)
+{
+	return DoGetByteTables(BYTE_TABLE_KS0).Lookup(x);
+}
+
+uint32_t CUtilSha256::Comp32Ks1(uint32_t x)
+{
+	return DoGetByteTables(BYTE_TABLE_KS1).Lookup(x);
+}
+
+// numRounds shall be a multiple of 8, with 64 being the full standard.
+void CUtilSha256::CompSha256(uint32_t h_entry[8], const uint32_t w_entry[16], uint32_t numRounds /*= 64*/)
+{
+	enum { A, B, C, D, E, F, G, H };
+
+	uint32_t w[64];
+
+	uint32_t h[8];
+
+	const CUtilSha256ByteTables &hs0 = DoGetByteTables(BYTE_TABLE_HS0);
+	const CUtilSha256ByteTables &hs1 = DoGetByteTables(BYTE_TABLE_HS1);
+	const CUtilSha256ByteTables &ks0 = DoGetByteTables(BYTE_TABLE_KS0);
+	const CUtilSha256ByteTables &ks1 = DoGetByteTables(BYTE_TABLE_KS1);
+
+	for(uint32_t i = 0; i < 16; ++i)
+	{
+		w[i] = w_entry[i];
+	}
+
+	for(uint32_t i = 16; i < 64; ++i)
+	{
+		w[i] = w[i - 16] + ks0.Lookup(w[(i + 1) - 16]) + w[(i + 9) - 16] + ks1.Lookup(w[(i + 14) - 16]);
+	}
+
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		h[i] = h_entry[i];
+	}
+
+	for(uint32_t i = 0; i < numRounds; ++i)
+	{
+#undef VAR
+#define VAR(x) h[((x) - i) & 7]
+		VAR(H) += hs1.Lookup(VAR(E)) + Comp32Ch(VAR(E), VAR(F), VAR(G)) + sha256_table_k[i] + w[i];
+
+		VAR(D) += VAR(H);
+
+		VAR(H) += hs0.Lookup(VAR(A)) + Comp32Maj(VAR(A), VAR(B), VAR(C));
+#undef VAR
+	}
+
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		h_entry[i] += h[i];
+	}
+}
+
+void CUtilSha256::WriteH(std::ostream &os, uint32_t h[8], bool cStyle /*= false*/)
+{
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		char s[32 + 1];
+
+		std::sprintf(s, "%08X", (unsigned int)(h[i]));
+
+		if(cStyle == true)
+		{
+			os << "0x";
+		}
+		os << s;
+		
+		if(i != 7)
+		{
+			if(cStyle == true)
+				os << ",";
+			else
+				os << " ";
+		}
+	}        
+	os << std::endl;
+}
+
+void CUtilSha256::SelfTest(std::ostream &os, uint32_t numRounds /*= 64*/)
+{
+        uint32_t h[8];
+        uint32_t w[16];
+        
+        for(uint32_t i = 0; i < 8; ++i)
+        {
+        	h[i] = sha256_initial_h[i];
+        }
+        
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+        	w[i] = 0;
+        }
+        
+        w[0] = ('t' << 0) + ('s' << 8) + ('e' << 16) + ('t' << 24);	// message to digest ("test")
+        w[1] = 0x80000000u;						// marker bit
+        w[15] = (4 * 8);						// message length, low 32 bits
+        
+        CompSha256(h, w);
+
+	os << "4092FEF0 263500F6 48BD3A9B E8A5BEE6 F662B089 96D7DCE6 30390A6E 51EFD3EA [8]\n";
+	os << "F6FEA097 241DA176 018401FD 7029A783 74866420 4242CAF1 86B6906D 7E3EF42F [16]\n";
+	os << "C5D60ADA 8ADCF131 1DA993BC A1460DBC 493C24FA 11145185 9F3F5F47 3CA160F8 [24]\n";
+	os << "5C1DE77E E5C56410 F9937A39 BF5F5F4C D6E5F802 1A8FB422 72401439 A94AB795 [32]\n";
+	os << "85454A4A BB363DB5 F69AEA15 28588B34 3B1B5DCF D330022C 63FDD7F5 2535D2F4 [40]\n";
+	os << "FBD318B4 C80A34D1 289D43E4 2B400C18 8BC0FE27 F292BC76 6702F299 A7D043E8 [48]\n";
+	os << "3407105C 0B72A53B F02BCE70 E9603A20 41541D57 81AEFD0D 3355EFF2 35F375C9 [56]\n";
+	os << "9F86D081 884C7D65 9A2FEAA0 C55AD015 A3BF4F1B 2B0B822C D15D6C15 B0F00A08 [64]\n" << std::endl;
+	
+	WriteH(os, h);
+}
+
+// ================================================================================
+
+CSha256Stream::CSha256Stream()
+{
+	this->Reset();
+}
+
+void CSha256Stream::Reset()
+{
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		this->h[i] = sha256_initial_h[i];
+	}
+
+	this->blockBytes = 0;
+	this->totalBytes = 0;
+}
+
+void CSha256Stream::Add(const void *data, uint64_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	this->totalBytes += size;
+
+	if(this->blockBytes != 0)
+	{
+		while(size != 0 && this->blockBytes < 64)
+		{
+			this->block[this->blockBytes++] = *p++;
+			--size;
+		}
+
+		if(this->blockBytes < 64)
+		{
+			return;
+		}
+
+		this->DoBlock(this->block);
+		this->blockBytes = 0;
+	}
+
+	for(; size >= 64; p += 64, size -= 64)
+	{
+		this->DoBlock(p);
+	}
+
+	memcpy(this->block, p, size);
+	this->blockBytes = size;
+}
+
+void CSha256Stream::Finish(uint8_t digest[DIGEST_BYTES])
+{
+	const uint64_t totalBits = this->totalBytes * 8;
+	uint8_t padding[64 + 8] = { 0x80 };
+	const uint32_t paddingBytes = (this->blockBytes < 56) ? (56 - this->blockBytes) : (120 - this->blockBytes);
+
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		padding[paddingBytes + i] = (uint8_t)(totalBits >> (56 - 8 * i));
+	}
+
+	this->Add(padding, paddingBytes + 8);
+
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		digest[4 * i + 0] = (uint8_t)(this->h[i] >> 24);
+		digest[4 * i + 1] = (uint8_t)(this->h[i] >> 16);
+		digest[4 * i + 2] = (uint8_t)(this->h[i] >> 8);
+		digest[4 * i + 3] = (uint8_t)(this->h[i]);
+	}
+}
+
+bool CSha256Stream::SelfTest(std::ostream &os)
+{
+	static const char *messages[3] =
+	{
+		"",
+		"abc",
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+	};
+
+	static const char *expected[3] =
+	{
+		"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+	};
+
+	for(uint32_t n = 0; n < 3; ++n)
+	{
+		CSha256Stream stream;
+		uint8_t digest[DIGEST_BYTES];
+
+		// Feed the message a byte at a time, to also exercise partial blocks.
+		for(const char *p = messages[n]; *p != '\0'; ++p)
+		{
+			stream.Add(p, 1);
+		}
+
+		stream.Finish(digest);
+
+		if(ToHex(digest) != expected[n])
+		{
+			os << "CSha256Stream::SelfTest(): wrong digest for \"" << messages[n] << "\": " << ToHex(digest) << std::endl;
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::string CSha256Stream::ToHex(const uint8_t digest[DIGEST_BYTES])
+{
+	std::string s;
+
+	for(uint32_t i = 0; i < DIGEST_BYTES; ++i)
+	{
+		char t[4];
+
+		std::snprintf(t, sizeof(t), "%02x", (unsigned int)digest[i]);
+		s += t;
+	}
+
+	return s;
+}
+
+void CSha256Stream::DoBlock(const uint8_t *p)
+{
+	uint32_t w[16];
+
+	for(uint32_t i = 0; i < 16; ++i, p += 4)
+	{
+		w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+	}
+
+	CUtilSha256::CompSha256(this->h, w);
+}
+
+// ================================================================================
+
+// Rotate-right within a word of 'bits' bits.
+static uint32_t DoScaledROTR(uint32_t x, uint32_t y, uint32_t bits, uint32_t mask)
+{
+	y %= bits;
+
+	if(y == 0)
+	{
+		return x & mask;
+	}
+
+	return ((x >> y) | (x << (bits - y))) & mask;
+}
+
+// Scales a SHA-256 rotate/shift amount (which assumes a 32-bit word) down to 'bits' bits, rounding to nearest.
+static uint32_t DoScaleAmount(uint32_t amount, uint32_t bits)
+{
+	return (amount * bits + 16) / 32;
+}
+
+// Builds a lookup table for x -> ROTR(x, a) ^ ROTR(x, b) ^ (c is a rotation ? ROTR(x, c) : x >> c).
+static void DoBuildScaledTable(uint32_t table[WORD_SIZE_BITS_MAX], uint32_t a, uint32_t b, uint32_t c, bool cIsRotate, uint32_t bits, uint32_t mask)
+{
+	uint32_t sa = DoScaleAmount(a, bits);
+	uint32_t sb = DoScaleAmount(b, bits);
+	uint32_t sc = DoScaleAmount(c, bits);
+
+	if(sa == 0 || sb == 0 || sc == 0 || sa == sb || sa == sc || sb == sc)
+	{
+		throw std::runtime_error("CUtilScaledSha256::CUtilScaledSha256(): the requested word size makes a sigma function degenerate.");
+	}
+
+	for(uint32_t i = 0; i < WORD_SIZE_BITS_MAX; ++i)
+	{
+		table[i] = 0;
+
+		if(i >= bits)
+		{
+			continue;
+		}
+
+		uint32_t x = 1u << i;
+
+		table[i] = DoScaledROTR(x, sa, bits, mask) ^ DoScaledROTR(x, sb, bits, mask);
+		table[i] ^= (cIsRotate == true) ? DoScaledROTR(x, sc, bits, mask) : (x >> sc);
+	}
+}
+
+CUtilScaledSha256::CUtilScaledSha256(uint32_t wordSizeBitsT /*= 32*/) :
+	wordSizeBits(wordSizeBitsT),
+	mask(0)
+{
+	if(wordSizeBitsT < 8 || wordSizeBitsT > 32 || wordSizeBitsT > WORD_SIZE_BITS_MAX)
+	{
+		throw std::runtime_error("CUtilScaledSha256::CUtilScaledSha256(): word size must be between 8 and 32 bits inclusive.");
+	}
+
+	this->mask = (wordSizeBitsT == 32) ? 0xffffffffu : ((1u << wordSizeBitsT) - 1);
+
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		this->initialH[i] = CUtilSha256::GetInitialH(i) >> (32 - wordSizeBitsT);
+	}
+
+	for(uint32_t i = 0; i < 64; ++i)
+	{
+		this->tableK[i] = CUtilSha256::GetEntryK(i) >> (32 - wordSizeBitsT);
+	}
+
+	// These are the SHA-256 amounts; see the hs0.h, hs1.h, ks0.h and ks1.h tables.
+	DoBuildScaledTable(this->tableHs0, 2, 13, 22, true, wordSizeBitsT, this->mask);
+	DoBuildScaledTable(this->tableHs1, 6, 11, 25, true, wordSizeBitsT, this->mask);
+	DoBuildScaledTable(this->tableKs0, 7, 18, 3, false, wordSizeBitsT, this->mask);
+	DoBuildScaledTable(this->tableKs1, 17, 19, 10, false, wordSizeBitsT, this->mask);
+}
+
+void CUtilScaledSha256::CompSha256(uint32_t h_entry[8], const uint32_t w_entry[16], uint32_t numRounds /*= 64*/) const
+{
+	enum { A, B, C, D, E, F, G, H };
+
+	uint32_t w[64];
+
+	uint32_t h[8];
+
+	for(uint32_t i = 0; i < 16; ++i)
+	{
+		w[i] = w_entry[i] & this->mask;
+	}
+
+	for(uint32_t i = 16; i < 64; ++i)
+	{
+		w[i] = (w[i - 16] + Comp32Lookup(tableKs0, w[(i + 1) - 16]) + w[(i + 9) - 16] + Comp32Lookup(tableKs1, w[(i + 14) - 16])) & this->mask;
+	}
+
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		h[i] = h_entry[i] & this->mask;
+	}
+
+	for(uint32_t i = 0; i < numRounds; ++i)
+	{
+#undef VAR
+#define VAR(x) h[((x) - i) & 7]
+		VAR(H) += Comp32Lookup(tableHs1, VAR(E)) + Comp32Ch(VAR(E), VAR(F), VAR(G)) + this->tableK[i] + w[i];
+		VAR(H) &= this->mask;
+
+		VAR(D) += VAR(H);
+		VAR(D) &= this->mask;
+
+		VAR(H) += Comp32Lookup(tableHs0, VAR(A)) + Comp32Maj(VAR(A), VAR(B), VAR(C));
+		VAR(H) &= this->mask;
+#undef VAR
+	}
+
+	for(uint32_t i = 0; i < 8; ++i)
+	{
+		h_entry[i] = (h_entry[i] + h[i]) & this->mask;
+	}
+}
+
+bool CUtilScaledSha256::SelfTest(std::ostream &os)
+{
+	CUtilScaledSha256 scaled(32);
+	uint32_t seed = 0x12345678u;
+
+	for(uint32_t numRounds = 8; numRounds <= 64; numRounds += 8)
+	{
+		for(uint32_t n = 0; n < 16; ++n)
+		{
+			uint32_t w[16];
+			uint32_t h1[8];
+			uint32_t h2[8];
+
+			for(uint32_t i = 0; i < 16; ++i)
+			{
+				seed = seed * 1103515245u + 12345u;
+				w[i] = seed ^ (seed >> 16);
+			}
+
+			for(uint32_t i = 0; i < 8; ++i)
+			{
+				h1[i] = h2[i] = CUtilSha256::GetInitialH(i);
+			}
+
+			CUtilSha256::CompSha256(h1, w, numRounds);
+			scaled.CompSha256(h2, w, numRounds);
+
+			if(memcmp(h1, h2, sizeof(h1)) != 0)
+			{
+				os << "CUtilScaledSha256::SelfTest(): mismatch with " << numRounds << " round(s)." << std::endl;
+
+				return false;
+			}
+		}
+	}
+
+	os << "CUtilScaledSha256::SelfTest(): 32-bit instance matches CUtilSha256." << std::endl;
+
+	return true;
+}
+
+}	// namespace formal_crypto
@@ -4,9 +4,15 @@
 #define l_matrix_h__formal_included
 
 #include <stdexcept>
+#include <algorithm>
+#include <iterator>
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <atomic>
 #include <vector>
 #include <map>
 #include <set>
@@ -15,7 +21,13 @@
 
 #include <cstdio>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "common.h"
+#include "rowblockfile.h"
+#include "workstealing.h"
 
 struct uword_t
 {
@@ -89,7 +101,7 @@ struct uword_t
 			src.x *= src.x;
 		}
 		*/
-		uword_t result = ComputeModuloInverse(src.x, 1uLL << (WORD_SIZE_BITS + 1));
+		uword_t result = ComputeOddInverse(src.x);
 		
 		uword_t check = result.x * original.x;
 	
@@ -103,6 +115,20 @@ struct uword_t
 		return result;
 	}
 
+	// pre: 'odd' is odd. This returns its inverse modulo 2^64 (and so modulo 2^33 as well), by Newton's iteration:
+	// odd * odd is 1 modulo 8, so 'odd' is its own inverse to 3 bits, and each step doubles the number of bits.
+	static uint64_t ComputeOddInverse(uint64_t odd)
+	{
+		uint64_t inverse = odd;
+		
+		for(uint32_t i = 0; i < 5; ++i)		// 3, 6, 12, 24, 48, 96 bits
+		{
+			inverse *= 2 - odd * inverse;
+		}
+		
+		return inverse;
+	}
+
 	// pre: value and modulo should be relatively prime, e.g.
 	// GCD(value, modulo) should be 1.
 	static uint64_t ComputeModuloInverse(uint64_t value, uint64_t modulo)
@@ -180,11 +206,15 @@ struct uword_t
 	}
 };
 
+// The rows are kept in memory, or in a file if the matrix is made with an out-of-core CMatrixStorage (see
+// CRowBlockFile). Either way, the entries are reached through GetRowBuffer(); GetBuffer() is nullptr for a file.
 class CIntegralMatrix
 {
 	uint64_t height;
 	uint64_t width;
 	uword_t *buffer;
+	std::shared_ptr<CRowBlockFile> file;		// this has the rows instead of 'buffer', if it's set
+	CMatrixStorage storage;
 
 public:
 	uint64_t GetBufferEntryCount() const
@@ -196,6 +226,28 @@ public:
 	{
 		return this->buffer;
 	}
+	
+	// Row 'row' is GetRowBuffer(row)[0] to GetRowBuffer(row)[width - 1]. For a file, the pointer is only good for a
+	// few more calls (see CRowBlockFile::GetRow()).
+	uword_t *GetRowBuffer(uint64_t row)
+	{
+		if(this->file != nullptr)
+		{
+			return (uword_t *)this->file->GetRow(row, true);
+		}
+		
+		return this->buffer + this->width * row;
+	}
+	
+	const uword_t *GetRowBuffer(uint64_t row) const
+	{
+		if(this->file != nullptr)
+		{
+			return (const uword_t *)this->file->GetRow(row, false);
+		}
+		
+		return this->buffer + this->width * row;
+	}
 
 	CIntegralMatrix() :
 		height(0),
@@ -215,48 +267,93 @@ public:
 	}
 	
 	CIntegralMatrix(const CIntegralMatrix &src) :
-		height(src.height),
-		width(src.width),
+		height(0),
+		width(0),
 		buffer(nullptr)
 	{
-		this->buffer = new uword_t [width * (height + 1)];
-		
-		for(uint64_t n = 0; n < width * (height + 1); ++n)
-		{
-			this->buffer[n] = src.buffer[n];
-		}
+		*this = src;
 	}
 	
 	CIntegralMatrix &operator=(const CIntegralMatrix &src)
 	{
+		if(this == &src)
+		{
+			return *this;
+		}
+		
+		delete [] this->buffer;
+		
 		this->height = src.height;
 		this->width = src.width;
 		this->buffer = nullptr;
-	
-		this->buffer = new uword_t [width * (height + 1)];
+		this->storage = src.storage;
+		this->DoAllocate();
 		
-		for(uint64_t n = 0; n < width * (height + 1); ++n)
+		for(uint64_t y = 0; y <= this->height; ++y)
 		{
-			this->buffer[n] = src.buffer[n];
+			const uword_t *srcRow = src.GetRowBuffer(y);
+			uword_t *row = this->GetRowBuffer(y);
+			
+			for(uint64_t x = 0; x < this->width; ++x)
+			{
+				row[x] = srcRow[x];
+			}
 		}
 		
 		return *this;
 	}
 
-	CIntegralMatrix(uint64_t heightT, uint64_t widthT) :
+	CIntegralMatrix(uint64_t heightT, uint64_t widthT, const CMatrixStorage &storageT = CMatrixStorage()) :
 		height(heightT),
 		width(widthT),
-		buffer(nullptr)
+		buffer(nullptr),
+		storage(storageT)
 	{
-		this->buffer = new uword_t [width * (height + 1)];
+		this->DoAllocate();
 		
-		this->ZeroMatrix();
-		
-		this->ZeroRow(height);				// zero out invisible bottom row
+		if(this->file == nullptr)		// a new file is all zeros already
+		{
+			this->ZeroMatrix();
+			
+			this->ZeroRow(height);				// zero out invisible bottom row
+		}
+	}
+	
+	bool IsOutOfCore() const
+	{
+		return this->file != nullptr;
+	}
+	
+	// This has the given rows (sorted) read in ahead of time, if they're in a file.
+	void PrefetchRows(const uint64_t *rows, uint64_t count)
+	{
+		if(this->file != nullptr)
+		{
+			this->file->Prefetch(rows, count);
+		}
+	}
+	
+	// This shows how the file was used, if the rows are in one.
+	void Report(std::ostream &os)
+	{
+		if(this->file != nullptr)
+		{
+			this->file->Report(os);
+		}
 	}
 	
 	void ZeroMatrix()
 	{
+		if(this->file != nullptr)
+		{
+			for(uint64_t y = 0; y < height; ++y)
+			{
+				this->ZeroRow(y);
+			}
+			
+			return;
+		}
+		
 		for(uint64_t n = 0; n < width * height; ++n)	// don't zero out invisible bottom row
 		{
 			this->buffer[n].x = 0;
@@ -265,9 +362,11 @@ public:
 	
 	void ZeroRow(uint64_t row)
 	{
+		uword_t *data = this->GetRowBuffer(row);
+		
 		for(uint64_t n = 0; n < width; ++n)
 		{
-			this->buffer[width * row + n].x = 0;
+			data[n].x = 0;
 		}
 	}
 	
@@ -278,9 +377,11 @@ public:
 	
 	bool RowIsAllZeros(uint64_t row)
 	{
+		const uword_t *data = this->GetRowBuffer(row);
+		
 		for(uint64_t n = 0; n < width; ++n)
 		{
-			if(this->buffer[width * row + n].x != 0)
+			if(data[n].x != 0)
 			{
 				return false;
 			}
@@ -291,800 +392,4630 @@ public:
 	
 	void Set(uint64_t y, uint64_t x, uword_t src)
 	{
-		this->buffer[this->width * y + x] = src;
+		this->GetRowBuffer(y)[x] = src;
 	}
 	
 	uword_t Get(uint64_t y, uint64_t x) const
 	{
-		return this->buffer[this->width * y + x];
+		return this->GetRowBuffer(y)[x];
+	}
+
+private:
+	void DoAllocate()
+	{
+		this->file = nullptr;
+		
+		if(this->storage.IsOutOfCore() == true && this->width != 0)
+		{
+			this->file = std::make_shared<CRowBlockFile>(this->height + 1, this->width * sizeof(uword_t), this->storage);
+		}
+		else
+		{
+			this->buffer = new uword_t [width * (height + 1)];
+		}
 	}
 };
 
-// This is a matrix reference.
-class CMatrix
+// This is one nonzero entry of a CSparseIntegralMatrix row.
+struct CSparseEntry
 {
-	std::shared_ptr<CIntegralMatrix> target;
-	CIntegralMatrix unityColumnAdder;
-	std::vector<uint64_t> actualColumns;		// -1uLL means: the column is 0
-	uint64_t logicalHeight;
-	uint64_t logicalWidth;
+	uint64_t column;
+	uint64_t value;		// never 0 (modulo 2^33)
+};
+
+// This is a matrix that only keeps the nonzero entries of each row, in column order; check2's matrix only has a few
+// nonzero columns per row, since each row defines one temporary in terms of a few earlier ones. It also keeps the
+// number of nonzero rows in each column, and the columns ordered by that count, for picking pivots (see
+// CSparseEchelonEngine). Unlike CMatrix, there's no column mapping and no 'unity' adder.
+class CSparseIntegralMatrix
+{
+	uint64_t height;
+	uint64_t width;
+	uint64_t numNonzeros;
+	uint64_t numNonzeroRows;
+	std::vector<std::vector<CSparseEntry> > rows;
+	std::vector<uint64_t> columnCounts;							// nonzero rows in each column
+	std::vector<std::vector<uint64_t> > columnRows;				// see GetColumnRows()
+	std::set<std::pair<uint64_t, uint64_t> > columnsByCount;	// (count, column), for the columns that aren't all zeros
+	std::vector<uint64_t> rowStamps;							// for GetColumnRows()
+	uint64_t stamp;
+	std::vector<CSparseEntry> scratch;
+
+public:
+	CSparseIntegralMatrix(uint64_t heightT, uint64_t widthT) :
+		height(heightT),
+		width(widthT),
+		numNonzeros(0),
+		numNonzeroRows(0),
+		rows(heightT),
+		columnCounts(widthT, 0),
+		columnRows(widthT),
+		rowStamps(heightT, 0),
+		stamp(0)
+	{
+	}
 	
-	void WriteMatrix(std::FILE *fo, CIntegralMatrix &m, const char eightcc[8])
+	uint64_t GetHeight() const
 	{
-		uint64_t x = m.GetBufferEntryCount() * sizeof(uint64_t) + sizeof(uint64_t) * 4;
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		return this->height;
+	}
+	
+	uint64_t GetWidth() const
+	{
+		return this->width;
+	}
+	
+	uint64_t GetNonzeroCount() const
+	{
+		return this->numNonzeros;
+	}
+	
+	uint64_t GetNonzeroRowCount() const
+	{
+		return this->numNonzeroRows;
+	}
+	
+	// This is the number of nonzero rows in column 'x'.
+	uint64_t GetColumnCount(uint64_t x) const
+	{
+		return this->columnCounts[x];
+	}
+	
+	// These are the columns that aren't all zeros, as (count, column) pairs, with the sparsest columns first.
+	const std::set<std::pair<uint64_t, uint64_t> > &GetColumnsByCount() const
+	{
+		return this->columnsByCount;
+	}
+	
+	const std::vector<CSparseEntry> &GetRow(uint64_t y) const
+	{
+		return this->rows[y];
+	}
+	
+	uword_t Get(uint64_t y, uint64_t x) const
+	{
+		const std::vector<CSparseEntry> &row = this->rows[y];
 		
-		memcpy(&x, eightcc, 8);
-		fwrite(&x, sizeof(uint64_t), 1, fo);
-
-		x = m.GetHeight();
-		fwrite(&x, sizeof(uint64_t), 1, fo);
-
-		x = m.GetWidth();
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		std::vector<CSparseEntry>::const_iterator i = std::lower_bound(row.begin(), row.end(), x,
+			[](const CSparseEntry &entry, uint64_t column) { return entry.column < column; }
+		);
 		
-		fwrite(m.GetBuffer(), m.GetBufferEntryCount() * sizeof(uword_t), 1, fo);
+		return (i == row.end() || i->column != x) ? 0 : i->value;
 	}
 	
-	// Returns true on success, false otherwise.
-	bool ReadMatrix(std::FILE *fi, CIntegralMatrix &m, const char eightcc[8])
+	// This replaces row 'y' with 'entries', which must be in column order, in range and nonzero ('entries' is left with
+	// the old row).
+	void SetRow(uint64_t y, std::vector<CSparseEntry> &entries)
 	{
-		uint64_t x = 0;
-		(void) fread(&x, sizeof(uint64_t), 1, fi);
-
-		if(x != m.GetBufferEntryCount() * sizeof(uint64_t) + sizeof(uint64_t) * 4)
-		{
-			return false;
-		}
+		std::vector<CSparseEntry> &row = this->rows[y];
 		
-		(void) fread(&x, sizeof(uint64_t), 1, fi);
-		if(memcmp(&x, eightcc, 8) != 0)
+		for(uint64_t i = 0; i < row.size(); ++i)
 		{
-			return false;
+			this->DoSetColumnCount(row[i].column, this->columnCounts[row[i].column] - 1);
 		}
 		
-		(void) fread(&x, sizeof(uint64_t), 1, fi);
-		if(x != m.GetHeight())
+		for(uint64_t i = 0; i < entries.size(); ++i)
 		{
-			return false;
+			this->DoSetColumnCount(entries[i].column, this->columnCounts[entries[i].column] + 1);
+			this->columnRows[entries[i].column].push_back(y);
 		}
 		
-		(void) fread(&x, sizeof(uint64_t), 1, fi);
-		if(x != m.GetWidth())
-		{
-			return false;
-		}
+		this->DoResize(y, entries.size());
 		
-		if(fread(m.GetBuffer(), m.GetBufferEntryCount() * sizeof(uword_t), 1, fi) != 1)
-		{
-			return false;
-		}
+		row.swap(entries);
+	}
 	
-		return true;
+	// This zeroes row 'y' and returns what it was.
+	std::vector<CSparseEntry> TakeRow(uint64_t y)
+	{
+		std::vector<CSparseEntry> entries;
+		
+		this->SetRow(y, entries);
+		
+		return entries;
 	}
 	
-public:
-	// returns true on success, false in case of failure.
-	bool AcceptColumnMapping(const CMatrix &src)
+	// This adds 'src' (see SetRow()), times 'scalar', to row 'y'. Returns the number of entries that were zero and now
+	// aren't, i.e. the fill-in.
+	uint64_t AddRow(uint64_t y, const std::vector<CSparseEntry> &src, uword_t scalar)
 	{
-		if(this->actualColumns.size() != src.actualColumns.size())
+		std::vector<CSparseEntry> &row = this->rows[y];
+		uint64_t numCreated = 0;
+		uint64_t i = 0;
+		uint64_t j = 0;
+		
+		this->scratch.clear();
+		
+		while(i < row.size() || j < src.size())
 		{
-			return false;
+			if(j == src.size() || (i < row.size() && row[i].column < src[j].column))
+			{
+				this->scratch.push_back(row[i++]);
+				continue;
+			}
+			
+			CSparseEntry entry = src[j++];
+			uword_t value = entry.value * scalar.x;
+			
+			if(i < row.size() && row[i].column == entry.column)
+			{
+				value = value.x + row[i++].value;
+				
+				if(value.x == 0)
+				{
+					this->DoSetColumnCount(entry.column, this->columnCounts[entry.column] - 1);
+					continue;
+				}
+			}
+			else if(value.x == 0)
+			{
+				continue;
+			}
+			else
+			{
+				this->DoSetColumnCount(entry.column, this->columnCounts[entry.column] + 1);
+				this->columnRows[entry.column].push_back(y);
+				++numCreated;
+			}
+			
+			entry.value = value.x;
+			this->scratch.push_back(entry);
 		}
 		
-		this->actualColumns = src.actualColumns;
+		this->DoResize(y, this->scratch.size());
 		
-		return true;
+		row.swap(this->scratch);
+		
+		return numCreated;
 	}
-
-	void Asgn(const CMatrix &src)
+	
+	// These are the rows that are nonzero in column 'x', in no particular order. Rows that stopped being nonzero there
+	// are only dropped from the list here, so the list is good until the matrix is changed.
+	const std::vector<uint64_t> &GetColumnRows(uint64_t x)
 	{
-		this->target = std::make_shared<CIntegralMatrix>(*src.target);
-		
-		this->unityColumnAdder = src.unityColumnAdder;
-		
-		this->actualColumns = src.actualColumns;
+		std::vector<uint64_t> &list = this->columnRows[x];
 		
-		this->logicalHeight = src.logicalHeight;
+		if(list.size() != this->columnCounts[x])
+		{
+			uint64_t count = 0;
+			
+			++this->stamp;
+			
+			for(uint64_t i = 0; i < list.size(); ++i)
+			{
+				const uint64_t y = list[i];
+				
+				if(this->rowStamps[y] != this->stamp && this->Get(y, x).x != 0)
+				{
+					this->rowStamps[y] = this->stamp;
+					list[count++] = y;
+				}
+			}
+			
+			list.resize(count);
+		}
 		
-		this->logicalWidth = src.logicalWidth;
+		return list;
 	}
 
-	uint64_t GetPhysicalColumnIndex(uint64_t logicalX) const
+private:
+	void DoSetColumnCount(uint64_t x, uint64_t count)
 	{
-		return this->actualColumns[logicalX];
+		if(this->columnCounts[x] != 0)
+		{
+			this->columnsByCount.erase(std::make_pair(this->columnCounts[x], x));
+		}
+		
+		if(count != 0)
+		{
+			this->columnsByCount.insert(std::make_pair(count, x));
+		}
+		
+		this->columnCounts[x] = count;
 	}
-
-	uint64_t GetLogicalHeight() const
+	
+	// This updates the totals for row 'y' having 'size' entries from now on.
+	void DoResize(uint64_t y, uint64_t size)
 	{
-		return this->logicalHeight;
+		const uint64_t oldSize = this->rows[y].size();
+		
+		this->numNonzeros += size - oldSize;
+		
+		if(oldSize == 0 && size != 0)
+		{
+			++this->numNonzeroRows;
+		}
+		else if(oldSize != 0 && size == 0)
+		{
+			--this->numNonzeroRows;
+		}
 	}
+};
 
-	uint64_t GetLogicalWidth() const
+// This is a view of one row of a CMatrix (see CMatrix::GetRow()). The column mapping is resolved once, when the view
+// is made, instead of on every CMatrix::Get(); if no columns were erased or moved, 'columns' is nullptr and the row
+// is simply data[0] to data[width - 1]. The view is good until the matrix's columns are changed (or, for a matrix
+// kept in a file, until rows in a few other blocks are used; see CRowBlockFile).
+class CMatrixRow
+{
+public:
+	const uword_t *data;		// the physical row
+	const uint64_t *columns;	// the physical column of each logical column (-1uLL means: the column is 0), or nullptr
+	uint64_t width;			// the logical width; the rightmost column is the 'unity' column
+	uint64_t unityAdder;		// this is added to the 'unity' column (see CMatrix::AddToRow())
+	
+	CMatrixRow() :
+		data(nullptr),
+		columns(nullptr),
+		width(0),
+		unityAdder(0)
 	{
-		return this->logicalWidth;
 	}
-
-	// Returns true on success, false otherwise.
-	bool Read(std::FILE *fi)
+	
+	uword_t Get(uint64_t x) const
 	{
-		uint64_t totalSize = 0;
-		(void) fread(&totalSize, sizeof(uint64_t), 1, fi);
-		
-		uint64_t x = 0;
-		(void) fread(&x, sizeof(uint64_t), 1, fi);
-		if(memcmp(&x, "integral", 8) != 0)
+		if(x >= this->width)
 		{
-			return false;
+			return 0;
 		}
 		
-		(void) fread(&this->logicalHeight, sizeof(uint64_t), 1, fi);
-		(void) fread(&this->logicalWidth, sizeof(uint64_t), 1, fi);
+		uint64_t physicalX = (this->columns == nullptr) ? x : this->columns[x];
 		
-		(void) fread(&x, sizeof(uint64_t), 1, fi);
-		if(x < sizeof(uint64_t) * 2)
+		if(physicalX == -1uLL)
 		{
-			return false;
+			return 0;	// this column is all 0s
 		}
-		x -= sizeof(uint64_t) * 2;
-		x /= sizeof(uint64_t);
 		
-		if(x != actualColumns.size())
+		uword_t value = this->data[physicalX];
+		
+		if(x == this->width - 1)
 		{
-			return false;
+			value.x += this->unityAdder;
 		}
 		
-		(void) fread(&x, sizeof(uint64_t), 1, fi);
-		if(memcmp(&x, "actualco", 8) != 0)
+		return value;
+	}
+	
+	// Returns the leftmost nonzero column from column 'begin' up to (but not including) column 'n', or 'n' if there
+	// is none.
+	uint64_t GetLeadingNonzeroColumn(uint64_t n, uint64_t begin = 0) const
+	{
+		if(n > this->width)
 		{
-			return false;
+			n = this->width;
 		}
 		
-		for(uint64_t i = 0; i < actualColumns.size(); ++i)
+		if(begin >= n)
 		{
-			(void) fread(&x, sizeof(uint64_t), 1, fi);
-			this->actualColumns[i] = x;
+			return n;
 		}
 		
-		if(ReadMatrix(fi, this->unityColumnAdder, "unitycol") == false)
+		uint64_t x = begin;
+		
+		if(this->columns == nullptr)
 		{
-			return false;
+			// Everything left of the unity column is contiguous, with nothing to add.
+			for(const uint64_t end = (n < this->width) ? n : this->width - 1; x < end; ++x)
+			{
+				if(this->data[x].x != 0)
+				{
+					return x;
+				}
+			}
 		}
-
-		if(ReadMatrix(fi, *this->target, "maindata") == false)
+		
+		for(; x < n; ++x)
 		{
-			return false;
+			if(this->Get(x).x != 0)
+			{
+				return x;
+			}
 		}
 		
-		return true;
+		return n;
 	}
-
-	void Write(std::FILE *fo)
+	
+	bool IsAllZeros() const
 	{
-		using namespace std;
+		return this->GetLeadingNonzeroColumn(this->width) == this->width;
+	}
 	
-		uint64_t x = 0;
-		
-		uint64_t fp = ftell(fo);
-		
-		x = 0;
-		fwrite(&x, sizeof(uint64_t), 1, fo);	// placeholder for file size (0 = invalid)
-
-		memcpy(&x, "integral", 8);		// 8cc used to identify our matrix
-		fwrite(&x, sizeof(uint64_t), 1, fo);
-		
-		fwrite(&this->logicalHeight, sizeof(uint64_t), 1, fo);
-		fwrite(&this->logicalWidth, sizeof(uint64_t), 1, fo);
-
-		x = actualColumns.size() * sizeof(uint64_t) + sizeof(uint64_t) * 2;
-		fwrite(&x, sizeof(uint64_t), 1, fo);	// size of 'actualco' section
-
-		memcpy(&x, "actualco", 8);		// 8cc used to identify 'actualColumns'
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+	uint64_t GetNonzeroCount() const
+	{
+		uint64_t count = 0;
 		
-		for(uint64_t i = 0; i < actualColumns.size(); ++i)
+		if(this->columns == nullptr && this->width != 0)
 		{
-			x = this->actualColumns[i];
-			fwrite(&x, sizeof(uint64_t), 1, fo);
+			for(uint64_t x = 0; x < this->width - 1; ++x)
+			{
+				count += (this->data[x].x != 0);
+			}
+			
+			return count + (this->Get(this->width - 1).x != 0);
 		}
 		
-		WriteMatrix(fo, this->unityColumnAdder, "unitycol");
-		
-		WriteMatrix(fo, *this->target, "maindata");
+		for(uint64_t x = 0; x < this->width; ++x)
+		{
+			count += (this->Get(x).x != 0);
+		}
 		
-		x = ftell(fo);
-
-		if(fp == 0)
-			rewind(fo);
-		else
-			fseek(fo, fp, SEEK_SET);
-
-		// update file size
-		fwrite(&x, sizeof(uint64_t), 1, fo);
+		return count;
 	}
+};
 
-	// Create a 'null' matrix.
-	CMatrix()
-	{
-	}
-	
-	CMatrix(const CMatrix &src) :
-		target(src.target),
-		unityColumnAdder(src.unityColumnAdder),
-		actualColumns(src.actualColumns),
-		logicalHeight(src.logicalHeight),
-		logicalWidth(src.logicalWidth)
+// This keeps, for each row of a CMatrix, its number of nonzero columns and its leftmost nonzero column ('width' if
+// there is none). The leftmost columns are also kept in a tree of minimums, so the leftmost nonzero column of a range
+// of rows, and the last row that isn't all zeros, are found in O(log n) instead of by scanning the matrix.
+class CMatrixRowInfo
+{
+public:
+	CMatrixRowInfo() :
+		width(0),
+		leaves(0)
 	{
 	}
 	
-	CMatrix &operator=(const CMatrix &src)
-	{
-		this->target = src.target;
-		this->unityColumnAdder = src.unityColumnAdder;
-		this->actualColumns = src.actualColumns;
-		this->logicalHeight = src.logicalHeight;
-		this->logicalWidth = src.logicalWidth;
-		return *this;
-	}
-
-	CMatrix(uint64_t heightT, uint64_t widthT) :
-		unityColumnAdder(heightT, 1)
+	// This makes every one of 'numRows' rows all zeros.
+	void Reset(uint64_t numRows, uint64_t widthT)
 	{
-		// create target matrix
-		this->target = std::make_shared<CIntegralMatrix>(heightT, widthT);
+		this->width = widthT;
 		
-		// create identity mapping
-		this->actualColumns.resize(widthT, -1uLL);
-		for(uint64_t x = 0; x < widthT; ++x)
+		for(this->leaves = 1; this->leaves < numRows; this->leaves <<= 1)
 		{
-			this->actualColumns[x] = x;
 		}
 		
-		this->logicalHeight = heightT + 1;
-		this->logicalWidth = widthT;
+		this->counts.assign(numRows, 0);
+		this->tree.assign(2 * this->leaves, widthT);
 	}
 	
-	// Create a zero'd out and ready-to-use matrix of the indicated size.
-	static std::shared_ptr<CMatrix> Create(uint64_t heightT, uint64_t widthT)
+	uint64_t GetNonzeroCount(uint64_t y) const
 	{
-		return std::make_shared<CMatrix>(heightT, widthT);
+		return this->counts[y];
 	}
 	
-	uword_t Get(uint64_t y, uint64_t x) const
+	uint64_t GetLeadingColumn(uint64_t y) const
 	{
-		if(y >= this->logicalHeight || x >= this->logicalWidth)
-		{
-			return 0;
-		}
-	
-		uint64_t physicalX = this->actualColumns[x];
-		
-		if(physicalX == -1uLL)
-		{
-			return 0;	// this column is all 0s
-		}
-		
-		uword_t adder = 0;
-		
-		if(x == this->logicalWidth - 1)
-		{
-			// the rightmost logical column is always a special 'unity' column.
-			adder = this->unityColumnAdder.Get(y, 0);
-		}
-		
-		return this->target->Get(y, physicalX).x + adder.x;
+		return this->tree[this->leaves + y];
 	}
 	
-	// Returns true on success, false in case of failure.
-	bool AddToRow(uint64_t y, uword_t adder)
+	void SetRow(uint64_t y, uint64_t count, uint64_t leadingColumn)
 	{
-		if(y >= this->logicalHeight)
-		{
-			return false;
-		}
+		this->counts[y] = count;
 		
-		this->unityColumnAdder.Set(y, 0, this->unityColumnAdder.Get(y, 0).x + adder.x);
-		
-		return true;
-	}
-	
-	// Returns true on success, false otherwise.
-	bool Set(uint64_t y, uint64_t x, uword_t src)
-	{
-		if(y >= this->logicalHeight || x >= this->logicalWidth)
-		{
-			return false;
-		}
-
-		uint64_t physicalX = this->actualColumns[x];
+		uint64_t node = this->leaves + y;
 		
-		if(physicalX == -1uLL)
+		if(this->tree[node] == leadingColumn)
 		{
-			return false;	// tried to set an always-0 column (not allowed!)
+			return;
 		}
 		
-		this->target->Set(y, physicalX, src);
+		this->tree[node] = leadingColumn;
 		
-		if(x == this->logicalWidth - 1)
+		for(node >>= 1; node != 0; node >>= 1)
 		{
-			// zero out adder since we're overwriting the unity column
-			this->unityColumnAdder.Set(y, 0, 0);
+			uint64_t least = std::min(this->tree[2 * node], this->tree[2 * node + 1]);
+			
+			if(this->tree[node] == least)
+			{
+				break;		// nothing above this changes
+			}
+			
+			this->tree[node] = least;
 		}
-		
-		return true;		// success!
 	}
 	
-	bool ZeroRow(uint64_t y)
+	void SwapRows(uint64_t y1, uint64_t y2)
 	{
-		if(y >= this->logicalHeight)
-		{
-			return false;
-		}
-		
-		this->target->ZeroRow(y);
+		uint64_t count1 = this->counts[y1];
+		uint64_t leadingColumn1 = this->GetLeadingColumn(y1);
 		
-		return true;		// success
+		this->SetRow(y1, this->counts[y2], this->GetLeadingColumn(y2));
+		this->SetRow(y2, count1, leadingColumn1);
 	}
 	
-	bool RowIsAllZeros(uint64_t y) const
+	// Returns the leftmost nonzero column of rows 'begin' to 'end' - 1, or 'width' if they're all zeros.
+	uint64_t GetLeadingColumn(uint64_t begin, uint64_t end) const
 	{
-		for(uint64_t x = 0; x < this->logicalWidth; ++x)
+		uint64_t least = this->width;
+		
+		for(begin += this->leaves, end += this->leaves; begin < end; begin >>= 1, end >>= 1)
 		{
-			if(this->Get(y, x).x != 0)
+			if((begin & 1) != 0)
 			{
-				return false;
+				least = std::min(least, this->tree[begin++]);
+			}
+			
+			if((end & 1) != 0)
+			{
+				least = std::min(least, this->tree[--end]);
 			}
 		}
-	
-		return true;
+		
+		return least;
 	}
 	
-	uint64_t GetActiveHeight() const
+	// Returns one more than the last row before row 'end' that isn't all zeros, or 0 if there is none.
+	uint64_t GetActiveHeight(uint64_t end) const
 	{
-		uint64_t rows = 0;
-		
-		for(uint64_t y = 0; y < this->logicalHeight; ++y)
+		if(end == 0 || this->tree.empty() == true)
 		{
-			if(this->RowIsAllZeros(y) == true)
-			{
-				continue;
-			}
-			
-			rows = y + 1;
+			return 0;
 		}
 		
-		return rows;
+		return this->DoFindLastNonzeroRow(1, 0, this->leaves, end);
 	}
 
-	// Warning! Do not ever delete the 'unity' (rightmost) column.
-	// Code should be modified to check for that case and return false.
-	bool EraseColumn(uint64_t logicalX)
+private:
+	uint64_t width;
+	uint64_t leaves;			// the tree's leaves are tree[leaves] to tree[2 * leaves - 1]
+	std::vector<uint64_t> counts;
+	std::vector<uint64_t> tree;		// tree[i] is the least of tree[2 * i] and tree[2 * i + 1]
+	
+	// 'node' covers rows 'begin' to 'end' - 1. Returns one more than the last of them, before row 'limit', that isn't
+	// all zeros, or 0.
+	uint64_t DoFindLastNonzeroRow(uint64_t node, uint64_t begin, uint64_t end, uint64_t limit) const
 	{
-		if(logicalX >= this->logicalWidth)
+		if(begin >= limit || this->tree[node] == this->width)
 		{
-			return false;
+			return 0;
 		}
 		
-		for(uint64_t x = logicalX; x < this->logicalWidth - 1; ++x)
+		if(end - begin == 1)
 		{
-			this->actualColumns[x] = this->actualColumns[x + 1];
+			return end;
 		}
 		
-		this->actualColumns[this->logicalWidth - 1] = -1uLL;
-		
-		--this->logicalWidth;
+		uint64_t middle = begin + (end - begin) / 2;
+		uint64_t found = this->DoFindLastNonzeroRow(2 * node + 1, middle, end, limit);
 		
-		return true;
+		return (found != 0) ? found : this->DoFindLastNonzeroRow(2 * node, begin, middle, limit);
 	}
+};
+
+// This is a matrix reference.
+class CMatrix
+{
+	std::shared_ptr<CIntegralMatrix> target;
+	CIntegralMatrix unityColumnAdder;
+	std::vector<uint64_t> actualColumns;		// -1uLL means: the column is 0
+	uint64_t logicalHeight;
+	uint64_t logicalWidth;
+	bool identityColumns;				// true if actualColumns[x] == x for every logical column
+	CMatrixRowInfo rowInfo;				// this covers every physical row, whatever the logical height
 	
-	// Returns true on success, false in case of failure.
-	bool PromoteConstantColumn(uint64_t logicalX)
+	// This must be called whenever the columns are erased or moved.
+	void DoUpdateColumnMapping()
 	{
-		if(logicalX + 1 >= this->logicalWidth)
+		this->identityColumns = (this->logicalWidth <= this->actualColumns.size());
+		
+		for(uint64_t x = 0; x < this->logicalWidth && this->identityColumns == true; ++x)
 		{
-			return false;	// note: we can't promote the 'unity' column
+			this->identityColumns = (this->actualColumns[x] == x);
 		}
 		
-		uint64_t former = this->actualColumns[logicalX];
+		const uint64_t numRows = this->target->GetHeight() + 1;
 		
-		for(uint64_t x = logicalX; x < this->logicalWidth - 1; ++x)
+		this->rowInfo.Reset(numRows, this->logicalWidth);
+		
+		for(uint64_t y = 0; y < numRows; ++y)
 		{
-			this->actualColumns[x] = this->actualColumns[x + 1];
+			this->DoUpdateRow(y);
 		}
-		
-		this->actualColumns[this->logicalWidth - 1] = former;
-		
-		// return the 'unity' column to its former location
-		std::swap(this->actualColumns[this->logicalWidth - 1],
-			this->actualColumns[this->logicalWidth - 2]
-		);
-	
-		return true;
 	}
 	
-	bool SetLogicalHeight(uint64_t logicalHeightT)
+	// This is GetRow(), for any physical row.
+	CMatrixRow DoGetRow(uint64_t y) const
 	{
-		if(logicalHeightT > this->target->GetHeight())
-		{
-			return false;
-		}
+		CMatrixRow row;
 		
-		this->logicalHeight = logicalHeightT;
+		row.data = this->target->GetRowBuffer(y);
+		row.columns = (this->identityColumns == true) ? nullptr : this->actualColumns.data();
+		row.width = this->logicalWidth;
+		row.unityAdder = this->unityColumnAdder.Get(y, 0).x;
 		
-		return true;	// success
+		return row;
 	}
 	
-	void Write(std::ostream &os, int row = -1)
+	// This recounts row y's nonzero columns, after it's been changed in bulk.
+	void DoUpdateRow(uint64_t y)
 	{
-		uint64_t height = this->GetActiveHeight();
+		const CMatrixRow row = this->DoGetRow(y);
 		
-		if(height == 0)
+		this->rowInfo.SetRow(y, row.GetNonzeroCount(), row.GetLeadingNonzeroColumn(row.width));
+	}
+	
+	// This updates row y's nonzero columns after logical column x was changed.
+	void DoUpdateRow(uint64_t y, uint64_t x, bool wasNonzero, bool isNonzero)
+	{
+		if(wasNonzero == isNonzero)
 		{
-			height = 1;	// just so we get some kind of output when empty
+			return;
 		}
 		
-		char s[33];
-		s[32] = '\0';
+		uint64_t count = this->rowInfo.GetNonzeroCount(y);
+		uint64_t leadingColumn = this->rowInfo.GetLeadingColumn(y);
 		
-		for(uint64_t y = (row == -1) ? 0 : row; y < height; ++y)
+		if(isNonzero == true)
 		{
-			for(uint64_t x = 0; x < this->logicalWidth; ++x)
+			++count;
+			
+			if(x < leadingColumn)
 			{
-				using namespace std;
-				sprintf(s, "%9llX", (unsigned long long int)(this->Get(y, x).x));
-				if(x != 0)
-					os << " ";
-				os << s;
+				leadingColumn = x;
 			}
+		}
+		else
+		{
+			--count;
 			
-			os << "\n";
-			
-			if(row != -1)
+			if(x == leadingColumn)
 			{
-				break;
+				// The columns before x are all zeros already.
+				leadingColumn = (count == 0) ? this->logicalWidth : this->DoGetRow(y).GetLeadingNonzeroColumn(this->logicalWidth, x + 1);
 			}
 		}
-		os << std::flush;
+		
+		this->rowInfo.SetRow(y, count, leadingColumn);
 	}
 	
-	void AddLinear(uint64_t row, uint64_t varCol, uword_t varCoeff, uword_t adder)
+	// This calls f(physicalX) for each logical column that isn't always 0, in order. The rightmost (unity) column is
+	// included, but its adder is not; see DoFoldUnityAdder().
+	template <class F>
+	void DoForEachPhysicalColumn(F f) const
 	{
-		this->Add(row, varCol, varCoeff);
-		this->Add(row, this->logicalWidth - 1, adder);		// unity column
-	}
-	
-	void Add(uint64_t row, uint64_t col, uword_t value)
+		if(this->identityColumns == true)
+		{
+			for(uint64_t x = 0; x < this->logicalWidth; ++x)
+			{
+				f(x);
+			}
+			
+			return;
+		}
+		
+		for(uint64_t x = 0; x < this->logicalWidth; ++x)
+		{
+			uint64_t physicalX = this->actualColumns[x];
+			
+			if(physicalX != -1uLL)
+			{
+				f(physicalX);
+			}
+		}
+	}
+	
+	// This is the physical column of the 'unity' column, or -1uLL.
+	uint64_t DoGetUnityColumn() const
+	{
+		return (this->logicalWidth == 0) ? -1uLL : this->actualColumns[this->logicalWidth - 1];
+	}
+	
+	// This moves row y's unity adder into the row itself, as Set() does when the unity column is written, so the
+	// bulk operations below can treat every column alike. Returns the physical row.
+	uword_t *DoFoldUnityAdder(uint64_t y)
+	{
+		uword_t *row = this->target->GetRowBuffer(y);
+		uint64_t unityX = this->DoGetUnityColumn();
+		
+		if(unityX != -1uLL)
+		{
+			row[unityX].x += this->unityColumnAdder.Get(y, 0).x;
+			
+			this->unityColumnAdder.Set(y, 0, 0);
+		}
+		
+		return row;
+	}
+	
+	void WriteMatrix(std::FILE *fo, CIntegralMatrix &m, const char eightcc[8])
+	{
+		uint64_t x = m.GetBufferEntryCount() * sizeof(uint64_t) + sizeof(uint64_t) * 4;
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+		
+		memcpy(&x, eightcc, 8);
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+
+		x = m.GetHeight();
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+
+		x = m.GetWidth();
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+		
+		for(uint64_t y = 0; y < m.GetHeight() && m.GetWidth() != 0; ++y)	// a row at a time, in case they're in a file
+		{
+			fwrite(m.GetRowBuffer(y), m.GetWidth() * sizeof(uword_t), 1, fo);
+		}
+	}
+	
+	// Returns true on success, false otherwise.
+	bool ReadMatrix(std::FILE *fi, CIntegralMatrix &m, const char eightcc[8])
+	{
+		uint64_t x = 0;
+		(void) fread(&x, sizeof(uint64_t), 1, fi);
+
+		if(x != m.GetBufferEntryCount() * sizeof(uint64_t) + sizeof(uint64_t) * 4)
+		{
+			return false;
+		}
+		
+		(void) fread(&x, sizeof(uint64_t), 1, fi);
+		if(memcmp(&x, eightcc, 8) != 0)
+		{
+			return false;
+		}
+		
+		(void) fread(&x, sizeof(uint64_t), 1, fi);
+		if(x != m.GetHeight())
+		{
+			return false;
+		}
+		
+		(void) fread(&x, sizeof(uint64_t), 1, fi);
+		if(x != m.GetWidth())
+		{
+			return false;
+		}
+		
+		for(uint64_t y = 0; y < m.GetHeight() && m.GetWidth() != 0; ++y)
+		{
+			if(fread(m.GetRowBuffer(y), m.GetWidth() * sizeof(uword_t), 1, fi) != 1)
+			{
+				return false;
+			}
+		}
+	
+		return true;
+	}
+	
+public:
+	// returns true on success, false in case of failure.
+	bool AcceptColumnMapping(const CMatrix &src)
+	{
+		if(this->actualColumns.size() != src.actualColumns.size())
+		{
+			return false;
+		}
+		
+		this->actualColumns = src.actualColumns;
+		
+		this->DoUpdateColumnMapping();
+		
+		return true;
+	}
+
+	void Asgn(const CMatrix &src)
+	{
+		this->target = std::make_shared<CIntegralMatrix>(*src.target);
+		
+		this->unityColumnAdder = src.unityColumnAdder;
+		
+		this->actualColumns = src.actualColumns;
+		
+		this->logicalHeight = src.logicalHeight;
+		
+		this->logicalWidth = src.logicalWidth;
+		
+		this->identityColumns = src.identityColumns;
+		
+		this->rowInfo = src.rowInfo;
+	}
+
+	uint64_t GetPhysicalColumnIndex(uint64_t logicalX) const
+	{
+		return this->actualColumns[logicalX];
+	}
+
+	uint64_t GetLogicalHeight() const
+	{
+		return this->logicalHeight;
+	}
+
+	uint64_t GetLogicalWidth() const
+	{
+		return this->logicalWidth;
+	}
+
+	// Returns true on success, false otherwise.
+	bool Read(std::FILE *fi)
+	{
+		uint64_t totalSize = 0;
+		(void) fread(&totalSize, sizeof(uint64_t), 1, fi);
+		
+		uint64_t x = 0;
+		(void) fread(&x, sizeof(uint64_t), 1, fi);
+		if(memcmp(&x, "integral", 8) != 0)
+		{
+			return false;
+		}
+		
+		(void) fread(&this->logicalHeight, sizeof(uint64_t), 1, fi);
+		(void) fread(&this->logicalWidth, sizeof(uint64_t), 1, fi);
+		
+		(void) fread(&x, sizeof(uint64_t), 1, fi);
+		if(x < sizeof(uint64_t) * 2)
+		{
+			return false;
+		}
+		x -= sizeof(uint64_t) * 2;
+		x /= sizeof(uint64_t);
+		
+		if(x != actualColumns.size())
+		{
+			return false;
+		}
+		
+		(void) fread(&x, sizeof(uint64_t), 1, fi);
+		if(memcmp(&x, "actualco", 8) != 0)
+		{
+			return false;
+		}
+		
+		for(uint64_t i = 0; i < actualColumns.size(); ++i)
+		{
+			(void) fread(&x, sizeof(uint64_t), 1, fi);
+			this->actualColumns[i] = x;
+		}
+		
+		if(ReadMatrix(fi, this->unityColumnAdder, "unitycol") == false)
+		{
+			return false;
+		}
+
+		if(ReadMatrix(fi, *this->target, "maindata") == false)
+		{
+			return false;
+		}
+		
+		this->DoUpdateColumnMapping();
+		
+		return true;
+	}
+
+	void Write(std::FILE *fo)
+	{
+		using namespace std;
+	
+		uint64_t x = 0;
+		
+		uint64_t fp = ftell(fo);
+		
+		x = 0;
+		fwrite(&x, sizeof(uint64_t), 1, fo);	// placeholder for file size (0 = invalid)
+
+		memcpy(&x, "integral", 8);		// 8cc used to identify our matrix
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+		
+		fwrite(&this->logicalHeight, sizeof(uint64_t), 1, fo);
+		fwrite(&this->logicalWidth, sizeof(uint64_t), 1, fo);
+
+		x = actualColumns.size() * sizeof(uint64_t) + sizeof(uint64_t) * 2;
+		fwrite(&x, sizeof(uint64_t), 1, fo);	// size of 'actualco' section
+
+		memcpy(&x, "actualco", 8);		// 8cc used to identify 'actualColumns'
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+		
+		for(uint64_t i = 0; i < actualColumns.size(); ++i)
+		{
+			x = this->actualColumns[i];
+			fwrite(&x, sizeof(uint64_t), 1, fo);
+		}
+		
+		WriteMatrix(fo, this->unityColumnAdder, "unitycol");
+		
+		WriteMatrix(fo, *this->target, "maindata");
+		
+		x = ftell(fo);
+
+		if(fp == 0)
+			rewind(fo);
+		else
+			fseek(fo, fp, SEEK_SET);
+
+		// update file size
+		fwrite(&x, sizeof(uint64_t), 1, fo);
+	}
+
+	// Create a 'null' matrix.
+	CMatrix() :
+		identityColumns(true)
+	{
+	}
+	
+	CMatrix(const CMatrix &src) :
+		target(src.target),
+		unityColumnAdder(src.unityColumnAdder),
+		actualColumns(src.actualColumns),
+		logicalHeight(src.logicalHeight),
+		logicalWidth(src.logicalWidth),
+		identityColumns(src.identityColumns),
+		rowInfo(src.rowInfo)
+	{
+	}
+	
+	CMatrix &operator=(const CMatrix &src)
+	{
+		this->target = src.target;
+		this->unityColumnAdder = src.unityColumnAdder;
+		this->actualColumns = src.actualColumns;
+		this->logicalHeight = src.logicalHeight;
+		this->logicalWidth = src.logicalWidth;
+		this->identityColumns = src.identityColumns;
+		this->rowInfo = src.rowInfo;
+		return *this;
+	}
+
+	CMatrix(uint64_t heightT, uint64_t widthT) :
+		CMatrix(heightT, widthT, CMatrixStorage())
+	{
+	}
+	
+	// This is CMatrix(heightT, widthT) with its entries kept as 'storage' says (e.g. in a file); the 'unity' column
+	// adders are always in memory.
+	CMatrix(uint64_t heightT, uint64_t widthT, const CMatrixStorage &storage) :
+		unityColumnAdder(heightT, 1)
+	{
+		// create target matrix
+		this->target = std::make_shared<CIntegralMatrix>(heightT, widthT, storage);
+		
+		// create identity mapping
+		this->actualColumns.resize(widthT, -1uLL);
+		for(uint64_t x = 0; x < widthT; ++x)
+		{
+			this->actualColumns[x] = x;
+		}
+		
+		this->logicalHeight = heightT + 1;
+		this->logicalWidth = widthT;
+		this->identityColumns = true;
+		
+		this->rowInfo.Reset(heightT + 1, widthT);	// all zeros
+	}
+	
+	// Create a zero'd out and ready-to-use matrix of the indicated size.
+	static std::shared_ptr<CMatrix> Create(uint64_t heightT, uint64_t widthT)
+	{
+		return std::make_shared<CMatrix>(heightT, widthT);
+	}
+	
+	static std::shared_ptr<CMatrix> Create(uint64_t heightT, uint64_t widthT, const CMatrixStorage &storage)
+	{
+		return std::make_shared<CMatrix>(heightT, widthT, storage);
+	}
+	
+	// This has the given rows (sorted) read in ahead of time, if the matrix is kept in a file; otherwise it does
+	// nothing.
+	void PrefetchRows(const std::vector<uint64_t> &rows)
+	{
+		this->target->PrefetchRows(rows.data(), rows.size());
+	}
+	
+	// This shows how the file was used, if the matrix is kept in one.
+	void ReportStorage(std::ostream &os)
+	{
+		this->target->Report(os);
+	}
+	
+	uword_t Get(uint64_t y, uint64_t x) const
+	{
+		if(y >= this->logicalHeight || x >= this->logicalWidth)
+		{
+			return 0;
+		}
+	
+		uint64_t physicalX = this->actualColumns[x];
+		
+		if(physicalX == -1uLL)
+		{
+			return 0;	// this column is all 0s
+		}
+		
+		uword_t adder = 0;
+		
+		if(x == this->logicalWidth - 1)
+		{
+			// the rightmost logical column is always a special 'unity' column.
+			adder = this->unityColumnAdder.Get(y, 0);
+		}
+		
+		return this->target->Get(y, physicalX).x + adder.x;
+	}
+	
+	// This returns a view of row 'y', for reading many of its columns (see CMatrixRow). The view is empty if 'y' is
+	// out of range.
+	CMatrixRow GetRow(uint64_t y) const
+	{
+		if(y >= this->logicalHeight)
+		{
+			return CMatrixRow();
+		}
+		
+		return this->DoGetRow(y);
+	}
+	
+	// This is the number of nonzero columns in row 'y' (this is kept up to date as the matrix changes).
+	uint64_t GetRowNonzeroCount(uint64_t y) const
+	{
+		return (y >= this->logicalHeight) ? 0 : this->rowInfo.GetNonzeroCount(y);
+	}
+	
+	// This sets the first 'count' columns of row 'y' to values[0] to values[count - 1]; the other columns are left
+	// alone. Columns that are always 0 are skipped, as Set() would. Returns true on success, false otherwise.
+	bool SetRow(uint64_t y, const uint64_t *values, uint64_t count)
+	{
+		if(y >= this->logicalHeight || count > this->logicalWidth)
+		{
+			return false;
+		}
+		
+		uword_t *row = this->target->GetRowBuffer(y);
+		
+		if(this->identityColumns == true)
+		{
+			for(uint64_t x = 0; x < count; ++x)
+			{
+				row[x].x = values[x];
+			}
+		}
+		else
+		{
+			for(uint64_t x = 0; x < count; ++x)
+			{
+				uint64_t physicalX = this->actualColumns[x];
+				
+				if(physicalX != -1uLL)
+				{
+					row[physicalX].x = values[x];
+				}
+			}
+		}
+		
+		if(count == this->logicalWidth && this->DoGetUnityColumn() != -1uLL)
+		{
+			this->unityColumnAdder.Set(y, 0, 0);	// we've overwritten the unity column
+		}
+		
+		this->DoUpdateRow(y);
+		
+		return true;
+	}
+	
+	// This sets column pairs[2 * i] of row 'y' to pairs[2 * i + 1], for each of the 'count' pairs; the other columns
+	// are left alone. Returns true on success, false if a column is out of range (the pairs before it are set).
+	bool SetRowPairs(uint64_t y, const uint64_t *pairs, uint64_t count)
+	{
+		if(y >= this->logicalHeight)
+		{
+			return false;
+		}
+		
+		uword_t *row = this->target->GetRowBuffer(y);
+		
+		for(uint64_t i = 0; i < count; ++i)
+		{
+			uint64_t x = pairs[2 * i];
+			
+			if(x >= this->logicalWidth)
+			{
+				return false;
+			}
+			
+			uint64_t physicalX = this->actualColumns[x];
+			
+			if(physicalX == -1uLL)
+			{
+				continue;	// an always-0 column (Set() doesn't allow these either)
+			}
+			
+			const bool wasNonzero = (this->Get(y, x).x != 0);
+			
+			row[physicalX].x = pairs[2 * i + 1];
+			
+			if(x == this->logicalWidth - 1)
+			{
+				this->unityColumnAdder.Set(y, 0, 0);
+			}
+			
+			this->DoUpdateRow(y, x, wasNonzero, row[physicalX].x != 0);
+		}
+		
+		return true;
+	}
+	
+	// This adds the pairs (see SetRowPairs(); no column may be in more than one), times 'scalar', to row 'y', so it
+	// costs as much as there are pairs instead of as much as the matrix is wide. Returns true on success, false if a
+	// column is out of range (the pairs before it are added).
+	bool AddRowPairs(uint64_t y, const uint64_t *pairs, uint64_t count, uword_t scalar)
+	{
+		if(y >= this->logicalHeight)
+		{
+			return false;
+		}
+		
+		const uint64_t k = scalar.x;
+		uword_t *row = this->DoFoldUnityAdder(y);
+		uint64_t numNonzeros = this->rowInfo.GetNonzeroCount(y);
+		uint64_t formerLeadingColumn = this->rowInfo.GetLeadingColumn(y);
+		uint64_t leastNonzero = this->logicalWidth;	// the leftmost column that was added to and isn't 0
+		bool lostLeadingColumn = false;
+		bool ok = true;
+		
+		for(uint64_t i = 0; i < count; ++i)
+		{
+			const uint64_t x = pairs[2 * i];
+			
+			if(x >= this->logicalWidth)
+			{
+				ok = false;
+				
+				break;
+			}
+			
+			const uint64_t physicalX = (this->identityColumns == true) ? x : this->actualColumns[x];
+			
+			if(physicalX == -1uLL)
+			{
+				continue;
+			}
+			
+			const uint64_t before = row[physicalX].x;
+			
+			row[physicalX].x = before + pairs[2 * i + 1] * k;
+			
+			if(row[physicalX].x != 0)
+			{
+				numNonzeros += (before == 0);
+				
+				leastNonzero = std::min(leastNonzero, x);
+			}
+			else if(before != 0)
+			{
+				--numNonzeros;
+				
+				lostLeadingColumn = lostLeadingColumn || (x == formerLeadingColumn);
+			}
+		}
+		
+		uint64_t leadingColumn = std::min(leastNonzero, formerLeadingColumn);
+		
+		if(numNonzeros == 0)
+		{
+			leadingColumn = this->logicalWidth;
+		}
+		else if(lostLeadingColumn == true)
+		{
+			// The columns before the former leftmost one were all zeros, and the ones added to are in 'leastNonzero'.
+			leadingColumn = std::min(leastNonzero, this->DoGetRow(y).GetLeadingNonzeroColumn(this->logicalWidth, formerLeadingColumn + 1));
+		}
+		
+		this->rowInfo.SetRow(y, numNonzeros, leadingColumn);
+		
+		return ok;
+	}
+	
+	// This swaps rows 'y1' and 'y2'. Returns true on success, false otherwise.
+	bool SwapRows(uint64_t y1, uint64_t y2)
+	{
+		if(y1 >= this->logicalHeight || y2 >= this->logicalHeight)
+		{
+			return false;
+		}
+		
+		if(y1 == y2)
+		{
+			return true;
+		}
+		
+		uword_t *row1 = this->DoFoldUnityAdder(y1);
+		uword_t *row2 = this->DoFoldUnityAdder(y2);
+		
+		this->DoForEachPhysicalColumn([row1, row2](uint64_t x) { uint64_t temp = row1[x].x; row1[x].x = row2[x].x; row2[x].x = temp; });
+		
+		this->rowInfo.SwapRows(y1, y2);
+		
+		return true;
+	}
+	
+	// This copies row 'srcY' to row 'destY', then zeroes row 'srcY'. Returns true on success, false otherwise.
+	bool MoveRow(uint64_t destY, uint64_t srcY)
+	{
+		if(destY >= this->logicalHeight || srcY >= this->logicalHeight)
+		{
+			return false;
+		}
+		
+		uword_t *dest = this->DoFoldUnityAdder(destY);
+		uword_t *src = this->DoFoldUnityAdder(srcY);
+		
+		this->DoForEachPhysicalColumn([dest, src](uint64_t x) { dest[x].x = src[x].x; src[x].x = 0; });
+		
+		this->rowInfo.SetRow(destY, this->rowInfo.GetNonzeroCount(srcY), this->rowInfo.GetLeadingColumn(srcY));
+		this->rowInfo.SetRow(srcY, 0, this->logicalWidth);
+		
+		return true;
+	}
+	
+	// Returns true on success, false in case of failure.
+	bool AddToRow(uint64_t y, uword_t adder)
+	{
+		if(y >= this->logicalHeight)
+		{
+			return false;
+		}
+		
+		const bool wasNonzero = (this->Get(y, this->logicalWidth - 1).x != 0);
+		
+		this->unityColumnAdder.Set(y, 0, this->unityColumnAdder.Get(y, 0).x + adder.x);
+		
+		this->DoUpdateRow(y, this->logicalWidth - 1, wasNonzero, this->Get(y, this->logicalWidth - 1).x != 0);
+		
+		return true;
+	}
+	
+	// Returns true on success, false otherwise.
+	bool Set(uint64_t y, uint64_t x, uword_t src)
+	{
+		if(y >= this->logicalHeight || x >= this->logicalWidth)
+		{
+			return false;
+		}
+
+		uint64_t physicalX = this->actualColumns[x];
+		
+		if(physicalX == -1uLL)
+		{
+			return false;	// tried to set an always-0 column (not allowed!)
+		}
+		
+		const bool wasNonzero = (this->Get(y, x).x != 0);
+		
+		this->target->Set(y, physicalX, src);
+		
+		if(x == this->logicalWidth - 1)
+		{
+			// zero out adder since we're overwriting the unity column
+			this->unityColumnAdder.Set(y, 0, 0);
+		}
+		
+		this->DoUpdateRow(y, x, wasNonzero, src.x != 0);
+		
+		return true;		// success!
+	}
+	
+	bool ZeroRow(uint64_t y)
+	{
+		if(y >= this->logicalHeight)
+		{
+			return false;
+		}
+		
+		this->target->ZeroRow(y);
+		
+		this->DoUpdateRow(y);	// the unity column's adder is kept
+		
+		return true;		// success
+	}
+	
+	bool RowIsAllZeros(uint64_t y) const
+	{
+		return this->GetRowNonzeroCount(y) == 0;
+	}
+	
+	uint64_t GetActiveHeight() const
+	{
+		return this->rowInfo.GetActiveHeight(this->logicalHeight);
+	}
+
+	// Warning! Do not ever delete the 'unity' (rightmost) column.
+	// Code should be modified to check for that case and return false.
+	bool EraseColumn(uint64_t logicalX)
+	{
+		if(logicalX >= this->logicalWidth)
+		{
+			return false;
+		}
+		
+		for(uint64_t x = logicalX; x < this->logicalWidth - 1; ++x)
+		{
+			this->actualColumns[x] = this->actualColumns[x + 1];
+		}
+		
+		this->actualColumns[this->logicalWidth - 1] = -1uLL;
+		
+		--this->logicalWidth;
+		
+		this->DoUpdateColumnMapping();
+		
+		return true;
+	}
+	
+	// Returns true on success, false in case of failure.
+	bool PromoteConstantColumn(uint64_t logicalX)
+	{
+		if(logicalX + 1 >= this->logicalWidth)
+		{
+			return false;	// note: we can't promote the 'unity' column
+		}
+		
+		uint64_t former = this->actualColumns[logicalX];
+		
+		for(uint64_t x = logicalX; x < this->logicalWidth - 1; ++x)
+		{
+			this->actualColumns[x] = this->actualColumns[x + 1];
+		}
+		
+		this->actualColumns[this->logicalWidth - 1] = former;
+		
+		// return the 'unity' column to its former location
+		std::swap(this->actualColumns[this->logicalWidth - 1],
+			this->actualColumns[this->logicalWidth - 2]
+		);
+		
+		this->DoUpdateColumnMapping();
+	
+		return true;
+	}
+	
+	bool SetLogicalHeight(uint64_t logicalHeightT)
+	{
+		if(logicalHeightT > this->target->GetHeight())
+		{
+			return false;
+		}
+		
+		this->logicalHeight = logicalHeightT;
+		
+		return true;	// success
+	}
+	
+	void Write(std::ostream &os, int row = -1)
+	{
+		uint64_t height = this->GetActiveHeight();
+		
+		if(height == 0)
+		{
+			height = 1;	// just so we get some kind of output when empty
+		}
+		
+		char s[33];
+		s[32] = '\0';
+		
+		for(uint64_t y = (row == -1) ? 0 : row; y < height; ++y)
+		{
+			const CMatrixRow rowView = this->GetRow(y);
+			
+			for(uint64_t x = 0; x < this->logicalWidth; ++x)
+			{
+				using namespace std;
+				sprintf(s, "%9llX", (unsigned long long int)(rowView.Get(x).x));
+				if(x != 0)
+					os << " ";
+				os << s;
+			}
+			
+			os << "\n";
+			
+			if(row != -1)
+			{
+				break;
+			}
+		}
+		os << std::flush;
+	}
+	
+	void AddLinear(uint64_t row, uint64_t varCol, uword_t varCoeff, uword_t adder)
+	{
+		this->Add(row, varCol, varCoeff);
+		this->Add(row, this->logicalWidth - 1, adder);		// unity column
+	}
+	
+	void Add(uint64_t row, uint64_t col, uword_t value)
+	{
+		this->Set(row, col, this->Get(row, col).x + value.x);
+	}
+	
+	// do not call this to change the value of 'unity' (!) returns true on success, false otherwise.
+	bool SetColumnValue(uint64_t logicalX, uword_t value)
+	{
+		if(logicalX == this->logicalWidth - 1)	// user tried to change the unity column
+		{
+			return false;
+		}
+	
+		for(uint64_t y = 0; y < this->logicalHeight; ++y)
+		{
+			uword_t coeff = this->Get(y, logicalX);
+		
+			if(coeff.x == 0)
+			{
+				continue;
+			}
+			
+			this->AddToRow(y, coeff.x * value.x);
+		}
+		
+		this->EraseColumn(logicalX);
+		
+		return true;
+	}
+	
+	// This adds row 'srcY', times 'scalar', to row 'destY' (modulo 2^33, like everything else).
+	void AddRows(uint64_t destY, uint64_t srcY, uword_t scalar)
+	{
+		if(scalar.x == 0 || destY >= this->logicalHeight || srcY >= this->logicalHeight)
+		{
+			return;
+		}
+		
+		const uint64_t k = scalar.x;
+		uword_t *dest = this->DoFoldUnityAdder(destY);
+		const uword_t *src = this->target->GetRowBuffer(srcY);
+		
+		if(this->identityColumns == true && this->logicalWidth != 0)
+		{
+			// Row 'srcY' is all zeros before its leftmost nonzero column, so row 'destY' only changes from there on;
+			// it's recounted from there as it goes.
+			const uint64_t unityX = this->logicalWidth - 1;
+			const uint64_t begin = std::min(this->rowInfo.GetLeadingColumn(srcY), unityX);
+			uint64_t count = this->rowInfo.GetNonzeroCount(destY);
+			
+			for(uint64_t x = begin; x < unityX; ++x)
+			{
+				const uint64_t before = dest[x].x;
+				
+				dest[x].x = before + src[x].x * k;
+				
+				count += (uint64_t)(dest[x].x != 0) - (uint64_t)(before != 0);
+			}
+			
+			// Row 'srcY' keeps its unity adder (this is 0 if it's the same row as 'destY').
+			const uint64_t before = dest[unityX].x;
+			
+			dest[unityX].x += (src[unityX].x + this->unityColumnAdder.Get(srcY, 0).x) * k;
+			
+			count += (uint64_t)(dest[unityX].x != 0) - (uint64_t)(before != 0);
+			
+			uint64_t leadingColumn = this->rowInfo.GetLeadingColumn(destY);
+			
+			if(leadingColumn >= begin)
+			{
+				leadingColumn = (count == 0) ? this->logicalWidth : this->DoGetRow(destY).GetLeadingNonzeroColumn(this->logicalWidth, begin);
+			}
+			
+			this->rowInfo.SetRow(destY, count, leadingColumn);
+			
+			return;
+		}
+		
+		this->DoForEachPhysicalColumn([dest, src, k](uint64_t x) { dest[x].x += src[x].x * k; });
+		
+		// Row 'srcY' keeps its unity adder (this is 0 if it's the same row as 'destY').
+		uint64_t unityX = this->DoGetUnityColumn();
+		
+		if(unityX != -1uLL)
+		{
+			dest[unityX].x += this->unityColumnAdder.Get(srcY, 0).x * k;
+		}
+		
+		this->DoUpdateRow(destY);
+	}
+	
+	// Returns true on success, false otherwise. This brings the matrix to echelon form; see CEchelonEngine, below (or
+	// CTiledEchelonEngine, if the matrix is kept in a file).
+	// Note: I experimented with using row reduction to break two rounds of SHA2-256.
+	// I left this old, dead code in (note that there is a much better way to break SHA-256
+	// once it's been reduced to only two rounds, and the full algorithm has 64 rounds).
+	bool RowReduce(std::ostream &os);
+	
+	// Returns true on success, false otherwise. This is RowReduce() for sparse matrices; see CSparseEchelonEngine, below.
+	bool RowReduceSparse(std::ostream &os);
+	
+	// Returns true on success, false otherwise. This is RowReduce() for dense matrices, on 'numThreads' threads (0 means
+	// one per core); see CBlockedEchelonEngine, below.
+	bool RowReduceBlocked(std::ostream &os, uint32_t numThreads = 0);
+	
+	// Returns true if the active rows are consistent modulo 2, false if they contradict each other (and so contradict
+	// each other modulo 2^33 as well). This doesn't change the matrix; it reduces a copy of it modulo 2, in a
+	// CBitMatrix, with CBitEchelonEngine (see below), which finds the rank modulo 2 much sooner than RowReduce() can.
+	// A row whose entries are all multiples of some power of two is divided by it first (see CBitMatrix).
+	bool CheckModTwo(std::ostream &os) const;
+	
+	void MultiplyRow(uint64_t y, uword_t scalar)
+	{
+		if(y >= this->logicalHeight)
+		{
+			return;
+		}
+		
+		const uint64_t k = scalar.x;
+		uword_t *row = this->DoFoldUnityAdder(y);
+		
+		this->DoForEachPhysicalColumn([row, k](uint64_t x) { row[x].x *= k; });
+		
+		this->DoUpdateRow(y);
+	}
+	
+	uint64_t GetLeadingNonzeroColumn(uint64_t y, uint64_t n) const
+	{
+		uint64_t x = (y >= this->logicalHeight) ? n : this->rowInfo.GetLeadingColumn(y);
+		
+		return (x < n) ? x : n;
+	}
+
+	uint64_t DetermineLeftmostNonzeroColumn(uint64_t skip, uint64_t m/*height*/, uint64_t n/*width*/) const
+	{
+		if(m > this->logicalHeight)
+		{
+			m = this->logicalHeight;
+		}
+		
+		// n is returned if there is no leftmost nonzero column
+		uint64_t pivotX = (skip >= m) ? n : this->rowInfo.GetLeadingColumn(skip, m);
+		
+		return (pivotX < n) ? pivotX : n;
+	}
+};
+
+// This brings a CMatrix to echelon form over Z/2^33 (see CMatrix::RowReduce()).
+//
+// Each row is queued under its leftmost nonzero column. The columns are then taken from left to right. Of the rows
+// queued under a column, the one whose entry there has the fewest trailing zero bits (the lowest 2-adic valuation)
+// becomes the pivot, and is multiplied by the inverse of the odd part of that entry, which leaves a power of two there.
+// That power of two divides the entry of every other row in the queue, so each of them is cleared by adding a multiple
+// of the pivot row (only its nonzero columns, see CMatrix::AddRowPairs()) and queued again under its new leftmost
+// column. Rows are only ever multiplied by odd (invertible) numbers and added
+// to each other, so the row space doesn't change. Only the rows queued under a column are looked at, instead of every
+// row below the pivot, and no row is rescanned to find its leftmost column (see CMatrixRowInfo).
+//
+// The pivot rows end up at the top, in column order, and the cleared rows below them. A row that's left with only its
+// 'unity' column nonzero says that 0 is equal to some other constant, which is a contradiction.
+class CEchelonEngine
+{
+public:
+	CEchelonEngine(CMatrix &matrixT) :
+		matrix(matrixT),
+		numPivots(0),
+		numRowOperations(0)
+	{
+	}
+	
+	// Returns true on success, false if a contradiction was found.
+	bool Reduce(std::ostream &os)
+	{
+		const uint64_t m = this->matrix.GetActiveHeight();
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		
+		os << m << " row(s)" << std::endl;
+		os << "Reducing matrix... " << std::flush;
+		
+		this->numPivots = 0;
+		this->numRowOperations = 0;
+		
+		if(m == 0 || n == 0)
+		{
+			os << "done, is all zeros" << std::endl;
+			return true;
+		}
+		
+		// Each row is done once it's a pivot or all zeros; progress is the share of rows that are done.
+		std::vector<std::vector<uint64_t> > queues(n);
+		uint64_t numDone = 0;
+		uint64_t lastPercent = -1;
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			this->DoQueueRow(queues, y, numDone);
+		}
+		
+		std::vector<uint64_t> pivotRows;
+		std::vector<uint64_t> rows;
+		std::vector<uint64_t> pairs;
+		
+		for(uint64_t pivotX = 0; pivotX + 1 < n; ++pivotX)
+		{
+			if(numDone * 100 / m != lastPercent)
+			{
+				lastPercent = numDone * 100 / m;
+				
+				os << "\rReducing matrix... " << lastPercent << "%" << std::flush;
+			}
+			
+			rows.clear();
+			rows.swap(queues[pivotX]);
+			
+			if(rows.empty() == true)
+			{
+				continue;
+			}
+			
+			// Pick the pivot: the lowest valuation, then the lowest row.
+			uint64_t pivotY = rows[0];
+			uint32_t valuation = GetValuation(this->matrix.Get(pivotY, pivotX));
+			
+			for(uint64_t i = 1; i < rows.size(); ++i)
+			{
+				uint32_t rowValuation = GetValuation(this->matrix.Get(rows[i], pivotX));
+				
+				if(rowValuation < valuation || (rowValuation == valuation && rows[i] < pivotY))
+				{
+					pivotY = rows[i];
+					valuation = rowValuation;
+				}
+			}
+			
+			const uint64_t odd = this->matrix.Get(pivotY, pivotX).x >> valuation;
+			
+			if(odd != 1)
+			{
+				this->matrix.MultiplyRow(pivotY, uword_t::ComputeOddInverse(odd));
+				
+				++this->numRowOperations;
+			}
+			
+			pivotRows.push_back(pivotY);
+			++numDone;
+			
+			// The pivot row is usually sparse, so only its nonzero columns are added to the other rows.
+			const CMatrixRow pivotRow = this->matrix.GetRow(pivotY);
+			
+			pairs.clear();
+			
+			for(uint64_t x = pivotX; x < n; ++x)
+			{
+				const uword_t value = pivotRow.Get(x);
+				
+				if(value.x != 0)
+				{
+					pairs.push_back(x);
+					pairs.push_back(value.x);
+				}
+			}
+			
+			// Put zeros in the pivot column of the other rows. Their entries there are multiples of 2^valuation.
+			for(uint64_t i = 0; i < rows.size(); ++i)
+			{
+				const uint64_t y = rows[i];
+				
+				if(y == pivotY)
+				{
+					continue;
+				}
+				
+				const uint64_t scalar = this->matrix.Get(y, pivotX).x >> valuation;
+				
+				this->matrix.AddRowPairs(y, pairs.data(), pairs.size() / 2, 0 - scalar);
+				
+				++this->numRowOperations;
+				
+				if(this->matrix.GetLeadingNonzeroColumn(y, n) <= pivotX)
+				{
+					os << "\rReducing matrix... failure! internal error." << std::endl;
+					
+					return false;
+				}
+				
+				this->DoQueueRow(queues, y, numDone);
+			}
+		}
+		
+		this->numPivots = pivotRows.size();
+		
+		std::vector<uint64_t> where = MovePivotRowsUp(this->matrix, pivotRows, m);
+		
+		if(queues[n - 1].empty() == false)
+		{
+			const uint64_t y = where[queues[n - 1][0]];
+			
+			os << "\rReducing matrix... failure! contradiction detected." << std::endl;
+			os << "Row " << y << " value " << std::hex << this->matrix.Get(y, n - 1).x << std::dec << " (and " <<
+				(queues[n - 1].size() - 1) << " more)" << std::endl
+			;
+			
+			return false;
+		}
+		
+		os << "\rReducing matrix... done (" << this->numPivots << " pivot row(s), " << this->numRowOperations << " row operation(s))" << std::endl;
+		
+		return true;
+	}
+	
+	// This is the number of pivot rows found by Reduce(). (Echelon forms over Z/2^33 aren't unique, so another order of
+	// elimination can leave a different number of them for the same row space.)
+	uint64_t GetPivotCount() const
+	{
+		return this->numPivots;
+	}
+	
+	// This is the number of rows Reduce() multiplied or added to.
+	uint64_t GetRowOperationCount() const
+	{
+		return this->numRowOperations;
+	}
+	
+	// This swaps the pivot rows of 'matrix' into rows 0 to pivotRows.size() - 1, in order. Returns where each of the
+	// first 'm' rows went.
+	static std::vector<uint64_t> MovePivotRowsUp(CMatrix &matrix, const std::vector<uint64_t> &pivotRows, uint64_t m)
+	{
+		std::vector<uint64_t> where(m);		// where[row] is the row's position now
+		std::vector<uint64_t> at(m);		// at[position] is the row that's there
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			where[y] = y;
+			at[y] = y;
+		}
+		
+		for(uint64_t i = 0; i < pivotRows.size(); ++i)
+		{
+			const uint64_t position = where[pivotRows[i]];
+			
+			if(position == i)
+			{
+				continue;
+			}
+			
+			matrix.SwapRows(i, position);
+			
+			std::swap(at[i], at[position]);
+			where[at[i]] = i;
+			where[at[position]] = position;
+		}
+		
+		return where;
+	}
+	
+	// Returns the number of trailing zero bits of 'value' (WORD_SIZE_BITS + 1 if it's 0).
+	static uint32_t GetValuation(uword_t value)
+	{
+		return (value.x == 0) ? (WORD_SIZE_BITS + 1) : __builtin_ctzll(value.x);
+	}
+
+private:
+	CMatrix &matrix;
+	uint64_t numPivots;
+	uint64_t numRowOperations;
+	
+	// This queues row 'y' under its leftmost nonzero column, or counts it as done if it's all zeros.
+	void DoQueueRow(std::vector<std::vector<uint64_t> > &queues, uint64_t y, uint64_t &numDone)
+	{
+		const uint64_t x = this->matrix.GetLeadingNonzeroColumn(y, queues.size());
+		
+		if(x == queues.size())
+		{
+			++numDone;
+		}
+		else
+		{
+			queues[x].push_back(y);
+		}
+	}
+};
+
+// This brings a CMatrix to echelon form over Z/2^33 like CEchelonEngine does, but a panel of columns at a time, so
+// that a matrix kept in a file (see CRowBlockFile) is read about once per panel instead of once per pivot; it's what
+// CMatrix::RowReduce() uses for such a matrix.
+//
+// For each panel, the panel's columns of the rows whose leftmost nonzero column is in the panel (no other row can be
+// changed by its pivots) are copied into memory, and the pivots are found there, as CEchelonEngine finds them, while
+// recording the multiple of each pivot row that's added to each other row. The pivot rows are then brought up to
+// date in order, and after them the other rows, in row order, with the next rows read ahead while each is worked on.
+// The pivots are the same as CEchelonEngine's, and so is the result.
+class CTiledEchelonEngine
+{
+public:
+	uint32_t panelWidth;		// columns per panel
+	
+	CTiledEchelonEngine(CMatrix &matrixT) :
+		panelWidth(64),
+		matrix(matrixT),
+		numPivots(0),
+		numRowOperations(0)
+	{
+	}
+	
+	// Returns true on success, false if a contradiction was found.
+	bool Reduce(std::ostream &os)
+	{
+		const uint64_t m = this->matrix.GetActiveHeight();
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		
+		os << m << " row(s)" << std::endl;
+		os << "Reducing matrix... " << std::flush;
+		
+		this->numPivots = 0;
+		this->numRowOperations = 0;
+		
+		if(m == 0 || n == 0)
+		{
+			os << "done, is all zeros" << std::endl;
+			return true;
+		}
+		
+		std::vector<uint64_t> active;		// the rows that aren't pivot rows yet, in order
+		std::vector<uint64_t> pivotRows;
+		uint64_t lastPercent = -1;
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			active.push_back(y);
+		}
+		
+		// The 'unity' column is never a pivot column.
+		for(uint64_t begin = 0; begin + 1 < n; begin += this->panelWidth)
+		{
+			if(begin * 100 / (n - 1) != lastPercent)
+			{
+				lastPercent = begin * 100 / (n - 1);
+				
+				os << "\rReducing matrix... " << lastPercent << "%" << std::flush;
+			}
+			
+			const uint64_t end = std::min<uint64_t>(begin + this->panelWidth, n - 1);
+			
+			this->DoReducePanel(active, pivotRows, begin, end);
+		}
+		
+		this->numPivots = pivotRows.size();
+		
+		std::vector<uint64_t> where = CEchelonEngine::MovePivotRowsUp(this->matrix, pivotRows, m);
+		
+		// Only the 'unity' column of the other rows can be left.
+		std::vector<uint64_t> contradictions;
+		
+		for(uint64_t i = 0; i < active.size(); ++i)
+		{
+			if(this->matrix.GetLeadingNonzeroColumn(where[active[i]], n) < n)
+			{
+				contradictions.push_back(where[active[i]]);
+			}
+		}
+		
+		if(contradictions.empty() == false)
+		{
+			const uint64_t y = contradictions[0];
+			
+			os << "\rReducing matrix... failure! contradiction detected." << std::endl;
+			os << "Row " << y << " value " << std::hex << this->matrix.Get(y, n - 1).x << std::dec << " (and " <<
+				(contradictions.size() - 1) << " more)" << std::endl
+			;
+			
+			return false;
+		}
+		
+		os << "\rReducing matrix... done (" << this->numPivots << " pivot row(s), " << this->numRowOperations << " row operation(s))" << std::endl;
+		
+		return true;
+	}
+	
+	// This is the number of pivot rows found by Reduce().
+	uint64_t GetPivotCount() const
+	{
+		return this->numPivots;
+	}
+	
+	// This is the number of rows Reduce() multiplied or added to.
+	uint64_t GetRowOperationCount() const
+	{
+		return this->numRowOperations;
+	}
+
+private:
+	CMatrix &matrix;
+	uint64_t numPivots;
+	uint64_t numRowOperations;
+	
+	// This finds the pivots in columns 'begin' to 'end' - 1 and clears those columns of the other rows. The new pivot
+	// rows are taken out of 'active' and added to 'pivotRows'.
+	void DoReducePanel(std::vector<uint64_t> &active, std::vector<uint64_t> &pivotRows, uint64_t begin, uint64_t end)
+	{
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		const uint64_t k = end - begin;
+		std::vector<uint64_t> rows;
+		
+		for(uint64_t i = 0; i < active.size(); ++i)
+		{
+			if(this->matrix.GetLeadingNonzeroColumn(active[i], n) < end)
+			{
+				rows.push_back(active[i]);
+			}
+		}
+		
+		if(rows.empty() == true)
+		{
+			return;
+		}
+		
+		// Copy the panel.
+		std::vector<uint64_t> panel(rows.size() * k);
+		
+		this->matrix.PrefetchRows(rows);
+		
+		for(uint64_t i = 0; i < rows.size(); ++i)
+		{
+			const CMatrixRow row = this->matrix.GetRow(rows[i]);
+			
+			for(uint64_t x = begin; x < end; ++x)
+			{
+				panel[i * k + (x - begin)] = row.Get(x).x;
+			}
+		}
+		
+		// Find the pivots. pivots[j] is the index in 'rows' of the j-th pivot row, multipliers[i * k + j] is the
+		// multiple of it added to rows[i], and inverses[j] is what the pivot row was then multiplied by.
+		std::vector<uint64_t> pivots;
+		std::vector<uint64_t> inverses;
+		std::vector<uint64_t> multipliers(rows.size() * k, 0);
+		std::vector<bool> isPivot(rows.size(), false);
+		
+		for(uint64_t x = 0; x < k; ++x)
+		{
+			uint64_t best = rows.size();
+			uint32_t valuation = WORD_SIZE_BITS + 1;
+			
+			for(uint64_t i = 0; i < rows.size(); ++i)
+			{
+				const uint32_t rowValuation = CEchelonEngine::GetValuation(panel[i * k + x]);
+				
+				if(isPivot[i] == false && rowValuation < valuation)		// ties go to the lowest row, which comes first
+				{
+					best = i;
+					valuation = rowValuation;
+				}
+			}
+			
+			if(best == rows.size())
+			{
+				continue;
+			}
+			
+			uint64_t *pivot = &panel[best * k];
+			const uint64_t odd = pivot[x] >> valuation;
+			const uint64_t inverse = uword_t::ComputeOddInverse(odd);
+			
+			for(uint64_t j = x; j < k; ++j)
+			{
+				pivot[j] = uword_t(pivot[j] * inverse).x;
+			}
+			
+			for(uint64_t i = 0; i < rows.size(); ++i)
+			{
+				uint64_t *row = &panel[i * k];
+				
+				if(isPivot[i] == true || i == best || row[x] == 0)
+				{
+					continue;
+				}
+				
+				const uint64_t scalar = uword_t(0 - (row[x] >> valuation)).x;
+				
+				for(uint64_t j = x; j < k; ++j)
+				{
+					row[j] = uword_t(row[j] + scalar * pivot[j]).x;
+				}
+				
+				multipliers[i * k + pivots.size()] = scalar;
+			}
+			
+			isPivot[best] = true;
+			pivots.push_back(best);
+			inverses.push_back(uword_t(inverse).x);
+		}
+		
+		// Bring the pivot rows up to date, in order, keeping the nonzero columns of each for the rows after it.
+		std::vector<std::vector<uint64_t> > pairs(pivots.size());
+		
+		for(uint64_t j = 0; j < pivots.size(); ++j)
+		{
+			const uint64_t i = pivots[j];
+			
+			this->DoAddPivotRows(rows[i], &multipliers[i * k], pairs, j);
+			
+			if(inverses[j] != 1)
+			{
+				this->matrix.MultiplyRow(rows[i], inverses[j]);
+				
+				++this->numRowOperations;
+			}
+			
+			const CMatrixRow row = this->matrix.GetRow(rows[i]);
+			
+			for(uint64_t x = begin; x < n; ++x)
+			{
+				const uword_t value = row.Get(x);
+				
+				if(value.x != 0)
+				{
+					pairs[j].push_back(x);
+					pairs[j].push_back(value.x);
+				}
+			}
+			
+			pivotRows.push_back(rows[i]);
+		}
+		
+		// Then the other rows, in order.
+		std::vector<uint64_t> others;
+		
+		for(uint64_t i = 0; i < rows.size(); ++i)
+		{
+			if(isPivot[i] == false)
+			{
+				others.push_back(i);
+			}
+		}
+		
+		std::vector<uint64_t> prefetch;
+		
+		for(uint64_t i = 0; i < others.size(); ++i)
+		{
+			prefetch.push_back(rows[others[i]]);
+		}
+		
+		this->matrix.PrefetchRows(prefetch);
+		
+		for(uint64_t i = 0; i < others.size(); ++i)
+		{
+			this->DoAddPivotRows(rows[others[i]], &multipliers[others[i] * k], pairs, pivots.size());
+		}
+		
+		// Take the pivot rows out of 'active'.
+		std::vector<uint64_t> left;
+		std::vector<uint64_t> taken(pivotRows.end() - pivots.size(), pivotRows.end());
+		
+		std::sort(taken.begin(), taken.end());
+		std::set_difference(active.begin(), active.end(), taken.begin(), taken.end(), std::back_inserter(left));
+		active.swap(left);
+	}
+	
+	// This adds multipliers[j] times pivot row j (whose nonzero columns are pairs[j]) to row 'y', for j up to 'count'.
+	void DoAddPivotRows(uint64_t y, const uint64_t *multipliers, const std::vector<std::vector<uint64_t> > &pairs, uint64_t count)
+	{
+		for(uint64_t j = 0; j < count; ++j)
+		{
+			if(multipliers[j] != 0)
+			{
+				this->matrix.AddRowPairs(y, pairs[j].data(), pairs[j].size() / 2, multipliers[j]);
+				
+				++this->numRowOperations;
+			}
+		}
+	}
+};
+
+// This brings a CMatrix to echelon form over Z/2^33 like CEchelonEngine does, but on a CSparseIntegralMatrix copy,
+// picking pivots by their Markowitz cost so the matrix stays sparse (see CMatrix::RowReduceSparse()).
+//
+// Eliminating column x with row y as the pivot can make up to (r - 1) * (c - 1) entries nonzero, if row y has r
+// nonzero columns and column x has c nonzero rows; that's the Markowitz cost. Only the entries with the lowest
+// valuation in their column can be pivots, since it takes a power of two that divides all the others to clear the
+// column. Of those, in the 'searchColumns' sparsest columns, the cheapest is taken. check2's matrix is nearly
+// triangular, so there's nearly always a column with one nonzero row, which costs nothing. The pivot row is taken out
+// of the matrix, so the counts are only for the rows that are left, and the columns are no longer taken in order; the
+// result is in echelon form once the columns are put in the order of GetPivotColumns().
+//
+// Once what's left is at least 'denseThreshold' nonzero, it's copied into a CMatrix of its own and finished by
+// CEchelonEngine. The number of entries each phase makes nonzero, and the time it takes, is reported.
+//
+// The pivot rows end up at the top and the other rows are zeroed. If a contradiction is found (see CEchelonEngine),
+// the matrix is left alone.
+class CSparseEchelonEngine
+{
+public:
+	double denseThreshold;		// the share of nonzero entries that's dense enough for CEchelonEngine
+	uint32_t searchColumns;		// the number of columns searched for each pivot
+	
+	CSparseEchelonEngine(CMatrix &matrixT) :
+		denseThreshold(0.25),
+		searchColumns(4),
+		matrix(matrixT),
+		numRowOperations(0),
+		numFillIn(0)
+	{
+	}
+	
+	// Returns true on success, false if a contradiction was found.
+	bool Reduce(std::ostream &os)
+	{
+		const uint64_t m = this->matrix.GetActiveHeight();
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		
+		os << m << " row(s)" << std::endl;
+		
+		this->pivotRows.clear();
+		this->pivotColumns.clear();
+		this->numRowOperations = 0;
+		this->numFillIn = 0;
+		
+		if(m == 0 || n == 0)
+		{
+			os << "Reducing matrix... done, is all zeros" << std::endl;
+			return true;
+		}
+		
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		
+		os << "Copying to a sparse matrix... " << std::flush;
+		
+		CSparseIntegralMatrix sparse(m, n);
+		std::vector<CSparseEntry> entries;
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			const CMatrixRow row = this->matrix.GetRow(y);
+			
+			entries.clear();
+			
+			for(uint64_t x = this->matrix.GetLeadingNonzeroColumn(y, n); x < n; ++x)
+			{
+				const uword_t value = row.Get(x);
+				
+				if(value.x != 0)
+				{
+					CSparseEntry entry = { x, value.x };
+					entries.push_back(entry);
+				}
+			}
+			
+			sparse.SetRow(y, entries);
+		}
+		
+		os << "done (" << sparse.GetNonzeroCount() << " nonzero(s), " << DoGetSeconds(t0) << "s)" << std::endl;
+		
+		t0 = std::chrono::steady_clock::now();
+		
+		const uint64_t dense = this->DoEliminateSparse(os, sparse);
+		
+		os << "\rSparse elimination... done (" << this->pivotRows.size() << " pivot row(s), " << this->numFillIn <<
+			" fill-in, " << sparse.GetNonzeroCount() << " nonzero(s) left, " << DoGetSeconds(t0) << "s)" << std::endl
+		;
+		
+		if(dense != 0)
+		{
+			t0 = std::chrono::steady_clock::now();
+			
+			if(this->DoEliminateDense(os, sparse, dense) == false)
+			{
+				return false;
+			}
+			
+			os << "Dense elimination took " << DoGetSeconds(t0) << "s" << std::endl;
+		}
+		
+		// Every column but the 'unity' column is gone, so a row that's left says 0 is equal to some other constant.
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			if(sparse.GetRow(y).empty() == false)
+			{
+				os << "Reducing matrix... failure! contradiction detected." << std::endl;
+				os << "Row " << y << " value " << std::hex << sparse.Get(y, n - 1).x << std::dec << " (and " <<
+					(sparse.GetNonzeroRowCount() - 1) << " more)" << std::endl
+				;
+				
+				return false;
+			}
+		}
+		
+		t0 = std::chrono::steady_clock::now();
+		
+		std::vector<uint64_t> pairs;
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			this->matrix.ZeroRow(y);
+			this->matrix.Set(y, n - 1, 0);		// this zeroes the unity adder, which ZeroRow() keeps
+			
+			if(y < this->pivotRows.size())
+			{
+				pairs.clear();
+				
+				for(uint64_t i = 0; i < this->pivotRows[y].size(); ++i)
+				{
+					pairs.push_back(this->pivotRows[y][i].column);
+					pairs.push_back(this->pivotRows[y][i].value);
+				}
+				
+				this->matrix.SetRowPairs(y, pairs.data(), pairs.size() / 2);
+			}
+		}
+		
+		os << "Reducing matrix... done (" << this->pivotRows.size() << " pivot row(s), " << this->numRowOperations <<
+			" row operation(s), copied back in " << DoGetSeconds(t0) << "s)" << std::endl
+		;
+		
+		return true;
+	}
+	
+	// This is the number of pivot rows found by Reduce() (see CEchelonEngine::GetPivotCount()).
+	uint64_t GetPivotCount() const
+	{
+		return this->pivotColumns.size();
+	}
+	
+	// This is the pivot column of each pivot row, in order.
+	const std::vector<uint64_t> &GetPivotColumns() const
+	{
+		return this->pivotColumns;
+	}
+	
+	// This is the number of rows Reduce() multiplied or added to.
+	uint64_t GetRowOperationCount() const
+	{
+		return this->numRowOperations;
+	}
+	
+	// This is the number of entries the sparse phase of Reduce() made nonzero.
+	uint64_t GetFillInCount() const
+	{
+		return this->numFillIn;
+	}
+
+private:
+	CMatrix &matrix;
+	std::vector<std::vector<CSparseEntry> > pivotRows;
+	std::vector<uint64_t> pivotColumns;
+	uint64_t numRowOperations;
+	uint64_t numFillIn;
+	
+	static double DoGetSeconds(std::chrono::steady_clock::time_point t0)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	}
+	
+	// This is the number of columns that are left to eliminate, i.e. the nonzero columns other than the 'unity' column.
+	static uint64_t DoGetColumnsLeft(const CSparseIntegralMatrix &sparse)
+	{
+		return sparse.GetColumnsByCount().size() - ((sparse.GetColumnCount(sparse.GetWidth() - 1) != 0) ? 1 : 0);
+	}
+	
+	// This eliminates columns until there are none left, or until what's left is dense. Returns the number of columns
+	// left in the latter case, 0 otherwise.
+	uint64_t DoEliminateSparse(std::ostream &os, CSparseIntegralMatrix &sparse)
+	{
+		const uint64_t m = sparse.GetHeight();
+		uint64_t lastPercent = -1;
+		
+		for(;;)
+		{
+			if((m - sparse.GetNonzeroRowCount()) * 100 / m != lastPercent)
+			{
+				lastPercent = (m - sparse.GetNonzeroRowCount()) * 100 / m;
+				
+				os << "\rSparse elimination... " << lastPercent << "%" << std::flush;
+			}
+			
+			const uint64_t columnsLeft = DoGetColumnsLeft(sparse);
+			
+			if(columnsLeft == 0)
+			{
+				return 0;
+			}
+			
+			// The unity column is counted as part of what's left, since it's copied along with it.
+			if(sparse.GetNonzeroCount() >= this->denseThreshold * sparse.GetNonzeroRowCount() * (columnsLeft + 1))
+			{
+				return columnsLeft;
+			}
+			
+			uint64_t pivotY = 0;
+			uint64_t pivotX = 0;
+			
+			this->DoFindPivot(sparse, pivotY, pivotX);
+			
+			const uword_t pivotValue = sparse.Get(pivotY, pivotX);
+			std::vector<CSparseEntry> pivot = sparse.TakeRow(pivotY);
+			
+			const uint32_t valuation = CEchelonEngine::GetValuation(pivotValue);
+			const uint64_t odd = pivotValue.x >> valuation;
+			
+			if(odd != 1)
+			{
+				const uint64_t inverse = uword_t::ComputeOddInverse(odd);
+				
+				for(uint64_t i = 0; i < pivot.size(); ++i)
+				{
+					pivot[i].value = uword_t(pivot[i].value * inverse).x;
+				}
+				
+				++this->numRowOperations;
+			}
+			
+			const std::vector<uint64_t> rows = sparse.GetColumnRows(pivotX);
+			
+			for(uint64_t i = 0; i < rows.size(); ++i)
+			{
+				const uint64_t y = rows[i];
+				const uint64_t scalar = sparse.Get(y, pivotX).x >> valuation;
+				
+				this->numFillIn += sparse.AddRow(y, pivot, 0 - scalar);
+				++this->numRowOperations;
+			}
+			
+			if(sparse.GetColumnCount(pivotX) != 0)
+			{
+				throw std::runtime_error("Internal error: a sparse pivot didn't clear its column");
+			}
+			
+			this->pivotRows.push_back(std::vector<CSparseEntry>());
+			this->pivotRows.back().swap(pivot);
+			this->pivotColumns.push_back(pivotX);
+		}
+	}
+	
+	// This picks the pivot with the lowest Markowitz cost, of those in the sparsest columns whose valuation is lowest
+	// in their column (ties go to the lowest row). There must be a column left.
+	void DoFindPivot(CSparseIntegralMatrix &sparse, uint64_t &pivotY, uint64_t &pivotX)
+	{
+		const uint64_t unityX = sparse.GetWidth() - 1;
+		const std::set<std::pair<uint64_t, uint64_t> > &columns = sparse.GetColumnsByCount();
+		uint64_t bestCost = -1;
+		uint32_t searched = 0;
+		
+		for(std::set<std::pair<uint64_t, uint64_t> >::const_iterator i = columns.begin(); i != columns.end() &&
+			searched < this->searchColumns && bestCost != 0; ++i)
+		{
+			const uint64_t x = i->second;
+			
+			if(x == unityX)
+			{
+				continue;
+			}
+			
+			const std::vector<uint64_t> &rows = sparse.GetColumnRows(x);
+			uint32_t valuation = WORD_SIZE_BITS + 1;
+			
+			for(uint64_t j = 0; j < rows.size(); ++j)
+			{
+				valuation = std::min(valuation, CEchelonEngine::GetValuation(sparse.Get(rows[j], x)));
+			}
+			
+			for(uint64_t j = 0; j < rows.size(); ++j)
+			{
+				const uint64_t y = rows[j];
+				
+				if(CEchelonEngine::GetValuation(sparse.Get(y, x)) != valuation)
+				{
+					continue;
+				}
+				
+				const uint64_t cost = (sparse.GetRow(y).size() - 1) * (rows.size() - 1);
+				
+				if(cost < bestCost || (cost == bestCost && y < pivotY))
+				{
+					bestCost = cost;
+					pivotY = y;
+					pivotX = x;
+				}
+			}
+			
+			++searched;
+		}
+	}
+	
+	// This finishes the 'columnsLeft' columns that are left with CEchelonEngine. Returns true on success, false if a
+	// contradiction was found.
+	bool DoEliminateDense(std::ostream &os, CSparseIntegralMatrix &sparse, uint64_t columnsLeft)
+	{
+		const uint64_t unityX = sparse.GetWidth() - 1;
+		std::vector<uint64_t> rows;
+		std::vector<uint64_t> columns;
+		std::vector<uint64_t> denseColumns(sparse.GetWidth(), -1uLL);
+		
+		for(uint64_t y = 0; y < sparse.GetHeight(); ++y)
+		{
+			if(sparse.GetRow(y).empty() == false)
+			{
+				rows.push_back(y);
+			}
+		}
+		
+		for(uint64_t x = 0; x < unityX; ++x)
+		{
+			if(sparse.GetColumnCount(x) != 0)
+			{
+				denseColumns[x] = columns.size();
+				columns.push_back(x);
+			}
+		}
+		
+		denseColumns[unityX] = columns.size();
+		columns.push_back(unityX);
+		
+		os << "Switching to dense elimination: " << rows.size() << " x " << columnsLeft << " left, " <<
+			(100.0 * sparse.GetNonzeroCount() / (rows.size() * columns.size())) << "% nonzero" << std::endl
+		;
+		
+		CMatrix block(rows.size(), columns.size());
+		std::vector<uint64_t> pairs;
+		
+		for(uint64_t i = 0; i < rows.size(); ++i)
+		{
+			const std::vector<CSparseEntry> &row = sparse.GetRow(rows[i]);
+			
+			pairs.clear();
+			
+			for(uint64_t j = 0; j < row.size(); ++j)
+			{
+				pairs.push_back(denseColumns[row[j].column]);
+				pairs.push_back(row[j].value);
+			}
+			
+			block.SetRowPairs(i, pairs.data(), pairs.size() / 2);
+		}
+		
+		CEchelonEngine engine(block);
+		
+		if(engine.Reduce(os) == false)
+		{
+			return false;
+		}
+		
+		this->numRowOperations += engine.GetRowOperationCount();
+		
+		const uint64_t startNonzeros = sparse.GetNonzeroCount();
+		uint64_t nonzeros = 0;
+		std::vector<CSparseEntry> entries;
+		
+		for(uint64_t i = 0; i < engine.GetPivotCount(); ++i)
+		{
+			const CMatrixRow row = block.GetRow(i);
+			
+			this->pivotRows.push_back(std::vector<CSparseEntry>());
+			this->pivotColumns.push_back(columns[block.GetLeadingNonzeroColumn(i, columns.size())]);
+			
+			for(uint64_t x = 0; x < columns.size(); ++x)
+			{
+				const uword_t value = row.Get(x);
+				
+				if(value.x != 0)
+				{
+					CSparseEntry entry = { columns[x], value.x };
+					this->pivotRows.back().push_back(entry);
+				}
+			}
+			
+			nonzeros += this->pivotRows.back().size();
+		}
+		
+		// The other rows are all zeros now.
+		for(uint64_t i = 0; i < rows.size(); ++i)
+		{
+			entries.clear();
+			sparse.SetRow(rows[i], entries);
+		}
+		
+		os << "Dense elimination: " << startNonzeros << " nonzero(s) to " << nonzeros << std::endl;
+		
+		return true;
+	}
+};
+
+// This brings a CMatrix to echelon form over Z/2^33 like CEchelonEngine does, but a panel of columns at a time, so
+// it's suited to dense matrices (see CMatrix::RowReduceBlocked()).
+//
+// Adding rows one at a time, as CEchelonEngine does, reads and writes the whole of each row for every pivot, so it's
+// limited by memory bandwidth once the matrix is dense. Here the active rows are copied into a plain array, and the
+// columns are taken 'panelWidth' at a time. Within a panel, pivots are picked and the other rows cleared as before,
+// but only the panel's columns are updated; the multiple of each pivot row that was added to each other row is
+// recorded instead. Once the panel is done, the columns to its right are brought up to date in tiles of 'tileWidth'
+// columns, on 'numThreads' threads, each tile taking every recorded multiple of every pivot row while it's in the
+// cache. Values are kept modulo 2^64, which is enough since 2^33 divides it, and reduced to 33 bits once per tile.
+//
+// Pivots are picked as CEchelonEngine picks them (ties go to the row that was lowest in the matrix), so the result is
+// the same as CMatrix::RowReduce()'s.
+class CBlockedEchelonEngine
+{
+public:
+	uint32_t numThreads;		// 0 means one per core
+	uint32_t panelWidth;		// columns per panel
+	uint32_t tileWidth;			// columns per tile when updating the rest of the matrix
+	
+	CBlockedEchelonEngine(CMatrix &matrixT) :
+		numThreads(0),
+		panelWidth(64),
+		tileWidth(256),
+		matrix(matrixT),
+		numPivots(0),
+		numRowOperations(0),
+		threadCount(1)
+	{
+	}
+	
+	// Returns true on success, false if a contradiction was found.
+	bool Reduce(std::ostream &os)
+	{
+		const uint64_t m = this->matrix.GetActiveHeight();
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		
+		os << m << " row(s)" << std::endl;
+		os << "Reducing matrix... " << std::flush;
+		
+		this->numPivots = 0;
+		this->numRowOperations = 0;
+		
+		if(m == 0 || n == 0)
+		{
+			os << "done, is all zeros" << std::endl;
+			return true;
+		}
+		
+		this->threadCount = (this->numThreads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : this->numThreads;
+		
+		this->height = m;
+		this->width = n;
+		this->stride = (n + 3) & ~3uLL;
+		this->data.assign(m * this->stride, 0);
+		this->multipliers.assign(m * this->panelWidth, 0);
+		this->rowIds.resize(m);
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			const CMatrixRow row = this->matrix.GetRow(y);
+			uint64_t *dest = this->DoGetRow(y);
+			
+			for(uint64_t x = this->matrix.GetLeadingNonzeroColumn(y, n); x < n; ++x)
+			{
+				dest[x] = row.Get(x).x;
+			}
+			
+			this->rowIds[y] = y;
+		}
+		
+		uint64_t lastPercent = -1;
+		
+		// The 'unity' column is never a pivot column.
+		for(uint64_t begin = 0; begin + 1 < n; begin += this->panelWidth)
+		{
+			if(begin * 100 / (n - 1) != lastPercent)
+			{
+				lastPercent = begin * 100 / (n - 1);
+				
+				os << "\rReducing matrix... " << lastPercent << "%" << std::flush;
+			}
+			
+			const uint64_t end = std::min(begin + this->panelWidth, n - 1);
+			const uint64_t top = this->numPivots;
+			const uint64_t count = this->DoFactorPanel(begin, end);
+			
+			this->DoUpdateTrailingColumns(top, count, end);
+		}
+		
+		// The rows below the pivot rows only have their 'unity' column left.
+		for(uint64_t y = this->numPivots; y < m; ++y)
+		{
+			if(this->DoGetRow(y)[n - 1] != 0)
+			{
+				os << "\rReducing matrix... failure! contradiction detected." << std::endl;
+				os << "Row " << y << " value " << std::hex << this->DoGetRow(y)[n - 1] << std::dec << std::endl;
+				
+				return false;
+			}
+		}
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			this->matrix.SetRow(y, this->DoGetRow(y), n);
+		}
+		
+		os << "\rReducing matrix... done (" << this->numPivots << " pivot row(s), " << this->numRowOperations << " row operation(s))" << std::endl;
+		
+		return true;
+	}
+	
+	// This is the number of pivot rows found by Reduce().
+	uint64_t GetPivotCount() const
+	{
+		return this->numPivots;
+	}
+	
+	// This is the number of rows Reduce() multiplied or added to.
+	uint64_t GetRowOperationCount() const
+	{
+		return this->numRowOperations;
+	}
+	
+	// This adds 'src' times 'scalar' to 'dest', for 'count' entries, modulo 2^64.
+	static void MultiplyAdd(uint64_t *dest, const uint64_t *src, uint64_t scalar, uint64_t count)
+	{
+		uint64_t x = 0;
+		
+#ifdef __AVX2__
+		// AVX2 has no 64-bit multiply, so each lane's product is put together from three 32 x 32 bit ones; the
+		// product of the two high halves only affects bits above 64.
+		const __m256i k = _mm256_set1_epi64x(scalar);
+		const __m256i kHigh = _mm256_srli_epi64(k, 32);
+		
+		for(; x + 4 <= count; x += 4)
+		{
+			const __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+			const __m256i low = _mm256_mul_epu32(s, k);
+			const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(s, 32), k), _mm256_mul_epu32(s, kHigh));
+			const __m256i d = _mm256_loadu_si256((const __m256i *)(dest + x));
+			
+			_mm256_storeu_si256((__m256i *)(dest + x), _mm256_add_epi64(d, _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32))));
+		}
+#endif
+		
+		for(; x < count; ++x)
+		{
+			dest[x] += src[x] * scalar;
+		}
+	}
+
+private:
+	CMatrix &matrix;
+	uint64_t numPivots;
+	uint64_t numRowOperations;
+	uint32_t threadCount;
+	uint64_t height;
+	uint64_t width;
+	uint64_t stride;
+	std::vector<uint64_t> data;				// the active rows, 'stride' entries apart
+	std::vector<uint64_t> multipliers;		// per row, the multiple of each of the panel's pivot rows added to it
+	std::vector<uint64_t> rowIds;			// the row each row was in the matrix
+	
+	static const uint64_t WORD_MASK = (1uLL << (WORD_SIZE_BITS + 1)) - 1;
+	
+	uint64_t *DoGetRow(uint64_t y)
+	{
+		return this->data.data() + y * this->stride;
+	}
+	
+	static void DoReduce(uint64_t *values, uint64_t count)
+	{
+		for(uint64_t x = 0; x < count; ++x)
+		{
+			values[x] &= WORD_MASK;
+		}
+	}
+	
+	void DoSwapRows(uint64_t y1, uint64_t y2)
+	{
+		std::swap_ranges(this->DoGetRow(y1), this->DoGetRow(y1) + this->width, this->DoGetRow(y2));
+		std::swap_ranges(this->multipliers.begin() + y1 * this->panelWidth, this->multipliers.begin() + (y1 + 1) * this->panelWidth,
+			this->multipliers.begin() + y2 * this->panelWidth
+		);
+		std::swap(this->rowIds[y1], this->rowIds[y2]);
+	}
+	
+	// This finds the pivots in columns 'begin' to 'end' - 1, updating only those columns. Returns the number of pivots;
+	// their rows are numPivots - count to numPivots - 1.
+	uint64_t DoFactorPanel(uint64_t begin, uint64_t end)
+	{
+		const uint64_t top = this->numPivots;
+		
+		std::fill(this->multipliers.begin() + top * this->panelWidth, this->multipliers.end(), 0);
+		
+		for(uint64_t pivotX = begin; pivotX < end; ++pivotX)
+		{
+			const uint64_t pivotY = this->numPivots;
+			uint64_t bestY = this->height;
+			uint32_t valuation = WORD_SIZE_BITS + 1;
+			
+			for(uint64_t y = pivotY; y < this->height; ++y)
+			{
+				const uint32_t rowValuation = CEchelonEngine::GetValuation(this->DoGetRow(y)[pivotX]);
+				
+				if(rowValuation < valuation || (rowValuation == valuation && rowValuation <= WORD_SIZE_BITS &&
+					this->rowIds[y] < this->rowIds[bestY]))
+				{
+					bestY = y;
+					valuation = rowValuation;
+				}
+			}
+			
+			if(bestY == this->height)
+			{
+				continue;	// no pivot in this column
+			}
+			
+			if(bestY != pivotY)
+			{
+				this->DoSwapRows(bestY, pivotY);
+			}
+			
+			uint64_t *pivot = this->DoGetRow(pivotY);
+			const uint64_t odd = pivot[pivotX] >> valuation;
+			
+			// The columns to the right of the panel haven't been brought up to date yet, but they're multiplied along
+			// with this row's multipliers, which comes to the same thing.
+			if(odd != 1)
+			{
+				const uint64_t inverse = uword_t::ComputeOddInverse(odd);
+				uint64_t *rowMultipliers = this->multipliers.data() + pivotY * this->panelWidth;
+				
+				for(uint64_t x = pivotX; x < this->width; ++x)
+				{
+					pivot[x] = (pivot[x] * inverse) & WORD_MASK;
+				}
+				
+				for(uint64_t i = 0; i < pivotY - top; ++i)
+				{
+					rowMultipliers[i] = (rowMultipliers[i] * inverse) & WORD_MASK;
+				}
+				
+				++this->numRowOperations;
+			}
+			
+			for(uint64_t y = pivotY + 1; y < this->height; ++y)
+			{
+				uint64_t *row = this->DoGetRow(y);
+				
+				if(row[pivotX] == 0)
+				{
+					continue;
+				}
+				
+				const uint64_t scalar = (0 - (row[pivotX] >> valuation)) & WORD_MASK;
+				
+				MultiplyAdd(row + pivotX, pivot + pivotX, scalar, end - pivotX);
+				DoReduce(row + pivotX, end - pivotX);
+				
+				this->multipliers[y * this->panelWidth + (pivotY - top)] = scalar;
+				++this->numRowOperations;
+			}
+			
+			++this->numPivots;
+		}
+		
+		return this->numPivots - top;
+	}
+	
+	// This brings columns 'begin' and up to date with the panel's 'count' pivot rows, which start at row 'top'.
+	void DoUpdateTrailingColumns(uint64_t top, uint64_t count, uint64_t begin)
+	{
+		if(count == 0 || begin >= this->width)
+		{
+			return;
+		}
+		
+		// Only the rows below the pivot rows that had a pivot row added to them need updating.
+		std::vector<uint64_t> rows;
+		
+		for(uint64_t y = top + count; y < this->height; ++y)
+		{
+			const uint64_t *rowMultipliers = this->multipliers.data() + y * this->panelWidth;
+			
+			if(std::any_of(rowMultipliers, rowMultipliers + count, [](uint64_t k) { return k != 0; }))
+			{
+				rows.push_back(y);
+			}
+		}
+		
+		const uint64_t numTiles = (this->width - begin + this->tileWidth - 1) / this->tileWidth;
+		std::atomic<uint64_t> nextTile(0);
+		
+		auto worker = [&]()
+		{
+			std::vector<uint64_t> live;		// the pivot rows that aren't all zeros in this tile
+			
+			for(uint64_t tile = nextTile++; tile < numTiles; tile = nextTile++)
+			{
+				const uint64_t x = begin + tile * this->tileWidth;
+				const uint64_t tileCount = std::min<uint64_t>(this->tileWidth, this->width - x);
+				
+				live.clear();
+				
+				// The pivot rows are done in order, so each is up to date before it's added to the ones after it.
+				for(uint64_t y = top; y < top + count; ++y)
+				{
+					this->DoUpdateTile(y, top, live, x, tileCount);
+					
+					const uint64_t *row = this->DoGetRow(y) + x;
+					
+					if(std::any_of(row, row + tileCount, [](uint64_t value) { return value != 0; }))
+					{
+						live.push_back(y - top);
+					}
+				}
+				
+				for(uint64_t i = 0; i < rows.size() && live.empty() == false; ++i)
+				{
+					this->DoUpdateTile(rows[i], top, live, x, tileCount);
+				}
+			}
+		};
+		
+		const uint32_t threads = std::min<uint64_t>(this->threadCount, numTiles);
+		
+		if(threads <= 1)
+		{
+			worker();
+			return;
+		}
+		
+		std::vector<std::thread> workers;
+		
+		for(uint32_t n = 0; n < threads; ++n)
+		{
+			workers.push_back(std::thread(worker));
+		}
+		
+		for(std::thread &thread : workers)
+		{
+			thread.join();
+		}
+	}
+	
+	// This adds the recorded multiples of the pivot rows in 'live' (numbered from row 'top') to columns 'x' to
+	// x + count - 1 of row 'y'.
+	void DoUpdateTile(uint64_t y, uint64_t top, const std::vector<uint64_t> &live, uint64_t x, uint64_t count)
+	{
+		const uint64_t *rowMultipliers = this->multipliers.data() + y * this->panelWidth;
+		uint64_t *row = this->DoGetRow(y) + x;
+		bool changed = false;
+		
+		for(uint64_t i = 0; i < live.size(); ++i)
+		{
+			const uint64_t scalar = rowMultipliers[live[i]];
+			
+			if(scalar != 0)
+			{
+				MultiplyAdd(row, this->DoGetRow(top + live[i]) + x, scalar, count);
+				changed = true;
+			}
+		}
+		
+		if(changed == true)
+		{
+			DoReduce(row, count);
+		}
+	}
+};
+
+// This is a matrix over GF(2), 64 columns to a word, e.g. a CMatrix modulo 2 (see CMatrix::CheckModTwo()). It takes
+// a 32nd of the memory of a CMatrix, and a row operation is an exclusive or of whole words.
+class CBitMatrix
+{
+public:
+	CBitMatrix(uint64_t heightT, uint64_t widthT) :
+		height(heightT),
+		width(widthT),
+		stride((widthT + 63) / 64),
+		data(heightT * ((widthT + 63) / 64), 0)
+	{
+	}
+	
+	// This keeps the first 'm' rows of 'matrix' modulo 2, each divided first by the largest power of two that divides
+	// all its entries (see GetRowValuation()). The equations of a scaled-down problem (see generate008's -w option) have
+	// all their entries multiplied by 2^31 or so, so modulo 2 they'd all be 0. A row that's 2^v times r is 0 modulo 2^33
+	// only if r is 0 modulo 2^(33 - v), and so modulo 2, so every solution of the matrix is still one of these rows. Each
+	// row gets its own 2^v, not the one every row has in common, which for those problems is just as degenerate.
+	CBitMatrix(const CMatrix &matrix, uint64_t m) :
+		CBitMatrix(m, matrix.GetLogicalWidth())
+	{
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			const CMatrixRow row = matrix.GetRow(y);
+			const uint32_t shift = GetRowValuation(row);
+			uint64_t *dest = this->GetRow(y);
+			
+			if(shift > WORD_SIZE_BITS)
+			{
+				continue;
+			}
+			
+			for(uint64_t x = row.GetLeadingNonzeroColumn(this->width); x < this->width; ++x)
+			{
+				dest[x / 64] |= ((row.Get(x).x >> shift) & 1) << (x % 64);
+			}
+		}
+	}
+	
+	// Returns the fewest trailing zero bits of any entry of 'row' (WORD_SIZE_BITS + 1 if they're all 0).
+	static uint32_t GetRowValuation(const CMatrixRow &row)
+	{
+		uint64_t bits = 0;		// the bits set in any entry
+		
+		for(uint64_t x = row.GetLeadingNonzeroColumn(row.width); x < row.width; ++x)
+		{
+			bits |= row.Get(x).x;
+		}
+		
+		return (bits == 0) ? (WORD_SIZE_BITS + 1) : __builtin_ctzll(bits);
+	}
+	
+	uint64_t GetHeight() const
+	{
+		return this->height;
+	}
+	
+	uint64_t GetWidth() const
+	{
+		return this->width;
+	}
+	
+	// This is the number of words in a row.
+	uint64_t GetStride() const
+	{
+		return this->stride;
+	}
+	
+	uint64_t *GetRow(uint64_t y)
+	{
+		return &this->data[y * this->stride];
+	}
+	
+	const uint64_t *GetRow(uint64_t y) const
+	{
+		return &this->data[y * this->stride];
+	}
+	
+	bool Get(uint64_t y, uint64_t x) const
+	{
+		return (this->GetRow(y)[x / 64] >> (x % 64)) & 1;
+	}
+	
+	void Set(uint64_t y, uint64_t x, bool value)
+	{
+		uint64_t &word = this->GetRow(y)[x / 64];
+		
+		word = (word & ~(1uLL << (x % 64))) | (uint64_t(value) << (x % 64));
+	}
+	
+	void SwapRows(uint64_t a, uint64_t b)
+	{
+		if(a != b)
+		{
+			std::swap_ranges(this->GetRow(a), this->GetRow(a) + this->stride, this->GetRow(b));
+		}
+	}
+	
+	// This adds (exclusive ors) words 'begin' on of row 'src' to row 'dest'.
+	void AddRow(uint64_t dest, uint64_t src, uint64_t begin = 0)
+	{
+		XorWords(this->GetRow(dest) + begin, this->GetRow(src) + begin, this->stride - begin);
+	}
+	
+	static void XorWords(uint64_t *dest, const uint64_t *src, uint64_t count)
+	{
+		XorWords(dest, &src, 1, count);
+	}
+	
+	// This adds (exclusive ors) each of the 'numSrcs' rows in 'srcs' to 'dest', a few words of all of them at a time,
+	// so 'dest' is only read and written once.
+	static void XorWords(uint64_t *dest, const uint64_t *const *srcs, uint32_t numSrcs, uint64_t count)
+	{
+		uint64_t x = 0;
+		
+#ifdef __AVX2__
+		for(; x + 4 <= count; x += 4)
+		{
+			__m256i d = _mm256_loadu_si256((const __m256i *)(dest + x));
+			
+			for(uint32_t i = 0; i < numSrcs; ++i)
+			{
+				d = _mm256_xor_si256(d, _mm256_loadu_si256((const __m256i *)(srcs[i] + x)));
+			}
+			
+			_mm256_storeu_si256((__m256i *)(dest + x), d);
+		}
+#endif
+		
+		for(; x < count; ++x)
+		{
+			uint64_t d = dest[x];
+			
+			for(uint32_t i = 0; i < numSrcs; ++i)
+			{
+				d ^= srcs[i][x];
+			}
+			
+			dest[x] = d;
+		}
+	}
+
+private:
+	uint64_t height;
+	uint64_t width;
+	uint64_t stride;
+	std::vector<uint64_t> data;
+};
+
+// This brings a CBitMatrix to echelon form by the Method of Four Russians (M4RI), to find the rank of a CMatrix
+// modulo 2 and whether it's consistent, in much less time than CEchelonEngine takes (see CMatrix::CheckModTwo()). If
+// the equations contradict each other modulo 2, they do modulo 2^33 as well; the converse doesn't hold.
+//
+// The columns are taken 64 (a word) at a time. The pivots in them are found with Gaussian elimination on just that
+// word of each row, and the pivot rows are moved up and reduced against each other, so each has a 1 in its own pivot
+// column and 0s in the others. Which pivot rows have to be added to another row is then given by that row's bits in
+// the pivot columns. The pivot rows are split into groups of up to 'tableBits', and a table of every sum of the rows
+// in each group is made (2^tableBits sums, each from an earlier one plus a single row), so clearing the word from a
+// row below takes one table lookup and one row addition per group instead of one addition per pivot row.
+//
+// As in CEchelonEngine, the 'unity' column is never a pivot column, and a row left with only that column nonzero
+// says that 0 is equal to 1, which is a contradiction.
+class CBitEchelonEngine
+{
+public:
+	uint32_t tableBits;		// pivot rows per table
+	
+	CBitEchelonEngine(CBitMatrix &matrixT) :
+		tableBits(8),
+		matrix(matrixT),
+		rank(0)
+	{
+	}
+	
+	// Returns true on success, false if a contradiction was found.
+	bool Reduce(std::ostream &os)
+	{
+		const uint64_t m = this->matrix.GetHeight();
+		const uint64_t n = this->matrix.GetWidth();
+		const uint64_t stride = this->matrix.GetStride();
+		
+		os << m << " row(s)" << std::endl;
+		os << "Reducing matrix modulo 2... " << std::flush;
+		
+		this->rank = 0;
+		this->rowIds.resize(m);
+		this->contradictions.clear();
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			this->rowIds[y] = y;
+		}
+		
+		if(m == 0 || n == 0)
+		{
+			os << "done, is all zeros" << std::endl;
+			return true;
+		}
+		
+		uint64_t lastPercent = -1;
+		
+		for(uint64_t w = 0; w < stride && this->rank < m; ++w)
+		{
+			if(w * 100 / stride != lastPercent)
+			{
+				lastPercent = w * 100 / stride;
+				
+				os << "\rReducing matrix modulo 2... " << lastPercent << "%" << std::flush;
+			}
+			
+			this->DoReduceWord(w);
+		}
+		
+		// Only the 'unity' column of the rows below the pivot rows can be left.
+		for(uint64_t y = this->rank; y < m; ++y)
+		{
+			if(this->matrix.Get(y, n - 1) == true)
+			{
+				this->contradictions.push_back(this->rowIds[y]);
+			}
+		}
+		
+		if(this->contradictions.empty() == false)
+		{
+			std::sort(this->contradictions.begin(), this->contradictions.end());
+			
+			os << "\rReducing matrix modulo 2... failure! contradiction detected." << std::endl;
+			os << "Row " << this->contradictions[0] << " (and " << (this->contradictions.size() - 1) << " more)" << std::endl;
+			
+			return false;
+		}
+		
+		os << "\rReducing matrix modulo 2... done (rank " << this->rank << ")" << std::endl;
+		
+		return true;
+	}
+	
+	// This is the number of pivot rows found by Reduce(), which is the rank modulo 2.
+	uint64_t GetRank() const
+	{
+		return this->rank;
+	}
+	
+	// These are the rows, as they were numbered before Reduce(), that were left as 0 = 1. (Each is what's left of that
+	// row once multiples of the pivot rows have been added to it.)
+	const std::vector<uint64_t> &GetContradictions() const
+	{
+		return this->contradictions;
+	}
+	
+	// This is the row, as it was numbered before Reduce(), that's in row 'y' now.
+	uint64_t GetRowId(uint64_t y) const
+	{
+		return this->rowIds[y];
+	}
+
+private:
+	CBitMatrix &matrix;
+	uint64_t rank;
+	std::vector<uint64_t> rowIds;			// the row each row was in the matrix
+	std::vector<uint64_t> contradictions;
+	
+	// This finds the pivots in columns 64 * w to 64 * w + 63, and clears those columns of the rows below them.
+	void DoReduceWord(uint64_t w)
+	{
+		const uint64_t m = this->matrix.GetHeight();
+		const uint64_t n = this->matrix.GetWidth();
+		const uint64_t top = this->rank;
+		
+		// The 'unity' column is never a pivot column.
+		const uint64_t last = std::min<uint64_t>(64, (n - 1 > 64 * w) ? (n - 1 - 64 * w) : 0);
+		const uint64_t mask = (last == 64) ? -1uLL : ((1uLL << last) - 1);
+		
+		if(mask == 0)
+		{
+			return;
+		}
+		
+		// Find the pivots on a copy of this word of each row below 'top'.
+		std::vector<uint64_t> words(m - top);
+		std::vector<uint64_t> pivotRows;
+		std::vector<uint32_t> pivotColumns;
+		std::vector<bool> isPivot(m - top, false);
+		
+		for(uint64_t i = 0; i < words.size(); ++i)
+		{
+			words[i] = this->matrix.GetRow(top + i)[w] & mask;
+		}
+		
+		for(uint32_t bit = 0; bit < last; ++bit)
+		{
+			const uint64_t b = 1uLL << bit;
+			uint64_t i = 0;
+			
+			while(i < words.size() && (isPivot[i] == true || (words[i] & b) == 0))
+			{
+				++i;
+			}
+			
+			if(i == words.size())
+			{
+				continue;
+			}
+			
+			const uint64_t pivotWord = words[i];
+			
+			for(uint64_t j = i + 1; j < words.size(); ++j)
+			{
+				if((words[j] & b) != 0)
+				{
+					words[j] ^= pivotWord;
+				}
+			}
+			
+			isPivot[i] = true;
+			pivotRows.push_back(top + i);
+			pivotColumns.push_back(bit);
+		}
+		
+		if(pivotRows.empty() == true)
+		{
+			return;
+		}
+		
+		// Move the pivot rows up, in order, and reduce them against each other.
+		const uint64_t p = pivotRows.size();
+		std::vector<uint64_t> at(m - top);		// at[i] is the row (relative to 'top') that's in row top + i now
+		std::vector<uint64_t> where(m - top);	// where[i] is where that row is now
+		
+		for(uint64_t i = 0; i < at.size(); ++i)
+		{
+			at[i] = i;
+			where[i] = i;
+		}
+		
+		for(uint64_t k = 0; k < p; ++k)
+		{
+			const uint64_t position = where[pivotRows[k] - top];
+			
+			this->matrix.SwapRows(top + k, top + position);
+			std::swap(this->rowIds[top + k], this->rowIds[top + position]);
+			
+			std::swap(at[k], at[position]);
+			where[at[k]] = k;
+			where[at[position]] = position;
+		}
+		
+		for(uint64_t k = 0; k < p; ++k)
+		{
+			const uint64_t b = 1uLL << pivotColumns[k];
+			
+			for(uint64_t j = 0; j < p; ++j)
+			{
+				if(j != k && (this->matrix.GetRow(top + j)[w] & b) != 0)
+				{
+					this->matrix.AddRow(top + j, top + k, w);
+				}
+			}
+		}
+		
+		this->rank += p;
+		
+		// Clear the rows below. Each row's bits in the pivot columns say which pivot rows it needs, and since each pivot
+		// row only has a 1 in its own pivot column, adding them doesn't change those bits; so the lookups are all done
+		// first, and the entries of all the tables added at once.
+		const uint64_t stride = this->matrix.GetStride();
+		const uint64_t count = stride - w;
+		const uint64_t numTables = (p + this->tableBits - 1) / this->tableBits;
+		std::vector<uint64_t> sums((numTables << this->tableBits) * count, 0);		// the tables, 'count' words per entry
+		std::vector<const uint64_t *> entries(numTables);
+		
+		for(uint64_t t = 0; t < numTables; ++t)
+		{
+			const uint64_t first = t * this->tableBits;
+			const uint64_t size = std::min<uint64_t>(this->tableBits, p - first);
+			uint64_t *table = &sums[(t << this->tableBits) * count];
+			
+			// Entry 'e' is the sum of the pivot rows first + i for each bit i of 'e'; it's entry 'e' without its top
+			// bit plus that one row.
+			for(uint64_t e = 1; e < (1uLL << size); ++e)
+			{
+				const uint32_t i = 63 - __builtin_clzll(e);
+				
+				std::copy(table + (e ^ (1uLL << i)) * count, table + (e ^ (1uLL << i)) * count + count, table + e * count);
+				CBitMatrix::XorWords(table + e * count, this->matrix.GetRow(top + first + i) + w, count);
+			}
+		}
+		
+		for(uint64_t y = top + p; y < m; ++y)
+		{
+			uint64_t *row = this->matrix.GetRow(y) + w;
+			const uint64_t word = row[0];
+			
+			if((word & mask) == 0)
+			{
+				continue;
+			}
+			
+			uint32_t numEntries = 0;
+			
+			for(uint64_t t = 0; t < numTables; ++t)
+			{
+				const uint64_t first = t * this->tableBits;
+				const uint64_t size = std::min<uint64_t>(this->tableBits, p - first);
+				uint64_t e = 0;
+				
+				for(uint64_t i = 0; i < size; ++i)
+				{
+					e |= ((word >> pivotColumns[first + i]) & 1) << i;
+				}
+				
+				if(e != 0)
+				{
+					entries[numEntries++] = &sums[((t << this->tableBits) + e) * count];
+				}
+			}
+			
+			CBitMatrix::XorWords(row, entries.data(), numEntries, count);
+		}
+	}
+};
+
+inline bool CMatrix::RowReduce(std::ostream &os)
+{
+	if(this->target->IsOutOfCore() == true)
+	{
+		CTiledEchelonEngine engine(*this);
+		
+		return engine.Reduce(os);
+	}
+	
+	CEchelonEngine engine(*this);
+	
+	return engine.Reduce(os);
+}
+
+inline bool CMatrix::RowReduceSparse(std::ostream &os)
+{
+	CSparseEchelonEngine engine(*this);
+	
+	return engine.Reduce(os);
+}
+
+inline bool CMatrix::RowReduceBlocked(std::ostream &os, uint32_t numThreads)
+{
+	CBlockedEchelonEngine engine(*this);
+	
+	engine.numThreads = numThreads;
+	
+	return engine.Reduce(os);
+}
+
+inline bool CMatrix::CheckModTwo(std::ostream &os) const
+{
+	const uint64_t m = this->GetActiveHeight();
+	uint64_t numScaled = 0;
+	
+	for(uint64_t y = 0; y < m; ++y)
+	{
+		const uint32_t valuation = CBitMatrix::GetRowValuation(this->GetRow(y));
+		
+		if(valuation != 0 && valuation <= WORD_SIZE_BITS)
+		{
+			++numScaled;
+		}
+	}
+	
+	if(numScaled != 0)
+	{
+		os << numScaled << " row(s) are multiples of a power of two; dividing each by its own first." << std::endl;
+	}
+	
+	CBitMatrix bits(*this, m);
+	CBitEchelonEngine engine(bits);
+	const bool consistent = engine.Reduce(os);
+	
+	// Most of the rows of a scaled-down problem keep only a few of their terms modulo 2, so they say little there.
+	if(consistent == true && 4 * engine.GetRank() < m)
+	{
+		os << "Warning: the rank modulo 2 is only " << engine.GetRank() << " of " << m << " row(s), so being consistent " <<
+			"modulo 2 says little about the equations modulo 2^33." << std::endl
+		;
+	}
+	
+	return consistent;
+}
+
+typedef std::shared_ptr<CMatrix> RMatrix;
+
+// This keeps a matrix in echelon form over Z/2^33 while rows are added to it one at a time, so the equations can be
+// reduced as they're read instead of once the whole matrix has been (see check2's -reduce-online), and the number of
+// pivot rows is known at every point.
+//
+// Each new row is reduced against the pivot rows so far, from its leftmost nonzero column on. If there's a pivot row
+// for that column whose entry has no more trailing zero bits than the row's, a multiple of it clears the column, as
+// in CEchelonEngine. Otherwise the new row becomes the pivot row for the column (multiplied by the inverse of the odd
+// part of its entry, which leaves a power of two there), and the old pivot row takes its place and goes on being
+// reduced. A row that ends up all zeros depended on the rows before it and is dropped, so only the pivot rows are
+// kept, and only their nonzero entries. A row left with only its 'unity' column nonzero is a contradiction; it's
+// counted and dropped.
+class COnlineEchelon
+{
+public:
+	enum EAddResult
+	{
+		E_ADD_PIVOT,			// the row is a new pivot row
+		E_ADD_DEPENDENT,		// the row was all zeros once reduced
+		E_ADD_CONTRADICTION		// the row was all zeros but for its 'unity' column once reduced
+	};
+	
+	// 'widthT' is the number of columns, including the 'unity' column.
+	COnlineEchelon(uint64_t widthT) :
+		width(widthT),
+		work(widthT, 0),
+		pivotAt(widthT, -1uLL),
+		numRows(0),
+		numDependent(0),
+		numContradictions(0),
+		numRowOperations(0),
+		numEntries(0)
+	{
+	}
+	
+	// This reduces the row and keeps it if it's independent of the rows before it.
+	EAddResult AddRow(const CMatrixRow &row)
+	{
+		const uint64_t n = std::min(row.width, this->width);
+		
+		for(uint64_t x = row.GetLeadingNonzeroColumn(n); x < n; ++x)
+		{
+			this->work[x] = row.Get(x).x;
+		}
+		
+		return this->DoAddWorkRow();
+	}
+	
+	// This is AddRow() for a row given as 'count' column, value pairs (see CMatrix::SetRowPairs()). Columns out of range
+	// are left out.
+	EAddResult AddRowPairs(const uint64_t *pairs, uint64_t count)
+	{
+		for(uint64_t i = 0; i < count; ++i)
+		{
+			if(pairs[2 * i] < this->width)
+			{
+				this->work[pairs[2 * i]] = uword_t(pairs[2 * i + 1]).x;
+			}
+		}
+		
+		return this->DoAddWorkRow();
+	}
+	
+	// This is the number of pivot rows, i.e. of independent rows added so far.
+	uint64_t GetRank() const
+	{
+		return this->pivots.size();
+	}
+	
+	uint64_t GetRowCount() const
+	{
+		return this->numRows;
+	}
+	
+	uint64_t GetDependentCount() const
+	{
+		return this->numDependent;
+	}
+	
+	uint64_t GetContradictionCount() const
+	{
+		return this->numContradictions;
+	}
+	
+	// This is the number of times a multiple of a pivot row was added to a row.
+	uint64_t GetRowOperationCount() const
+	{
+		return this->numRowOperations;
+	}
+	
+	// Returns a matrix with the pivot rows, in column order (so it's in echelon form), stored as 'storage' says.
+	std::shared_ptr<CMatrix> Publish(const CMatrixStorage &storage = CMatrixStorage()) const
+	{
+		std::shared_ptr<CMatrix> matrix = CMatrix::Create(this->pivots.size(), this->width, storage);
+		std::vector<uint64_t> pairs;
+		uint64_t y = 0;
+		
+		for(uint64_t x = 0; x < this->width; ++x)
+		{
+			if(this->pivotAt[x] == -1uLL)
+			{
+				continue;
+			}
+			
+			const std::vector<CSparseEntry> &entries = this->pivots[this->pivotAt[x]];
+			
+			pairs.clear();
+			
+			for(uint64_t i = 0; i < entries.size(); ++i)
+			{
+				pairs.push_back(entries[i].column);
+				pairs.push_back(entries[i].value);
+			}
+			
+			matrix->SetRowPairs(y++, pairs.data(), entries.size());
+		}
+		
+		return matrix;
+	}
+	
+	void Report(std::ostream &os) const
+	{
+		os << "Online echelon form: " << this->numRows << " row(s) added, " << this->pivots.size() << " pivot row(s) (" <<
+			this->numEntries << " nonzero entries) kept, " << this->numDependent << " dependent row(s) and " <<
+			this->numContradictions << " contradiction(s) dropped, " << this->numRowOperations << " row operation(s)" << std::endl
+		;
+	}
+
+private:
+	uint64_t width;
+	std::vector<uint64_t> work;		// the row being reduced; all zeros between calls
+	std::vector<uint64_t> pivotAt;		// the index in 'pivots' of the pivot row for each column (-1uLL means: none)
+	std::vector<std::vector<CSparseEntry> > pivots;
+	uint64_t numRows;
+	uint64_t numDependent;
+	uint64_t numContradictions;
+	uint64_t numRowOperations;
+	uint64_t numEntries;		// in all of 'pivots'
+	
+	// Returns the leftmost nonzero column of 'work' from column 'begin' on, or 'width' if there is none.
+	uint64_t DoGetNextColumn(uint64_t begin) const
+	{
+		while(begin < this->width && this->work[begin] == 0)
+		{
+			++begin;
+		}
+		
+		return begin;
+	}
+	
+	// This reduces 'work' and leaves it all zeros.
+	EAddResult DoAddWorkRow()
+	{
+		++this->numRows;
+		
+		// The 'unity' column is never a pivot column.
+		for(uint64_t x = this->DoGetNextColumn(0); x + 1 < this->width; x = this->DoGetNextColumn(x))
+		{
+			const uint32_t valuation = CEchelonEngine::GetValuation(this->work[x]);
+			
+			if(this->pivotAt[x] == -1uLL)
+			{
+				this->pivotAt[x] = this->pivots.size();
+				this->pivots.push_back(std::vector<CSparseEntry>());
+				this->DoMakePivot(this->pivots.back(), x, valuation);
+				
+				return E_ADD_PIVOT;
+			}
+			
+			std::vector<CSparseEntry> &pivot = this->pivots[this->pivotAt[x]];
+			const uint32_t pivotValuation = CEchelonEngine::GetValuation(pivot[0].value);		// it's a power of two
+			
+			if(valuation < pivotValuation)
+			{
+				// The new row takes over as the pivot row, and the old one is reduced instead. Its entry here is now
+				// a multiple of the new pivot's, so the next pass clears it.
+				std::vector<CSparseEntry> old;
+				
+				old.swap(pivot);
+				this->numEntries -= old.size();
+				this->DoMakePivot(pivot, x, valuation);
+				
+				for(uint64_t i = 0; i < old.size(); ++i)
+				{
+					this->work[old[i].column] = old[i].value;
+				}
+				
+				continue;
+			}
+			
+			const uint64_t scalar = 0 - (this->work[x] >> pivotValuation);
+			
+			for(uint64_t i = 0; i < pivot.size(); ++i)
+			{
+				this->work[pivot[i].column] = uword_t(this->work[pivot[i].column] + scalar * pivot[i].value).x;
+			}
+			
+			++this->numRowOperations;
+		}
+		
+		if(this->work[this->width - 1] != 0)
+		{
+			this->work[this->width - 1] = 0;
+			++this->numContradictions;
+			
+			return E_ADD_CONTRADICTION;
+		}
+		
+		++this->numDependent;
+		
+		return E_ADD_DEPENDENT;
+	}
+	
+	// This moves 'work', from its leftmost nonzero column 'x' on, into 'pivot', multiplied by the inverse of the odd part
+	// of its entry at 'x' (whose valuation is 'valuation').
+	void DoMakePivot(std::vector<CSparseEntry> &pivot, uint64_t x, uint32_t valuation)
+	{
+		const uint64_t inverse = uword_t::ComputeOddInverse(this->work[x] >> valuation);
+		
+		for(; x < this->width; ++x)
+		{
+			if(this->work[x] != 0)
+			{
+				CSparseEntry entry;
+				
+				entry.column = x;
+				entry.value = uword_t(this->work[x] * inverse).x;
+				
+				if(entry.value != 0)
+				{
+					pivot.push_back(entry);
+				}
+				
+				this->work[x] = 0;
+			}
+		}
+		
+		this->numEntries += pivot.size();
+	}
+};
+
+// This solves the equations of a CMatrix modulo 2^33, i.e. finds a value for each column whose value isn't given
+// (the 'unity' column's being 1) that makes every active row 0, by lifting a solution modulo 2 to one modulo 4, 8 and
+// so on, instead of reducing modulo 2^33 as CEchelonEngine does. The matrix isn't changed. For a problem like
+// SHA-256, the constants (the message, the initial H values) and the output temporaries (the hash) are given, and the
+// inputs and the other temporaries are solved for; the given columns are multiplied by their values and added to
+// the 'unity' column of each row first, so they're never pivot columns.
+//
+// First the rows are sorted into levels, by their parity. At level L, each row stands for an equation modulo
+// 2^(33 - L). It's made even in the pivot columns found so far by subtracting their pivot rows (once each, from left
+// to right; a pivot row is odd in its own column and even to the left of it, and its level is L or lower, so it holds
+// modulo 2^(33 - L) as well). Then, if it's odd in some other column, the leftmost one becomes its pivot column and the
+// row a pivot row of level L; if only its 'unity' column is odd, it says that an odd number is 0 modulo 2^(33 - L),
+// which is a contradiction. Otherwise it's even, and is halved and moved to level L + 1 (2r = 0 modulo 2^k just when
+// r = 0 modulo 2^(k - 1)). A row that reaches level 33 says nothing. This takes the place of the kernel of the
+// equations modulo 2: the rows that depend on the others modulo 2 are what's left to lift. The rows are kept sparse,
+// as their nonzero entries in column order (see CSparseEntry), and only the row being reduced is spread out over
+// the columns; at the last level, where the rows are equations modulo 2, they're reduced as CBitMatrix rows instead.
+//
+// Modulo 2, the pivot rows are in echelon form with a 1 in each pivot column, so the pivot columns can be solved for
+// any values of the others (all 0 here). Bit t of the solution is found from bits 0 to t - 1 by solving, modulo 2,
+// for the bits of the pivot rows' values that aren't 0 yet; each such step is a back substitution over the pivot
+// rows' low bits, packed 64 columns to a word (see CBitMatrix). A pivot row of level L only has to be 0 modulo
+// 2^(33 - L), so it's left out of the steps after that.
+//
+// Unlike CEchelonEngine, this also finds contradictions like 2x + 1 = 0, whose rows aren't 0 but for the 'unity'
+// column.
+class CHenselSolver
+{
+public:
+	enum
+	{
+		FREE = -1		// a column whose value isn't given (see Solve())
+	};
+	
+	CHenselSolver(const CMatrix &matrixT) :
+		matrix(matrixT),
+		numRowOperations(0),
+		lowBits(0, 0)
+	{
+	}
+	
+	// Returns true on success, false if a contradiction was found. 'pinsT' gives each column's value (modulo 2^33), or
+	// FREE if it's to be solved for; columns past its end are FREE, and the last column ('unity') is always 1.
+	bool Solve(std::ostream &os, const std::vector<int64_t> &pinsT)
+	{
+		const uint64_t m = this->matrix.GetActiveHeight();
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		
+		this->pins = pinsT;
+		this->pins.resize(n, FREE);
+		
+		os << m << " row(s), " << std::count(this->pins.begin(), this->pins.end(), int64_t(FREE)) << " free column(s)" << std::endl;
+		os << "Solving by Hensel lifting... " << std::flush;
+		
+		this->pivots.clear();
+		this->solution.assign(n, 0);
+		this->numRowOperations = 0;
+		
+		if(n == 0)
+		{
+			os << "done, no columns" << std::endl;
+			return true;
+		}
+		
+		this->pins[n - 1] = 1;
+		
+		for(uint64_t x = 0; x < n; ++x)
+		{
+			if(this->pins[x] != FREE)
+			{
+				this->solution[x] = uint64_t(this->pins[x]) & WORD_MASK;
+			}
+		}
+		
+		if(this->DoFindPivots(os) == false)
+		{
+			return false;
+		}
+		
+		this->DoLift(os);
+		
+		os << "\rSolving by Hensel lifting... done (" << this->pivots.size() << " pivot row(s), " << this->numRowOperations <<
+			" row operation(s))" << std::endl
+		;
+		
+		return true;
+	}
+	
+	// This is the value of each column found by Solve(), or given to it.
+	const std::vector<uint64_t> &GetSolution() const
+	{
+		return this->solution;
+	}
+	
+	uint64_t GetPivotCount() const
+	{
+		return this->pivots.size();
+	}
+	
+	// After Solve(), this returns true if column 'x' is given or has the same value modulo 2 in every solution, i.e.
+	// if the pivot rows modulo 2 add up to a row that's 0 but in 'x' and 'unity'. The other columns not given are 0
+	// in the solution found, which needn't be the solution one is after.
+	bool IsDetermined(uint64_t x) const
+	{
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		const uint64_t stride = this->lowBits.GetStride();
+		
+		if(x + 1 >= n || this->pins[x] != FREE)
+		{
+			return (x < n);
+		}
+		
+		std::vector<uint64_t> bits(stride, 0);
+		
+		bits[x / 64] = 1uLL << (x % 64);
+		
+		for(uint64_t z = x; ; ++z)
+		{
+			z = DoGetNextColumn(bits.data(), stride, z);
+			
+			if(z + 1 >= n)
+			{
+				return true;
+			}
+			
+			if(this->pivotAt[z] == -1uLL)
+			{
+				return false;
+			}
+			
+			CBitMatrix::XorWords(bits.data() + z / 64, this->lowBits.GetRow(this->pivotAt[z]) + z / 64, stride - z / 64);
+		}
+	}
+	
+	// This is the number of pivot rows subtracted from a row by Solve().
+	uint64_t GetRowOperationCount() const
+	{
+		return this->numRowOperations;
+	}
+	
+	// Returns a matrix with the pivot rows found by Solve(), each times 2^level so it's an equation modulo 2^33 again,
+	// in the order of their pivot columns. The given columns are 0 in it, having been added to the 'unity' column. Its
+	// rows have the same solutions as the matrix's, for the given columns' values, but it isn't in echelon form modulo
+	// 2^33 (a pivot row can have even entries left of its pivot column).
+	std::shared_ptr<CMatrix> Publish() const
+	{
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		std::shared_ptr<CMatrix> result = CMatrix::Create(this->pivots.size(), n);
+		std::vector<uint64_t> pairs;
+		
+		for(uint64_t i = 0; i < this->pivots.size(); ++i)
+		{
+			const CPivot &pivot = this->pivots[i];
+			
+			pairs.clear();
+			
+			for(const CSparseEntry &entry : pivot.entries)
+			{
+				pairs.push_back(entry.column);
+				pairs.push_back(uword_t(entry.value << pivot.level).x);
+			}
+			
+			result->SetRowPairs(i, pairs.data(), pairs.size() / 2);
+		}
+		
+		return result;
+	}
+	
+	// Returns the number of active rows of 'matrix' that the values in 'solution' don't make 0 (modulo 2^33).
+	static uint64_t CountUnsolvedRows(const CMatrix &matrix, const std::vector<uint64_t> &solution)
+	{
+		uint64_t count = 0;
+		
+		for(uint64_t y = 0; y < matrix.GetActiveHeight(); ++y)
+		{
+			const CMatrixRow row = matrix.GetRow(y);
+			uword_t value = 0;
+			
+			for(uint64_t x = row.GetLeadingNonzeroColumn(row.width); x < row.width && x < solution.size(); ++x)
+			{
+				value.x += row.Get(x).x * solution[x];
+			}
+			
+			count += (value.x != 0);
+		}
+		
+		return count;
+	}
+
+private:
+	typedef std::vector<CSparseEntry> CSparseRow;		// the nonzero entries, in column order
+	
+	struct CPivot
+	{
+		uint64_t column;
+		uint32_t level;				// the row is an equation modulo 2^(33 - level)
+		CSparseRow entries;
+		
+		// For DoReduceRow(), a bit for each column from word 'firstWord' (of 64 columns) to the last entry's: the
+		// columns of the entries, and those of the odd ones.
+		uint64_t firstWord;
+		std::vector<uint64_t> usedBits;
+		std::vector<uint64_t> oddBits;
+	};
+	
+	const CMatrix &matrix;
+	std::vector<int64_t> pins;
+	std::vector<CPivot> pivots;		// in the order of their pivot columns, once DoFindPivots() is done
+	std::vector<uint64_t> solution;
+	uint64_t numRowOperations;
+	
+	std::vector<uint64_t> pivotAt;		// the index in 'pivots' of each column's pivot row (-1uLL: none)
+	CBitMatrix lowBits;				// each pivot row modulo 2, once DoLift() has begun
+	
+	// DoReduceRow() works on one row at a time, spread out over the columns in 'work'.
+	std::vector<uint64_t> work;
+	std::vector<uint64_t> oddColumns;		// a bit for each column, set if it's odd in 'work'
+	std::vector<uint64_t> usedColumns;		// a bit for each column, set if it may be nonzero in 'work'
+	
+	static const uint64_t WORD_MASK = (1uLL << (WORD_SIZE_BITS + 1)) - 1;
+	
+	// Returns true on success, false if a contradiction was found.
+	bool DoFindPivots(std::ostream &os)
+	{
+		const uint64_t m = this->matrix.GetActiveHeight();
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		std::vector<CSparseRow> rows;
+		
+		this->pivotAt.assign(n, -1uLL);
+		this->work.assign(n, 0);
+		this->oddColumns.assign((n + 63) / 64, 0);
+		this->usedColumns.assign((n + 63) / 64, 0);
+		
+		for(uint64_t y = 0; y < m; ++y)
+		{
+			const CMatrixRow row = this->matrix.GetRow(y);
+			CSparseRow entries;
+			uint64_t given = 0;		// the sum of the given columns, times their values
+			
+			for(uint64_t x = row.GetLeadingNonzeroColumn(n); x < n; x = row.GetLeadingNonzeroColumn(n, x + 1))
+			{
+				CSparseEntry entry;
+				
+				entry.column = x;
+				entry.value = row.Get(x).x;
+				
+				if(this->pins[x] != FREE)
+				{
+					given += entry.value * this->solution[x];
+				}
+				else
+				{
+					entries.push_back(entry);
+				}
+			}
+			
+			if((given & WORD_MASK) != 0)
+			{
+				CSparseEntry entry;
+				
+				entry.column = n - 1;
+				entry.value = given & WORD_MASK;
+				entries.push_back(entry);
+			}
+			
+			if(entries.empty() == false)
+			{
+				rows.push_back(CSparseRow());
+				rows.back().swap(entries);
+			}
+		}
+		
+		for(uint32_t level = 0; level < WORD_SIZE_BITS + 1 && rows.empty() == false; ++level)
+		{
+			os << "\rSolving by Hensel lifting... level " << level << ", " << rows.size() << " row(s)" << std::flush;
+			
+			if(level == WORD_SIZE_BITS)
+			{
+				if(this->DoFindLastPivots(os, rows) == false)
+				{
+					return false;
+				}
+				
+				break;
+			}
+			
+			std::vector<CSparseRow> next;
+			
+			for(uint64_t i = 0; i < rows.size(); ++i)
+			{
+				CSparseRow &row = rows[i];
+				const uint64_t x = this->DoReduceRow(row);
+				
+				if(x + 1 < n)
+				{
+					this->DoAddPivot(x, level, row);
+					continue;
+				}
+				
+				if(row.empty() == false && row.back().column + 1 == n && (row.back().value & 1) != 0)
+				{
+					DoReportContradiction(os, level);
+					return false;
+				}
+				
+				// Only the low 33 - level bits mean anything; the rest are left over from the subtractions.
+				const uint64_t mask = (1uLL << (WORD_SIZE_BITS - level)) - 1;
+				uint64_t count = 0;
+				
+				for(uint64_t j = 0; j < row.size(); ++j)
+				{
+					row[count].column = row[j].column;
+					row[count].value = (row[j].value >> 1) & mask;
+					count += (row[count].value != 0);
+				}
+				
+				row.resize(count);
+				
+				if(row.empty() == false)
+				{
+					next.push_back(CSparseRow());
+					next.back().swap(row);
+				}
+			}
+			
+			rows.swap(next);
+		}
+		
+		std::sort(this->pivots.begin(), this->pivots.end(), [](const CPivot &a, const CPivot &b) { return a.column < b.column; });
+		
+		for(uint64_t i = 0; i < this->pivots.size(); ++i)
+		{
+			this->pivotAt[this->pivots[i].column] = i;
+		}
+		
+		return true;
+	}
+	
+	void DoAddPivot(uint64_t x, uint32_t level, CSparseRow &row)
+	{
+		this->pivotAt[x] = this->pivots.size();
+		this->pivots.push_back(CPivot());
+		
+		CPivot &pivot = this->pivots.back();
+		
+		pivot.column = x;
+		pivot.level = level;
+		pivot.entries.swap(row);
+		pivot.firstWord = pivot.entries.front().column / 64;
+		pivot.usedBits.assign(pivot.entries.back().column / 64 + 1 - pivot.firstWord, 0);
+		pivot.oddBits.assign(pivot.usedBits.size(), 0);
+		
+		for(const CSparseEntry &entry : pivot.entries)
+		{
+			pivot.usedBits[entry.column / 64 - pivot.firstWord] |= 1uLL << (entry.column % 64);
+			pivot.oddBits[entry.column / 64 - pivot.firstWord] |= (entry.value & 1) << (entry.column % 64);
+		}
+	}
+	
+	// At the last level, each row is an equation modulo 2, so only the rows' low bits matter, and the rows are reduced
+	// as CBitMatrix rows, a word of columns at a time, instead.
+	bool DoFindLastPivots(std::ostream &os, const std::vector<CSparseRow> &rows)
+	{
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		const uint64_t firstNew = this->pivots.size();
+		CBitMatrix lowBits(firstNew + rows.size(), n);		// each pivot row modulo 2, in the order they were found
+		const uint64_t stride = lowBits.GetStride();
+		
+		for(uint64_t i = 0; i < firstNew + rows.size(); ++i)
+		{
+			const CSparseRow &entries = (i < firstNew) ? this->pivots[i].entries : rows[i - firstNew];
+			
+			for(const CSparseEntry &entry : entries)
+			{
+				if((entry.value & 1) != 0)
+				{
+					lowBits.Set(i, entry.column, true);
+				}
+			}
+		}
+		
+		for(uint64_t i = firstNew; i < firstNew + rows.size(); ++i)
+		{
+			uint64_t *row = lowBits.GetRow(i);
+			const uint64_t y = this->pivots.size();		// the row it's moved to if it's a pivot row
+			uint64_t x = 0;
+			
+			for(;; ++x)
+			{
+				x = DoGetNextColumn(row, stride, x);
+				
+				if(x + 1 >= n || this->pivotAt[x] == -1uLL)
+				{
+					break;
+				}
+				
+				CBitMatrix::XorWords(row + x / 64, lowBits.GetRow(this->pivotAt[x]) + x / 64, stride - x / 64);
+				++this->numRowOperations;
+			}
+			
+			if(x + 1 < n)
+			{
+				lowBits.SwapRows(i, y);
+				row = lowBits.GetRow(y);
+				
+				this->pivotAt[x] = y;
+				this->pivots.push_back(CPivot());
+				this->pivots.back().column = x;
+				this->pivots.back().level = WORD_SIZE_BITS;
+				
+				for(uint64_t z = x; z < n; ++z)
+				{
+					z = DoGetNextColumn(row, stride, z);
+					
+					if(z < n)
+					{
+						CSparseEntry entry;
+						
+						entry.column = z;
+						entry.value = 1;
+						this->pivots.back().entries.push_back(entry);
+					}
+				}
+			}
+			else if(lowBits.Get(i, n - 1) == true)
+			{
+				DoReportContradiction(os, WORD_SIZE_BITS);
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	static void DoReportContradiction(std::ostream &os, uint32_t level)
+	{
+		os << "\rSolving by Hensel lifting... failure! contradiction detected." << std::endl;
+		os << "A row is odd modulo 2^" << (WORD_SIZE_BITS + 1 - level) << " in the 'unity' column only" << std::endl;
+	}
+	
+	// This subtracts pivot rows from 'row' until it's even in every pivot column, and returns the leftmost column
+	// (other than 'unity') it's odd in, or the 'unity' column if there's none. The row is spread out in 'work' while
+	// it's reduced, with its columns marked in 'usedColumns' and its odd ones in 'oddColumns', so each subtraction
+	// costs as much as the pivot row has entries, however long the row gets, and the next odd column is found a word
+	// of columns at a time.
+	uint64_t DoReduceRow(CSparseRow &row)
+	{
+		const uint64_t n = this->work.size();
+		uint64_t x = 0;
+		
+		if(std::none_of(row.begin(), row.end(), [](const CSparseEntry &entry) { return (entry.value & 1) != 0; }) == true)
+		{
+			return n - 1;		// it's even already, as most rows of a scaled-down problem are at first
+		}
+		
+		for(const CSparseEntry &entry : row)
+		{
+			this->work[entry.column] = entry.value;
+			this->usedColumns[entry.column / 64] |= 1uLL << (entry.column % 64);
+			this->oddColumns[entry.column / 64] |= (entry.value & 1) << (entry.column % 64);
+		}
+		
+		for(;; ++x)
+		{
+			x = DoGetNextColumn(this->oddColumns.data(), this->oddColumns.size(), x);
+			
+			if(x + 1 >= n || this->pivotAt[x] == -1uLL)
+			{
+				break;
+			}
+			
+			// The pivot row's entries left of 'x' are even, so the row's stay even; its entry in 'x' becomes even too.
+			// Subtracting an entry changes the parity of the row's just when the entry is odd.
+			const CPivot &pivot = this->pivots[this->pivotAt[x]];
+			
+			for(const CSparseEntry &entry : pivot.entries)
+			{
+				this->work[entry.column] = (this->work[entry.column] - entry.value) & WORD_MASK;
+			}
+			
+			for(uint64_t w = 0; w < pivot.usedBits.size(); ++w)
+			{
+				this->usedColumns[pivot.firstWord + w] |= pivot.usedBits[w];
+				this->oddColumns[pivot.firstWord + w] ^= pivot.oddBits[w];
+			}
+			
+			++this->numRowOperations;
+		}
+		
+		row.clear();
+		
+		for(uint64_t w = 0; w < this->usedColumns.size(); ++w)
+		{
+			for(uint64_t bits = this->usedColumns[w]; bits != 0; bits &= bits - 1)
+			{
+				CSparseEntry entry;
+				
+				entry.column = 64 * w + __builtin_ctzll(bits);
+				entry.value = this->work[entry.column];
+				
+				if(entry.value != 0)
+				{
+					row.push_back(entry);
+				}
+				
+				this->work[entry.column] = 0;
+			}
+			
+			this->usedColumns[w] = 0;
+			this->oddColumns[w] = 0;
+		}
+		
+		return std::min(x, n - 1);
+	}
+	
+	// Returns the leftmost column from 'x' on whose bit is set in 'bits', or a column past the last one if there's none.
+	static uint64_t DoGetNextColumn(const uint64_t *bits, uint64_t stride, uint64_t x)
+	{
+		uint64_t w = x / 64;
+		
+		if(w >= stride)
+		{
+			return x;
+		}
+		
+		uint64_t word = bits[w] & (-1uLL << (x % 64));
+		
+		while(word == 0 && ++w < stride)
+		{
+			word = bits[w];
+		}
+		
+		return (word == 0) ? 64 * w : 64 * w + __builtin_ctzll(word);
+	}
+	
+	// This finds the pivot columns' values, a bit at a time, for the other columns' values in 'solution'.
+	void DoLift(std::ostream &os)
+	{
+		const uint64_t n = this->matrix.GetLogicalWidth();
+		const uint64_t p = this->pivots.size();
+		CBitMatrix &lowBits = this->lowBits;
+		CBitMatrix bits(1, n);			// the bit of the solution being found, in the pivot columns
+		std::vector<uint64_t> residues(p);
+		
+		lowBits = CBitMatrix(p, n);
+		
+		for(uint64_t i = 0; i < p; ++i)
+		{
+			for(const CSparseEntry &entry : this->pivots[i].entries)
+			{
+				if((entry.value & 1) != 0)
+				{
+					lowBits.Set(i, entry.column, true);
+				}
+			}
+		}
+		
+		for(uint32_t t = 0; t < WORD_SIZE_BITS + 1; ++t)
+		{
+			os << "\rSolving by Hensel lifting... lifting, bit " << t << "   " << std::flush;
+			
+			uint64_t *bitRow = bits.GetRow(0);
+			
+			std::fill(bitRow, bitRow + bits.GetStride(), 0);
+			
+			// Each pivot row's value is 0 modulo 2^t; bit t of it has to be made 0 too, if its level leaves that bit.
+			for(uint64_t i = 0; i < p; ++i)
+			{
+				uint64_t value = 0;
+				
+				for(const CSparseEntry &entry : this->pivots[i].entries)
+				{
+					value += entry.value * this->solution[entry.column];
+				}
+				
+				residues[i] = (value >> t) & 1;
+			}
+			
+			// The pivot rows' low bits are 1 in their own pivot column and 0 to the left of it, so the bits are found
+			// from the rightmost pivot column to the leftmost.
+			for(uint64_t i = p; i-- > 0; )
+			{
+				if(t >= WORD_SIZE_BITS + 1 - this->pivots[i].level)
+				{
+					continue;		// it's 0 modulo 2^(33 - level) already
+				}
+				
+				const uint64_t *row = lowBits.GetRow(i);
+				uint64_t parity = residues[i];
+				
+				for(uint64_t w = this->pivots[i].column / 64; w < bits.GetStride(); ++w)
+				{
+					parity ^= __builtin_popcountll(row[w] & bitRow[w]);
+				}
+				
+				if((parity & 1) != 0)
+				{
+					bits.Set(0, this->pivots[i].column, true);
+					this->solution[this->pivots[i].column] |= 1uLL << t;
+				}
+			}
+		}
+	}
+};
+
+// This finds the solutions of a set of equations in bits (every column 0 or 1), with some columns' values given, by
+// back substitution. The rows are added from one or more matrices, normally one in echelon form (see RowReduce())
+// and the matrix it was reduced from.
+//
+// Each value that becomes known is substituted into every row it's in, and a row with one unknown column left
+// gives that column's value: a v + r = 0 (a being its entry and r the rest of the row) leaves v = 0 if r = 0, v = 1
+// if r = -a, and no solution otherwise; a row with none left has to be 0. In echelon form, with the columns on the
+// right given, that's back substitution from the last row up. When no row has just one unknown column, a free
+// column (the first unknown one of a row with the fewest) is tried with each value in turn, and whatever follows from
+// it is undone before the next. Free columns in no row at all are tried last.
+//
+// The echelon form alone isn't much use for this: a row reduced from left to right solves for the leftmost of its
+// columns, where the equations of a problem like SHA-256 each define their rightmost one (a temporary) from the
+// columns before it, so going up from the last row means trying almost every free column that comes up. With the
+// unreduced rows as well, each temporary follows from the ones it's defined by. The echelon rows only cut a branch
+// off sooner where the reduction has related the given columns to the free ones directly.
+//
+// Each complete assignment (a candidate) is passed to a callback to be confirmed, e.g. by computing a hash. The
+// search tree is shared out by CWorkStealingPool: a worker whose deque is empty leaves the other value of the column
+// it's trying there, as the list of choices that lead to it, and a worker with nothing to do steals one.
+class CBackSubstitution
+{
+public:
+	enum
+	{
+		FREE = -1,							// a column whose value isn't given (see Enumerate())
+		MAX_UNCONSTRAINED_COLUMNS = 32		// the most free columns in no row
+	};
+	
+	// This is called with the value of every column, from several threads at once; it returns true if the candidate
+	// is confirmed.
+	typedef std::function<bool(const std::vector<uint8_t> &values)> ConfirmFunction;
+	
+	uint32_t numThreads;		// 0 means one per core
+	
+	// 'widthT' is the number of columns, including the 'unity' column.
+	CBackSubstitution(uint64_t widthT) :
+		numThreads(0),
+		width(widthT),
+		numCandidates(0),
+		numConfirmed(0),
+		numSubstitutions(0),
+		numBranches(0),
+		numSteals(0),
+		seconds(0.0)
+	{
+		this->rowBegin.push_back(0);
+	}
+	
+	// This adds the active rows of 'matrix' that aren't all zeros.
+	void AddRows(const CMatrix &matrix)
+	{
+		const uint64_t n = std::min(matrix.GetLogicalWidth(), this->width);
+		
+		for(uint64_t y = 0; y < matrix.GetActiveHeight(); ++y)
+		{
+			const CMatrixRow row = matrix.GetRow(y);
+			
+			for(uint64_t x = row.GetLeadingNonzeroColumn(n); x < n; ++x)
+			{
+				const uint64_t value = row.Get(x).x;
+				
+				if(value != 0)
+				{
+					this->rowEntries.push_back(CEntry(x, value));
+				}
+			}
+			
+			if(this->rowEntries.size() != this->rowBegin.back())
+			{
+				this->rowBegin.push_back(this->rowEntries.size());
+			}
+		}
+	}
+	
+	uint64_t GetRowCount() const
 	{
-		this->Set(row, col, this->Get(row, col).x + value.x);
+		return this->rowBegin.size() - 1;
 	}
 	
-	// do not call this to change the value of 'unity' (!) returns true on success, false otherwise.
-	bool SetColumnValue(uint64_t logicalX, uword_t value)
+	// This tries every assignment of the free columns that the rows leave possible, and passes each one that solves
+	// them all to 'confirm'. 'pinsT' gives each column's value, 0 or 1, or FREE; the last column ('unity') is always 1.
+	// Returns the number of candidates confirmed. Throws std::runtime_error if more than MAX_UNCONSTRAINED_COLUMNS free
+	// columns are in no row.
+	uint64_t Enumerate(std::ostream &os, const std::vector<int8_t> &pinsT, ConfirmFunction confirm)
 	{
-		if(logicalX == this->logicalWidth - 1)	// user tried to change the unity column
+		const auto t0 = std::chrono::steady_clock::now();
+		const uint64_t numRows = this->GetRowCount();
+		
+		this->DoPrepare(pinsT);
+		
+		os << numRows << " row(s), " << std::count(this->pins.begin(), this->pins.end(), int8_t(FREE)) << " free column(s)" <<
+			std::endl
+		;
+		os << "Enumerating by back substitution... " << std::flush;
+		
+		CWorkStealingPool<CTask> pool;
+		std::vector<CTask> tasks(1);
+		const uint32_t threads = (this->numThreads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : this->numThreads;
+		std::vector<CCounters> counters(threads);
+		
+		// The root: the given columns, and what follows from them.
+		CState root;
+		
+		root.values.assign(this->width, UNKNOWN);
+		root.numUnknown.resize(numRows);
+		root.sums.assign(numRows, 0);
+		
+		for(uint64_t i = 0; i < numRows; ++i)
 		{
-			return false;
+			root.numUnknown[i] = this->rowBegin[i + 1] - this->rowBegin[i];
 		}
-	
-		for(uint64_t y = 0; y < this->logicalHeight; ++y)
-		{
-			uword_t coeff = this->Get(y, logicalX);
 		
-			if(coeff.x == 0)
+		bool ok = true;
+		
+		for(uint64_t x = 0; x < this->width; ++x)
+		{
+			if(this->pins[x] != FREE)
 			{
-				continue;
+				ok = this->DoAssign(root, x, this->pins[x], counters[0]) && ok;
 			}
-			
-			this->AddToRow(y, coeff.x * value.x);
 		}
 		
-		this->EraseColumn(logicalX);
+		ok = ok && this->DoPropagate(root, counters[0]);
+		root.trail.clear();
 		
-		return true;
-	}
-	
-	void AddRows(uint64_t destY, uint64_t srcY, uword_t scalar)
-	{
-		if(scalar.x != 0)
+		if(ok == true)
 		{
-			for(uint64_t x = 0; x < this->logicalWidth; ++x)
+			pool.Run(tasks, threads, [&](CTask &task, uint32_t worker)
 			{
-				this->Add(destY, x, this->Get(srcY, x).x * scalar.x);
-			}
+				CState state = root;
+				
+				// Only the last choice hasn't been tried before.
+				for(const std::pair<uint64_t, uint8_t> &choice : task.choices)
+				{
+					if(this->DoAssign(state, choice.first, choice.second, counters[worker]) == false ||
+						this->DoPropagate(state, counters[worker]) == false)
+					{
+						return;
+					}
+				}
+				
+				state.choices.swap(task.choices);
+				this->DoSearch(state, pool, worker, counters[worker], confirm);
+			});
 		}
+		
+		this->numCandidates = 0;
+		this->numConfirmed = 0;
+		this->numSubstitutions = 0;
+		this->numBranches = 0;
+		
+		for(const CCounters &c : counters)
+		{
+			this->numCandidates += c.candidates;
+			this->numConfirmed += c.confirmed;
+			this->numSubstitutions += c.substitutions;
+			this->numBranches += c.branches;
+		}
+		
+		this->numSteals = pool.GetStealCount();
+		this->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		
+		os << "done (" << this->numCandidates << " candidate(s), " << this->numConfirmed << " confirmed, " << this->numBranches <<
+			" free column(s) tried, " << this->numSteals << " steal(s) among " << threads << " thread(s))" << std::endl
+		;
+		
+		return this->numConfirmed;
 	}
 	
-	// Returns true on success, false otherwise.
-	// Note: I experimented with using row reduction to break two rounds of SHA2-256.
-	// I left this old, dead code in (note that there is a much better way to break SHA-256
-	// once it's been reduced to only two rounds, and the full algorithm has 64 rounds).
-	bool RowReduce(std::ostream &os)
+	uint64_t GetCandidateCount() const
+	{
+		return this->numCandidates;
+	}
+	
+	uint64_t GetConfirmedCount() const
+	{
+		return this->numConfirmed;
+	}
+	
+	// This is the number of times Enumerate() substituted a value into a row, over all branches.
+	uint64_t GetSubstitutionCount() const
+	{
+		return this->numSubstitutions;
+	}
+	
+	// This is the number of times Enumerate() tried a free column with both values.
+	uint64_t GetBranchCount() const
 	{
-		uint64_t m = this->GetActiveHeight();
+		return this->numBranches;
+	}
+	
+	// This is how long the last Enumerate() took, in seconds.
+	double GetSeconds() const
+	{
+		return this->seconds;
+	}
 
-		os << m << " row(s)" << std::endl;
-		os << "Reducing matrix... " << std::flush;
-		uint64_t n = this->logicalWidth;
+private:
+	enum { UNKNOWN = 2 };
+	
+	struct CEntry
+	{
+		uint64_t column;		// or row, in 'columnEntries'
+		uint64_t value;
 		
-		if(m == 0 || n == 0)
+		CEntry(uint64_t columnT = 0, uint64_t valueT = 0) :
+			column(columnT),
+			value(valueT)
 		{
-			os << "done, is all zeros" << std::endl;
-			return true;
 		}
-
-		uint64_t skip = 0;
+	};
+	
+	// A worker's place in the search.
+	struct CState
+	{
+		std::vector<uint8_t> values;							// 0, 1 or UNKNOWN for each column
+		std::vector<uint64_t> numUnknown;						// for each row
+		std::vector<uint64_t> sums;								// of each row's known entries (modulo 2^33)
+		std::vector<uint64_t> trail;							// the columns found, in order, so they can be undone
+		std::vector<uint64_t> units;							// the rows that may have one unknown column left
+		std::vector<std::pair<uint64_t, uint8_t> > choices;		// the free columns tried, and their values
+	};
+	
+	// A branch of the search, as the choices that lead to it.
+	struct CTask
+	{
+		std::vector<std::pair<uint64_t, uint8_t> > choices;
+	};
+	
+	// Each worker's, padded to a cache line of its own.
+	struct CCounters
+	{
+		uint64_t candidates;
+		uint64_t confirmed;
+		uint64_t substitutions;
+		uint64_t branches;
+		uint64_t padding[4];
 		
-		uint64_t lastPercent = -1;
+		CCounters() :
+			candidates(0),
+			confirmed(0),
+			substitutions(0),
+			branches(0)
+		{
+		}
+	};
+	
+	static const uint64_t WORD_MASK = (1uLL << (WORD_SIZE_BITS + 1)) - 1;
+	
+	uint64_t width;
+	std::vector<int8_t> pins;
+	std::vector<CEntry> rowEntries;			// the nonzero entries of row i are rowEntries[rowBegin[i]] on
+	std::vector<uint64_t> rowBegin;
+	std::vector<CEntry> columnEntries;		// the rows column x is in are columnEntries[columnBegin[x]] on
+	std::vector<uint64_t> columnBegin;
+	std::vector<uint64_t> unconstrained;	// the free columns in no row
+	uint64_t numCandidates;
+	uint64_t numConfirmed;
+	uint64_t numSubstitutions;
+	uint64_t numBranches;
+	uint64_t numSteals;
+	double seconds;
+	
+	// This sets 'pins' and makes the list of the rows each column is in.
+	void DoPrepare(const std::vector<int8_t> &pinsT)
+	{
+		std::vector<uint64_t> counts(this->width, 0);
 		
-		uint64_t progress = 0;
+		this->pins = pinsT;
+		this->pins.resize(this->width, FREE);
 		
-		while(skip < m)
+		if(this->width != 0)
 		{
-			//os << "\rSkip = " << skip << std::endl;
+			this->pins[this->width - 1] = 1;
+		}
 		
-			if((progress*100/m) != lastPercent)
-			{
-				os << "\rReducing matrix... " << (skip*100/m) << "%" << std::flush;
-				
-				lastPercent = (skip*100/m);
-			}
-			++progress;
-			
-			bool done = true;
+		for(const CEntry &entry : this->rowEntries)
+		{
+			++counts[entry.column];
+		}
+		
+		this->columnBegin.assign(this->width + 1, 0);
+		this->unconstrained.clear();
+		
+		for(uint64_t x = 0; x < this->width; ++x)
+		{
+			this->columnBegin[x + 1] = this->columnBegin[x] + counts[x];
 			
-			for(uint64_t y = skip; y < m; ++y)
+			if(counts[x] == 0 && this->pins[x] == FREE)
 			{
-				if(RowIsAllZeros(y) == false)
-				{
-					done = false;
-					
-					break;
-				}
+				this->unconstrained.push_back(x);
 			}
-			
-			if(done)
+		}
+		
+		if(this->unconstrained.size() > MAX_UNCONSTRAINED_COLUMNS)
+		{
+			throw std::runtime_error("CBackSubstitution::Enumerate(): too many free columns in no row.");
+		}
+		
+		this->columnEntries.resize(this->rowEntries.size());
+		
+		for(uint64_t i = 0; i < this->GetRowCount(); ++i)
+		{
+			for(uint64_t j = this->rowBegin[i]; j < this->rowBegin[i + 1]; ++j)
 			{
-				break;
+				const uint64_t x = this->rowEntries[j].column;
+				
+				this->columnEntries[this->columnBegin[x + 1] - counts[x]] = CEntry(i, this->rowEntries[j].value);
+				--counts[x];
 			}
+		}
+	}
+	
+	// This gives column 'x' the value 'value' and substitutes it into the rows it's in. Returns false if that leaves
+	// a row with no unknown columns that isn't 0.
+	bool DoAssign(CState &state, uint64_t x, uint8_t value, CCounters &counters)
+	{
+		bool ok = true;
+		
+		state.values[x] = value;
+		state.trail.push_back(x);
+		
+		for(uint64_t j = this->columnBegin[x]; j < this->columnBegin[x + 1]; ++j)
+		{
+			const uint64_t i = this->columnEntries[j].column;
 			
-			uint64_t pivotX = this->DetermineLeftmostNonzeroColumn(skip, m, n);
+			state.sums[i] = (state.sums[i] + this->columnEntries[j].value * value) & WORD_MASK;
 			
-			if(pivotX >= n - 1)
+			if(--state.numUnknown[i] == 1)
 			{
-				if(pivotX == n)
-				{
-					continue;
-				}
-				
-				os << "\rReducing matrix... failure! contradiction detected." << std::endl;
-				os << "Col " << pivotX << " value " << std::hex << this->Get(skip, pivotX).x << std::dec << std::endl;
-				
-				for(uint64_t y = skip; y < m; ++y)
-				{
-					if(this->Get(y, pivotX).x == 0)  continue;
-					bool ok = false;
-					for(uint64_t xx = 0; xx < pivotX; ++xx)
-					{
-						if(this->Get(y, xx).x != 0)
-						{
-							ok = true;
-							break;
-						}
-					}
-					if(ok)  continue;
-					
-					os << "Row " << y << " value " << std::hex << this->Get(y, pivotX).x << std::dec << std::endl;
-					break;
-				}
-				
-				return false;
+				state.units.push_back(i);
 			}
-			
-			uint64_t powers[WORD_SIZE_BITS + 1];
-			
-			for(uint64_t i = 0; i < WORD_SIZE_BITS + 1; ++i)
+			else if(state.numUnknown[i] == 0 && state.sums[i] != 0)
 			{
-				powers[i] = n;
+				ok = false;
 			}
+		}
+		
+		counters.substitutions += this->columnBegin[x + 1] - this->columnBegin[x];
+		
+		return ok;
+	}
+	
+	// This finds the columns the rows with one unknown column left give. Returns false if one can't be 0 or 1.
+	bool DoPropagate(CState &state, CCounters &counters)
+	{
+		while(state.units.empty() == false)
+		{
+			const uint64_t i = state.units.back();
 			
-			uint64_t lowestPower = WORD_SIZE_BITS + 1;
+			state.units.pop_back();
 			
-			// Built histogram-like thing.
-			for(uint64_t y = skip; y < m; ++y)
+			if(state.numUnknown[i] != 1)
 			{
-				uint64_t x = GetLeadingNonzeroColumn(y, n);
-				
-				if(x >= n - 1)
-				{
-					continue;
-				}
-				
-				uword_t value = this->Get(y, x);
-				
-				uword_t scalar = value.GetScalarForPowerOfTwo();
-				
-				if(scalar.x != 1u)
-				{
-					this->MultiplyRow(y, scalar);
-				}
-				
-				value = this->Get(y, pivotX);
-				
-				if(value.x == 0)
-				{
-					continue;
-				}
-				
-				uint32_t shift = 0;
-				
-				while(value.x != 1u)
-				{
-					++shift;
-					
-					value.x >>= 1;
-				}
-				
-				if(powers[shift] != n)
-				{
-					continue;
-				}
-				
-				powers[shift] = y;
-				
-				if(shift < lowestPower)
-				{
-					lowestPower = shift;
-				}
+				continue;		// found since
 			}
 			
-			if(lowestPower == WORD_SIZE_BITS + 1)
+			uint64_t j = this->rowBegin[i];
+			
+			while(state.values[this->rowEntries[j].column] != UNKNOWN)
 			{
-				os << "\rReducing matrix... failure! internal error." << std::endl;
-				
-				return false;
+				++j;
 			}
 			
-			uint64_t pivotY = skip;
-			
+			uint8_t value = 0;
 			
-			// Let's put our "lowest power" row in row 'pivotY'.
-			uint64_t srcY = powers[lowestPower];
-			
-			if(srcY != pivotY)
+			if(state.sums[i] == 0)
 			{
-				for(uint64_t x = 0; x < n; ++x)
-				{
-					uword_t temp = this->Get(srcY, x);
-					
-					this->Set(srcY, x, this->Get(pivotY, x));
-					
-					this->Set(pivotY, x, temp);
-				}
+				value = 0;
 			}
-			
-			
-			// Put zero's beneath row 'pivotY'.
-			uword_t src = this->Get(pivotY, pivotX);
-			
-			for(uint64_t y = pivotY + 1; y < m; ++y)
+			else if(((state.sums[i] + this->rowEntries[j].value) & WORD_MASK) == 0)
 			{
-				uword_t dest = this->Get(y, pivotX);
-				
-				if(dest.x == 0)
-				{
-					continue;
-				}
-				
-				uword_t scalar = dest.x / src.x;
-
-				//os << std::hex << dest.x << " / " << src.x << " = " << scalar.x << std::dec << std::endl;
-				
-				for(uint64_t x = 0; x < n; ++x)
-				{
-					this->Set(y, x, this->Get(y, x).x - this->Get(pivotY, x).x * scalar.x);
-				}
-				
-				if(this->Get(y, pivotX).x != 0)
-				{
-					os << "\rReducing matrix... failure! internal error 2." << std::endl;
-					
-					return false;
-				}
+				value = 1;
 			}
-			
-			// Check for any non-unity column values with the sign bit set. Subtract and add in to unity column if found.
-			bool mustRepeat = false;
-			
-			/* this doesn't apply anymore now that our operands are 0 or 1 again
-			for(uint64_t x = 0; x < n - 1; ++x)
+			else
 			{
-				uword_t value = this->Get(skip, x);
-				
-				if(value.x >= (1uLL << WORD_SIZE_BITS))
-				{
-					mustRepeat = true;
-
-					// coefficients are always precisely +1 or -1, and thus are never 0.
-					// (2^32 + 2^30) * X = (2^32 * X) + (2^30 * X) = 2^32 + (2^30 * X).
-					this->Set(skip, x, value.x - (1uLL << WORD_SIZE_BITS));
-					
-					this->Set(skip, n - 1, this->Get(skip, n - 1).x + (1uLL << WORD_SIZE_BITS));
-				}
+				state.units.clear();
+				return false;
 			}
-			*/
 			
-			// Finish up.
-			if(mustRepeat == false && this->RowIsAllZeros(skip) == false)
+			if(this->DoAssign(state, this->rowEntries[j].column, value, counters) == false)
 			{
-				++skip;
+				state.units.clear();
+				return false;
 			}
 		}
 		
-		os << "\rReducing matrix... done          " << std::endl;
-	
 		return true;
 	}
 	
-	void MultiplyRow(uint64_t y, uword_t scalar)
+	// This undoes the values found since the trail was 'size' long.
+	void DoUndo(CState &state, uint64_t size)
 	{
-		for(uint64_t x = 0; x < this->logicalWidth; ++x)
+		while(state.trail.size() > size)
 		{
-			this->Set(y, x, this->Get(y, x).x * scalar.x);
+			const uint64_t x = state.trail.back();
+			const uint8_t value = state.values[x];
+			
+			state.trail.pop_back();
+			state.values[x] = UNKNOWN;
+			
+			for(uint64_t j = this->columnBegin[x]; j < this->columnBegin[x + 1]; ++j)
+			{
+				const uint64_t i = this->columnEntries[j].column;
+				
+				state.sums[i] = (state.sums[i] - this->columnEntries[j].value * value) & WORD_MASK;
+				++state.numUnknown[i];
+			}
 		}
 	}
 	
-	uint64_t GetLeadingNonzeroColumn(uint64_t y, uint64_t n)
+	void DoSearch(CState &state, CWorkStealingPool<CTask> &pool, uint32_t worker, CCounters &counters, ConfirmFunction &confirm)
 	{
-		uint64_t x = n;
+		if(pool.IsStopped() == true)
+		{
+			return;
+		}
 		
-		for(uint64_t xx = 0; xx < n; ++xx)
+		// The first unknown column of a row with the fewest.
+		uint64_t best = -1uLL;
+		
+		for(uint64_t i = 0; i < state.numUnknown.size(); ++i)
 		{
-			if(this->Get(y, xx).x != 0)
+			if(state.numUnknown[i] != 0 && (best == -1uLL || state.numUnknown[i] < state.numUnknown[best]))
 			{
-				x = xx;
-				
-				break;
+				best = i;
 			}
 		}
 		
-		return x;
+		if(best == -1uLL)
+		{
+			this->DoCandidates(state, counters, confirm);
+			return;
+		}
+		
+		uint64_t j = this->rowBegin[best];
+		
+		while(state.values[this->rowEntries[j].column] != UNKNOWN)
+		{
+			++j;
+		}
+		
+		const uint64_t x = this->rowEntries[j].column;
+		const uint64_t size = state.trail.size();
+		uint8_t last = 1;
+		
+		++counters.branches;
+		
+		// Trying 1 is left to another worker, if this one has nothing queued.
+		if(pool.IsHungry(worker) == true)
+		{
+			CTask task;
+			
+			task.choices = state.choices;
+			task.choices.push_back(std::make_pair(x, uint8_t(1)));
+			pool.Push(worker, std::move(task));
+			last = 0;
+		}
+		
+		for(uint8_t value = 0; value <= last; ++value)
+		{
+			state.choices.push_back(std::make_pair(x, value));
+			
+			if(this->DoAssign(state, x, value, counters) == true && this->DoPropagate(state, counters) == true)
+			{
+				this->DoSearch(state, pool, worker, counters, confirm);
+			}
+			
+			state.units.clear();
+			this->DoUndo(state, size);
+			state.choices.pop_back();
+		}
 	}
-
-	uint64_t DetermineLeftmostNonzeroColumn(uint64_t skip, uint64_t m/*height*/, uint64_t n/*width*/)
-	{
-		uint64_t pivotX = n;	// this will be the return value if there is no leftmost nonzero column
 	
-		for(uint64_t x = 0; x < n; ++x)
+	// Every row is solved; this tries the free columns in no row.
+	void DoCandidates(CState &state, CCounters &counters, ConfirmFunction &confirm)
+	{
+		const uint64_t count = 1uLL << this->unconstrained.size();
+		
+		for(uint64_t n = 0; n < count; ++n)
 		{
-			bool columnIsAllZeros = true;
-			
-			for(uint64_t y = skip; y < m; ++y)
+			for(uint64_t i = 0; i < this->unconstrained.size(); ++i)
 			{
-				uword_t first = this->Get(y, x);
-
-				if(first.x == 0)
-				{
-					continue;
-				}
-
-				columnIsAllZeros = false;
-				
-				break;
+				state.values[this->unconstrained[i]] = (n >> i) & 1;
 			}
 			
-			if(columnIsAllZeros == false)
+			++counters.candidates;
+			
+			if(confirm(state.values) == true)
 			{
-				pivotX = x;
-				
-				break;
+				++counters.confirmed;
 			}
 		}
 		
-		return pivotX;
+		for(uint64_t x : this->unconstrained)
+		{
+			state.values[x] = UNKNOWN;
+		}
 	}
 };
 
-typedef std::shared_ptr<CMatrix> RMatrix;
-
 #endif	// l_matrix_h__formal_included
 
@@ -0,0 +1,491 @@
+// rowblockfile.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// Keeping the rows of a matrix in a file, with only some blocks of rows in memory.
+// ================================================================================
+
+#ifndef l_rowblockfile_h__formal_included
+#define l_rowblockfile_h__formal_included
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// This says where a CMatrix keeps its entries. With no 'directory' they're in memory, as they've always been;
+// otherwise they're in a temporary file in that directory (see CRowBlockFile), of which only 'maxResidentBytes' or
+// so are in memory at once.
+struct CMatrixStorage
+{
+	std::string directory;
+	uint64_t maxResidentBytes;
+	uint64_t blockBytes;		// rows are read and written at most this many bytes at a time (see CRowBlockFile)
+
+	CMatrixStorage() :
+		maxResidentBytes(256 * 1024 * 1024),
+		blockBytes(8 * 1024 * 1024)
+	{
+	}
+
+	bool IsOutOfCore() const
+	{
+		return this->directory.empty() == false;
+	}
+};
+
+// This keeps 'numRows' rows of 'rowBytes' bytes each in a temporary file, which starts out all zeros and is deleted
+// when the object is. The rows are grouped into blocks of about CMatrixStorage::blockBytes, or smaller, so that
+// MIN_SLOTS of them fit in CMatrixStorage::maxResidentBytes (but at least a row each), and up to maxResidentBytes of
+// blocks are kept in memory; when another block is needed, the one that was used least recently is written back (if
+// it was changed) to make room for it. If MIN_SLOTS rows don't fit, a warning is printed, and more is kept.
+//
+// While a block is being used, the next one is read ahead on a thread of its own, unless other blocks were asked for
+// with Prefetch(), so rows that are used in order rarely have to be waited for.
+//
+// A row's pointer from GetRow() stays good until rows of NUM_PROTECTED other blocks have been asked for, since the
+// blocks used most recently are never evicted; a CMatrix row operation only holds two rows at once. This isn't
+// thread safe, apart from the prefetch thread it runs itself.
+class CRowBlockFile
+{
+public:
+	enum
+	{
+		NUM_PROTECTED = 4,		// the number of most recently used blocks that are never evicted
+		MIN_SLOTS = 8			// the number of blocks kept in memory is at least this (or all of them)
+	};
+
+	CRowBlockFile(uint64_t numRowsT, uint64_t rowBytesT, const CMatrixStorage &storage) :
+		numRows(numRowsT),
+		rowBytes(std::max<uint64_t>(rowBytesT, 1)),
+		fd(-1),
+		clock(0),
+		numPrefetchedUnused(0),
+		lastBlock(-1uLL),
+		lastSlot(0),
+		lastData(nullptr),
+		lastDirty(false),
+		stop(false),
+		failed(false),
+		numLoads(0),
+		numWrites(0),
+		numPrefetched(0),
+		numPrefetchHits(0)
+	{
+		this->rowsPerBlock = std::max<uint64_t>(std::min(storage.blockBytes, storage.maxResidentBytes / MIN_SLOTS) / this->rowBytes, 1);
+		this->blockBytes = this->rowsPerBlock * this->rowBytes;
+
+		const uint64_t numBlocks = (this->numRows + this->rowsPerBlock - 1) / this->rowsPerBlock;
+		const uint64_t numSlots = std::min<uint64_t>(numBlocks, std::max<uint64_t>(storage.maxResidentBytes / this->blockBytes, MIN_SLOTS));
+
+		if(numSlots * this->blockBytes > storage.maxResidentBytes)
+		{
+			std::cerr << "Warning: " << (storage.maxResidentBytes >> 10) << " KiB can't hold " << numSlots << " row(s) of " <<
+				this->rowBytes << " byte(s); keeping " << ((numSlots * this->blockBytes + 1023) >> 10) <<
+				" KiB of the matrix in memory." << std::endl
+			;
+		}
+
+		this->prefetchLimit = (numSlots > NUM_PROTECTED + 1) ? std::max<uint64_t>((numSlots - NUM_PROTECTED) / 2, 1) : 0;
+		this->slots.resize(numSlots);
+		this->blockSlots.resize(numBlocks, -1uLL);
+
+		for(uint32_t n = 0; n < NUM_PROTECTED; ++n)
+		{
+			this->recent[n] = -1uLL;
+		}
+
+		std::string path = storage.directory + "/matrix.XXXXXX";
+
+		this->fd = mkstemp(&path[0]);
+
+		if(this->fd == -1)
+		{
+			throw std::runtime_error("Unable to create a matrix file in " + storage.directory);
+		}
+
+		unlink(path.c_str());	// the file goes away once it's closed
+
+		if(ftruncate(this->fd, numBlocks * this->blockBytes) != 0)
+		{
+			close(this->fd);
+
+			throw std::runtime_error("Unable to size a matrix file in " + storage.directory);
+		}
+
+		this->thread = std::thread([this]() { this->DoPrefetch(); });
+	}
+
+	virtual ~CRowBlockFile()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			this->stop = true;
+			this->changed.notify_all();
+		}
+
+		this->thread.join();
+
+		close(this->fd);
+	}
+
+	uint64_t GetRowBytes() const
+	{
+		return this->rowBytes;
+	}
+
+	uint64_t GetRowsPerBlock() const
+	{
+		return this->rowsPerBlock;
+	}
+
+	// This returns row 'row', reading it in first if needed. If 'forWriting' is false, the row must not be changed
+	// through the pointer.
+	uint8_t *GetRow(uint64_t row, bool forWriting)
+	{
+		const uint64_t block = row / this->rowsPerBlock;
+		const uint64_t offset = (row % this->rowsPerBlock) * this->rowBytes;
+
+		if(block == this->lastBlock && (forWriting == false || this->lastDirty == true))
+		{
+			return this->lastData + offset;
+		}
+
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		const uint64_t slot = this->DoGetSlot(block, lock);
+		CSlot &s = this->slots[slot];
+
+		s.lastUse = ++this->clock;
+		s.dirty = s.dirty || forWriting;
+
+		if(s.prefetched == true)
+		{
+			s.prefetched = false;
+			--this->numPrefetchedUnused;
+			++this->numPrefetchHits;
+		}
+
+		if(block != this->recent[0])
+		{
+			uint32_t n = 0;
+
+			while(n + 1 < NUM_PROTECTED && this->recent[n] != block)
+			{
+				++n;
+			}
+
+			for(; n > 0; --n)
+			{
+				this->recent[n] = this->recent[n - 1];
+			}
+
+			this->recent[0] = block;
+		}
+
+		this->lastBlock = block;
+		this->lastSlot = slot;
+		this->lastData = s.data.data();
+		this->lastDirty = s.dirty;
+
+		// Read ahead, unless the caller said what it'll need.
+		if(this->pending.empty() == true && block + 1 < this->blockSlots.size() && this->blockSlots[block + 1] == -1uLL)
+		{
+			this->pending.push_back(block + 1);
+		}
+
+		this->changed.notify_all();
+
+		return this->lastData + offset;
+	}
+
+	// This has the blocks of 'rows' read in ahead of time, in that order (so the rows should be sorted), instead of
+	// any that were asked for before.
+	void Prefetch(const uint64_t *rows, uint64_t count)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		this->pending.clear();
+
+		for(uint64_t i = 0; i < count; ++i)
+		{
+			const uint64_t block = rows[i] / this->rowsPerBlock;
+
+			if(block < this->blockSlots.size() && (this->pending.empty() == true || this->pending.back() != block) &&
+				this->blockSlots[block] == -1uLL)
+			{
+				this->pending.push_back(block);
+			}
+		}
+
+		this->changed.notify_all();
+	}
+
+	// This shows how many blocks were read and written, and how many of the reads were done ahead of time.
+	void Report(std::ostream &os)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		os << "Matrix file: " << this->slots.size() << " block(s) of " << (this->blockBytes >> 10) << " KiB in memory, " <<
+			this->blockSlots.size() << " in all; " << (this->numLoads + this->numPrefetched) << " read (" << this->numPrefetched <<
+			" ahead of time, " << this->numPrefetchHits << " of those used), " << this->numWrites << " written" << std::endl
+		;
+	}
+
+private:
+	struct CSlot
+	{
+		std::vector<uint8_t> data;
+		uint64_t block;			// -1uLL if the slot is free
+		uint64_t lastUse;
+		bool dirty;
+		bool loading;			// the prefetch thread is reading it
+		bool prefetched;		// read ahead and not used yet
+
+		CSlot() :
+			block(-1uLL),
+			lastUse(0),
+			dirty(false),
+			loading(false),
+			prefetched(false)
+		{
+		}
+	};
+
+	uint64_t numRows;
+	uint64_t rowBytes;
+	uint64_t rowsPerBlock;
+	uint64_t blockBytes;
+	int fd;
+	std::vector<CSlot> slots;
+	std::vector<uint64_t> blockSlots;		// the slot each block is in, or -1uLL
+	std::deque<uint64_t> pending;			// blocks to read ahead
+	uint64_t recent[NUM_PROTECTED];			// the blocks used most recently, most recent first
+	uint64_t clock;
+	uint64_t prefetchLimit;					// the most blocks that can be read ahead and not used yet
+	uint64_t numPrefetchedUnused;
+	uint64_t lastBlock;						// GetRow() doesn't take the lock for this block
+	uint64_t lastSlot;
+	uint8_t *lastData;
+	bool lastDirty;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::thread thread;
+	bool stop;
+	bool failed;
+	uint64_t numLoads;
+	uint64_t numWrites;
+	uint64_t numPrefetched;
+	uint64_t numPrefetchHits;
+
+	bool DoIsProtected(uint64_t block) const
+	{
+		return std::find(this->recent, this->recent + NUM_PROTECTED, block) != this->recent + NUM_PROTECTED;
+	}
+
+	// pre: the lock is held. This returns the slot 'block' is in, reading it in (on this thread) if it isn't in one.
+	uint64_t DoGetSlot(uint64_t block, std::unique_lock<std::mutex> &lock)
+	{
+		for(;;)
+		{
+			if(this->failed == true)
+			{
+				throw std::runtime_error("Unable to read or write a matrix file");
+			}
+
+			const uint64_t slot = this->blockSlots[block];
+
+			if(slot == -1uLL)
+			{
+				break;
+			}
+
+			if(this->slots[slot].loading == false)
+			{
+				return slot;
+			}
+
+			this->changed.wait(lock);		// the prefetch thread is reading it
+		}
+
+		const uint64_t slot = this->DoEvict(false);
+
+		this->DoAssign(slot, block);
+
+		if(this->DoTransfer(slot, false) == false)
+		{
+			throw std::runtime_error("Unable to read a matrix file");
+		}
+
+		++this->numLoads;
+
+		return slot;
+	}
+
+	// pre: the lock is held. This frees the least recently used slot that may be evicted (writing it back if needed),
+	// and returns it, or -1uLL if there is none. The prefetch thread doesn't evict blocks it read ahead that haven't
+	// been used yet.
+	uint64_t DoEvict(bool prefetching)
+	{
+		uint64_t victim = -1uLL;
+
+		for(uint64_t n = 0; n < this->slots.size(); ++n)
+		{
+			const CSlot &s = this->slots[n];
+
+			if(s.block == -1uLL)
+			{
+				return n;
+			}
+
+			if(s.loading == true || this->DoIsProtected(s.block) == true || (prefetching == true && s.prefetched == true))
+			{
+				continue;
+			}
+
+			if(victim == -1uLL || s.lastUse < this->slots[victim].lastUse)
+			{
+				victim = n;
+			}
+		}
+
+		if(victim == -1uLL)
+		{
+			return -1uLL;
+		}
+
+		CSlot &s = this->slots[victim];
+
+		if(s.dirty == true)
+		{
+			if(this->DoTransfer(victim, true) == false)
+			{
+				this->failed = true;
+			}
+
+			++this->numWrites;
+		}
+
+		if(s.prefetched == true)
+		{
+			--this->numPrefetchedUnused;
+		}
+
+		this->blockSlots[s.block] = -1uLL;
+		s.block = -1uLL;
+		s.dirty = false;
+		s.prefetched = false;
+
+		return victim;
+	}
+
+	void DoAssign(uint64_t slot, uint64_t block)
+	{
+		CSlot &s = this->slots[slot];
+
+		s.data.resize(this->blockBytes);
+		s.block = block;
+		this->blockSlots[block] = slot;
+
+		// Nobody has to read it ahead any more.
+		std::deque<uint64_t>::iterator i = std::find(this->pending.begin(), this->pending.end(), block);
+
+		if(i != this->pending.end())
+		{
+			this->pending.erase(i);
+		}
+	}
+
+	// This reads slot 'slot' from its block, or writes it there. Returns true on success, false otherwise.
+	bool DoTransfer(uint64_t slot, bool writing)
+	{
+		CSlot &s = this->slots[slot];
+		const uint64_t offset = s.block * this->blockBytes;
+		uint64_t done = 0;
+
+		while(done < this->blockBytes)
+		{
+			const ssize_t n = writing ?
+				pwrite(this->fd, s.data.data() + done, this->blockBytes - done, offset + done) :
+				pread(this->fd, s.data.data() + done, this->blockBytes - done, offset + done)
+			;
+
+			if(n <= 0)
+			{
+				return false;
+			}
+
+			done += n;
+		}
+
+		return true;
+	}
+
+	// This runs on the prefetch thread.
+	void DoPrefetch()
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		for(;;)
+		{
+			this->changed.wait(lock, [this]()
+			{
+				return this->stop == true || (this->pending.empty() == false && this->numPrefetchedUnused < this->prefetchLimit);
+			});
+
+			if(this->stop == true)
+			{
+				return;
+			}
+
+			const uint64_t block = this->pending.front();
+
+			this->pending.pop_front();
+
+			if(this->blockSlots[block] != -1uLL)
+			{
+				continue;
+			}
+
+			const uint64_t slot = this->DoEvict(true);
+
+			if(slot == -1uLL)
+			{
+				this->pending.clear();		// everything in memory is still needed
+				continue;
+			}
+
+			this->DoAssign(slot, block);
+
+			CSlot &s = this->slots[slot];
+
+			s.loading = true;
+
+			lock.unlock();
+			const bool ok = this->DoTransfer(slot, false);
+			lock.lock();
+
+			s.loading = false;
+			s.prefetched = true;
+			s.lastUse = this->clock;
+			this->failed = this->failed || (ok == false);
+			++this->numPrefetchedUnused;
+			++this->numPrefetched;
+
+			this->changed.notify_all();
+		}
+	}
+};
+
+#endif	// l_rowblockfile_h__formal_included
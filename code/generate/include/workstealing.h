@@ -0,0 +1,194 @@
+// workstealing.h - by Willow Schlanger. Released to the Public Domain in August of 2017.
+// --------------------------------------------------------------------------------
+// A pool of threads that share out a tree of tasks by work stealing.
+// ================================================================================
+
+#ifndef l_workstealing_h__formal_included
+#define l_workstealing_h__formal_included
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// This runs tasks that make more tasks as they go, such as the branches of a search, on 'numThreads' threads. Each
+// worker has a deque of its own: it pushes the tasks it makes onto the back and takes its next task from the back
+// too, so it works depth first and keeps its working set small. A worker whose deque is empty steals from the front
+// of another's, where the oldest (and, in a search, biggest) tasks are, so a steal rarely has to be repeated soon.
+//
+// A task that can be split should only be split when IsHungry() says its worker's deque is empty; otherwise it's
+// cheaper to carry on with it on the same thread.
+template<typename TTask>
+class CWorkStealingPool
+{
+public:
+	typedef std::function<void(TTask &task, uint32_t worker)> ProcessFunction;
+
+	CWorkStealingPool() :
+		numPending(0),
+		numSteals(0),
+		stop(false)
+	{
+	}
+
+	// This runs 'tasks', and the tasks they Push(), until there are none left or Stop() is called. 'numThreads' of 0
+	// means one per core. 'process' is called on the worker threads, so it has to be thread safe.
+	void Run(std::vector<TTask> &tasks, uint32_t numThreads, ProcessFunction process)
+	{
+		const uint32_t threads = (numThreads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : numThreads;
+
+		this->queues.clear();
+
+		for(uint32_t n = 0; n < threads; ++n)
+		{
+			this->queues.push_back(std::unique_ptr<CQueue>(new CQueue()));
+		}
+
+		this->numPending = tasks.size();
+		this->numSteals = 0;
+		this->stop = false;
+
+		// The first tasks are dealt out round robin, so there's something to do everywhere from the start.
+		for(uint64_t i = 0; i < tasks.size(); ++i)
+		{
+			this->queues[i % threads]->tasks.push_back(std::move(tasks[i]));
+		}
+
+		tasks.clear();
+
+		if(threads == 1)
+		{
+			this->DoWork(0, process);
+			return;
+		}
+
+		std::vector<std::thread> workers;
+
+		for(uint32_t n = 0; n < threads; ++n)
+		{
+			workers.push_back(std::thread([this, n, &process]() { this->DoWork(n, process); }));
+		}
+
+		for(std::thread &thread : workers)
+		{
+			thread.join();
+		}
+	}
+
+	// This adds a task to the back of 'worker's deque. Only call it from that worker's thread, while Run() is running.
+	void Push(uint32_t worker, TTask &&task)
+	{
+		CQueue &queue = *this->queues[worker];
+
+		++this->numPending;
+
+		std::lock_guard<std::mutex> lock(queue.lock);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	// Returns true if 'worker's deque is empty, i.e. the task it's running should be split if it can be.
+	bool IsHungry(uint32_t worker)
+	{
+		CQueue &queue = *this->queues[worker];
+		std::lock_guard<std::mutex> lock(queue.lock);
+
+		return queue.tasks.empty();
+	}
+
+	// This makes Run() return once the tasks that are running are done; the ones still queued are dropped.
+	void Stop()
+	{
+		this->stop = true;
+	}
+
+	bool IsStopped() const
+	{
+		return this->stop;
+	}
+
+	// This is the number of tasks one worker took from another's deque during the last Run().
+	uint64_t GetStealCount() const
+	{
+		return this->numSteals;
+	}
+
+private:
+	struct CQueue
+	{
+		std::mutex lock;
+		std::deque<TTask> tasks;
+	};
+
+	std::vector<std::unique_ptr<CQueue> > queues;
+	std::atomic<uint64_t> numPending;		// the tasks queued or running
+	std::atomic<uint64_t> numSteals;
+	std::atomic<bool> stop;
+
+	void DoWork(uint32_t worker, ProcessFunction &process)
+	{
+		TTask task;
+
+		while(this->stop == false)
+		{
+			if(this->DoTakeOwn(worker, task) == false && this->DoSteal(worker, task) == false)
+			{
+				if(this->numPending == 0)
+				{
+					return;
+				}
+
+				std::this_thread::yield();		// someone else is still running a task that may be split
+				continue;
+			}
+
+			process(task, worker);
+
+			--this->numPending;
+		}
+	}
+
+	bool DoTakeOwn(uint32_t worker, TTask &task)
+	{
+		CQueue &queue = *this->queues[worker];
+		std::lock_guard<std::mutex> lock(queue.lock);
+
+		if(queue.tasks.empty() == true)
+		{
+			return false;
+		}
+
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+
+		return true;
+	}
+
+	bool DoSteal(uint32_t worker, TTask &task)
+	{
+		const uint32_t threads = this->queues.size();
+
+		for(uint32_t i = 1; i < threads; ++i)
+		{
+			CQueue &queue = *this->queues[(worker + i) % threads];
+			std::lock_guard<std::mutex> lock(queue.lock);
+
+			if(queue.tasks.empty() == false)
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+				++this->numSteals;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+#endif	// l_workstealing_h__formal_included